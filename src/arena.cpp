@@ -0,0 +1,50 @@
+// CLAP instrument plugin tutorial
+//
+// Per-instance arena for the DSP memory.
+
+#include "arena.h"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+#endif
+
+#if defined(_WIN32)
+
+bool Arena::Lock()
+{
+    if (!is_locked && block) {
+        is_locked = VirtualLock(block, capacity) != 0;
+    }
+    return is_locked;
+}
+
+void Arena::Unlock()
+{
+    if (is_locked) {
+        VirtualUnlock(block, capacity);
+    }
+    is_locked = false;
+}
+
+#else
+
+bool Arena::Lock()
+{
+    if (!is_locked && block) {
+        is_locked = mlock(block, capacity) == 0;
+    }
+    return is_locked;
+}
+
+void Arena::Unlock()
+{
+    if (is_locked) {
+        munlock(block, capacity);
+    }
+    is_locked = false;
+}
+
+#endif
@@ -0,0 +1,220 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Per-instance arena for the DSP memory.
+//
+// The voice pool, the render and mix buffers, and the other scratch arrays
+// the audio thread works on are all carved out of a single block that gets
+// allocated on activation. They end up next to each other, in the order
+// they're used, instead of wherever the heap happens to put a few dozen
+// separate allocations, so an instance's working set is compact, its size
+// is known up front, and releasing it is a single free.
+//
+// Every array starts on a cache line, which is also the width of the
+// widest SIMD registers, so no two arrays share a cache line and vector
+// loads from the start of an array never split one.
+//
+// The block is sized by running the same carving code twice (see Build()):
+// the first pass only adds up the sizes, the second one hands out the
+// arrays. The carving code must request the same arrays both times, and
+// must not touch them; they're only valid after Build() has returned.
+//
+// The second pass writes every array, so all pages of the block have been
+// faulted in by the time Build() returns, instead of on the first process
+// calls. The block is made of whole pages, so it can also be locked into
+// RAM (see Lock()) without affecting any other allocation.
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Array that lives in an Arena; a plain view that doesn't own the memory
+template <typename T>
+class ArenaArray {
+
+public:
+    ArenaArray() = default;
+
+    ArenaArray(T* _data, const size_t _size) : ptr(_data), count(_size) {}
+
+    T* data()
+    {
+        return ptr;
+    }
+    const T* data() const
+    {
+        return ptr;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    T& operator[](const size_t index)
+    {
+        assert(index < count);
+        return ptr[index];
+    }
+    const T& operator[](const size_t index) const
+    {
+        assert(index < count);
+        return ptr[index];
+    }
+
+    T* begin()
+    {
+        return ptr;
+    }
+    T* end()
+    {
+        return ptr + count;
+    }
+    const T* begin() const
+    {
+        return ptr;
+    }
+    const T* end() const
+    {
+        return ptr + count;
+    }
+
+    void Fill(const T& value)
+    {
+        std::fill_n(ptr, count, value);
+    }
+
+private:
+    T* ptr       = nullptr;
+    size_t count = 0;
+};
+
+class Arena {
+
+public:
+    static constexpr size_t Alignment = 64;
+
+    // The smallest page size of our platforms; larger pages just lock a
+    // bit more than needed
+    static constexpr size_t PageSize = 4096;
+
+    Arena() = default;
+
+    ~Arena()
+    {
+        Release();
+    }
+
+    // The arrays point into the block
+    Arena(const Arena&)            = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Main thread. Releases the current block, then calls `carve(*this)`
+    // twice: once to size the new block, and once more to hand out the
+    // arrays from it. Returns false if the block couldn't be allocated.
+    template <typename CarveFn>
+    bool Build(CarveFn&& carve)
+    {
+        Release();
+
+        is_sizing = true;
+        carve(*this);
+        is_sizing = false;
+
+        const auto needed = used;
+        const auto size   = (needed + PageSize - 1) / PageSize * PageSize;
+
+        if (size > 0) {
+            block = static_cast<std::byte*>(
+                ::operator new(size, std::align_val_t{PageSize}, std::nothrow));
+
+            if (!block) {
+                used = 0;
+                return false;
+            }
+        }
+
+        capacity = size;
+        used     = 0;
+
+        carve(*this);
+
+        assert(used == needed && "The carving passes requested different arrays");
+        return true;
+    }
+
+    // Only to be called by the carving code passed to Build(). The elements
+    // are value-initialised.
+    template <typename T>
+    ArenaArray<T> Allocate(const size_t count)
+    {
+        // The arena never runs destructors
+        static_assert(std::is_trivially_destructible_v<T>);
+
+        const auto offset = used;
+
+        used += (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+
+        if (is_sizing || count == 0) {
+            return {nullptr, count};
+        }
+        assert(used <= capacity);
+
+        const auto data = reinterpret_cast<T*>(block + offset);
+        std::uninitialized_value_construct_n(data, count);
+
+        return {data, count};
+    }
+
+    // Main thread; all arrays handed out become invalid
+    void Release()
+    {
+        Unlock();
+
+        if (block) {
+            ::operator delete(block, std::align_val_t{PageSize});
+        }
+        block    = nullptr;
+        capacity = 0;
+        used     = 0;
+    }
+
+    // Main thread. Locks the block into RAM, so it can't be paged out while
+    // the audio thread isn't looking, e.g. while the transport is stopped.
+    // Fails if the process is over its limit of locked memory (see
+    // RLIMIT_MEMLOCK, or the working set size on Windows), in which case
+    // the block just stays pageable.
+    bool Lock();
+
+    // Main thread; also done by Release()
+    void Unlock();
+
+    bool IsLocked() const
+    {
+        return is_locked;
+    }
+
+    // Size of the block in bytes
+    size_t Size() const
+    {
+        return capacity;
+    }
+
+private:
+    std::byte* block = nullptr;
+
+    size_t capacity = 0;
+    size_t used     = 0;
+
+    bool is_sizing = false;
+    bool is_locked = false;
+};
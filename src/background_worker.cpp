@@ -0,0 +1,149 @@
+// CLAP instrument plugin tutorial
+//
+// Low-priority worker thread for expensive jobs that aren't real-time.
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "background_worker.h"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#elif defined(__APPLE__)
+    #include <pthread.h>
+#elif defined(__linux__)
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace background_worker {
+
+static int ref_count = 0;
+
+static std::mutex queue_mutex         = {};
+static std::condition_variable wakeup = {};
+
+static std::deque<Job> queue = {};
+
+static std::thread* worker = nullptr;
+
+static bool quit = false;
+
+// Best effort, like the real-time priorities of the render threads. The
+// jobs still get to run on a busy machine, just after everyone else.
+static void SetBackgroundPriority()
+{
+#if defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__APPLE__)
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif defined(__linux__)
+    // Linux has a nice value per thread. This isn't SCHED_IDLE, as the main
+    // thread may end up waiting for a job's shared resources (see
+    // shared_resources.h), and shouldn't be starved along with it.
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+
+static void WorkerMain()
+{
+    SetBackgroundPriority();
+
+    std::unique_lock lock(queue_mutex);
+
+    while (true) {
+        wakeup.wait(lock, [] { return quit || !queue.empty(); });
+
+        if (quit) {
+            return;
+        }
+
+        auto job = std::move(queue.front());
+        queue.pop_front();
+
+        lock.unlock();
+
+        // Whatever the job has captured is released here as well, before
+        // the next one runs
+        job();
+        job = nullptr;
+
+        lock.lock();
+    }
+}
+
+void Init()
+{
+    const std::lock_guard lock(queue_mutex);
+
+    ++ref_count;
+}
+
+void Deinit()
+{
+    std::thread* to_join = nullptr;
+
+    // Released outside of the lock, in case they own anything that posts
+    // or waits for jobs when it's destroyed
+    std::deque<Job> dropped = {};
+
+    {
+        const std::lock_guard lock(queue_mutex);
+
+        if (ref_count == 0 || --ref_count > 0) {
+            return;
+        }
+
+        quit = true;
+        dropped.swap(queue);
+
+        to_join = std::exchange(worker, nullptr);
+    }
+
+    wakeup.notify_one();
+
+    if (to_join) {
+        to_join->join();
+        delete to_join;
+    }
+
+    const std::lock_guard lock(queue_mutex);
+
+    quit = false;
+}
+
+void Post(Job job)
+{
+    std::unique_lock lock(queue_mutex);
+
+    if (ref_count == 0) {
+        lock.unlock();
+        job();
+        return;
+    }
+
+    if (!worker) {
+        try {
+            worker = new std::thread(WorkerMain);
+
+        } catch (const std::system_error&) {
+            // No thread, no background; the job still gets done
+            lock.unlock();
+            job();
+            return;
+        }
+    }
+
+    queue.push_back(std::move(job));
+
+    lock.unlock();
+    wakeup.notify_one();
+}
+
+} // namespace background_worker
@@ -0,0 +1,39 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Low-priority worker thread for expensive jobs that aren't real-time.
+//
+// Some derived data takes milliseconds to build, e.g. the filter tables of
+// a resampler for a new render rate. The audio thread must never wait for
+// that, and the main thread shouldn't either if it can be avoided, as it
+// runs the host's UI. Jobs like these are queued here instead, and run one
+// at a time, in the order they were posted, on a single thread per process
+// that runs below normal priority.
+//
+// A job hands its result over with a Handoff (see handoff.h). Whoever
+// needs the result must cope with the job not having run yet, and do the
+// work itself then; jobs speed things up, they're never required.
+//
+// Jobs may outlive the plugin instance that posted them, so they must only
+// capture data they share ownership of.
+
+#include <functional>
+
+namespace background_worker {
+
+// Called from `clap_entry.init()` and `clap_entry.deinit()`; calls must be
+// balanced. The thread only gets started by the first job. The last
+// Deinit() drops the jobs that haven't run yet, waits for the running one
+// to finish, and joins the thread.
+void Init();
+void Deinit();
+
+using Job = std::function<void()>;
+
+// Queues a job; any thread but the audio thread, as this allocates.
+// Without Init() (e.g. in the benchmarks), the job runs right away on the
+// calling thread.
+void Post(Job job);
+
+} // namespace background_worker
@@ -0,0 +1,47 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Batch processing extension, for hosts that run many instances of our
+// plugins side by side (e.g. render farms rendering hundreds of stems with
+// the same synth).
+//
+// Instead of calling `clap_plugin.process()` once per instance, the host
+// hands over the process calls of a whole set of instances in a single
+// call. We then schedule them ourselves: the instances are grouped by
+// their render configuration, so the ones that run the same render path
+// with the same shared tables are processed back to back, and the groups
+// are spread across the threads of the first instance's host thread pool
+// (or its own render threads), in chunks of consecutive instances. Each
+// instance renders its voices on the thread it's been given, as nesting
+// thread pool requests isn't allowed.
+//
+// This is not part of CLAP; only hosts that know about this plugin can use
+// it. The extension is the same for every instance, so it can be queried
+// from any of them.
+
+#include "clap/clap.h"
+
+static constexpr char CLAP_TUTORIAL_EXT_BATCH_PROCESS[] =
+    "org.nakst.clap-tutorial.batch-process/1";
+
+typedef struct clap_tutorial_plugin_batch_process {
+    // Equivalent to calling `process(plugins[i], processes[i])` for every
+    // `i` in [0, count), and storing the results in `statuses[i]`. All
+    // instances must be active and processing, must have been created by
+    // this library, and may only appear once. Their buffers must not
+    // overlap, as the instances may be processed in parallel.
+    //
+    // Returns false without processing anything if any instance isn't one
+    // of ours, or if there are more than `max_count()` instances; the host
+    // should fall back to calling `process()` then.
+    // [audio-thread]
+    bool(CLAP_ABI* process)(const clap_plugin_t* const* plugins,
+                            const clap_process_t* const* processes,
+                            clap_process_status* statuses,
+                            uint32_t count);
+
+    // Largest number of instances that can be passed to `process()`
+    // [thread-safe]
+    uint32_t(CLAP_ABI* max_count)(void);
+} clap_tutorial_plugin_batch_process_t;
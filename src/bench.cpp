@@ -0,0 +1,741 @@
+// CLAP instrument plugin tutorial
+//
+// Micro-benchmarks of the DSP hot paths.
+//
+// The plugin is driven through the same entry points the host uses, by a
+// host that offers no extensions, so everything runs on the calling thread
+// exactly as it would on the audio thread. Every benchmark reports the CPU
+// time per output sample (and per voice where that makes sense) next to the
+// time per iteration, so results stay comparable across block sizes.
+//
+// Run with `--benchmark_filter=<regex>` to pick benchmarks, and compare two
+// runs with Google Benchmark's `compare.py` to spot regressions. Set
+// `CLAP_TUTORIAL_ISA` (e.g. to `sse2`) to compare the SIMD kernels.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "arena.h"
+#include "dsp_kernels.h"
+#include "my_plugin.h"
+#include "render_buffer.h"
+#include "render_scheduler.h"
+#include "resampler.h"
+
+namespace {
+
+constexpr uint32_t MaxFrameCount = 1024;
+
+constexpr auto RenderSampleRateHz = 16789.0;
+
+const clap_host_t BenchHost = {
+    .clap_version = CLAP_VERSION,
+    .host_data    = nullptr,
+    .name         = "ClapTutorialBench",
+    .vendor       = "nakst",
+    .url          = "https://nakst.gitlab.io",
+    .version      = "1.0.0",
+
+    .get_extension = [](const clap_host_t* host,
+                        const char* extension_id) -> const void* { return nullptr; },
+
+    .request_restart  = [](const clap_host_t* host) {},
+    .request_process  = [](const clap_host_t* host) {},
+    .request_callback = [](const clap_host_t* host) {}};
+
+// Input events of a block, in time order
+class EventList {
+
+public:
+    EventList() = default;
+
+    // The host-facing list refers back to the object
+    EventList(const EventList&)            = delete;
+    EventList& operator=(const EventList&) = delete;
+
+    void Clear()
+    {
+        events.clear();
+    }
+
+    void AddNote(const uint16_t type, const uint32_t time, const int16_t key,
+                 const int16_t channel, const int32_t note_id)
+    {
+        Event event = {};
+
+        event.note = {.header     = Header(type, sizeof(clap_event_note_t), time),
+                      .note_id    = note_id,
+                      .port_index = 0,
+                      .channel    = channel,
+                      .key        = key,
+                      .velocity   = 0.8};
+
+        events.push_back(event);
+    }
+
+    void AddParamValue(const uint32_t time, const clap_id param_id, const double value)
+    {
+        Event event = {};
+
+        event.param = {.header = Header(CLAP_EVENT_PARAM_VALUE,
+                                        sizeof(clap_event_param_value_t),
+                                        time),
+                       .param_id   = param_id,
+                       .cookie     = nullptr,
+                       .note_id    = -1,
+                       .port_index = -1,
+                       .channel    = -1,
+                       .key        = -1,
+                       .value      = value};
+
+        events.push_back(event);
+    }
+
+    void AddNoteExpression(const uint32_t time, const clap_note_expression expression_id,
+                           const int16_t key, const int16_t channel,
+                           const int32_t note_id, const double value)
+    {
+        Event event = {};
+
+        event.expression = {.header = Header(CLAP_EVENT_NOTE_EXPRESSION,
+                                             sizeof(clap_event_note_expression_t),
+                                             time),
+                            .expression_id = expression_id,
+                            .note_id       = note_id,
+                            .port_index    = 0,
+                            .channel       = channel,
+                            .key           = key,
+                            .value         = value};
+
+        events.push_back(event);
+    }
+
+    // Events may be added out of order; the host must deliver them sorted
+    void Sort()
+    {
+        std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) {
+            return a.header.time < b.header.time;
+        });
+    }
+
+    const clap_input_events_t* Input() const
+    {
+        return &input;
+    }
+
+private:
+    static clap_event_header_t Header(const uint16_t type, const uint32_t size,
+                                      const uint32_t time)
+    {
+        return {.size     = size,
+                .time     = time,
+                .space_id = CLAP_CORE_EVENT_SPACE_ID,
+                .type     = type,
+                .flags    = 0};
+    }
+
+    union Event {
+        clap_event_header_t header;
+        clap_event_note_t note;
+        clap_event_param_value_t param;
+        clap_event_note_expression_t expression;
+    };
+
+    std::vector<Event> events = {};
+
+    const clap_input_events_t input = {
+        .ctx  = this,
+        .size = [](const clap_input_events_t* list) -> uint32_t {
+            return static_cast<uint32_t>(
+                static_cast<const EventList*>(list->ctx)->events.size());
+        },
+        .get = [](const clap_input_events_t* list,
+                  uint32_t index) -> const clap_event_header_t* {
+            return &static_cast<const EventList*>(list->ctx)->events[index].header;
+        }};
+};
+
+// Our note end events are of no interest here
+const clap_output_events_t DiscardEvents = {
+    .ctx      = nullptr,
+    .try_push = [](const clap_output_events_t* list,
+                   const clap_event_header_t* event) -> bool { return true; }};
+
+// A plugin instance with stereo single precision output buffers
+class BenchPlugin {
+
+public:
+    BenchPlugin(const MyPlugin::Waveform waveform, const ResampleMode resample_mode)
+    {
+        plugin = std::make_unique<MyPlugin>(clap_plugin_t{}, &BenchHost, waveform,
+                                            resample_mode);
+        plugin->Init(plugin->GetPluginClass());
+
+        for (auto& channel : outputs) {
+            channel.resize(MaxFrameCount);
+        }
+    }
+
+    ~BenchPlugin()
+    {
+        if (is_active) {
+            plugin->Deactivate();
+        }
+        plugin->Shutdown();
+    }
+
+    // Parameters are looked up by name, as their indices are private
+    std::optional<clap_id> FindParam(const char* name)
+    {
+        clap_param_info_t info = {};
+
+        for (uint32_t i = 0; i < plugin->GetParamCount(); ++i) {
+            if (plugin->GetParamInfo(i, &info) && std::strcmp(info.name, name) == 0) {
+                return info.id;
+            }
+        }
+        return {};
+    }
+
+    // Settings that only take effect on activation
+    void SetParam(const char* name, const float value)
+    {
+        if (const auto id = FindParam(name)) {
+            plugin->SetMainParam(*id, value);
+        }
+    }
+
+    bool Activate(const double sample_rate)
+    {
+        is_active = plugin->Activate(sample_rate, 1, MaxFrameCount);
+        return is_active;
+    }
+
+    // The process call for a block; stays valid until the next call
+    const clap_process_t* PrepareProcess(const uint32_t num_frames,
+                                         const EventList& events)
+    {
+        channels = {outputs[0].data(), outputs[1].data()};
+
+        output = {.data32        = channels.data(),
+                  .data64        = nullptr,
+                  .channel_count = 2,
+                  .latency       = 0,
+                  .constant_mask = 0};
+
+        process = {.steady_time         = -1,
+                   .frames_count        = num_frames,
+                   .transport           = nullptr,
+                   .audio_inputs        = nullptr,
+                   .audio_outputs       = &output,
+                   .audio_inputs_count  = 0,
+                   .audio_outputs_count = 1,
+                   .in_events           = events.Input(),
+                   .out_events          = &DiscardEvents};
+
+        return &process;
+    }
+
+    clap_process_status Process(const uint32_t num_frames, const EventList& events)
+    {
+        const auto status = plugin->Process(PrepareProcess(num_frames, events));
+
+        benchmark::DoNotOptimize(outputs[0].data());
+        benchmark::DoNotOptimize(outputs[1].data());
+
+        return status;
+    }
+
+    MyPlugin* Get()
+    {
+        return plugin.get();
+    }
+
+    // Whether the render pipeline has dropped or duplicated frames; the
+    // benchmarks are usually built without assertions
+    bool LostFrames() const
+    {
+        return plugin->GetFrameCounters().num_violations > 0;
+    }
+
+    // Starts `num_voices` notes that are held forever, each on a key and
+    // channel of its own
+    void HoldVoices(const uint32_t num_voices)
+    {
+        EventList events = {};
+
+        for (uint32_t i = 0; i < num_voices; ++i) {
+            events.AddNote(CLAP_EVENT_NOTE_ON,
+                           0,
+                           static_cast<int16_t>(i % 128),
+                           static_cast<int16_t>(i / 128),
+                           static_cast<int32_t>(i));
+        }
+        Process(MaxFrameCount, events);
+
+        // Get past the attack
+        events.Clear();
+
+        for (uint32_t i = 0; i < 16; ++i) {
+            Process(MaxFrameCount, events);
+        }
+    }
+
+private:
+    std::unique_ptr<MyPlugin> plugin = {};
+
+    std::array<std::vector<float>, 2> outputs = {};
+
+    std::array<float*, 2> channels = {};
+    clap_audio_buffer_t output     = {};
+    clap_process_t process         = {};
+
+    bool is_active = false;
+};
+
+// Reports the time per output sample, and per voice if there are any
+void SetPerSampleCounters(benchmark::State& state, const uint32_t frames_per_iteration,
+                          const uint32_t num_voices = 0)
+{
+    using benchmark::Counter;
+
+    const auto num_samples = static_cast<double>(state.iterations()) *
+                             frames_per_iteration;
+
+    state.counters["per_sample"] = Counter(num_samples, Counter::kIsRate | Counter::kInvert);
+
+    if (num_voices > 0) {
+        state.counters["per_voice_sample"] = Counter(num_samples * num_voices,
+                                                     Counter::kIsRate | Counter::kInvert);
+    }
+}
+
+constexpr uint32_t BlockSize = 256;
+
+//////////////////////////////////////////////////////////////////////////////
+// Voice rendering
+//////////////////////////////////////////////////////////////////////////////
+
+// Held voices at the host's rate, so the time is spent in RenderAudio() and
+// the voice kernels rather than the resampler
+void BM_RenderAudio(benchmark::State& state)
+{
+    const auto waveform   = static_cast<MyPlugin::Waveform>(state.range(0));
+    const auto num_voices = static_cast<uint32_t>(state.range(1));
+
+    BenchPlugin plugin(waveform, ResampleMode::Off);
+
+    if (!plugin.Activate(48000.0)) {
+        state.SkipWithError("Activation failed");
+        return;
+    }
+    plugin.HoldVoices(num_voices);
+
+    const EventList no_events = {};
+
+    for (auto _ : state) {
+        plugin.Process(BlockSize, no_events);
+    }
+
+    SetPerSampleCounters(state, BlockSize, num_voices);
+}
+
+BENCHMARK(BM_RenderAudio)
+    ->ArgNames({"waveform", "voices"})
+    ->ArgsProduct({{MyPlugin::Sine, MyPlugin::Triangle, MyPlugin::Saw, MyPlugin::Square},
+                   {1, 8, 64, 256}});
+
+//////////////////////////////////////////////////////////////////////////////
+// Resampling
+//////////////////////////////////////////////////////////////////////////////
+
+// The render buffer to output path of ResampleAndPublishFrames(), driven by
+// the same scheduler as the plugin: stereo frames are buffered, resampled in
+// host-sized chunks and deinterleaved into the output channels.
+void BM_ResampleAndPublish(benchmark::State& state)
+{
+    const auto type        = static_cast<ResamplerType>(state.range(0));
+    const auto out_rate_hz = static_cast<double>(state.range(1));
+    const auto chunk_size  = static_cast<uint32_t>(state.range(2));
+
+    constexpr uint32_t NumChannels = 2;
+
+    auto resampler = CreateResampler(type, NumChannels, RenderSampleRateHz, out_rate_hz);
+
+    if (!resampler) {
+        state.SkipWithError("Couldn't create the resampler");
+        return;
+    }
+
+    RenderScheduler scheduler = {};
+    scheduler.Reset(resampler->RatioNum(), resampler->RatioDen(),
+                    resampler->InputLatency());
+
+    const auto max_render_frames =
+        (uint64_t{MaxFrameCount} * resampler->RatioNum() + resampler->RatioDen() - 1) /
+        resampler->RatioDen();
+
+    const auto capacity = static_cast<size_t>(max_render_frames) +
+                          resampler->InputLatency() + 2;
+
+    Arena arena                    = {};
+    RenderBuffer<float> render_buf = {};
+
+    arena.Build([&](Arena& a) { render_buf.Allocate(a, capacity, NumChannels); });
+
+    // Something to resample; rendering it isn't part of the measurement
+    std::vector<float> source(capacity);
+
+    for (size_t i = 0; i < source.size(); ++i) {
+        source[i] = static_cast<float>(0.2 * std::sin(0.1 * static_cast<double>(i)));
+    }
+
+    std::vector<float> resampled(static_cast<size_t>(MaxFrameCount) * NumChannels);
+    std::vector<float> out_left(MaxFrameCount);
+    std::vector<float> out_right(MaxFrameCount);
+
+    for (auto _ : state) {
+        const auto num_frames_to_render = scheduler.FramesToRender(chunk_size);
+
+        render_buf.Write(source.data(), source.data(), num_frames_to_render);
+        scheduler.AddRenderedFrames(num_frames_to_render);
+
+        auto in_len  = static_cast<uint32_t>(render_buf.Size());
+        auto out_len = chunk_size;
+
+        resampler->Process(render_buf.Read(), in_len, resampled.data(), out_len);
+
+        render_buf.Consume(in_len);
+        scheduler.FinishBlock(chunk_size);
+
+        for (uint32_t i = 0; i < out_len; ++i) {
+            out_left[i]  = resampled[i * 2];
+            out_right[i] = resampled[i * 2 + 1];
+        }
+        benchmark::DoNotOptimize(out_left.data());
+        benchmark::DoNotOptimize(out_right.data());
+    }
+
+    SetPerSampleCounters(state, chunk_size);
+}
+
+BENCHMARK(BM_ResampleAndPublish)
+    ->ArgNames({"type", "rate", "chunk"})
+    ->ArgsProduct({benchmark::CreateDenseRange(0, NumResamplerTypes - 1, 1),
+                   {44100, 48000, 96000},
+                   {32, 256, 1024}});
+
+//////////////////////////////////////////////////////////////////////////////
+// Processing with synthetic event streams
+//////////////////////////////////////////////////////////////////////////////
+
+// Every block starts `notes_per_block` notes at random positions and
+// releases the notes of the previous block, so voices are constantly
+// started, released and stolen
+void BM_ProcessNoteStorm(benchmark::State& state)
+{
+    const auto notes_per_block = static_cast<uint32_t>(state.range(0));
+
+    BenchPlugin plugin(MyPlugin::Saw, ResampleMode::On);
+
+    if (!plugin.Activate(48000.0)) {
+        state.SkipWithError("Activation failed");
+        return;
+    }
+
+    // Event times and keys are generated up front, so the random number
+    // generator isn't part of the measurement
+    constexpr uint32_t NumPatterns = 64;
+
+    std::vector<EventList> patterns(NumPatterns);
+
+    srand(1);
+
+    int32_t note_id = 0;
+
+    std::vector<std::pair<int16_t, int32_t>> held = {};
+
+    for (auto& events : patterns) {
+        for (const auto& [key, id] : held) {
+            events.AddNote(CLAP_EVENT_NOTE_OFF, rand() % BlockSize, key, 0, id);
+        }
+        held.clear();
+
+        for (uint32_t i = 0; i < notes_per_block; ++i) {
+            const auto key = static_cast<int16_t>(24 + rand() % 72);
+
+            events.AddNote(CLAP_EVENT_NOTE_ON, rand() % BlockSize, key, 0, note_id);
+            held.emplace_back(key, note_id++);
+        }
+        events.Sort();
+    }
+
+    uint32_t block = 0;
+
+    for (auto _ : state) {
+        plugin.Process(BlockSize, patterns[block++ % NumPatterns]);
+    }
+
+    if (plugin.LostFrames()) {
+        state.SkipWithError("Frames were dropped or duplicated");
+        return;
+    }
+
+    SetPerSampleCounters(state, BlockSize);
+
+    state.counters["notes"] = benchmark::Counter(
+        static_cast<double>(state.iterations()) * notes_per_block,
+        benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_ProcessNoteStorm)->ArgName("notes")->RangeMultiplier(4)->Range(1, 256);
+
+// Held voices with `changes_per_block` parameter changes per block, spread
+// evenly across the volume, pan and tune parameters, which are smoothed and
+// feed the per-voice gains and pitches
+void BM_ProcessAutomation(benchmark::State& state)
+{
+    const auto changes_per_block = static_cast<uint32_t>(state.range(0));
+
+    constexpr uint32_t NumVoices = 32;
+
+    BenchPlugin plugin(MyPlugin::Saw, ResampleMode::On);
+
+    if (!plugin.Activate(48000.0)) {
+        state.SkipWithError("Activation failed");
+        return;
+    }
+    plugin.HoldVoices(NumVoices);
+
+    const std::optional<clap_id> targets[] = {
+        plugin.FindParam("Volume"), plugin.FindParam("Pan"), plugin.FindParam("Tune")};
+
+    for (const auto& target : targets) {
+        if (!target) {
+            state.SkipWithError("Parameter not found");
+            return;
+        }
+    }
+
+    // Two blocks of sweeps back and forth, so the values keep changing
+    EventList sweeps[2] = {};
+
+    for (uint32_t b = 0; b < 2; ++b) {
+        for (uint32_t i = 0; i < changes_per_block; ++i) {
+            const auto time     = i * BlockSize / changes_per_block;
+            const auto position = static_cast<double>(i) / changes_per_block;
+            const auto ramp     = (b == 0) ? position : 1.0 - position;
+
+            switch (i % 3) {
+            case 0: sweeps[b].AddParamValue(time, *targets[0], 0.1 + 0.4 * ramp); break;
+            case 1: sweeps[b].AddParamValue(time, *targets[1], 2.0 * ramp - 1.0); break;
+            case 2: sweeps[b].AddParamValue(time, *targets[2], ramp); break;
+            }
+        }
+    }
+
+    uint32_t block = 0;
+
+    for (auto _ : state) {
+        plugin.Process(BlockSize, sweeps[block++ % 2]);
+    }
+
+    if (plugin.LostFrames()) {
+        state.SkipWithError("Frames were dropped or duplicated");
+        return;
+    }
+
+    SetPerSampleCounters(state, BlockSize, NumVoices);
+}
+
+BENCHMARK(BM_ProcessAutomation)->ArgName("changes")->RangeMultiplier(4)->Range(1, 256);
+
+// Voices that are started and released together at the start of every
+// cycle, then fade out over the rest of it. Most of the time is spent in
+// the quiet tails of the envelopes, which is where subnormals slip in when
+// the denormal protection doesn't work.
+void BM_ProcessDecayingVoices(benchmark::State& state)
+{
+    const auto num_voices = static_cast<uint32_t>(state.range(0));
+
+    // A second of release at 48 kHz takes 188 blocks to reach silence, so
+    // the voices are almost done by the time they're started again
+    constexpr auto ReleaseMs       = 1000.0f;
+    constexpr uint32_t CycleBlocks = 192;
+
+    BenchPlugin plugin(MyPlugin::Saw, ResampleMode::On);
+
+    plugin.SetParam("Release", ReleaseMs);
+
+    if (!plugin.Activate(48000.0)) {
+        state.SkipWithError("Activation failed");
+        return;
+    }
+
+    EventList note_ons  = {};
+    EventList note_offs = {};
+    EventList no_events = {};
+
+    for (uint32_t i = 0; i < num_voices; ++i) {
+        const auto key     = static_cast<int16_t>(i % 128);
+        const auto channel = static_cast<int16_t>(i / 128);
+
+        note_ons.AddNote(CLAP_EVENT_NOTE_ON, 0, key, channel, static_cast<int32_t>(i));
+        note_offs.AddNote(CLAP_EVENT_NOTE_OFF, 0, key, channel, static_cast<int32_t>(i));
+    }
+
+    uint32_t block = 0;
+
+    for (auto _ : state) {
+        const auto pos = block++ % CycleBlocks;
+
+        plugin.Process(BlockSize,
+                       (pos == 0) ? note_ons : (pos == 1) ? note_offs : no_events);
+    }
+
+    if (plugin.LostFrames()) {
+        state.SkipWithError("Frames were dropped or duplicated");
+        return;
+    }
+
+    SetPerSampleCounters(state, BlockSize, num_voices);
+}
+
+BENCHMARK(BM_ProcessDecayingVoices)->ArgName("voices")->RangeMultiplier(4)->Range(16, 256);
+
+// A sparse scene: the maximum number of held voices, of which only
+// `num_audible` can be heard; the others have been faded out with the
+// volume expression. Ideally, the cost only depends on the audible ones.
+void BM_ProcessSparseVoices(benchmark::State& state)
+{
+    const auto num_audible = static_cast<uint32_t>(state.range(0));
+
+    // The plugin's polyphony
+    constexpr uint32_t NumVoices = 256;
+
+    BenchPlugin plugin(MyPlugin::Saw, ResampleMode::On);
+
+    if (!plugin.Activate(48000.0)) {
+        state.SkipWithError("Activation failed");
+        return;
+    }
+    plugin.HoldVoices(NumVoices);
+
+    EventList mutes     = {};
+    EventList no_events = {};
+
+    for (uint32_t i = num_audible; i < NumVoices; ++i) {
+        mutes.AddNoteExpression(0,
+                                CLAP_NOTE_EXPRESSION_VOLUME,
+                                static_cast<int16_t>(i % 128),
+                                static_cast<int16_t>(i / 128),
+                                static_cast<int32_t>(i),
+                                0.0);
+    }
+    plugin.Process(BlockSize, mutes);
+
+    // Let the expressions settle
+    for (uint32_t i = 0; i < 64; ++i) {
+        plugin.Process(BlockSize, no_events);
+    }
+
+    for (auto _ : state) {
+        plugin.Process(BlockSize, no_events);
+    }
+
+    if (plugin.LostFrames()) {
+        state.SkipWithError("Frames were dropped or duplicated");
+        return;
+    }
+
+    SetPerSampleCounters(state, BlockSize, num_audible);
+}
+
+BENCHMARK(BM_ProcessSparseVoices)->ArgName("audible")->RangeMultiplier(4)->Range(4, 256);
+
+// Many small instances of the same plugin processed as one batch, the way
+// a render farm would use the batch processing extension. The first
+// instance leads the batch, and spreads it across `num_threads` render
+// threads of its own.
+void BM_ProcessBatch(benchmark::State& state)
+{
+    const auto num_instances = static_cast<uint32_t>(state.range(0));
+    const auto num_threads   = static_cast<uint32_t>(state.range(1));
+
+    constexpr uint32_t VoicesPerInstance = 8;
+
+    std::vector<std::unique_ptr<BenchPlugin>> plugins = {};
+
+    for (uint32_t i = 0; i < num_instances; ++i) {
+        auto plugin = std::make_unique<BenchPlugin>(MyPlugin::Saw, ResampleMode::On);
+
+        if (i == 0) {
+            plugin->SetParam("Render Threads", static_cast<float>(num_threads));
+        }
+        if (!plugin->Activate(48000.0)) {
+            state.SkipWithError("Activation failed");
+            return;
+        }
+        plugin->HoldVoices(VoicesPerInstance);
+
+        plugins.push_back(std::move(plugin));
+    }
+
+    EventList no_events = {};
+
+    std::vector<MyPlugin*> instances                = {};
+    std::vector<const clap_process_t*> processes    = {};
+    std::vector<clap_process_status> statuses(num_instances);
+
+    for (const auto& plugin : plugins) {
+        instances.push_back(plugin->Get());
+        processes.push_back(plugin->PrepareProcess(BlockSize, no_events));
+    }
+
+    for (auto _ : state) {
+        MyPlugin::ProcessBatch(instances.data(), processes.data(), statuses.data(),
+                               num_instances);
+    }
+
+    for (const auto& plugin : plugins) {
+        if (plugin->LostFrames()) {
+            state.SkipWithError("Frames were dropped or duplicated");
+            return;
+        }
+    }
+
+    SetPerSampleCounters(state, BlockSize * num_instances, VoicesPerInstance);
+}
+
+BENCHMARK(BM_ProcessBatch)
+    ->ArgNames({"instances", "threads"})
+    ->ArgsProduct({{16, 64}, {0, 3}})
+    ->UseRealTime();
+
+} // namespace
+
+// Same as BENCHMARK_MAIN(), but selects the SIMD kernels first like the
+// plugin's entry point does, and records which ones were used
+int main(int argc, char** argv)
+{
+    kernels::Init();
+
+    benchmark::AddCustomContext("isa", kernels::ToString(kernels::Get().isa));
+
+    benchmark::Initialize(&argc, argv);
+
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
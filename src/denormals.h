@@ -0,0 +1,131 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Denormal protection.
+//
+// Exponentially decaying signals (envelope and smoothing tails, filter and
+// reverb feedback, voices fading out) eventually produce subnormal floats,
+// and arithmetic on those can be 100 times slower on x86 CPUs. A synth that
+// is busy fading out a few hundred voices can then overrun its deadline in
+// the quietest part of a song.
+//
+// The cheapest fix is to let the FPU treat them as zero: flush-to-zero
+// (FTZ) for results and denormals-are-zero (DAZ) for inputs on x86, and the
+// FZ bit of FPCR on AArch64. The mode is per thread and belongs to the host,
+// so every entry point that renders sets it with a ScopedFlushDenormals
+// guard and puts the host's mode back on exit.
+//
+// Recursive state that outlives a block (e.g. one-pole filters) should
+// still be flushed explicitly with FlushDenormal(), so it stays clean on
+// platforms without a flush-to-zero mode and never leaks subnormals into
+// code running without the guard.
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <xmmintrin.h>
+    #define DENORMALS_X86
+#elif defined(__aarch64__)
+    #define DENORMALS_AARCH64
+#elif defined(_M_ARM64)
+    #include <intrin.h>
+    #define DENORMALS_AARCH64
+#endif
+
+class ScopedFlushDenormals {
+
+public:
+    ScopedFlushDenormals()
+    {
+        saved_mode = ReadMode();
+
+        const auto mode = saved_mode | FlushBits;
+
+        // Writing the control register serialises the pipeline on some
+        // CPUs, so it's only done if the host hasn't set the mode already
+        if (mode != saved_mode) {
+            WriteMode(mode);
+        }
+    }
+
+    ~ScopedFlushDenormals()
+    {
+        if (ReadMode() != saved_mode) {
+            WriteMode(saved_mode);
+        }
+    }
+
+    ScopedFlushDenormals(const ScopedFlushDenormals&)            = delete;
+    ScopedFlushDenormals& operator=(const ScopedFlushDenormals&) = delete;
+
+private:
+#if defined(DENORMALS_X86)
+    // MXCSR bits 15 (FTZ) and 6 (DAZ)
+    static constexpr uint64_t FlushBits = 0x8040;
+
+    static uint64_t ReadMode()
+    {
+        return _mm_getcsr();
+    }
+
+    static void WriteMode(const uint64_t mode)
+    {
+        _mm_setcsr(static_cast<unsigned int>(mode));
+    }
+
+#elif defined(DENORMALS_AARCH64)
+    // FPCR bit 24 (FZ); flushes both inputs and results
+    static constexpr uint64_t FlushBits = uint64_t{1} << 24;
+
+    static uint64_t ReadMode()
+    {
+    #if defined(_M_ARM64)
+        return static_cast<uint64_t>(_ReadStatusReg(ARM64_FPCR));
+    #else
+        uint64_t fpcr = 0;
+        __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+        return fpcr;
+    #endif
+    }
+
+    static void WriteMode(const uint64_t mode)
+    {
+    #if defined(_M_ARM64)
+        _WriteStatusReg(ARM64_FPCR, static_cast<__int64>(mode));
+    #else
+        __asm__ volatile("msr fpcr, %0" : : "r"(mode));
+    #endif
+    }
+
+#else
+    // No flush-to-zero mode; only the explicit flushing helps here
+    static constexpr uint64_t FlushBits = 0;
+
+    static uint64_t ReadMode()
+    {
+        return 0;
+    }
+
+    static void WriteMode(const uint64_t mode) {}
+#endif
+
+    uint64_t saved_mode = 0;
+};
+
+// Values this small are inaudible even after any amount of gain, but still
+// far above the subnormal range, so flushing them keeps the arithmetic on
+// the fast path
+constexpr float DenormalThreshold = 1e-15f;
+
+// Written as a select so loops over voices stay vectorised
+inline float FlushDenormal(const float x)
+{
+    return (std::fabs(x) < DenormalThreshold) ? 0.0f : x;
+}
+
+inline double FlushDenormal(const double x)
+{
+    return (std::fabs(x) < DenormalThreshold) ? 0.0 : x;
+}
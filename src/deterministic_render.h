@@ -0,0 +1,63 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Deterministic render extension, for hosts that split the rendering of a
+// song across many machines (e.g. render farms), and need every segment to
+// come out bit for bit the same as in a render of the whole song.
+//
+// By default, the output depends on more than the events: on the SIMD
+// kernels the machine can run, on whether render threads are available,
+// on the render mode, and on how the host splits its buffers. In
+// deterministic mode, none of these make a difference:
+//
+// - the voices, the mix and the resampler run on the baseline kernels of
+//   the architecture (SSE2 on x86, NEON on ARM)
+// - the voice groups are always summed in the same order, whether they're
+//   rendered in parallel or not
+// - the render block size, the resampler and the event timing are the same
+//   in both render modes; the Speex backends are replaced by the polyphase
+//   one, which can pick up its phase anywhere in the stream
+// - the voices are rendered in whole blocks of the render grid, which
+//   delays the output by one render block more (see render_scheduler.h)
+//
+// The render clock is derived from the absolute position in the stream,
+// counted in output frames from the activation or the last seek. When the
+// plugin wakes up from being idle, the whole render pipeline starts where
+// it would be had it kept running through the silence, so a node can start
+// rendering at any frame without any pre-roll.
+//
+// For a segment to match, it must start where the whole render would be
+// idle: at least the tail length (see `clap_plugin_tail`) after the last
+// voice ended, with no parameter still gliding. The plugin must be in the
+// same state at the start of the segment (parameters, tunings, MIDI
+// controllers), and the host must report the same transport for the tempo
+// synced LFOs and use the same sample type (32 or 64 bit) throughout. All
+// machines must run the same build of the plugin on the same architecture.
+//
+// This is not part of CLAP; only hosts that know about this plugin can use
+// it.
+
+#include "clap/clap.h"
+
+static constexpr char CLAP_TUTORIAL_EXT_DETERMINISTIC_RENDER[] =
+    "org.nakst.clap-tutorial.deterministic-render/1";
+
+typedef struct clap_tutorial_plugin_deterministic_render {
+    // Turns deterministic mode on or off for the next activation; the
+    // latency and the tail length are only known once activated. Returns
+    // false if the plugin is active.
+    // [main-thread & !active]
+    bool(CLAP_ABI* set_enabled)(const clap_plugin_t* plugin, bool enabled);
+
+    // [main-thread]
+    bool(CLAP_ABI* is_enabled)(const clap_plugin_t* plugin);
+
+    // Makes the next process call render from output frame `frame` of the
+    // stream, as if all the frames before it had been processed. Voices
+    // that are still playing are stopped without note end events, and any
+    // parameter that's still gliding jumps to its value. Returns false if
+    // the plugin isn't active in deterministic mode.
+    // [main-thread & active & !processing]
+    bool(CLAP_ABI* seek)(const clap_plugin_t* plugin, uint64_t frame);
+} clap_tutorial_plugin_deterministic_render_t;
@@ -0,0 +1,213 @@
+// CLAP instrument plugin tutorial
+//
+// Selection of the SIMD kernels, and the ones built for the instruction set
+// the compiler targets by default.
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "dsp_kernels_impl.h"
+
+#if defined(DSP_KERNELS_AVX2) || defined(DSP_KERNELS_AVX512)
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+namespace kernels {
+
+#if defined(__AVX512F__)
+static constexpr auto DefaultIsa = Isa::Avx512;
+#elif defined(__AVX2__)
+static constexpr auto DefaultIsa = Isa::Avx2;
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+static constexpr auto DefaultIsa = Isa::Sse2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+static constexpr auto DefaultIsa = Isa::Neon;
+#else
+static constexpr auto DefaultIsa = Isa::Scalar;
+#endif
+
+static constexpr auto DefaultKernels = MakeKernels(DefaultIsa);
+
+static std::atomic<const Kernels*> selected_kernels = &DefaultKernels;
+
+const char* ToString(const Isa isa)
+{
+    switch (isa) {
+    case Isa::Scalar: return "scalar";
+    case Isa::Sse2: return "sse2";
+    case Isa::Avx2: return "avx2";
+    case Isa::Avx512: return "avx512";
+    case Isa::Neon: return "neon";
+    }
+    return "unknown";
+}
+
+const Kernels& GetDefaultKernels()
+{
+    return DefaultKernels;
+}
+
+#if defined(DSP_KERNELS_AVX2) || defined(DSP_KERNELS_AVX512)
+
+struct CpuidRegs {
+    uint32_t eax = 0;
+    uint32_t ebx = 0;
+    uint32_t ecx = 0;
+    uint32_t edx = 0;
+};
+
+static CpuidRegs Cpuid(const uint32_t leaf, const uint32_t subleaf)
+{
+    CpuidRegs r = {};
+
+    #if defined(_MSC_VER)
+    int regs[4] = {};
+    __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+    r = {static_cast<uint32_t>(regs[0]),
+         static_cast<uint32_t>(regs[1]),
+         static_cast<uint32_t>(regs[2]),
+         static_cast<uint32_t>(regs[3])};
+    #else
+    if (leaf > __get_cpuid_max(0, nullptr)) {
+        return r;
+    }
+    __cpuid_count(leaf, subleaf, r.eax, r.ebx, r.ecx, r.edx);
+    #endif
+
+    return r;
+}
+
+// The register state the OS saves on context switches (XCR0). Only valid if
+// CPUID reports OSXSAVE.
+static uint64_t ReadXcr0()
+{
+    #if defined(_MSC_VER)
+    return _xgetbv(0);
+    #else
+    uint32_t eax = 0;
+    uint32_t edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+    #endif
+}
+
+struct CpuFeatures {
+    bool avx2   = false;
+    bool avx512 = false;
+};
+
+static CpuFeatures DetectCpuFeatures()
+{
+    constexpr auto Bit = [](const uint32_t reg, const uint32_t bit) {
+        return ((reg >> bit) & 1) != 0;
+    };
+
+    const auto leaf1 = Cpuid(1, 0);
+    const auto leaf7 = Cpuid(7, 0);
+
+    // It's not enough for the CPU to have the instructions; the OS must
+    // also save the wider registers, or they get corrupted on context
+    // switches
+    if (!Bit(leaf1.ecx, 27)) {
+        return {};
+    }
+    const auto xcr0 = ReadXcr0();
+
+    // XMM and YMM state
+    const auto os_avx = (xcr0 & 0x6) == 0x6;
+
+    // ... plus the opmask registers and the upper halves of ZMM0-31
+    const auto os_avx512 = (xcr0 & 0xe6) == 0xe6;
+
+    CpuFeatures features = {};
+
+    features.avx2 = os_avx && Bit(leaf1.ecx, 28) /* AVX */ &&
+                    Bit(leaf1.ecx, 12) /* FMA */ && Bit(leaf7.ebx, 5) /* AVX2 */;
+
+    features.avx512 = features.avx2 && os_avx512 && Bit(leaf7.ebx, 16) /* AVX512F */;
+
+    return features;
+}
+
+#endif
+
+bool IsAvailable(const Isa isa)
+{
+    if (isa == DefaultIsa) {
+        return true;
+    }
+
+#if defined(DSP_KERNELS_AVX2) || defined(DSP_KERNELS_AVX512)
+    static const auto features = DetectCpuFeatures();
+
+    switch (isa) {
+    #if defined(DSP_KERNELS_AVX2)
+    case Isa::Avx2: return features.avx2;
+    #endif
+    #if defined(DSP_KERNELS_AVX512)
+    case Isa::Avx512: return features.avx512;
+    #endif
+    default: return false;
+    }
+#else
+    return false;
+#endif
+}
+
+static const Kernels* GetKernels(const Isa isa)
+{
+    if (isa == DefaultIsa) {
+        return &DefaultKernels;
+    }
+
+    switch (isa) {
+#if defined(DSP_KERNELS_AVX2)
+    case Isa::Avx2: return &GetAvx2Kernels();
+#endif
+#if defined(DSP_KERNELS_AVX512)
+    case Isa::Avx512: return &GetAvx512Kernels();
+#endif
+    default: return nullptr;
+    }
+}
+
+void Init()
+{
+    // From the widest down to the default ones
+    constexpr Isa Candidates[] = {Isa::Avx512, Isa::Avx2, DefaultIsa};
+
+    // Narrower sets can be requested for testing. Unknown requests, or ones
+    // the machine can't run, get the default kernels.
+    const auto requested = std::getenv("CLAP_TUTORIAL_ISA");
+
+    auto kernels = &DefaultKernels;
+
+    for (const auto isa : Candidates) {
+        if (requested && strcmp(requested, ToString(isa)) != 0) {
+            continue;
+        }
+        if (!IsAvailable(isa)) {
+            continue;
+        }
+        if (const auto k = GetKernels(isa)) {
+            kernels = k;
+            break;
+        }
+    }
+
+    selected_kernels.store(kernels, std::memory_order_release);
+}
+
+const Kernels& Get()
+{
+    return *selected_kernels.load(std::memory_order_acquire);
+}
+
+} // namespace kernels
@@ -0,0 +1,109 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Runtime dispatch of the SIMD kernels.
+//
+// The hot loops (voice rendering, the polyphase resampler's filter, and
+// summing the mixes of the voice groups) are built several times, once per
+// instruction set, in separate translation units with the matching compiler
+// flags. When the library is loaded, Init() checks what the CPU and the OS
+// support and picks the widest set once; every plugin instance then calls
+// the kernels through the same table of function pointers.
+//
+// The kernels the compiler targets by default (SSE2 on x86-64, NEON on
+// AArch64) are always there, so portable builds run everywhere and only
+// pick the wider ones where they're supported. The `CLAP_TUTORIAL_ISA`
+// environment variable (e.g. `sse2`) selects a narrower set instead, to
+// compare them or to rule them out when tracking down a problem.
+//
+// The calls are made once per block and voice group, or once per output
+// sample for the resampler, so the indirection costs next to nothing.
+
+#include <cstdint>
+
+namespace kernels {
+
+enum class Isa : uint8_t { Scalar, Sse2, Avx2, Avx512, Neon };
+
+constexpr auto NumIsas = 5;
+
+const char* ToString(const Isa isa);
+
+// The shapes of osc::RenderVoices() that the plugin uses
+enum class Shape : uint8_t { Sine, Saw, Square };
+
+constexpr auto NumShapes = 3;
+
+// See osc::RenderVoices()
+template <typename T>
+using RenderVoicesFn = void (*)(T* const* out, uint32_t num_frames, uint32_t num_voices,
+                                float* phase, const float* phase_inc,
+                                const float* const* gain_start,
+                                const float* const* gain_end);
+
+// Adds `num_frames` samples of `in` to `out`
+template <typename T>
+using AccumulateFn = void (*)(T* out, const T* in, uint32_t num_frames);
+
+// Inner product of `x` with a row of filter coefficients. Multiples of 16
+// taps are the fastest.
+using FirFn = float (*)(const float* row, const float* x, uint32_t num_taps);
+
+// Linear interpolation between the inner products of `x` with two rows of
+// filter coefficients, by `t`
+using InterpolateFirFn = float (*)(const float* row0, const float* row1, const float* x,
+                                   uint32_t num_taps, float t);
+
+template <typename T>
+struct SampleKernels {
+    // By shape and number of channels (1 or 2)
+    RenderVoicesFn<T> render_voices[NumShapes][2] = {};
+
+    AccumulateFn<T> accumulate = nullptr;
+
+    RenderVoicesFn<T> RenderVoices(const Shape shape, const uint32_t num_channels) const
+    {
+        return render_voices[static_cast<uint32_t>(shape)][num_channels - 1];
+    }
+};
+
+struct Kernels {
+    Isa isa = Isa::Scalar;
+
+    SampleKernels<float> f32  = {};
+    SampleKernels<double> f64 = {};
+
+    FirFn fir                        = nullptr;
+    InterpolateFirFn interpolate_fir = nullptr;
+
+    template <typename T>
+    const SampleKernels<T>& For() const
+    {
+        if constexpr (sizeof(T) == sizeof(double)) {
+            return f64;
+        } else {
+            return f32;
+        }
+    }
+};
+
+// Selects the kernels; called from `clap_entry.init`, before any instance
+// is created. Until then, the default ones are used.
+void Init();
+
+// The selected kernels
+const Kernels& Get();
+
+// Whether this build contains the kernels for `isa` and the machine can run
+// them
+bool IsAvailable(const Isa isa);
+
+// The kernels of a single instruction set, implemented by the per-ISA
+// translation units. The wider ones are only part of x86 builds, which
+// define DSP_KERNELS_AVX2 and DSP_KERNELS_AVX512 when they are.
+const Kernels& GetDefaultKernels();
+const Kernels& GetAvx2Kernels();
+const Kernels& GetAvx512Kernels();
+
+} // namespace kernels
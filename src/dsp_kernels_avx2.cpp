@@ -0,0 +1,19 @@
+// CLAP instrument plugin tutorial
+//
+// AVX2 kernels; built with -mavx2 -mfma (/arch:AVX2 with MSVC).
+
+#include "dsp_kernels_impl.h"
+
+#if !defined(__AVX2__)
+    #error "This file must be compiled with AVX2 enabled"
+#endif
+
+namespace kernels {
+
+const Kernels& GetAvx2Kernels()
+{
+    static constexpr auto AvxKernels = MakeKernels(Isa::Avx2);
+    return AvxKernels;
+}
+
+} // namespace kernels
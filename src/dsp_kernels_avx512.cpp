@@ -0,0 +1,20 @@
+// CLAP instrument plugin tutorial
+//
+// AVX-512 kernels; built with -mavx512f -mavx2 -mfma (/arch:AVX512 with
+// MSVC).
+
+#include "dsp_kernels_impl.h"
+
+#if !defined(__AVX512F__)
+    #error "This file must be compiled with AVX-512 enabled"
+#endif
+
+namespace kernels {
+
+const Kernels& GetAvx512Kernels()
+{
+    static constexpr auto Avx512Kernels = MakeKernels(Isa::Avx512);
+    return Avx512Kernels;
+}
+
+} // namespace kernels
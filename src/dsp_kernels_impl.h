@@ -0,0 +1,128 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// The kernels of dsp_kernels.h, for the instruction set the including
+// translation unit is compiled for. Every per-ISA source file includes this
+// once and returns the result of MakeKernels().
+//
+// Only headers that keep their code in the `SIMD_ISA` inline namespace may
+// be included here; anything else would get instantiated with different
+// instruction sets under the same name.
+
+#include "dsp_kernels.h"
+#include "oscillator.h"
+#include "simd.h"
+
+namespace kernels {
+inline namespace SIMD_ISA {
+
+template <typename ShapeT, uint32_t NumChannels, typename T>
+void RenderVoices(T* const* out, const uint32_t num_frames, const uint32_t num_voices,
+                  float* phase, const float* phase_inc, const float* const* gain_start,
+                  const float* const* gain_end)
+{
+    osc::RenderVoices<ShapeT, NumChannels>(
+        out, num_frames, num_voices, phase, phase_inc, gain_start, gain_end);
+}
+
+template <typename T>
+void Accumulate(T* out, const T* in, const uint32_t num_frames)
+{
+    using V = typename simd::VectorTypes<T>::Wide;
+    using S = typename simd::VectorTypes<T>::Scalar;
+
+    uint32_t i = 0;
+
+    for (; i + V::NumLanes <= num_frames; i += V::NumLanes) {
+        (V::Load(out + i) + V::Load(in + i)).Store(out + i);
+    }
+    for (; i < num_frames; ++i) {
+        (S::Load(out + i) + S::Load(in + i)).Store(out + i);
+    }
+}
+
+inline float Fir(const float* row, const float* x, const uint32_t num_taps)
+{
+    using V = simd::F32xN;
+
+    auto sum = V::Set(0.0f);
+
+    uint32_t n = 0;
+
+    for (; n + V::NumLanes <= num_taps; n += V::NumLanes) {
+        sum = sum + V::Load(row + n) * V::Load(x + n);
+    }
+
+    auto y = HorizontalSum(sum);
+
+    for (; n < num_taps; ++n) {
+        y += row[n] * x[n];
+    }
+
+    return y;
+}
+
+// Both rows are read in the same pass over `x`
+inline float InterpolateFir(const float* row0, const float* row1, const float* x,
+                            const uint32_t num_taps, const float t)
+{
+    using V = simd::F32xN;
+
+    auto sum0 = V::Set(0.0f);
+    auto sum1 = V::Set(0.0f);
+
+    uint32_t n = 0;
+
+    for (; n + V::NumLanes <= num_taps; n += V::NumLanes) {
+        const auto xn = V::Load(x + n);
+
+        sum0 = sum0 + V::Load(row0 + n) * xn;
+        sum1 = sum1 + V::Load(row1 + n) * xn;
+    }
+
+    auto y0 = HorizontalSum(sum0);
+    auto y1 = HorizontalSum(sum1);
+
+    for (; n < num_taps; ++n) {
+        y0 += row0[n] * x[n];
+        y1 += row1[n] * x[n];
+    }
+
+    return y0 + (y1 - y0) * t;
+}
+
+template <typename T>
+constexpr SampleKernels<T> MakeSampleKernels()
+{
+    SampleKernels<T> kernels = {};
+
+    kernels.render_voices[static_cast<uint32_t>(Shape::Sine)][0] =
+        &RenderVoices<osc::Sine, 1, T>;
+    kernels.render_voices[static_cast<uint32_t>(Shape::Sine)][1] =
+        &RenderVoices<osc::Sine, 2, T>;
+    kernels.render_voices[static_cast<uint32_t>(Shape::Saw)][0] =
+        &RenderVoices<osc::Saw, 1, T>;
+    kernels.render_voices[static_cast<uint32_t>(Shape::Saw)][1] =
+        &RenderVoices<osc::Saw, 2, T>;
+    kernels.render_voices[static_cast<uint32_t>(Shape::Square)][0] =
+        &RenderVoices<osc::Square, 1, T>;
+    kernels.render_voices[static_cast<uint32_t>(Shape::Square)][1] =
+        &RenderVoices<osc::Square, 2, T>;
+
+    kernels.accumulate = &Accumulate<T>;
+
+    return kernels;
+}
+
+constexpr Kernels MakeKernels(const Isa isa)
+{
+    return {.isa             = isa,
+            .f32             = MakeSampleKernels<float>(),
+            .f64             = MakeSampleKernels<double>(),
+            .fir             = &Fir,
+            .interpolate_fir = &InterpolateFir};
+}
+
+} // namespace SIMD_ISA
+} // namespace kernels
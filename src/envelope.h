@@ -0,0 +1,141 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// ADSR amplitude envelopes, evaluated once per block.
+//
+// Every segment is an exponential approach towards a target level, so the
+// level after any number of frames has a closed form:
+//
+//     level(n) = target + (level(0) - target) * exp(-n / tau)
+//
+// For a block of `n` frames, the per-block multiplier `exp(-n / tau)` of
+// each segment is the same for every voice, so it's calculated once per
+// block (see EnvelopeBlock). Advancing a voice's envelope then costs a
+// single multiply-add, and the oscillator kernels apply it as a linear gain
+// ramp between the exact levels at the start and the end of the block, so
+// envelopes add nothing to the per-sample cost.
+//
+// Segment changes are handled at block boundaries: a segment that ends in
+// the middle of a block ends at the end of the block instead. Render blocks
+// are short enough for this not to be audible.
+//
+//   - Attack: rises towards an overshoot target above 1.0 and ends when the
+//     level reaches 1.0, which gives it the fast start of analog envelopes.
+//   - Decay: falls towards the sustain level.
+//   - Sustain: follows the sustain level.
+//   - Release: falls towards zero and ends once the level is inaudible.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+enum class EnvelopeStage : uint8_t { Attack, Decay, Sustain, Release, Done };
+
+constexpr auto NumEnvelopeStages = 5;
+
+struct EnvelopeParams {
+    float attack_ms  = 0.0f;
+    float decay_ms   = 0.0f;
+    float sustain    = 1.0f;
+    float release_ms = 0.0f;
+};
+
+// Levels below this are considered silent; the release ends here
+constexpr float EnvelopeSilenceLevel = 1e-4f;
+
+class EnvelopeBlock {
+
+public:
+    EnvelopeBlock() = default;
+
+    // Coefficients for advancing the envelopes by `num_frames` frames
+    EnvelopeBlock(const EnvelopeParams& params, const double sample_rate_hz,
+                  const uint32_t num_frames)
+    {
+        const auto frames_per_ms = sample_rate_hz / 1000.0;
+
+        sustain = std::clamp(params.sustain, 0.0f, 1.0f);
+
+        // The attack reaches 1.0 after `attack_ms`
+        constexpr auto AttackTarget = 1.3;
+        const auto attack_log = std::log(AttackTarget / (AttackTarget - 1.0));
+
+        // Decay and release reach the silence level (relative to their
+        // starting distance from the target) after their time
+        const auto silence_log = std::log(1.0 / EnvelopeSilenceLevel);
+
+        const auto multiplier = [&](const float time_ms, const double log_ratio) {
+            const auto segment_frames = time_ms * frames_per_ms;
+
+            if (segment_frames <= 0.0) {
+                return 0.0f;
+            }
+            return static_cast<float>(
+                std::exp(-log_ratio * num_frames / segment_frames));
+        };
+
+        Set(EnvelopeStage::Attack,
+            AttackTarget,
+            multiplier(params.attack_ms, attack_log));
+
+        Set(EnvelopeStage::Decay, sustain, multiplier(params.decay_ms, silence_log));
+
+        Set(EnvelopeStage::Sustain, sustain, 0.0f);
+
+        Set(EnvelopeStage::Release,
+            0.0f,
+            multiplier(params.release_ms, silence_log));
+
+        Set(EnvelopeStage::Done, 0.0f, 0.0f);
+    }
+
+    // Advances one voice's envelope by the block and returns its level at
+    // the end of the block
+    float Advance(EnvelopeStage& stage, const float level) const
+    {
+        const auto s = static_cast<uint32_t>(stage);
+
+        const auto target = targets[s];
+        auto next         = target + (level - target) * multipliers[s];
+
+        switch (stage) {
+        case EnvelopeStage::Attack:
+            if (next >= 1.0f) {
+                next  = 1.0f;
+                stage = EnvelopeStage::Decay;
+            }
+            break;
+
+        case EnvelopeStage::Decay:
+            if (next - sustain <= EnvelopeSilenceLevel) {
+                next  = sustain;
+                stage = EnvelopeStage::Sustain;
+            }
+            break;
+
+        case EnvelopeStage::Release:
+            if (next <= EnvelopeSilenceLevel) {
+                next  = 0.0f;
+                stage = EnvelopeStage::Done;
+            }
+            break;
+
+        default: break;
+        }
+
+        return next;
+    }
+
+private:
+    void Set(const EnvelopeStage stage, const double target, const float multiplier)
+    {
+        targets[static_cast<uint32_t>(stage)]     = static_cast<float>(target);
+        multipliers[static_cast<uint32_t>(stage)] = multiplier;
+    }
+
+    float sustain = 1.0f;
+
+    float targets[NumEnvelopeStages]     = {};
+    float multipliers[NumEnvelopeStages] = {};
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Pre-pass over the input events of a process block.
+//
+// Fetching events from the host goes through a function pointer per event,
+// and every event needs to be classified before we can do anything with it.
+// Instead of doing that in the middle of the render loop, the queue pulls
+// the events of the block into compact, structure-of-arrays storage up
+// front: the timestamps in one array (which is all the render loop needs to
+// look at to find the next event boundary), and the already classified
+// events in the others. Events we don't handle are dropped right there.
+//
+// Events are consumed in batches of the same timestamp. Within a batch we
+// keep the host's order, as reordering note on and note off events for the
+// same key would change their meaning.
+//
+// Every distinct timestamp splits the render loop, so events that only take
+// effect at block rate anyway (parameter changes, modulation, expressions,
+// ...) are moved back to the start of the quantum of frames they fall into.
+// Dense automation then costs at most one split per quantum, while notes
+// stay sample-accurate.
+
+#include <array>
+#include <cstdint>
+
+#include "clap/clap.h"
+#include "clap/ext/draft/tuning.h"
+
+// The events we distinguish, decoded from the space ID and type
+enum class EventKind : uint8_t {
+    NoteOn,
+    NoteOff,
+    NoteChoke,
+    NoteExpression,
+    ParamValue,
+    ParamMod,
+    Transport,
+    Midi,
+    MidiSysex,
+    Midi2,
+
+    // From the tuning extension's event space, if the host has one
+    Tuning,
+
+    // Non-core event spaces and event types we don't care about
+    Unhandled
+};
+
+// Notes start and stop at their exact frame. Raw MIDI events can be notes
+// too, so they're kept where they are as well.
+inline bool IsSampleAccurate(const EventKind kind)
+{
+    switch (kind) {
+    case EventKind::NoteOn:
+    case EventKind::NoteOff:
+    case EventKind::NoteChoke:
+    case EventKind::Midi:
+    case EventKind::MidiSysex:
+    case EventKind::Midi2: return true;
+    default: return false;
+    }
+}
+
+// `tuning_space_id` is the event space the host has assigned to the tuning
+// extension, or UINT16_MAX if there's none
+inline EventKind ClassifyEvent(const clap_event_header_t* event,
+                               const uint16_t tuning_space_id = UINT16_MAX)
+{
+    if (event->space_id != CLAP_CORE_EVENT_SPACE_ID) {
+        const auto is_tuning = (event->space_id == tuning_space_id &&
+                                event->size >= sizeof(clap_event_tuning_t));
+
+        return is_tuning ? EventKind::Tuning : EventKind::Unhandled;
+    }
+
+    switch (event->type) {
+    case CLAP_EVENT_NOTE_ON: return EventKind::NoteOn;
+    case CLAP_EVENT_NOTE_OFF: return EventKind::NoteOff;
+    case CLAP_EVENT_NOTE_CHOKE: return EventKind::NoteChoke;
+    case CLAP_EVENT_NOTE_EXPRESSION: return EventKind::NoteExpression;
+    case CLAP_EVENT_PARAM_VALUE: return EventKind::ParamValue;
+    case CLAP_EVENT_PARAM_MOD: return EventKind::ParamMod;
+    case CLAP_EVENT_TRANSPORT: return EventKind::Transport;
+    case CLAP_EVENT_MIDI: return EventKind::Midi;
+    case CLAP_EVENT_MIDI_SYSEX: return EventKind::MidiSysex;
+    case CLAP_EVENT_MIDI2: return EventKind::Midi2;
+    default: return EventKind::Unhandled;
+    }
+}
+
+class EventQueue {
+
+public:
+    // Number of events fetched from the host in one go. Blocks with more
+    // events than this are fetched in several passes.
+    static constexpr uint32_t Capacity = 512;
+
+    // Starts reading the events of a new process block
+    void Begin(const clap_input_events_t* _in, const uint32_t _num_frames)
+    {
+        in         = _in;
+        num_frames = _num_frames;
+        num_events = in->size(in);
+
+        next_to_fetch = 0;
+        last_time     = 0;
+
+        Fetch();
+    }
+
+    bool Empty() const
+    {
+        return read_pos == size;
+    }
+
+    // Length of the current block
+    uint32_t NumFrames() const
+    {
+        return num_frames;
+    }
+
+    void SetTuningSpace(const uint16_t space_id)
+    {
+        tuning_space_id = space_id;
+    }
+
+    // Quantum in frames for the events that aren't sample-accurate; 1 keeps
+    // all events where they are
+    void SetQuantum(const uint32_t frames)
+    {
+        quantum = (frames > 0) ? frames : 1;
+    }
+
+    // Timestamp of the next event, or the end of the block if there are no
+    // more events
+    uint32_t NextTime() const
+    {
+        return Empty() ? num_frames : times[read_pos];
+    }
+
+    // Calls `fn(kind, header)` for every event at `frame`, which must not be
+    // past NextTime()
+    template <typename Fn>
+    void DispatchAt(const uint32_t frame, Fn&& fn)
+    {
+        while (!Empty() && times[read_pos] == frame) {
+            fn(kinds[read_pos], headers[read_pos]);
+
+            if (++read_pos == size) {
+                Fetch();
+            }
+        }
+    }
+
+private:
+    void Fetch()
+    {
+        read_pos = 0;
+        size     = 0;
+
+        while (size < Capacity && next_to_fetch < num_events) {
+            const auto event = in->get(in, next_to_fetch++);
+            const auto kind  = ClassifyEvent(event, tuning_space_id);
+
+            if (kind == EventKind::Unhandled) {
+                continue;
+            }
+
+            auto time = event->time;
+
+            if (!IsSampleAccurate(kind)) {
+                time -= time % quantum;
+            }
+
+            // The host must send the events in order and within the block,
+            // but if it doesn't, we'd rather process an event late than
+            // render backwards in time. This also keeps quantised events
+            // after the sample-accurate ones that preceded them.
+            if (time < last_time) {
+                time = last_time;
+            }
+            if (time >= num_frames) {
+                time = (num_frames > 0) ? num_frames - 1 : 0;
+            }
+            last_time = time;
+
+            times[size]   = time;
+            kinds[size]   = kind;
+            headers[size] = event;
+            ++size;
+        }
+    }
+
+    const clap_input_events_t* in = nullptr;
+
+    uint16_t tuning_space_id = UINT16_MAX;
+
+    uint32_t quantum = 1;
+
+    uint32_t num_frames    = 0;
+    uint32_t num_events    = 0;
+    uint32_t next_to_fetch = 0;
+    uint32_t last_time     = 0;
+
+    uint32_t read_pos = 0;
+    uint32_t size     = 0;
+
+    std::array<uint32_t, Capacity> times                     = {};
+    std::array<EventKind, Capacity> kinds                    = {};
+    std::array<const clap_event_header_t*, Capacity> headers = {};
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Frame accounting of the render pipeline.
+//
+// Every block moves frames through three stages: the voices render internal
+// frames into the render buffer, the output stage (the resampler, or a
+// plain copy when not resampling) consumes them from there, and publishes
+// output frames to the host's buffers. The ledger keeps running totals of
+// all of them, and at the end of every block checks the contract the
+// pipeline relies on to get by with a single render pass per event:
+//
+// - every output frame the host asked for has been published, exactly once
+// - every rendered frame has either been consumed or is still buffered, so
+//   no frames are dropped or duplicated between the stages
+// - the voices rendered exactly what the scheduler asked for
+// - without resampling, nothing is left over in the render buffer, unless
+//   the render is deterministic and keeps up to a block ahead (see
+//   render_scheduler.h)
+//
+// Violations trip an assertion in debug builds. Release builds count them,
+// and the totals are published for the main thread after every block.
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+class FrameLedger {
+
+public:
+    struct Counters {
+        // Since the last reset of the pipeline, in internal frames
+        uint64_t rendered = 0;
+        uint64_t consumed = 0;
+        uint64_t buffered = 0;
+
+        // Since the last reset of the pipeline, in output frames
+        uint64_t requested = 0;
+        uint64_t published = 0;
+
+        // Since the plugin was created
+        uint64_t num_violations = 0;
+    };
+
+    // Audio thread, or main thread while the plugin is inactive. Keeps the
+    // violation count.
+    void Reset()
+    {
+        const auto num_violations = counters.num_violations;
+
+        counters                = {};
+        counters.num_violations = num_violations;
+
+        Publish();
+    }
+
+    // Audio thread
+    void BeginBlock(const uint32_t num_out_frames)
+    {
+        counters.requested += num_out_frames;
+    }
+
+    void AddRendered(const uint64_t num_frames)
+    {
+        counters.rendered += num_frames;
+    }
+
+    void AddConsumed(const uint64_t num_frames)
+    {
+        counters.consumed += num_frames;
+    }
+
+    void AddPublished(const uint64_t num_frames)
+    {
+        counters.published += num_frames;
+    }
+
+    // Checks the contract against what the render buffer and the scheduler
+    // say; returns false if it's been violated. `keeps_frames` is set if
+    // frames may stay buffered until the next block.
+    bool EndBlock(const uint64_t buffered, const uint64_t scheduled,
+                  const bool keeps_frames)
+    {
+        counters.buffered = buffered;
+
+        const auto ok = counters.published == counters.requested &&
+                        counters.rendered == counters.consumed + buffered &&
+                        counters.rendered == scheduled &&
+                        (keeps_frames || buffered == 0);
+
+        assert(ok && "Frames were dropped or duplicated in the render pipeline");
+
+        if (!ok) {
+            ++counters.num_violations;
+        }
+
+        Publish();
+
+        return ok;
+    }
+
+    // Any thread; the totals as of the end of the last block
+    Counters Snapshot() const
+    {
+        return {.rendered       = rendered.load(std::memory_order_relaxed),
+                .consumed       = consumed.load(std::memory_order_relaxed),
+                .buffered       = buffered.load(std::memory_order_relaxed),
+                .requested      = requested.load(std::memory_order_relaxed),
+                .published      = published.load(std::memory_order_relaxed),
+                .num_violations = num_violations.load(std::memory_order_relaxed)};
+    }
+
+private:
+    void Publish()
+    {
+        rendered.store(counters.rendered, std::memory_order_relaxed);
+        consumed.store(counters.consumed, std::memory_order_relaxed);
+        buffered.store(counters.buffered, std::memory_order_relaxed);
+        requested.store(counters.requested, std::memory_order_relaxed);
+        published.store(counters.published, std::memory_order_relaxed);
+        num_violations.store(counters.num_violations, std::memory_order_relaxed);
+    }
+
+    // Only accessed by the thread that processes
+    Counters counters = {};
+
+    // Copies for other threads; the counters aren't published as a
+    // consistent set, which is good enough for reporting
+    std::atomic<uint64_t> rendered       = 0;
+    std::atomic<uint64_t> consumed       = 0;
+    std::atomic<uint64_t> buffered       = 0;
+    std::atomic<uint64_t> requested      = 0;
+    std::atomic<uint64_t> published      = 0;
+    std::atomic<uint64_t> num_violations = 0;
+};
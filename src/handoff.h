@@ -0,0 +1,50 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Lock-free, single-slot channel for handing an object over from one
+// thread to another, e.g. the result of a background job (see
+// background_worker.h).
+//
+// The producer publishes a new object by swapping the slot's pointer; the
+// consumer takes the latest one by swapping in nullptr. Neither side ever
+// blocks or waits for the other, and an object that gets replaced before
+// it's been taken is freed by the producer, so only the newest one ever
+// reaches the consumer, and the consumer only ever frees what it has
+// taken, on its own thread.
+
+#include <atomic>
+#include <memory>
+
+template <typename T>
+class Handoff {
+
+public:
+    static_assert(std::atomic<T*>::is_always_lock_free);
+
+    Handoff() = default;
+
+    ~Handoff()
+    {
+        delete slot.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    Handoff(const Handoff&)            = delete;
+    Handoff& operator=(const Handoff&) = delete;
+
+    // Producer side; replaces the object that hasn't been taken yet, if any
+    void Publish(std::unique_ptr<T> object)
+    {
+        const std::unique_ptr<T> replaced(
+            slot.exchange(object.release(), std::memory_order_acq_rel));
+    }
+
+    // Consumer side; empty if nothing has been published since the last call
+    std::unique_ptr<T> Take()
+    {
+        return std::unique_ptr<T>(slot.exchange(nullptr, std::memory_order_acq_rel));
+    }
+
+private:
+    std::atomic<T*> slot = nullptr;
+};
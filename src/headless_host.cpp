@@ -0,0 +1,909 @@
+// CLAP instrument plugin tutorial
+//
+// Headless CLAP host for end-to-end throughput and latency testing.
+//
+// Loads a built plugin the way a DAW does (`clap_entry`, the plugin
+// factory, `create_plugin()`), creates any number of instances and drives
+// their `process()` calls with a synthetic or scripted stream of events,
+// as fast as possible. Every call is timed, and each cycle through all
+// instances is checked against the real-time deadline of one block, so the
+// result shows both the throughput (CPU load per instance) and the worst
+// case latencies that would cause dropouts in a real host.
+//
+// Usage:
+//
+//   ClapTutorialHost <plugin.clap> [options]
+//
+//   --plugin <id>         plugin ID; defaults to the first one in the factory
+//   --sample-rate <hz>    default 48000
+//   --block-size <n>      frames per process call, default 256
+//   --variable-blocks     random block sizes of 1 to `block-size` frames
+//   --instances <n>       default 1
+//   --seconds <s>         length of the run in audio time, default 10
+//   --events <file>       event script, see ParseScript(); by default,
+//                         random notes are played
+//   --notes-per-second <n>  density of the random notes, default 8
+//   --offline             activate in offline render mode
+//   --batch               process all instances with one call per cycle
+//                         through the plugin's batch processing extension
+//                         (see batch_process.h), if it has one
+//   --deterministic       render in the plugin's deterministic mode (see
+//                         deterministic_render.h), if it has one
+//   --sample <file.wav>   sample for the plugin to play back through its
+//                         sample content extension (see sample_content.h)
+//   --max-misses <n>      exit with an error above this many deadline misses
+//
+// Built with the `CLAP_TUTORIAL_RT_CHECK` CMake option, allocations, locks
+// and blocking calls that the plugin makes in `process()` are reported with
+// backtraces and make the run fail (see rt_check.h).
+//
+// The histograms are printed per instance: the 50th and 99th percentile and
+// the maximum time of a single process call, and the share of the audio
+// time spent processing. Batched instances can't be timed individually, so
+// each one is charged an equal share of the batch call. A deadline miss is
+// a cycle in which processing all instances took longer than the audio it
+// produced.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <dlfcn.h>
+    #include <sys/stat.h>
+#endif
+
+#include "clap/clap.h"
+
+#include "batch_process.h"
+#include "deterministic_render.h"
+#include "rt_check.h"
+#include "sample_content.h"
+
+namespace {
+
+//////////////////////////////////////////////////////////////////////////////
+// Plugin library
+//////////////////////////////////////////////////////////////////////////////
+
+class PluginLibrary {
+
+public:
+    ~PluginLibrary()
+    {
+        Close();
+    }
+
+    // Accepts the binary itself, or a macOS bundle
+    bool Open(const std::string& _path)
+    {
+        path = _path;
+
+        auto binary_path = path;
+
+#if !defined(_WIN32)
+        struct stat info = {};
+
+        if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            auto name = path;
+
+            while (!name.empty() && name.back() == '/') {
+                name.pop_back();
+            }
+            name = name.substr(name.find_last_of('/') + 1);
+            name = name.substr(0, name.find_last_of('.'));
+
+            binary_path = path + "/Contents/MacOS/" + name;
+        }
+#endif
+
+        handle = LoadLibrary(binary_path);
+
+        if (!handle) {
+            return false;
+        }
+
+        entry = static_cast<const clap_plugin_entry_t*>(FindSymbol("clap_entry"));
+
+        if (!entry || !clap_version_is_compatible(entry->clap_version) ||
+            !entry->init(path.c_str())) {
+
+            entry = nullptr;
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void Close()
+    {
+        if (entry) {
+            entry->deinit();
+            entry = nullptr;
+        }
+
+        if (handle) {
+#if defined(_WIN32)
+            FreeLibrary(static_cast<HMODULE>(handle));
+#else
+            dlclose(handle);
+#endif
+            handle = nullptr;
+        }
+    }
+
+    const clap_plugin_factory_t* Factory() const
+    {
+        return entry ? static_cast<const clap_plugin_factory_t*>(
+                           entry->get_factory(CLAP_PLUGIN_FACTORY_ID))
+                     : nullptr;
+    }
+
+private:
+    static void* LoadLibrary(const std::string& binary_path)
+    {
+#if defined(_WIN32)
+        return LoadLibraryA(binary_path.c_str());
+#else
+        return dlopen(binary_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+    }
+
+    const void* FindSymbol(const char* name) const
+    {
+#if defined(_WIN32)
+        return reinterpret_cast<const void*>(
+            GetProcAddress(static_cast<HMODULE>(handle), name));
+#else
+        return dlsym(handle, name);
+#endif
+    }
+
+    std::string path = {};
+
+    void* handle                     = nullptr;
+    const clap_plugin_entry_t* entry = nullptr;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Events
+//////////////////////////////////////////////////////////////////////////////
+
+struct ScriptEvent {
+    double time_s = 0.0;
+
+    // CLAP_EVENT_NOTE_ON, CLAP_EVENT_NOTE_OFF or CLAP_EVENT_PARAM_VALUE
+    uint16_t type = CLAP_EVENT_NOTE_ON;
+
+    int16_t key     = 0;
+    int16_t channel = 0;
+
+    // Velocity of notes, value of parameters
+    double value = 0.0;
+
+    clap_id param_id = CLAP_INVALID_ID;
+};
+
+// One event per line, in any order; `#` starts a comment:
+//
+//   <seconds> on <key> [velocity] [channel]
+//   <seconds> off <key> [channel]
+//   <seconds> param <id> <value>
+//
+// The script repeats for runs longer than its last event.
+std::optional<std::vector<ScriptEvent>> ParseScript(const char* path)
+{
+    auto file = fopen(path, "r");
+
+    if (!file) {
+        return {};
+    }
+
+    std::vector<ScriptEvent> events = {};
+
+    char line[256] = {};
+    auto line_no   = 0;
+    auto ok        = true;
+
+    while (ok && fgets(line, sizeof(line), file)) {
+        ++line_no;
+
+        if (auto comment = strchr(line, '#')) {
+            *comment = '\0';
+        }
+
+        ScriptEvent event = {};
+
+        char kind[16] = {};
+        double a = 0.0, b = -1.0, c = -1.0;
+
+        const auto n = sscanf(line, "%lf %15s %lf %lf %lf", &event.time_s, kind, &a, &b, &c);
+
+        if (n <= 0) {
+            continue;
+        }
+
+        if (n >= 3 && strcmp(kind, "on") == 0) {
+            event.type    = CLAP_EVENT_NOTE_ON;
+            event.key     = static_cast<int16_t>(a);
+            event.value   = (n >= 4) ? b : 0.8;
+            event.channel = (n >= 5) ? static_cast<int16_t>(c) : 0;
+
+        } else if (n >= 3 && strcmp(kind, "off") == 0) {
+            event.type    = CLAP_EVENT_NOTE_OFF;
+            event.key     = static_cast<int16_t>(a);
+            event.channel = (n >= 4) ? static_cast<int16_t>(b) : 0;
+
+        } else if (n >= 4 && strcmp(kind, "param") == 0) {
+            event.type     = CLAP_EVENT_PARAM_VALUE;
+            event.param_id = static_cast<clap_id>(a);
+            event.value    = b;
+
+        } else {
+            fprintf(stderr, "%s:%d: invalid event\n", path, line_no);
+            ok = false;
+        }
+
+        events.push_back(event);
+    }
+    fclose(file);
+
+    if (!ok) {
+        return {};
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) {
+        return a.time_s < b.time_s;
+    });
+
+    return events;
+}
+
+// Random notes of a quarter second on keys in the middle of the keyboard
+std::vector<ScriptEvent> RandomNotes(const double notes_per_second, const double seconds)
+{
+    std::vector<ScriptEvent> events = {};
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> offset(0.0, 1.0);
+    std::uniform_int_distribution<int> key(36, 96);
+
+    const auto num_notes = static_cast<uint64_t>(notes_per_second * seconds);
+
+    for (uint64_t i = 0; i < num_notes; ++i) {
+        const auto time = (static_cast<double>(i) + offset(rng)) / notes_per_second;
+        const auto k    = static_cast<int16_t>(key(rng));
+
+        events.push_back({.time_s = time, .type = CLAP_EVENT_NOTE_ON, .key = k, .value = 0.8});
+        events.push_back({.time_s = time + 0.25, .type = CLAP_EVENT_NOTE_OFF, .key = k});
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) {
+        return a.time_s < b.time_s;
+    });
+
+    return events;
+}
+
+// The events of one block, as the host hands them to the plugin
+class BlockEvents {
+
+public:
+    BlockEvents() = default;
+
+    // The host-facing list refers back to the object
+    BlockEvents(const BlockEvents&)            = delete;
+    BlockEvents& operator=(const BlockEvents&) = delete;
+
+    void Clear()
+    {
+        events.clear();
+    }
+
+    void Add(const ScriptEvent& event, const uint32_t time)
+    {
+        Event e = {};
+
+        const clap_event_header_t header = {
+            .size     = (event.type == CLAP_EVENT_PARAM_VALUE)
+                            ? static_cast<uint32_t>(sizeof(clap_event_param_value_t))
+                            : static_cast<uint32_t>(sizeof(clap_event_note_t)),
+            .time     = time,
+            .space_id = CLAP_CORE_EVENT_SPACE_ID,
+            .type     = event.type,
+            .flags    = 0};
+
+        if (event.type == CLAP_EVENT_PARAM_VALUE) {
+            e.param = {.header     = header,
+                       .param_id   = event.param_id,
+                       .cookie     = nullptr,
+                       .note_id    = -1,
+                       .port_index = -1,
+                       .channel    = -1,
+                       .key        = -1,
+                       .value      = event.value};
+        } else {
+            e.note = {.header     = header,
+                      .note_id    = -1,
+                      .port_index = 0,
+                      .channel    = event.channel,
+                      .key        = event.key,
+                      .velocity   = event.value};
+        }
+
+        events.push_back(e);
+    }
+
+    const clap_input_events_t* Input() const
+    {
+        return &input;
+    }
+
+private:
+    union Event {
+        clap_event_header_t header;
+        clap_event_note_t note;
+        clap_event_param_value_t param;
+    };
+
+    std::vector<Event> events = {};
+
+    const clap_input_events_t input = {
+        .ctx  = this,
+        .size = [](const clap_input_events_t* list) -> uint32_t {
+            return static_cast<uint32_t>(
+                static_cast<const BlockEvents*>(list->ctx)->events.size());
+        },
+        .get = [](const clap_input_events_t* list,
+                  uint32_t index) -> const clap_event_header_t* {
+            return &static_cast<const BlockEvents*>(list->ctx)->events[index].header;
+        }};
+};
+
+const clap_output_events_t DiscardEvents = {
+    .ctx      = nullptr,
+    .try_push = [](const clap_output_events_t* list,
+                   const clap_event_header_t* event) -> bool { return true; }};
+
+//////////////////////////////////////////////////////////////////////////////
+// Host
+//////////////////////////////////////////////////////////////////////////////
+
+// The main thread and the audio thread are the same here: main thread
+// callbacks and restarts are handled between two cycles
+struct HostState {
+    std::atomic<bool> callback_requested = false;
+    std::atomic<bool> restart_requested  = false;
+};
+
+// Process calls are what the real-time checks cover, so the thread making
+// them is the audio thread; any other thread is the main thread.
+const clap_host_thread_check_t HostThreadCheck = {
+    .is_main_thread = [](const clap_host_t* host) -> bool {
+        return !rt_check::IsAudioThread();
+    },
+
+    .is_audio_thread = [](const clap_host_t* host) -> bool {
+        return rt_check::IsAudioThread();
+    }};
+
+// Plugin messages, such as its telemetry, go straight to stderr
+const clap_host_log_t HostLog = {
+    .log = [](const clap_host_t* host, clap_log_severity severity, const char* message) {
+        static constexpr const char* SeverityNames[] = {
+            "debug", "info", "warning", "error", "fatal", "host misbehaving", "plugin misbehaving"};
+
+        const auto is_known = severity >= 0 &&
+                              static_cast<size_t>(severity) < std::size(SeverityNames);
+
+        const auto name = is_known ? SeverityNames[severity] : "unknown";
+
+        fprintf(stderr, "[%s] %s\n", name, message);
+    }};
+
+clap_host_t MakeHost(HostState* state)
+{
+    return {.clap_version = CLAP_VERSION,
+            .host_data    = state,
+            .name         = "ClapTutorialHost",
+            .vendor       = "nakst",
+            .url          = "https://nakst.gitlab.io",
+            .version      = "1.0.0",
+
+            .get_extension = [](const clap_host_t* host,
+                                const char* extension_id) -> const void* {
+                if (strcmp(extension_id, CLAP_EXT_THREAD_CHECK) == 0) {
+                    return &HostThreadCheck;
+                }
+                if (strcmp(extension_id, CLAP_EXT_LOG) == 0) {
+                    return &HostLog;
+                }
+                return nullptr;
+            },
+
+            .request_restart =
+                [](const clap_host_t* host) {
+                    static_cast<HostState*>(host->host_data)->restart_requested = true;
+                },
+
+            .request_process = [](const clap_host_t* host) {},
+
+            .request_callback =
+                [](const clap_host_t* host) {
+                    static_cast<HostState*>(host->host_data)->callback_requested = true;
+                }};
+}
+
+struct Options {
+    std::string plugin_path = {};
+    std::string plugin_id   = {};
+    std::string script_path = {};
+    std::string sample_path = {};
+
+    double sample_rate      = 48000.0;
+    uint32_t block_size     = 256;
+    bool variable_blocks    = false;
+    uint32_t num_instances  = 1;
+    double seconds          = 10.0;
+    double notes_per_second = 8.0;
+    bool offline            = false;
+    bool batch              = false;
+    bool deterministic      = false;
+
+    // Negative for no limit
+    int64_t max_misses = -1;
+};
+
+std::optional<Options> ParseOptions(const int argc, char** argv)
+{
+    Options options = {};
+
+    for (auto i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        const auto value = [&]() -> const char* {
+            return (i + 1 < argc) ? argv[++i] : nullptr;
+        };
+
+        if (arg == "--variable-blocks") {
+            options.variable_blocks = true;
+        } else if (arg == "--offline") {
+            options.offline = true;
+        } else if (arg == "--batch") {
+            options.batch = true;
+        } else if (arg == "--deterministic") {
+            options.deterministic = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            const auto v = value();
+
+            if (!v) {
+                fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                return {};
+            }
+
+            if (arg == "--plugin") {
+                options.plugin_id = v;
+            } else if (arg == "--sample-rate") {
+                options.sample_rate = atof(v);
+            } else if (arg == "--block-size") {
+                options.block_size = static_cast<uint32_t>(atoi(v));
+            } else if (arg == "--instances") {
+                options.num_instances = static_cast<uint32_t>(atoi(v));
+            } else if (arg == "--seconds") {
+                options.seconds = atof(v);
+            } else if (arg == "--events") {
+                options.script_path = v;
+            } else if (arg == "--notes-per-second") {
+                options.notes_per_second = atof(v);
+            } else if (arg == "--sample") {
+                options.sample_path = v;
+            } else if (arg == "--max-misses") {
+                options.max_misses = atoll(v);
+            } else {
+                fprintf(stderr, "Unknown option %s\n", arg.c_str());
+                return {};
+            }
+        } else {
+            options.plugin_path = arg;
+        }
+    }
+
+    if (options.plugin_path.empty() || options.sample_rate <= 0.0 ||
+        options.block_size == 0 || options.num_instances == 0 || options.seconds <= 0.0) {
+
+        fprintf(stderr, "Usage: %s <plugin.clap> [options]; see headless_host.cpp\n", argv[0]);
+        return {};
+    }
+
+    return options;
+}
+
+struct Instance {
+    const clap_plugin_t* plugin = nullptr;
+
+    // Duration of every process call in nanoseconds
+    std::vector<uint32_t> call_ns = {};
+
+    double total_s = 0.0;
+};
+
+bool Activate(const Instance& instance, const Options& options)
+{
+    const auto plugin = instance.plugin;
+
+    if (options.offline) {
+        const auto render = static_cast<const clap_plugin_render_t*>(
+            plugin->get_extension(plugin, CLAP_EXT_RENDER));
+
+        if (!render || !render->set(plugin, CLAP_RENDER_OFFLINE)) {
+            fprintf(stderr, "The plugin doesn't support offline rendering\n");
+            return false;
+        }
+    }
+
+    if (options.deterministic) {
+        const auto deterministic_render =
+            static_cast<const clap_tutorial_plugin_deterministic_render_t*>(
+                plugin->get_extension(plugin, CLAP_TUTORIAL_EXT_DETERMINISTIC_RENDER));
+
+        if (!deterministic_render || !deterministic_render->set_enabled(plugin, true)) {
+            fprintf(stderr, "The plugin doesn't support deterministic rendering\n");
+            return false;
+        }
+    }
+
+    if (!options.sample_path.empty()) {
+        const auto sample_content =
+            static_cast<const clap_tutorial_plugin_sample_content_t*>(
+                plugin->get_extension(plugin, CLAP_TUTORIAL_EXT_SAMPLE_CONTENT));
+
+        if (!sample_content || !sample_content->load(plugin, options.sample_path.c_str())) {
+            fprintf(stderr, "Couldn't load the sample %s\n", options.sample_path.c_str());
+            return false;
+        }
+    }
+
+    return plugin->activate(plugin, options.sample_rate, 1, options.block_size) &&
+           plugin->start_processing(plugin);
+}
+
+void Deactivate(const Instance& instance)
+{
+    instance.plugin->stop_processing(instance.plugin);
+    instance.plugin->deactivate(instance.plugin);
+}
+
+double Percentile(const std::vector<uint32_t>& sorted, const double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const auto index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+
+    return sorted[index];
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const auto parsed = ParseOptions(argc, argv);
+
+    if (!parsed) {
+        return 2;
+    }
+    const auto& options = *parsed;
+
+    PluginLibrary library = {};
+
+    if (!library.Open(options.plugin_path)) {
+        fprintf(stderr, "Couldn't load %s\n", options.plugin_path.c_str());
+        return 1;
+    }
+
+    const auto factory = library.Factory();
+
+    if (!factory || factory->get_plugin_count(factory) == 0) {
+        fprintf(stderr, "No plugins in %s\n", options.plugin_path.c_str());
+        return 1;
+    }
+
+    auto plugin_id = options.plugin_id;
+
+    if (plugin_id.empty()) {
+        plugin_id = factory->get_plugin_descriptor(factory, 0)->id;
+    }
+
+    // Events
+    std::vector<ScriptEvent> script = {};
+
+    if (!options.script_path.empty()) {
+        auto events = ParseScript(options.script_path.c_str());
+
+        if (!events) {
+            fprintf(stderr, "Couldn't read %s\n", options.script_path.c_str());
+            return 1;
+        }
+        script = std::move(*events);
+    } else {
+        script = RandomNotes(options.notes_per_second, options.seconds);
+    }
+
+    const auto script_length_s = script.empty() ? 0.0 : script.back().time_s + 1.0;
+
+    // Instances
+    HostState host_state   = {};
+    const clap_host_t host = MakeHost(&host_state);
+
+    const auto total_frames = static_cast<uint64_t>(options.seconds * options.sample_rate);
+
+    // Variable blocks can be as short as a single frame
+    const auto max_cycles = (options.variable_blocks ? total_frames
+                                                     : total_frames / options.block_size) +
+                            1;
+
+    std::vector<Instance> instances(options.num_instances);
+
+    for (auto& instance : instances) {
+        instance.plugin = factory->create_plugin(factory, &host, plugin_id.c_str());
+
+        if (!instance.plugin || !instance.plugin->init(instance.plugin)) {
+            fprintf(stderr, "Couldn't create %s\n", plugin_id.c_str());
+            return 1;
+        }
+        if (!Activate(instance, options)) {
+            fprintf(stderr, "Couldn't activate %s\n", plugin_id.c_str());
+            return 1;
+        }
+
+        instance.call_ns.reserve(static_cast<size_t>(max_cycles));
+    }
+
+    const clap_tutorial_plugin_batch_process_t* batch_process = nullptr;
+
+    if (options.batch) {
+        const auto plugin = instances[0].plugin;
+
+        batch_process = static_cast<const clap_tutorial_plugin_batch_process_t*>(
+            plugin->get_extension(plugin, CLAP_TUTORIAL_EXT_BATCH_PROCESS));
+
+        if (!batch_process || batch_process->max_count() < options.num_instances) {
+            fprintf(stderr, "The plugin can't process %u instances in a batch\n",
+                    options.num_instances);
+            return 1;
+        }
+    }
+
+    // Buffers, shared by all instances unless they're batched, in which
+    // case they may be processed in parallel
+    const auto num_buffers = batch_process ? options.num_instances : 1;
+
+    std::vector<float> buffers(size_t{options.block_size} * 2 * num_buffers);
+    std::vector<float*> channels(size_t{2} * num_buffers);
+
+    for (size_t i = 0; i < channels.size(); ++i) {
+        channels[i] = buffers.data() + i * options.block_size;
+    }
+
+    std::vector<clap_audio_buffer_t> outputs(num_buffers);
+    std::vector<clap_process_t> processes(num_buffers);
+
+    std::vector<const clap_plugin_t*> batch_plugins = {};
+    std::vector<const clap_process_t*> batch_processes(options.num_instances);
+    std::vector<clap_process_status> batch_statuses(options.num_instances);
+
+    for (size_t i = 0; i < instances.size(); ++i) {
+        batch_plugins.push_back(instances[i].plugin);
+        batch_processes[i] = &processes[i % num_buffers];
+    }
+
+    BlockEvents block_events = {};
+
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<uint32_t> block_size_dist(1, options.block_size);
+
+    uint64_t frame         = 0;
+    uint64_t num_cycles    = 0;
+    uint64_t num_misses    = 0;
+    uint64_t num_restarts  = 0;
+    size_t next_event      = 0;
+    double script_offset_s = 0.0;
+    double worst_cycle_s   = 0.0;
+
+    while (frame < total_frames) {
+        const auto num_frames = static_cast<uint32_t>(std::min<uint64_t>(
+            options.variable_blocks ? block_size_dist(rng) : options.block_size,
+            total_frames - frame));
+
+        // Collect the events of this block, looping the script
+        block_events.Clear();
+
+        const auto block_end_s = static_cast<double>(frame + num_frames) / options.sample_rate;
+
+        while (!script.empty()) {
+            if (next_event == script.size()) {
+                if (script_length_s <= 0.0) {
+                    break;
+                }
+                next_event = 0;
+                script_offset_s += script_length_s;
+            }
+
+            const auto& event = script[next_event];
+            const auto time_s = script_offset_s + event.time_s;
+
+            if (time_s >= block_end_s) {
+                break;
+            }
+
+            const auto event_frame = static_cast<uint64_t>(time_s * options.sample_rate);
+            const auto offset      = (event_frame > frame) ? event_frame - frame : 0;
+
+            block_events.Add(event, static_cast<uint32_t>(offset));
+            ++next_event;
+        }
+
+        for (uint32_t i = 0; i < num_buffers; ++i) {
+            outputs[i] = {.data32        = &channels[size_t{2} * i],
+                          .data64        = nullptr,
+                          .channel_count = 2,
+                          .latency       = 0,
+                          .constant_mask = 0};
+
+            processes[i] = {.steady_time         = static_cast<int64_t>(frame),
+                            .frames_count        = num_frames,
+                            .transport           = nullptr,
+                            .audio_inputs        = nullptr,
+                            .audio_outputs       = &outputs[i],
+                            .audio_inputs_count  = 0,
+                            .audio_outputs_count = 1,
+                            .in_events           = block_events.Input(),
+                            .out_events          = &DiscardEvents};
+        }
+
+        const auto record = [&](Instance& instance, const int64_t ns) {
+            instance.call_ns.push_back(static_cast<uint32_t>(
+                std::min<int64_t>(ns, std::numeric_limits<uint32_t>::max())));
+
+            instance.total_s += static_cast<double>(ns) * 1e-9;
+        };
+
+        double cycle_s = 0.0;
+
+        if (batch_process) {
+            const auto start = std::chrono::steady_clock::now();
+            {
+                rt_check::ScopedAudioThread audio_thread = {};
+
+                batch_process->process(batch_plugins.data(),
+                                       batch_processes.data(),
+                                       batch_statuses.data(),
+                                       options.num_instances);
+            }
+            const auto end = std::chrono::steady_clock::now();
+
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                                .count();
+
+            for (auto& instance : instances) {
+                record(instance, ns / options.num_instances);
+            }
+            cycle_s = static_cast<double>(ns) * 1e-9;
+
+        } else {
+            for (auto& instance : instances) {
+                const auto start = std::chrono::steady_clock::now();
+                {
+                    rt_check::ScopedAudioThread audio_thread = {};
+
+                    instance.plugin->process(instance.plugin, &processes[0]);
+                }
+                const auto end = std::chrono::steady_clock::now();
+
+                const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    end - start)
+                                    .count();
+
+                record(instance, ns);
+                cycle_s += static_cast<double>(ns) * 1e-9;
+            }
+        }
+
+        // A real host would have had to deliver this block by now
+        const auto deadline_s = static_cast<double>(num_frames) / options.sample_rate;
+
+        if (cycle_s > deadline_s) {
+            ++num_misses;
+        }
+        worst_cycle_s = std::max(worst_cycle_s, cycle_s / deadline_s);
+
+        frame += num_frames;
+        ++num_cycles;
+
+        // Main thread duties
+        if (host_state.callback_requested.exchange(false)) {
+            for (auto& instance : instances) {
+                instance.plugin->on_main_thread(instance.plugin);
+            }
+        }
+
+        if (host_state.restart_requested.exchange(false)) {
+            for (auto& instance : instances) {
+                Deactivate(instance);
+
+                if (!Activate(instance, options)) {
+                    fprintf(stderr, "Couldn't reactivate %s\n", plugin_id.c_str());
+                    return 1;
+                }
+            }
+            ++num_restarts;
+        }
+    }
+
+    // Report
+    const auto audio_s = static_cast<double>(total_frames) / options.sample_rate;
+
+    printf("%s: %u instance(s), %.0f Hz, %s%u frame blocks, %.1f s of audio\n",
+           plugin_id.c_str(),
+           options.num_instances,
+           options.sample_rate,
+           options.variable_blocks ? "up to " : "",
+           options.block_size,
+           audio_s);
+
+    printf("%-10s %12s %12s %12s %10s\n", "instance", "p50 (us)", "p99 (us)", "max (us)", "cpu (%)");
+
+    for (size_t i = 0; i < instances.size(); ++i) {
+        auto sorted = instances[i].call_ns;
+        std::sort(sorted.begin(), sorted.end());
+
+        printf("%-10zu %12.2f %12.2f %12.2f %10.2f\n",
+               i,
+               Percentile(sorted, 0.50) * 1e-3,
+               Percentile(sorted, 0.99) * 1e-3,
+               sorted.empty() ? 0.0 : sorted.back() * 1e-3,
+               100.0 * instances[i].total_s / audio_s);
+    }
+
+    printf("cycles %llu, deadline misses %llu, worst cycle %.1f%% of its deadline, "
+           "restarts %llu\n",
+           static_cast<unsigned long long>(num_cycles),
+           static_cast<unsigned long long>(num_misses),
+           100.0 * worst_cycle_s,
+           static_cast<unsigned long long>(num_restarts));
+
+    for (auto& instance : instances) {
+        Deactivate(instance);
+        instance.plugin->destroy(instance.plugin);
+    }
+
+    if (rt_check::IsEnabled()) {
+        printf("real-time violations %llu\n",
+               static_cast<unsigned long long>(rt_check::NumViolations()));
+    }
+
+    if (options.max_misses >= 0 && num_misses > static_cast<uint64_t>(options.max_misses)) {
+        fprintf(stderr, "Too many deadline misses\n");
+        return 1;
+    }
+
+    if (rt_check::NumViolations() > 0) {
+        fprintf(stderr, "The plugin isn't real-time safe\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+// CLAP instrument plugin tutorial
+//
+// Read-only memory-mapped file.
+
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string& _path)
+{
+    Close();
+
+    const auto file = CreateFileA(_path.c_str(),
+                                  GENERIC_READ,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL,
+                                  nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size = {};
+
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // The mapping keeps the file open, so we don't need the handle anymore
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (!mapping) {
+        return false;
+    }
+
+    const auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!view) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+        return false;
+    }
+
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(file_size.QuadPart);
+    path = _path;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data) {
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+    }
+
+    data    = nullptr;
+    size    = 0;
+    mapping = nullptr;
+
+    path.clear();
+}
+
+#else
+
+bool MappedFile::Open(const std::string& _path)
+{
+    Close();
+
+    const auto fd = open(_path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st = {};
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    const auto file_size = static_cast<size_t>(st.st_size);
+
+    const auto view = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after closing the file
+    close(fd);
+
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    data = static_cast<const uint8_t*>(view);
+    size = file_size;
+    path = _path;
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+
+    data = nullptr;
+    size = 0;
+
+    path.clear();
+}
+
+#endif
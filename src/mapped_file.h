@@ -0,0 +1,58 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Read-only memory-mapped file.
+//
+// Mapping a file instead of reading it means only the pages that actually
+// get touched are loaded from disk, and they're shared by every process
+// and plugin instance that maps the same file.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile {
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Unmaps the current file first. Returns false if the file couldn't be
+    // mapped; empty files can't be mapped either.
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return data != nullptr;
+    }
+
+    const uint8_t* Data() const
+    {
+        return data;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+    const std::string& Path() const
+    {
+        return path;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size         = 0;
+
+    std::string path = {};
+
+#if defined(_WIN32)
+    void* mapping = nullptr;
+#endif
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Decoder for raw MIDI 1.0 and MIDI 2.0 channel voice messages.
+//
+// Hosts deliver raw MIDI as CLAP_EVENT_MIDI events, which carry a single
+// MIDI 1.0 message, and CLAP_EVENT_MIDI2 events, which carry a single
+// Universal MIDI Packet. Both get decoded into the same small,
+// self-contained `midi::Op`, with all values already normalised, so the
+// plugin handles notes and controllers the same way no matter which
+// protocol they arrived in.
+//
+// The decoders look up what to do with a message in a table indexed by the
+// status nibble, so decoding is a few loads and shifts and never allocates.
+// Messages we have no use for (program changes, system messages, MIDI 2.0
+// per-note management, ...) decode to `OpType::None`.
+
+#include <array>
+#include <cstdint>
+
+namespace midi {
+
+enum class OpType : uint8_t {
+    None,
+    NoteOn,
+    NoteOff,
+    PolyPressure,
+    Controller,
+    ChannelPressure,
+    PitchBend,
+
+    // MIDI 2.0 only
+    PerNotePitchBend,
+    PerNotePitch
+};
+
+struct Op {
+    OpType type     = OpType::None;
+    int16_t channel = 0;
+
+    // -1 for channel-wide ops
+    int16_t key = -1;
+
+    // Controller number
+    uint8_t index = 0;
+
+    // Velocities, pressures and controllers are in the [0, 1] range, pitch
+    // bends in [-1, 1]. Per-note pitch is an absolute, fractional key.
+    float value = 0.0f;
+};
+
+// Where a message keeps its value
+enum class ValueLayout : uint8_t {
+    None,
+
+    // MIDI 1.0: the first or second data byte, or both as a 14-bit pitch
+    // bend
+    Data1,
+    Data2,
+    Bend14,
+
+    // MIDI 2.0: the upper half of the data word (velocities), the whole
+    // word, or the whole word as a pitch bend centered on 0x80000000
+    Velocity16,
+    Data32,
+    Bend32
+};
+
+struct MessageInfo {
+    OpType type        = OpType::None;
+    ValueLayout layout = ValueLayout::None;
+    bool has_key       = false;
+};
+
+// Indexed by the status nibble
+using MessageTable = std::array<MessageInfo, 16>;
+
+constexpr MessageTable Midi1Messages = [] {
+    MessageTable table = {};
+
+    table[0x8] = {OpType::NoteOff, ValueLayout::Data2, true};
+    table[0x9] = {OpType::NoteOn, ValueLayout::Data2, true};
+    table[0xA] = {OpType::PolyPressure, ValueLayout::Data2, true};
+    table[0xB] = {OpType::Controller, ValueLayout::Data2, false};
+    table[0xD] = {OpType::ChannelPressure, ValueLayout::Data1, false};
+    table[0xE] = {OpType::PitchBend, ValueLayout::Bend14, false};
+
+    return table;
+}();
+
+// MIDI 2.0 channel voice messages (UMP message type 0x4). Registered
+// per-note controllers (0x0) are only decoded for the pitch controller, see
+// DecodeMidi2().
+constexpr MessageTable Midi2Messages = [] {
+    MessageTable table = {};
+
+    table[0x0] = {OpType::PerNotePitch, ValueLayout::Data32, true};
+    table[0x6] = {OpType::PerNotePitchBend, ValueLayout::Bend32, true};
+    table[0x8] = {OpType::NoteOff, ValueLayout::Velocity16, true};
+    table[0x9] = {OpType::NoteOn, ValueLayout::Velocity16, true};
+    table[0xA] = {OpType::PolyPressure, ValueLayout::Data32, true};
+    table[0xB] = {OpType::Controller, ValueLayout::Data32, false};
+    table[0xD] = {OpType::ChannelPressure, ValueLayout::Data32, false};
+    table[0xE] = {OpType::PitchBend, ValueLayout::Bend32, false};
+
+    return table;
+}();
+
+inline Op DecodeMidi1(const uint8_t status, const uint8_t data1, const uint8_t data2)
+{
+    // Running status isn't allowed in CLAP events, so anything without the
+    // status bit set is malformed
+    if (!(status & 0x80)) {
+        return {};
+    }
+
+    const auto& info = Midi1Messages[status >> 4];
+
+    Op op = {.type    = info.type,
+             .channel = static_cast<int16_t>(status & 0x0F),
+             .key     = info.has_key ? static_cast<int16_t>(data1 & 0x7F) : int16_t{-1},
+             .index   = static_cast<uint8_t>(data1 & 0x7F)};
+
+    switch (info.layout) {
+    case ValueLayout::Data1: op.value = (data1 & 0x7F) / 127.0f; break;
+    case ValueLayout::Data2: op.value = (data2 & 0x7F) / 127.0f; break;
+
+    case ValueLayout::Bend14:
+        op.value = (((data2 & 0x7F) << 7 | (data1 & 0x7F)) - 8192) / 8192.0f;
+        break;
+
+    default: break;
+    }
+
+    // A note on with zero velocity is a note off in MIDI 1.0
+    if (op.type == OpType::NoteOn && (data2 & 0x7F) == 0) {
+        op.type = OpType::NoteOff;
+    }
+
+    return op;
+}
+
+inline Op DecodeMidi1(const uint8_t data[3])
+{
+    return DecodeMidi1(data[0], data[1], data[2]);
+}
+
+inline Op DecodeMidi2(const uint32_t data[4])
+{
+    const auto word          = data[0];
+    const auto message_type  = word >> 28;
+    const uint8_t status     = (word >> 16) & 0xFF;
+    const uint8_t byte3      = (word >> 8) & 0xFF;
+    const uint8_t byte4      = word & 0xFF;
+
+    // MIDI 1.0 channel voice messages wrapped in a packet
+    if (message_type == 0x2) {
+        return DecodeMidi1(status, byte3, byte4);
+    }
+
+    if (message_type != 0x4) {
+        return {};
+    }
+
+    const auto& info = Midi2Messages[status >> 4];
+
+    Op op = {.type    = info.type,
+             .channel = static_cast<int16_t>(status & 0x0F),
+             .key     = info.has_key ? static_cast<int16_t>(byte3 & 0x7F) : int16_t{-1},
+             .index   = byte3};
+
+    const auto value = data[1];
+
+    switch (info.layout) {
+    case ValueLayout::Velocity16: op.value = (value >> 16) / 65535.0f; break;
+    case ValueLayout::Data32: op.value = static_cast<float>(value / 4294967295.0); break;
+
+    case ValueLayout::Bend32:
+        op.value = static_cast<float>(
+            (static_cast<double>(value) - 2147483648.0) / 2147483648.0);
+        break;
+
+    default: break;
+    }
+
+    if (op.type == OpType::PerNotePitch) {
+        // Registered per-note controller 3 is the absolute pitch of the
+        // note, as a 7.25 fixed point key
+        constexpr uint8_t PitchController = 3;
+
+        if (byte4 != PitchController) {
+            return {};
+        }
+        op.value = static_cast<float>(value / 33554432.0);
+    }
+
+    return op;
+}
+
+} // namespace midi
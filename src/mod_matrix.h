@@ -0,0 +1,144 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Polyphonic modulation matrix.
+//
+// A route adds a per-voice modulation source (an envelope, an LFO, the
+// velocity, ...) scaled by an amount to a destination, which is one of the
+// parameters that can be modulated per voice (see MyPlugin::PolyLanes).
+//
+// The matrix is evaluated once per block. Like the rest of the voice state,
+// sources and destinations are laid out as one array per source and per
+// destination, indexed by voice, so every route is a multiply-add over
+// consecutive voices that runs on the widest SIMD vectors we have. Large
+// matrices cost a few vector instructions per route and block for every
+// handful of voices.
+
+#include <array>
+#include <cstdint>
+
+#include "simd.h"
+
+namespace mod {
+
+enum class Source : uint8_t {
+    None,
+
+    // Unipolar, [0, 1]
+    Envelope,
+
+    // Bipolar, [-1, 1]
+    Lfo,
+
+    // Unipolar, [0, 1]
+    Velocity,
+    Key,
+    Brightness,
+    Pressure
+};
+
+constexpr uint32_t NumSources = 7;
+
+inline const char* ToString(const Source source)
+{
+    switch (source) {
+    case Source::None: return "None";
+    case Source::Envelope: return "Envelope";
+    case Source::Lfo: return "LFO";
+    case Source::Velocity: return "Velocity";
+    case Source::Key: return "Key";
+    case Source::Brightness: return "Brightness";
+    case Source::Pressure: return "Pressure";
+    default: return "Unknown";
+    }
+}
+
+struct Route {
+    Source source = Source::None;
+
+    // Destination lane
+    uint32_t lane = 0;
+
+    // In units of the destination parameter
+    float amount = 0.0f;
+};
+
+// One array per source, indexed by voice. Sources the plugin doesn't provide
+// may be null as long as no route uses them.
+using SourceArrays = std::array<const float*, NumSources>;
+
+template <uint32_t NumLanes, uint32_t MaxRoutes>
+class Matrix {
+
+public:
+    void Clear()
+    {
+        num_routes = 0;
+    }
+
+    // Routes without a source or an amount don't do anything, so they
+    // aren't kept
+    void Add(const Route& route)
+    {
+        if (route.source != Source::None && route.amount != 0.0f &&
+            route.lane < NumLanes && num_routes < MaxRoutes) {
+
+            routes[num_routes++] = route;
+        }
+    }
+
+    bool Empty() const
+    {
+        return num_routes == 0;
+    }
+
+    // For the voices in the [first_voice, last_voice) range, sets every
+    // destination lane of `out` to its `base` value plus the sum of the
+    // routes to it
+    void Evaluate(const SourceArrays& sources,
+                  const std::array<const float*, NumLanes>& base,
+                  const std::array<float*, NumLanes>& out,
+                  const uint32_t first_voice, const uint32_t last_voice) const
+    {
+        for (uint32_t lane = 0; lane < NumLanes; ++lane) {
+            for (uint32_t i = first_voice; i < last_voice; ++i) {
+                out[lane][i] = base[lane][i];
+            }
+        }
+
+        for (uint32_t r = 0; r < num_routes; ++r) {
+            const auto& route = routes[r];
+
+            MultiplyAdd(out[route.lane],
+                        sources[static_cast<uint32_t>(route.source)],
+                        route.amount,
+                        first_voice,
+                        last_voice);
+        }
+    }
+
+private:
+    static void MultiplyAdd(float* out, const float* source, const float amount,
+                            const uint32_t first_voice, const uint32_t last_voice)
+    {
+        using V = simd::F32xN;
+        using S = simd::F32x1;
+
+        const auto amount_v = V::Set(amount);
+
+        auto i = first_voice;
+
+        for (; i + V::NumLanes <= last_voice; i += V::NumLanes) {
+            (V::Load(out + i) + V::Load(source + i) * amount_v).Store(out + i);
+        }
+        for (; i < last_voice; ++i) {
+            (S::Load(out + i) + S::Load(source + i) * S::Set(amount)).Store(out + i);
+        }
+    }
+
+    std::array<Route, MaxRoutes> routes = {};
+    uint32_t num_routes                 = 0;
+};
+
+} // namespace mod
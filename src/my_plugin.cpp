@@ -7,21 +7,39 @@
 // Adjusted for C++20 by John Novak <john@johnnovak.net>
 // https://github.com/johnnovak/
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
-
+#include <cstring>
+#include <numeric>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include "background_worker.h"
+#include "denormals.h"
 #include "my_plugin.h"
+#include "oscillator.h"
 
 MyPlugin::MyPlugin(const clap_plugin_t _plugin_class, const clap_host_t* _host,
-                   const Waveform _waveform, const bool resample)
+                   const Waveform _waveform, const ResampleMode _resample_mode)
 {
-    plugin_class = _plugin_class;
-    host         = _host;
-    waveform     = _waveform;
-    do_resample  = resample;
+    plugin_class  = _plugin_class;
+    host          = _host;
+    waveform      = _waveform;
+    resample_mode = _resample_mode;
+
+    has_fixed_render_rate = (resample_mode == ResampleMode::On);
 
+    process_fn  = SelectProcessFn(waveform, resample_mode);
+    dsp_kernels = &kernels::Get();
+
+    // Hosts create an instance of every plugin when scanning, and with
+    // large projects there can be hundreds of them that never get
+    // activated, so nothing gets allocated here. All DSP resources are
+    // allocated in Activate().
     plugin_class.plugin_data = this;
 }
 
@@ -35,15 +53,93 @@ bool MyPlugin::Init(const clap_plugin* _plugin_instance)
     plugin_instance = _plugin_instance;
 
     for (uint32_t i = 0; i < NumParams; ++i) {
-        clap_param_info_t info = {};
+        main_params[i]  = static_cast<float>(ParamSpecs[i].default_value);
+        audio_params[i] = static_cast<float>(ParamSpecs[i].default_value);
+    }
+
+    main_to_audio.Reset(main_params);
+    audio_to_main.Reset(audio_params);
+
+    // Voices can be rendered in parallel if the host lets us use its
+    // thread pool; otherwise we'll render them serially.
+    host_thread_pool = static_cast<const clap_host_thread_pool_t*>(
+        host->get_extension(host, CLAP_EXT_THREAD_POOL));
+
+    if (host_thread_pool && !host_thread_pool->request_exec) {
+        host_thread_pool = nullptr;
+    }
+
+    host_preset_load = static_cast<const clap_host_preset_load_t*>(
+        host->get_extension(host, CLAP_EXT_PRESET_LOAD));
+
+    if (host_preset_load &&
+        (!host_preset_load->on_error || !host_preset_load->loaded)) {
+        host_preset_load = nullptr;
+    }
+
+    host_latency = static_cast<const clap_host_latency_t*>(
+        host->get_extension(host, CLAP_EXT_LATENCY));
+
+    if (host_latency && !host_latency->changed) {
+        host_latency = nullptr;
+    }
+
+    // Tunings are assigned to channels by events in an event space of their
+    // own, so we need both extensions to support them
+    host_tuning = static_cast<const clap_host_tuning_t*>(
+        host->get_extension(host, CLAP_EXT_TUNING));
+
+    const auto event_registry = static_cast<const clap_host_event_registry_t*>(
+        host->get_extension(host, CLAP_EXT_EVENT_REGISTRY));
 
-        auto extension_params = reinterpret_cast<const clap_plugin_params_t*>(
-            plugin_class.get_extension(plugin_instance, CLAP_EXT_PARAMS));
+    if (host_tuning && event_registry && host_tuning->get_relative &&
+        host_tuning->should_play &&
+        event_registry->query(host, CLAP_EXT_TUNING, &tuning_space_id)) {
 
-        extension_params->get_info(&plugin_class, i, &info);
+        events.SetTuningSpace(tuning_space_id);
+        OnTuningsChanged();
+    } else {
+        host_tuning     = nullptr;
+        tuning_space_id = UINT16_MAX;
+    }
+
+    channel_tunings.fill(CLAP_INVALID_ID);
+
+    host_params = static_cast<const clap_host_params_t*>(
+        host->get_extension(host, CLAP_EXT_PARAMS));
+
+    if (host_params && !host_params->request_flush) {
+        host_params = nullptr;
+    }
+
+    host_timer_support = static_cast<const clap_host_timer_support_t*>(
+        host->get_extension(host, CLAP_EXT_TIMER_SUPPORT));
+
+    if (host_timer_support &&
+        (!host_timer_support->register_timer ||
+         !host_timer_support->unregister_timer ||
+         !host_timer_support->register_timer(
+             host, ParamSyncPeriodMs, &param_sync_timer_id))) {
 
-        main_params[i]  = info.default_value;
-        audio_params[i] = info.default_value;
+        host_timer_support  = nullptr;
+        param_sync_timer_id = CLAP_INVALID_ID;
+    }
+
+    // For telemetry and reporting errors in the render pipeline
+    host_log = static_cast<const clap_host_log_t*>(host->get_extension(host, CLAP_EXT_LOG));
+
+    if (host_log && !host_log->log) {
+        host_log = nullptr;
+    }
+
+    // The sampler refills its voices' streams in the host's event loop if
+    // it can watch an fd for us; see StartSampleStreaming()
+    host_posix_fd_support = static_cast<const clap_host_posix_fd_support_t*>(
+        host->get_extension(host, CLAP_EXT_POSIX_FD_SUPPORT));
+
+    if (host_posix_fd_support &&
+        (!host_posix_fd_support->register_fd || !host_posix_fd_support->unregister_fd)) {
+        host_posix_fd_support = nullptr;
     }
 
     return true;
@@ -51,12 +147,15 @@ bool MyPlugin::Init(const clap_plugin* _plugin_instance)
 
 void MyPlugin::Shutdown()
 {
-    std::lock_guard lock(sync_params);
-
-    if (resampler) {
-        speex_resampler_destroy(resampler);
-        resampler = nullptr;
+    if (host_timer_support) {
+        host_timer_support->unregister_timer(host, param_sync_timer_id);
+        param_sync_timer_id = CLAP_INVALID_ID;
     }
+
+    worker_pool.Stop();
+    StopSampleStreaming();
+
+    ReleaseDspResources();
 }
 
 bool MyPlugin::Activate(const double sample_rate, const uint32_t min_frame_count,
@@ -64,531 +163,3323 @@ bool MyPlugin::Activate(const double sample_rate, const uint32_t min_frame_count
 {
     output_sample_rate_hz = sample_rate;
 
-    if (do_resample) {
-        render_sample_rate_hz = RenderSampleRateHz;
+    // Some parameters can only be changed while the plugin is deactivated,
+    // so we pick up their latest values from the main thread here.
+    SyncAudioParamsToMain();
+
+    const auto is_offline = (render_mode == RenderMode::Offline);
+
+    // Deterministic renders must come out the same in both modes, and
+    // can't have the events' timing depend on the host's buffers
+    if (is_deterministic) {
+        render_block_size = DeterministicRenderBlockSize;
+    } else {
+        render_block_size = is_offline ? OfflineRenderBlockSize
+                                       : RealtimeRenderBlockSize;
+    }
+    render_lead = is_deterministic ? render_block_size : 0;
+
+    events.SetQuantum((is_offline || is_deterministic) ? 1 : RealtimeEventQuantum);
 
-        // Initialise Speex resampler
-        resample_ratio = render_sample_rate_hz / output_sample_rate_hz;
+    // We only need our own threads if the host can't lend us its pool.
+    // Offline, we don't need to leave any headroom for other instances, so
+    // we use all cores regardless of the parameter.
+    auto num_render_threads = static_cast<uint32_t>(std::clamp(
+        static_cast<int>(main_params[ParamRenderThreads]),
+        0,
+        static_cast<int>(WorkerPool::MaxWorkers)));
 
-        const spx_uint32_t in_rate_hz = static_cast<int>(render_sample_rate_hz);
-        const spx_uint32_t out_rate_hz = static_cast<int>(output_sample_rate_hz);
+    if (is_offline) {
+        // The audio thread takes part in the rendering too
+        const auto num_cores       = std::thread::hardware_concurrency();
+        const auto num_spare_cores = (num_cores > 1) ? num_cores - 1 : 0u;
 
-        constexpr auto NumChannels     = 2; // always stereo
-        constexpr auto ResampleQuality = SPEEX_RESAMPLER_QUALITY_DESKTOP;
+        num_render_threads = std::clamp(
+            num_spare_cores, num_render_threads, WorkerPool::MaxWorkers);
+    }
+
+    // Any render rate other than the host's goes through the resampler,
+    // so the process function is picked again for the new setup
+    render_rate = GetRenderRateParam(main_params[ParamRenderRate]);
 
-        resampler = speex_resampler_init(
-            NumChannels, in_rate_hz, out_rate_hz, ResampleQuality, nullptr);
+    const auto render_rate_hz = RenderRateHz(render_rate, sample_rate);
 
-        speex_resampler_set_rate(resampler, in_rate_hz, out_rate_hz);
-        speex_resampler_skip_zeros(resampler);
+    resample_mode = (render_rate_hz != sample_rate) ? ResampleMode::On
+                                                    : ResampleMode::Off;
 
-        const auto max_render_buf_size = static_cast<size_t>(
-            static_cast<double>(max_frame_count) * resample_ratio * 1.10f);
+    process_fn = SelectProcessFn(waveform, resample_mode);
+
+    if (resample_mode == ResampleMode::On) {
+        resampler_type = SelectResamplerType(main_params[ParamResampleQuality]);
+    }
 
-        render_buf[0].resize(max_render_buf_size);
-        render_buf[1].resize(max_render_buf_size);
+    // A mono output gets its own render path, so nothing is rendered or
+    // resampled twice
+    num_render_channels = ports_layout.output_channels;
 
+    // A sample loaded while we were active takes over now
+    if (pending_sample_file) {
+        sample_file = std::move(pending_sample_file);
+    }
+    const auto has_sample = (waveform == Waveform::Sample && sample_file);
+
+    const DspConfig config = {.sample_rate      = sample_rate,
+                              .render_rate_hz   = render_rate_hz,
+                              .max_frame_count  = max_frame_count,
+                              .resampler_type   = resampler_type,
+                              .num_channels     = num_render_channels,
+                              .is_deterministic = is_deterministic,
+                              .sample_channels  = has_sample ? sample_file->NumChannels()
+                                                             : 0};
+
+    // If we're reactivated with the same settings before the resources of
+    // the last activation have been released, there's nothing to allocate
+    if (dsp_config != config) {
+        if (!AllocateDspResources(config)) {
+            return false;
+        }
     } else {
-        render_sample_rate_hz = output_sample_rate_hz;
-        resample_ratio        = 1.0;
+        voices.Clear();
+    }
+
+    // Every stream starts over, reading from the sample we have now. The
+    // voices play it at its own rate, whatever the render rate.
+    sample_streamer.Reset(has_sample ? sample_file.get() : nullptr);
 
-        render_buf[0].resize(max_frame_count);
-        render_buf[1].resize(max_frame_count);
+    if (has_sample) {
+        sample_inc_per_phase_inc = sample_file->SampleRateHz() / SampleRootKeyHz;
+    }
+    sample_reads_may_block = is_offline || is_deterministic;
+
+    num_signalled_underruns = 0;
+    num_logged_underruns    = 0;
+
+    // Offline, the audio thread can't miss a deadline, so there's no point
+    // in keeping the memory out of the page file
+    if (!is_offline) {
+        if (!dsp_arena.IsLocked() && !dsp_arena.Lock() && host_log) {
+            host_log->log(host,
+                          CLAP_LOG_DEBUG,
+                          "Couldn't lock the DSP memory; it may get paged out");
+        }
+    } else {
+        dsp_arena.Unlock();
     }
 
-    return true;
-}
+    // The resampler converts by an exact rational ratio, which is only an
+    // approximation of the nominal rates if the host's rate is fractional.
+    // Deriving the render rate from that ratio (instead of the other way
+    // around) keeps the internal clock locked to the host's: every output
+    // frame is always worth exactly `num / den` rendered frames, so there's
+    // no drift to correct, and the oscillators are tuned to the rate the
+    // frames actually get played back at.
+    if (resampler) {
+        resample_ratio = static_cast<double>(resampler->RatioNum()) /
+                         resampler->RatioDen();
+    } else {
+        resample_ratio = 1.0;
+    }
+    render_sample_rate_hz = output_sample_rate_hz * resample_ratio;
 
-clap_process_status MyPlugin::Process(const clap_process_t* process)
-{
-    assert(process->audio_outputs_count == 1);
-    assert(process->audio_inputs_count == 0);
+    // Tunings can only come from the host
+    if (host_tuning) {
+        tuning_table.EnableTunings();
+    }
+    tuning_table.SetSampleRate(render_sample_rate_hz);
 
-    const uint32_t num_frames = process->frames_count;
-    const uint32_t num_events = process->in_events->size(process->in_events);
+    transport_clock.Reset(render_sample_rate_hz, output_sample_rate_hz);
 
-    uint32_t event_index      = 0;
-    uint32_t next_event_frame = (num_events == 0) ? num_frames : 0;
+    stream_position = 0;
 
-    SyncMainParamsToAudio(process->out_events);
+    ResetRenderPipeline();
 
-    for (uint32_t curr_frame = 0; curr_frame < num_frames;) {
-        while (event_index < num_events && next_event_frame == curr_frame) {
+    const auto new_latency_frames = OutputLatencyFrames();
 
-            const auto event = process->in_events->get(process->in_events,
-                                                       event_index);
-            if (event->time != curr_frame) {
-                next_event_frame = event->time;
-                break;
-            }
+    // Once the inputs have gone silent, the render buffer holds at most the
+    // look-ahead of the last non-silent frames (and in deterministic mode,
+    // the lead and up to a block more), and the filter reaches another
+    // `input_latency` frames back.
+    tail_frames = (new_latency_frames > 0) ? new_latency_frames * 2 + 2 : 0;
 
-            ProcessEvent(event);
-            ++event_index;
+    // The host must only be told about latency changes from here
+    if (new_latency_frames != latency_frames) {
+        latency_frames = new_latency_frames;
 
-            if (event_index == num_events) {
-                // We've reached the end of the event list
-                next_event_frame = num_frames;
-                break;
-            }
+        if (host_latency) {
+            host_latency->changed(host);
         }
+    }
 
-        const auto num_frames_to_render = static_cast<int>(
-            static_cast<double>(next_event_frame - curr_frame) * resample_ratio);
-
-        // Render samples until the next event
-        RenderAudio(num_frames_to_render);
+    // Sized for the latency by AllocateDspResources()
+    assert(input_delay[0].size() == latency_frames);
 
-        curr_frame = next_event_frame;
+    for (auto& channel : input_delay) {
+        channel.Fill(0.0);
+    }
+    input_delay_pos = 0;
+
+    if (!host_thread_pool && num_render_threads > 0) {
+        worker_pool.Start(
+            num_render_threads,
+            [](void* context, const uint32_t task_index) {
+                static_cast<MyPlugin*>(context)->ExecThreadPoolTask(task_index);
+            },
+            this);
     }
 
-    auto out_left  = process->audio_outputs[0].data32[0];
-    auto out_right = process->audio_outputs[0].data32[1];
+    StartSampleStreaming();
 
-    if (do_resample) {
-        ResampleAndPublishFrames(num_frames, out_left, out_right);
+    restart_requested = false;
 
-    } else {
-        for (size_t i = 0; i < num_frames; ++i) {
-            out_left[i]  = render_buf[0][i];
-            out_right[i] = render_buf[1][i];
+    is_idle           = true;
+    frames_until_idle = 0;
 
-            render_buf[0].clear();
-            render_buf[1].clear();
-        }
+    needs_warm_up = true;
+
+    is_active = true;
+
+    // Parameter smoothing runs at the render rate
+    for (uint32_t i = 0; i < NumParams; ++i) {
+        param_smoothers[i].Setup(SmoothingMode::Linear,
+                                 ParamSmoothingTimeMs,
+                                 render_sample_rate_hz);
+    }
+    SnapParamSmoothers();
+
+    return true;
+}
+
+void MyPlugin::SnapParamSmoothers()
+{
+    for (uint32_t i = 0; i < NumParams; ++i) {
+        param_smoothers[i].SnapTo(audio_params[i]);
+    }
+}
+
+bool MyPlugin::StartProcessing()
+{
+    if (needs_warm_up) {
+        WarmUp();
+        needs_warm_up = false;
     }
+    return true;
+}
 
-    // Clear voices
-    for (size_t i = 0; i < voices.size(); ++i) {
-        auto voice = &voices[i];
+// The input list is empty, and the output list refuses everything, so any
+// events we have for the host stay queued for the first real block
+static const clap_input_events_t NoInputEvents = {
+    .ctx  = nullptr,
+    .size = [](const clap_input_events_t*) -> uint32_t { return 0; },
+    .get  = [](const clap_input_events_t*, uint32_t) -> const clap_event_header_t* {
+        return nullptr;
+    },
+};
+
+static const clap_output_events_t RefuseOutputEvents = {
+    .ctx      = nullptr,
+    .try_push = [](const clap_output_events_t*, const clap_event_header_t*) {
+        return false;
+    },
+};
 
-        if (!voice->held) {
-            clap_event_note_t event = {
-                .header     = {.size     = sizeof(event),
-                               .time     = 0,
-                               .space_id = CLAP_CORE_EVENT_SPACE_ID,
-                               .type     = CLAP_EVENT_NOTE_END,
-                               .flags    = 0},
-                .key        = voice->key,
-                .note_id    = voice->note_id,
-                .channel    = voice->channel,
-                .port_index = 0
-            };
+void MyPlugin::WarmUp()
+{
+    if (warm_up_buf.empty()) {
+        return;
+    }
+    const auto num_frames = static_cast<uint32_t>(warm_up_buf.size() /
+                                                  num_render_channels);
 
-            process->out_events->try_push(process->out_events, &event.header);
+    float* channels[NumMixChannels] = {};
 
-            voices.erase(voices.cbegin() + i);
-        }
+    for (uint32_t c = 0; c < num_render_channels; ++c) {
+        channels[c] = warm_up_buf.data() + c * num_frames;
     }
 
-    return CLAP_PROCESS_CONTINUE;
+    clap_audio_buffer_t output = {.data32        = channels,
+                                  .data64        = nullptr,
+                                  .channel_count = num_render_channels,
+                                  .latency       = 0,
+                                  .constant_mask = 0};
+
+    const clap_process_t process = {.steady_time         = -1,
+                                    .frames_count        = num_frames,
+                                    .transport           = nullptr,
+                                    .audio_inputs        = nullptr,
+                                    .audio_outputs       = &output,
+                                    .audio_inputs_count  = 0,
+                                    .audio_outputs_count = 1,
+                                    .in_events           = &NoInputEvents,
+                                    .out_events          = &RefuseOutputEvents};
+
+    // An idle instance skips the render pipeline, so this one has to run
+    // it. Without voices, the pipeline goes idle again at the end of the
+    // block, which resets it to where Activate() has left it. Only the
+    // transport clock and the stream position have to be put back by hand.
+    const auto clock    = transport_clock;
+    const auto position = stream_position;
+
+    is_idle = false;
+
+    Process(&process);
+
+    assert(is_idle);
+
+    transport_clock = clock;
+    stream_position = position;
 }
 
-uint32_t MyPlugin::GetParamCount()
+void MyPlugin::Reset()
 {
-    return NumParams;
+    if (!is_active) {
+        return;
+    }
+
+    // The voices are cut off without a release, so the host gets their
+    // note end events now, with the next process or flush call
+    while (voices.Size() > 0) {
+        const auto& voice = voices[0];
+
+        SendNoteEnd(0, voice.key, voice.note_id, voice.channel);
+
+        voices.Stop(0);
+    }
+
+    ResetToSilence();
 }
 
-bool MyPlugin::GetParamInfo(const uint32_t index, clap_param_info_t* info)
+void MyPlugin::ResetToSilence()
 {
-    if (index == ParamVolume) {
-        memset(info, 0, sizeof(clap_param_info_t));
+    // Silence from here on, as far as the pipeline and the input delay are
+    // concerned, until the next event wakes us up
+    is_idle           = true;
+    frames_until_idle = 0;
 
-        info->id = index;
+    ResetRenderPipeline();
+    SnapParamSmoothers();
 
-        // These flags enable polyphonic modulation.
-        info->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE |
-                      CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID;
+    for (auto& channel : input_delay) {
+        channel.Fill(0.0);
+    }
+    input_delay_pos = 0;
+}
 
-        info->min_value     = 0.0f;
-        info->max_value     = 1.0f;
-        info->default_value = 0.5f;
+void MyPlugin::Deactivate()
+{
+    worker_pool.Stop();
+    StopSampleStreaming();
 
-        strcpy(info->name, "Volume");
+    is_active = false;
 
-        return true;
-    } else {
-        return false;
+    // Hosts often reactivate us right away, so we hold on to the DSP
+    // resources until the host calls us back on the main thread
+    if (dsp_config && !release_requested) {
+        release_requested = true;
+        host->request_callback(host);
     }
 }
 
-std::optional<double> MyPlugin::GetParamValue(const clap_id id)
+void MyPlugin::OnMainThread()
 {
-    uint32_t i = id;
-    if (i >= NumParams) {
-        return {};
+    if (release_requested && !is_active) {
+        ReleaseDspResources();
     }
+    release_requested = false;
 
-    // This gets called on the main thread, but should return the value of the
-    // parameter according to the audio thread, since the value on the audio
-    // thread is the one that host communicates with us via
-    // CLAP_EVENT_PARAM_VALUE events.
-    //
-    // Since we're accessing the opposite thread's arrays, we must acquire the
-    // sync params mutex. And although we need to check the
-    // `main_params_changed` array, we mustn't actually modify the
-    // `audio_params` array since that can only be done on the audio thread.
-    //
-    // Don't worry -- it'll pick up the changes eventually.
-    //
-    std::lock_guard lock(sync_params);
+    if (render_setup_pending.exchange(false, std::memory_order_relaxed)) {
+        PrepareRenderSetup();
+    }
 
-    return main_params_changed[i] ? main_params[i] : audio_params[i];
+    DrainTelemetry();
+    ReportFrameViolations();
+    ReportSampleUnderruns();
 }
 
-bool MyPlugin::ParamValueToText(const clap_id id, const double value,
-                                char* display, const uint32_t size)
+void MyPlugin::EndTelemetryBlock()
 {
-    uint32_t i = id;
-    if (i >= MyPlugin::NumParams) {
-        return false;
+    // The records pile up in the ring until the host calls us back on the
+    // main thread
+    if (telemetry.EndBlock(voices.Size())) {
+        host->request_callback(host);
     }
+}
 
-    snprintf(display, size, "%f", value);
+void MyPlugin::ReportFrameViolations()
+{
+    const auto counters = frame_ledger.Snapshot();
 
-    return true;
+    if (counters.num_violations == num_logged_frame_violations) {
+        return;
+    }
+    num_logged_frame_violations = counters.num_violations;
+
+    if (!host_log) {
+        return;
+    }
+
+    char text[256] = {};
+
+    snprintf(text,
+             sizeof(text),
+             "Render pipeline lost track of frames (%llu times); rendered %llu, "
+             "consumed %llu, buffered %llu, published %llu of %llu",
+             static_cast<unsigned long long>(counters.num_violations),
+             static_cast<unsigned long long>(counters.rendered),
+             static_cast<unsigned long long>(counters.consumed),
+             static_cast<unsigned long long>(counters.buffered),
+             static_cast<unsigned long long>(counters.published),
+             static_cast<unsigned long long>(counters.requested));
+
+    host_log->log(host, CLAP_LOG_ERROR, text);
 }
 
-std::optional<double> MyPlugin::ParamTextToValue(const clap_id id, const char* display)
+void MyPlugin::ReportSampleUnderruns()
 {
-    return false;
+    const auto num_underruns = sample_streamer.NumUnderruns();
+
+    if (num_underruns == num_logged_underruns) {
+        return;
+    }
+    num_logged_underruns = num_underruns;
+
+    if (!host_log) {
+        return;
+    }
+
+    char text[256] = {};
+
+    snprintf(text,
+             sizeof(text),
+             "Sample streaming fell behind the voices (%llu times); the frames "
+             "it hadn't read in yet were played as silence",
+             static_cast<unsigned long long>(num_underruns));
+
+    host_log->log(host, CLAP_LOG_WARNING, text);
 }
 
-bool MyPlugin::LoadState(const clap_istream_t* stream)
+void MyPlugin::DrainTelemetry()
 {
-    // Since we're modifying a parameter array, we need to acquire the
-    // sync_params mutex.
-    std::lock_guard lock(sync_params);
+    if constexpr (!telemetry::Recorder::Enabled) {
+        return;
+    }
 
-    const auto bytes_to_read = sizeof(float) * NumParams;
-    const auto bytes_read    = stream->read(stream, main_params, bytes_to_read);
+    const auto sample_rate_hz = output_sample_rate_hz;
 
-    const bool success = (bytes_read == bytes_to_read);
+    telemetry.Drain(telemetry_summary, sample_rate_hz);
 
-    // Make sure that the audio thread will pick up upon the modified
-    // parameters next time pluginClass.process is called.
-    for (uint32_t i = 0; i < NumParams; ++i) {
-        main_params_changed[i] = true;
+    // Report about once per period of audio, however the host sizes its
+    // blocks
+    if (!host_log || sample_rate_hz <= 0.0 ||
+        telemetry_summary.num_frames < TelemetryReportPeriodS * sample_rate_hz) {
+        return;
     }
 
-    return success;
+    char text[512] = {};
+
+    if (telemetry_summary.Format(text, sizeof(text), sample_rate_hz)) {
+        host_log->log(host, CLAP_LOG_DEBUG, text);
+    }
+    telemetry_summary = {};
 }
 
-bool MyPlugin::SaveState(const clap_ostream_t* stream)
+void MyPlugin::OnTimer(const clap_id timer_id)
 {
-    // Synchronize any changes from the audio thread (that is, parameter
-    // values sent to us by the host) before we save the state of the
-    // plugin.
+    if (timer_id != param_sync_timer_id) {
+        return;
+    }
+
+    // Keep the main thread's copy of the parameters current, whether or not
+    // anyone is looking at it
     SyncAudioParamsToMain();
 
-    const auto bytes_to_write = sizeof(float) * NumParams;
-    const auto bytes_written = stream->write(stream, main_params, bytes_to_write);
+    if (!flush_requested) {
+        return;
+    }
 
-    return (bytes_written == bytes_to_write);
+    if (main_to_audio.AnyPending()) {
+        // The host hasn't got around to it yet, or the request got lost
+        // because it arrived while the host was already calling us
+        host_params->request_flush(host);
+    } else {
+        flush_requested = false;
+    }
 }
 
-void MyPlugin::Flush(const clap_input_events_t* in, const clap_output_events_t* out)
+void MyPlugin::OnFd(const int fd, const clap_posix_fd_flags_t flags)
 {
-    const uint32_t num_events = in->size(in);
+    if (fd < 0 || fd != stream_timer.Fd()) {
+        return;
+    }
+    stream_timer.Acknowledge();
 
-    // For parameters that have been modified by the main thread,
-    // send CLAP_EVENT_PARAM_VALUE events to the host.
-    SyncMainParamsToAudio(out);
+    // This is the host's main thread, which mustn't wait for the disk
+    sample_streamer.Fill(false);
+}
 
-    // Process events sent to our plugin from the host.
-    for (uint32_t event_index = 0; event_index < num_events; ++event_index) {
-        ProcessEvent(in->get(in, event_index));
+void MyPlugin::StartSampleStreaming()
+{
+    if (!dsp_config || dsp_config->sample_channels == 0) {
+        return;
     }
+
+    // Refilling from the host's event loop saves us a thread per instance
+    if (host_posix_fd_support && stream_timer.Open(SampleStreamer::FillPeriodMs)) {
+        const auto fd = stream_timer.Fd();
+
+        if (host_posix_fd_support->register_fd(host, fd, CLAP_POSIX_FD_READ)) {
+            return;
+        }
+        stream_timer.Close();
+    }
+    sample_streamer.StartThread();
 }
 
-void MyPlugin::ProcessEvent(const clap_event_header_t* event)
+void MyPlugin::StopSampleStreaming()
 {
-    if (event->space_id == CLAP_CORE_EVENT_SPACE_ID) {
+    if (stream_timer.Fd() >= 0) {
+        host_posix_fd_support->unregister_fd(host, stream_timer.Fd());
+        stream_timer.Close();
+    }
+    sample_streamer.StopThread();
+}
 
-        switch (event->type) {
-        case CLAP_EVENT_NOTE_ON:
-        case CLAP_EVENT_NOTE_OFF:
-        case CLAP_EVENT_NOTE_CHOKE: {
-            const auto note_event = reinterpret_cast<const clap_event_note_t*>(event);
+// The resampler is reused (or just retuned) if possible, while all buffers
+// are carved out of a fresh arena, sized for the new settings
+bool MyPlugin::AllocateDspResources(const DspConfig& config)
+{
+    dsp_config.reset();
 
-            // Look through our voices array, and if the event
-            // matches any of them, it must have been released.
-            for (size_t i = 0; i < voices.size(); ++i) {
-                auto voice = &voices[i];
+    const auto max_frame_count = config.max_frame_count;
 
-                if ((note_event->key == -1 || voice->key == note_event->key) &&
-                    (note_event->note_id == -1 || voice->note_id == note_event->note_id) &&
-                    (note_event->channel == -1 ||
-                     voice->channel == note_event->channel)) {
+    if (resample_mode == ResampleMode::On) {
+        // The background worker may have built the resampler already, if
+        // the audio thread saw this setup coming
+        if (auto prepared = prepared_resampler->Take();
+            prepared && prepared->type == config.resampler_type &&
+            prepared->num_channels == num_render_channels &&
+            prepared->in_rate_hz == config.render_rate_hz &&
+            prepared->out_rate_hz == config.sample_rate &&
+            prepared->simd == dsp_kernels) {
 
-                    if (event->type == CLAP_EVENT_NOTE_CHOKE) {
-                        // Stop the voice immediately; don't process the
-                        // release segment of any ADSR envelopes.
-                        voices.erase(voices.cbegin() + i);
-                        --i;
-                    } else {
-                        voice->held = false;
-                    }
-                }
-            }
+            resampler = std::move(prepared->resampler);
+        }
 
-            // If this is a note on event, create a new voice
-            // and add it to our vector.
-            if (event->type == CLAP_EVENT_NOTE_ON) {
-                Voice voice = {.held    = true,
-                               .note_id = note_event->note_id,
-                               .channel = note_event->channel,
-                               .key     = note_event->key,
-                               .phase   = 0.0f};
+        // Only resample as many channels as we actually render. If only the
+        // host's sample rate has changed, the resampler is just retuned.
+        if (!UpdateResampler(resampler,
+                             config.resampler_type,
+                             num_render_channels,
+                             config.render_rate_hz,
+                             config.sample_rate,
+                             *dsp_kernels)) {
+            return false;
+        }
+    } else {
+        // The render rate might have been changed to the host's
+        resampler.reset();
+    }
 
-                voices.emplace_back(voice);
-            }
-        } break;
+    // The arrays are released before the block they point into
+    ReleaseDspBuffers();
+
+    const auto carve = [&](Arena& arena) {
+        if (resampler) {
+            // Before the first output frame, the resampler needs its
+            // look-ahead worth of input frames. After that, the scheduler
+            // keeps the buffer at most one frame above what the resampler
+            // consumes, plus the lead and up to a block beyond it in
+            // deterministic mode.
+            const auto max_render_frames =
+                (uint64_t{max_frame_count} * resampler->RatioNum() +
+                 resampler->RatioDen() - 1) /
+                resampler->RatioDen();
+
+            const auto max_render_buf_size = static_cast<size_t>(max_render_frames) +
+                                             resampler->InputLatency() + 2 +
+                                             size_t{render_lead} * 2;
+
+            render_buf.Allocate(arena, max_render_buf_size, num_render_channels);
+
+            // Stereo content is resampled into an interleaved scratch buffer
+            // first, mono content straight into the left output channel
+            // (unless the host asks for double precision output).
+            resample_buf = arena.Allocate<float>(static_cast<size_t>(max_frame_count) *
+                                                 num_render_channels);
+        } else if (render_lead > 0) {
+            // At the host's rate, the voices are rendered straight into its
+            // buffers (see ProcessImpl()), so only the lead of deterministic
+            // renders needs a buffer. We don't know in advance which sample
+            // type the host will ask for.
+            const auto max_render_buf_size = size_t{max_frame_count} +
+                                             size_t{render_lead} * 2;
+
+            render_buf.Allocate(arena, max_render_buf_size, num_render_channels);
+            render_buf64.Allocate(arena, max_render_buf_size, num_render_channels);
+        }
 
-        case CLAP_EVENT_NOTE_EXPRESSION: {
-            [[maybe_unused]] const auto note_expression_event =
-                reinterpret_cast<const clap_event_note_expression_t*>(event);
-            // TODO
-        } break;
+        mix_buffers.Allocate(arena, config.sample_channels > 0);
 
-        case CLAP_EVENT_PARAM_VALUE: {
-            const auto value_event =
-                reinterpret_cast<const clap_event_param_value_t*>(event);
+        voices.Allocate(arena, MaxPolyphony);
 
-            auto i = value_event->param_id;
+        // Read-ahead rings for the voices' streams, one per voice slot
+        if (config.sample_channels > 0) {
+            sample_streamer.Allocate(
+                arena, MaxPolyphony, config.sample_channels, SampleStreamBudgetBytes);
+        }
+
+        // The input gets delayed by our latency; see Activate()
+        const auto delay_frames = OutputLatencyFrames();
 
-            std::lock_guard lock(sync_params);
+        for (auto& channel : input_delay) {
+            channel = arena.Allocate<double>(delay_frames);
+        }
 
-            audio_params[i]         = value_event->value;
-            audio_params_changed[i] = true;
-        } break;
+        // Output of the block rendered by WarmUp()
+        warm_up_buf = arena.Allocate<float>(static_cast<size_t>(max_frame_count) *
+                                             num_render_channels);
+    };
 
-        case CLAP_EVENT_PARAM_MOD: {
-            const auto mod_event = reinterpret_cast<const clap_event_param_mod_t*>(
-                event);
+    if (!dsp_arena.Build(carve)) {
+        ReleaseDspBuffers();
+        return false;
+    }
 
-            for (size_t i = 0; i < voices.size(); ++i) {
-                auto voice = &voices[i];
+    voices.Reset();
 
-                if ((mod_event->key == -1 || voice->key == mod_event->key) &&
-                    (mod_event->note_id == -1 || voice->note_id == mod_event->note_id) &&
-                    (mod_event->channel == -1 ||
-                     voice->channel == mod_event->channel)) {
+    if (waveform == Waveform::Triangle) {
+        triangle_table = wavetables::Get(WavetableShape::Triangle);
+    }
 
-                    voice->param_offsets[mod_event->param_id] = mod_event->amount;
-                    break;
-                }
-            }
-        } break;
+    dsp_config = config;
 
-        case CLAP_EVENT_TRANSPORT: {
-            [[maybe_unused]] const auto transport_event =
-                reinterpret_cast<const clap_event_transport_t*>(event);
-            // TODO
-        } break;
+    return true;
+}
 
-        case CLAP_EVENT_MIDI: {
-            [[maybe_unused]] const auto midi_event =
-                reinterpret_cast<const clap_event_midi_t*>(event);
-            // TODO
-        } break;
+void MyPlugin::ReleaseDspBuffers()
+{
+    render_buf.Release();
+    render_buf64.Release();
 
-        case CLAP_EVENT_MIDI_SYSEX: {
-            [[maybe_unused]] const auto sysex_event =
-                reinterpret_cast<const clap_event_midi_sysex*>(event);
-            // TODO
-        } break;
+    resample_buf = {};
+    mix_buffers  = {};
+    input_delay  = {};
+    warm_up_buf  = {};
 
-        case CLAP_EVENT_MIDI2: {
-            [[maybe_unused]] const auto midi2_event =
-                reinterpret_cast<const clap_event_midi2*>(event);
-            // TODO
-        } break;
-        }
-    }
+    voices.Release();
+    sample_streamer.Release();
+
+    dsp_arena.Release();
+}
+
+void MyPlugin::ReleaseDspResources()
+{
+    resampler.reset();
+
+    ReleaseDspBuffers();
+
+    triangle_table = nullptr;
+
+    dsp_config.reset();
 }
 
-static float triangle(const float x)
+clap_process_status MyPlugin::Process(const clap_process_t* process)
 {
-    // amplitude
-    constexpr auto A = 2.0f;
+    assert(process->audio_outputs_count == 1);
+    assert(process->audio_inputs_count <= 1);
+    assert(process->audio_outputs[0].channel_count == num_render_channels);
 
-    // period
-    constexpr auto P = 1.0f * M_PI;
+    // Voices fading out produce subnormals, which are very slow to compute
+    // with. The host's floating-point mode is restored on return.
+    const ScopedFlushDenormals flush_denormals = {};
+
+    return (this->*process_fn)(process);
+}
 
-    constexpr auto AmplitudeOffset = A / 2.0f;
-    constexpr auto PhaseOffset     = P / -2.0f;
+MyPlugin::ProcessFn MyPlugin::SelectProcessFn(const Waveform waveform,
+                                              const ResampleMode resample_mode)
+{
+    // Table of the ProcessVariant() specialisations for every waveform and
+    // resample mode combination, generated at compile time
+    constexpr auto table = []<size_t... Ws>(std::index_sequence<Ws...>) {
+        return std::array<std::array<ProcessFn, NumResampleModes>, NumWaveforms>{
+            {{&MyPlugin::ProcessVariant<static_cast<Waveform>(Ws), ResampleMode::Off>,
+              &MyPlugin::ProcessVariant<static_cast<Waveform>(Ws), ResampleMode::On>}...}};
+    }(std::make_index_sequence<NumWaveforms>{});
+
+    return table[waveform][static_cast<size_t>(resample_mode)];
+}
 
-    return (A / P) * (P - fabs(fmod(x - PhaseOffset, 2.0f * P) - P)) - AmplitudeOffset;
+template <MyPlugin::Waveform W, ResampleMode R>
+clap_process_status MyPlugin::ProcessVariant(const clap_process_t* process)
+{
+    // The host can ask for either single or double precision output on a
+    // per-block basis
+    if (process->audio_outputs[0].data64) {
+        return ProcessImpl<double, W, R>(process, process->audio_outputs[0].data64);
+    } else {
+        return ProcessImpl<float, W, R>(process, process->audio_outputs[0].data32);
+    }
 }
 
-void MyPlugin::RenderAudio(const uint32_t num_frames)
+template <typename T, MyPlugin::Waveform W, ResampleMode R>
+clap_process_status MyPlugin::ProcessImpl(const clap_process_t* process,
+                                          T** out_buffers)
 {
-    for (size_t frame = 0; frame < num_frames; ++frame) {
-        auto sum = 0.0f;
+    // The resampler backends work in single precision, so when resampling we
+    // always render floats and only widen them at the very end
+    using RenderT = std::conditional_t<R == ResampleMode::On, float, T>;
 
-        for (size_t i = 0; i < voices.size(); ++i) {
-            auto voice = &voices[i];
-            if (!voice->held) {
-                continue;
-            }
+    const uint32_t num_frames = process->frames_count;
+
+    telemetry.BeginBlock(num_frames, process->in_events->size(process->in_events));
 
-            const auto volume = std::clamp(audio_params[ParamVolume] +
-                                               voice->param_offsets[ParamVolume],
-                                           0.0f,
-                                           1.0f);
+    events.Begin(process->in_events, num_frames);
 
-            switch (waveform) {
-            case Waveform::Sine:
-                sum += sinf(voice->phase * 2.0f * M_PI) * 0.2f * volume;
-                break;
+    pending_out_events.BeginBlock();
 
-            case Waveform::Triangle:
-                sum += triangle(voice->phase * 2.0f * M_PI) * 0.2f * volume;
-                break;
+    SyncMainParamsToAudio();
 
-            default: assert(false);
+    if (have_dynamic_tunings.load(std::memory_order_relaxed)) {
+        RefreshDynamicTunings();
+    }
+
+    // Where the song is at the first frame; transport events in the block
+    // move the clock from there
+    if (process->transport) {
+        transport_clock.Sync(*process->transport);
+    }
+
+    // A mono output only has the left channel
+    const auto is_mono = (process->audio_outputs[0].channel_count == 1);
+
+    auto out_left  = out_buffers[0];
+    auto out_right = is_mono ? nullptr : out_buffers[1];
+
+    // Whatever we render gets mixed into the input
+    const auto has_input = ReadInput(process, out_left, out_right);
+
+    // Nothing can change the output of an idle instance until the next
+    // event, so we don't need to touch the render pipeline at all. The host
+    // can skip reading our buffers, but they still must contain the
+    // constant value.
+    if (is_idle && events.Empty()) {
+        if (!has_input) {
+            std::fill_n(out_left, num_frames, T{});
+
+            if (out_right) {
+                std::fill_n(out_right, num_frames, T{});
             }
+        }
+
+        // Undelayed, the output is as constant as the input
+        if (!has_input) {
+            process->audio_outputs[0].constant_mask = is_mono ? 0b1 : 0b11;
+        } else if (input_delay[0].empty()) {
+            // Each output channel is made of one input channel, or of the
+            // downmix of both
+            const auto& input     = process->audio_inputs[0];
+            const auto all_inputs = (uint64_t{1} << input.channel_count) - 1;
+            const auto all_const  = (input.constant_mask & all_inputs) == all_inputs;
+            const auto is_upmix   = (input.channel_count == 1 && !is_mono);
+
+            process->audio_outputs[0].constant_mask =
+                is_mono ? (all_const ? 0b1 : 0)
+                        : (is_upmix ? (all_const ? 0b11 : 0) : input.constant_mask);
+        } else {
+            process->audio_outputs[0].constant_mask = 0;
+        }
+
+        // Nothing gets rendered, but the song goes on for the next note's
+        // tempo synced LFO, and so does the stream
+        transport_clock.Advance(num_frames * resample_ratio);
 
-            voice->phase += 440.0f * exp2f((voice->key - 57.0f) / 12.0f) /
-                            render_sample_rate_hz;
+        stream_position += num_frames;
 
-            voice->phase -= floorf(voice->phase);
+        // We need to be called again if the host couldn't take all our
+        // events. With an input, there's a delay line to drain, so we leave
+        // it to the host to decide based on the output.
+        const auto all_sent = pending_out_events.Flush(process->out_events);
+
+        EndTelemetryBlock();
+
+        if (!all_sent) {
+            return CLAP_PROCESS_CONTINUE;
         }
+        return has_input ? CLAP_PROCESS_CONTINUE_IF_NOT_QUIET : CLAP_PROCESS_SLEEP;
+    }
 
-        render_buf[0].emplace_back(sum);
-        render_buf[1].emplace_back(sum);
+    // Deterministic renders wake up in the state the pipeline would be in
+    // had it rendered the silence since it went idle, so a render that
+    // starts here comes out the same as one that started earlier
+    if (is_idle && is_deterministic) {
+        ResetRenderPipeline();
+        SnapParamSmoothers();
     }
-}
 
-void MyPlugin::ResampleAndPublishFrames(const uint32_t num_out_frames,
-                                        float* out_left, float* out_right)
-{
-    const auto input_len  = render_buf[0].size();
-    const auto output_len = num_out_frames;
+    is_idle = false;
 
-    spx_uint32_t in_len  = input_len;
-    spx_uint32_t out_len = output_len;
+    process->audio_outputs[0].constant_mask = 0;
 
-    speex_resampler_process_float(
-        resampler, 0, render_buf[0].data(), &in_len, out_left, &out_len);
+    frame_ledger.BeginBlock(num_frames);
 
-    in_len  = input_len;
-    out_len = output_len;
+    // At the host's rate and without a lead, the frames rendered in a block
+    // are exactly the block's output frames, so they're rendered straight
+    // into the host's buffers, and the render buffer isn't needed at all.
+    // Only the resampler and the deterministic lead keep frames around.
+    const auto is_direct = (R == ResampleMode::Off && render_lead == 0);
 
-    speex_resampler_process_float(
-        resampler, 1, render_buf[1].data(), &in_len, out_right, &out_len);
+    uint32_t num_direct_frames = 0;
 
-    // Speex returns the number actually consumed and written samples in
-    // `in_len` and `out_len`, respectively. There are three outcomes:
-    //
-    // 1) The input buffer hasn't been fully consumed, but the output buffer
-    //    has been completely filled.
-    //
-    // 2) The output buffer hasn't been filled completely, but all input
-    //    samples have been consumed.
-    //
-    // 3) All input samples have been consumed and the output buffer has been
-    //    completely filled.
-    //
-    if (out_len < output_len) {
-        // Case 2: The output buffer hasn't been filled completely; we need to
-        // generate more input samples.
-        //
-        const auto num_out_frames_remaining = output_len - out_len;
-        const auto curr_out_pos             = out_len;
+    for (;;) {
+        const auto next_event_frame = events.NextTime();
+        const auto is_block_end     = (next_event_frame >= num_frames);
 
-        // "It's the only way to be sure"
-        const auto render_frame_count = static_cast<int>(std::ceil(
-            static_cast<double>(num_out_frames_remaining) * resample_ratio));
+        // Render exactly the internal frames that precede the next event, or
+        // the ones the output of the block needs after the last one
+        const auto num_frames_to_render =
+            is_block_end ? render_scheduler.FramesToRender(num_frames)
+                         : render_scheduler.FramesToRenderBefore(next_event_frame);
 
-        render_buf[0].clear();
-        render_buf[1].clear();
+        const auto render_start = telemetry.Now();
 
-        RenderAudio(render_frame_count);
+        if constexpr (R == ResampleMode::Off) {
+            if (is_direct) {
+                // Never write past the host's buffers if the above
+                // assumption is ever broken in release builds
+                assert(num_direct_frames + num_frames_to_render <= num_frames);
 
-        in_len  = render_buf[0].size();
-        out_len = num_out_frames_remaining;
+                const auto num_direct = std::min(num_frames_to_render,
+                                                 num_frames - num_direct_frames);
 
-        speex_resampler_process_float(resampler,
-                                      0,
-                                      render_buf[0].data(),
-                                      &in_len,
-                                      out_left + curr_out_pos,
-                                      &out_len);
+                T* const out[NumMixChannels] = {
+                    out_left + num_direct_frames,
+                    out_right ? out_right + num_direct_frames : nullptr};
 
-        in_len  = render_buf[1].size();
-        out_len = num_out_frames_remaining;
+                RenderAudio<RenderT, W>(num_direct, out, has_input);
 
-        speex_resampler_process_float(resampler,
-                                      1,
-                                      render_buf[1].data(),
-                                      &in_len,
-                                      out_right + curr_out_pos,
-                                      &out_len);
-    }
+                num_direct_frames += num_direct;
+            } else {
+                RenderAudio<RenderT, W>(num_frames_to_render, nullptr, false);
+            }
+        } else {
+            RenderAudio<RenderT, W>(num_frames_to_render, nullptr, false);
+        }
+
+        telemetry.AddStage(telemetry::Stage::Render, render_start);
 
-    if (in_len < input_len) {
-        // Case 1: The input buffer hasn't been fully consumed; we have
-        // leftover input samples that we need to keep for the next Process()
-        // call.
-        //
-        if (in_len > 0) {
-            render_buf[0].erase(render_buf[0].begin(), render_buf[0].begin() + in_len);
-            render_buf[1].erase(render_buf[1].begin(), render_buf[1].begin() + in_len);
+        if (is_block_end) {
+            break;
         }
 
-    } else {
-        // Case 3: All input samples have been consumed and the output buffer
-        // has been completely filled.
-        //
-        render_buf[0].clear();
-        render_buf[1].clear();
+        const auto dispatch_start = telemetry.Now();
+
+        events.DispatchAt(next_event_frame, [&](const EventKind kind, const auto event) {
+            ProcessEvent(kind, event);
+        });
+
+        telemetry.AddStage(telemetry::Stage::Dispatch, dispatch_start);
     }
-}
 
-void MyPlugin::SyncMainParamsToAudio(const clap_output_events_t* out)
-{
-    std::lock_guard lock(sync_params);
+    if constexpr (R == ResampleMode::On) {
+        ResampleAndPublishFrames(num_frames, out_left, out_right, has_input);
 
-    for (uint32_t i = 0; i < NumParams; ++i) {
-        if (main_params_changed[i]) {
-            audio_params[i]        = main_params[i];
-            main_params_changed[i] = false;
+    } else if (is_direct) {
+        // Already in place
+        assert(num_direct_frames == num_frames);
 
-            clap_event_param_value_t event = {
-                .header     = {.size     = sizeof(event),
-                               .time     = 0,
-                               .space_id = CLAP_CORE_EVENT_SPACE_ID,
-                               .type     = CLAP_EVENT_PARAM_VALUE,
-                               .flags    = 0},
-                .param_id   = i,
-                .cookie     = nullptr,
-                .note_id    = -1,
-                .port_index = -1,
-                .channel    = -1,
-                .key        = -1,
-                .value      = audio_params[i]
-            };
+        if (num_direct_frames < num_frames && !has_input) {
+            std::fill(out_left + num_direct_frames, out_left + num_frames, T{});
 
-            out->try_push(out, &event.header);
+            if (out_right) {
+                std::fill(out_right + num_direct_frames, out_right + num_frames, T{});
+            }
         }
-    }
-}
 
-bool MyPlugin::SyncAudioParamsToMain()
-{
-    bool any_changed = false;
+        frame_ledger.AddConsumed(num_direct_frames);
+        frame_ledger.AddPublished(num_direct_frames);
 
-    std::lock_guard lock(sync_params);
+    } else {
+        auto& buf = GetRenderBuffer<T>();
 
-    for (uint32_t i = 0; i < NumParams; ++i) {
-        if (audio_params_changed[i]) {
-            main_params[i]          = audio_params[i];
-            audio_params_changed[i] = false;
+        // Deterministic renders keep their lead in the buffer
+        assert(buf.Size() >= num_frames);
 
-            any_changed = true;
+        // Never read past the rendered frames if the above assumption is
+        // ever broken in release builds
+        const auto num_available = static_cast<uint32_t>(
+            std::min<size_t>(buf.Size(), num_frames));
+
+        const auto publish_start = telemetry.Now();
+
+        PublishFrames(buf.Read(), num_available, out_left, out_right, has_input);
+
+        if (num_available < num_frames && !has_input) {
+            std::fill(out_left + num_available, out_left + num_frames, T{});
+
+            if (out_right) {
+                std::fill(out_right + num_available, out_right + num_frames, T{});
+            }
         }
+
+        telemetry.AddStage(telemetry::Stage::Publish, publish_start);
+
+        buf.Consume(num_available);
+
+        frame_ledger.AddConsumed(num_available);
+        frame_ledger.AddPublished(num_available);
     }
 
+    render_scheduler.FinishBlock(num_frames);
+
+    stream_position += num_frames;
+
+    if (!frame_ledger.EndBlock(GetRenderBuffer<RenderT>().Size(),
+                               render_scheduler.TotalRendered(),
+                               R == ResampleMode::On || render_lead > 0)) {
+        host->request_callback(host);
+    }
+
+    StopFinishedVoices();
+
+    // Go idle once the output of the last voice has made it all the way
+    // through the resampler
+    if (voices.Size() > 0) {
+        frames_until_idle = tail_frames;
+
+    } else if (frames_until_idle > num_frames) {
+        frames_until_idle -= num_frames;
+
+    } else {
+        // Everything in the pipeline is silent at this point, so starting
+        // from scratch is indistinguishable from carrying on.
+        ResetRenderPipeline();
+
+        frames_until_idle = 0;
+        is_idle           = true;
+    }
+
+    pending_out_events.Flush(process->out_events);
+
+    EndTelemetryBlock();
+
+    return CLAP_PROCESS_CONTINUE;
+}
+
+void MyPlugin::StopFinishedVoices()
+{
+    const auto num_frames = events.NumFrames();
+    const auto num_voices = voices.Size();
+
+    for (uint32_t i = 0; i < voices.Size();) {
+        const auto& voice = voices[i];
+
+        if (voices.State().envelope_stage[i] == EnvelopeStage::Done) {
+            // The release has faded out. Report the end of the voice at the
+            // last frame of the block, after any other events we might have
+            // sent during this block.
+            SendNoteEnd(num_frames > 0 ? num_frames - 1 : 0,
+                        voice.key,
+                        voice.note_id,
+                        voice.channel);
+
+            voices.Stop(i);
+        } else {
+            ++i;
+        }
+    }
+
+    // The last voice may have been rendered right up to the end of the
+    // block, so the countdown to going idle starts there; see ProcessImpl()
+    if (num_voices > 0 && voices.Size() == 0) {
+        frames_until_idle = tail_frames + num_frames;
+    }
+}
+
+uint32_t MyPlugin::GetTailLength()
+{
+    return tail_frames;
+}
+
+uint32_t MyPlugin::GetLatency()
+{
+    return latency_frames;
+}
+
+bool MyPlugin::GetVoiceInfo(clap_voice_info_t* info)
+{
+    // All voices are always available to the patch. Overlapping notes on
+    // the same key are told apart by their note IDs (see ProcessEvent()),
+    // so the host can send per-note modulation to each of them.
+    info->voice_count    = MaxPolyphony;
+    info->voice_capacity = MaxPolyphony;
+    info->flags          = CLAP_VOICE_INFO_SUPPORTS_OVERLAPPING_NOTES;
+
+    return true;
+}
+
+uint32_t MyPlugin::GetAudioPortCount(const bool is_input)
+{
+    return 1;
+}
+
+void MyPlugin::FillAudioPortInfo(const AudioPortsLayout& layout, const bool is_input,
+                                 clap_audio_port_info_t* info)
+{
+    const auto num_channels = is_input ? layout.input_channels
+                                       : layout.output_channels;
+
+    info->id            = is_input ? AudioInputPortId : AudioOutputPortId;
+    info->channel_count = num_channels;
+
+    // We can write double precision output directly, so the host doesn't
+    // need to convert our output on 64-bit buses.
+    info->flags = CLAP_AUDIO_PORT_IS_MAIN | CLAP_AUDIO_PORT_SUPPORTS_64BITS;
+
+    info->port_type     = (num_channels == 1) ? CLAP_PORT_MONO : CLAP_PORT_STEREO;
+    info->in_place_pair = is_input ? AudioOutputPortId : AudioInputPortId;
+
+    // Anything on the input gets mixed into our output, so we can be
+    // layered with other sources in an effect chain
+    snprintf(info->name,
+             sizeof(info->name),
+             "%s",
+             is_input ? "Audio Input" : "Audio Output");
+}
+
+bool MyPlugin::GetAudioPortInfo(const uint32_t index, const bool is_input,
+                                clap_audio_port_info_t* info)
+{
+    if (index) {
+        return false;
+    }
+
+    FillAudioPortInfo(ports_layout, is_input, info);
+
+    return true;
+}
+
+uint32_t MyPlugin::GetAudioPortsConfigCount()
+{
+    return static_cast<uint32_t>(AudioPortsConfigs.size());
+}
+
+bool MyPlugin::GetAudioPortsConfig(const uint32_t index,
+                                   clap_audio_ports_config_t* config)
+{
+    if (index >= AudioPortsConfigs.size()) {
+        return false;
+    }
+
+    const auto& entry  = AudioPortsConfigs[index];
+    const auto& layout = entry.layout;
+
+    config->id = entry.id;
+    snprintf(config->name, sizeof(config->name), "%s", entry.name);
+
+    config->input_port_count  = 1;
+    config->output_port_count = 1;
+
+    config->has_main_input           = true;
+    config->main_input_channel_count = layout.input_channels;
+    config->main_input_port_type     = (layout.input_channels == 1) ? CLAP_PORT_MONO
+                                                                    : CLAP_PORT_STEREO;
+
+    config->has_main_output           = true;
+    config->main_output_channel_count = layout.output_channels;
+    config->main_output_port_type = (layout.output_channels == 1) ? CLAP_PORT_MONO
+                                                                  : CLAP_PORT_STEREO;
+
+    return true;
+}
+
+bool MyPlugin::SelectAudioPortsConfig(const clap_id config_id)
+{
+    if (is_active) {
+        return false;
+    }
+
+    for (const auto& entry : AudioPortsConfigs) {
+        if (entry.id == config_id) {
+            ports_layout = entry.layout;
+            return true;
+        }
+    }
+    return false;
+}
+
+clap_id MyPlugin::GetCurrentAudioPortsConfig()
+{
+    for (const auto& entry : AudioPortsConfigs) {
+        if (entry.layout == ports_layout) {
+            return entry.id;
+        }
+    }
+    return CLAP_INVALID_ID;
+}
+
+bool MyPlugin::GetAudioPortsConfigPortInfo(const clap_id config_id,
+                                           const uint32_t index, const bool is_input,
+                                           clap_audio_port_info_t* info)
+{
+    if (index) {
+        return false;
+    }
+
+    for (const auto& entry : AudioPortsConfigs) {
+        if (entry.id == config_id) {
+            FillAudioPortInfo(entry.layout, is_input, info);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Resolves a set of configuration requests into the layout they ask for,
+// starting from the current one. Only mono and stereo main ports are
+// supported.
+static std::optional<std::array<uint32_t, 2>> ResolvePortRequests(
+    std::array<uint32_t, 2> channels,
+    const clap_audio_port_configuration_request_t* requests, const uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto& request = requests[i];
+
+        const auto num_channels = request.channel_count;
+
+        if (request.port_index != 0 || (num_channels != 1 && num_channels != 2)) {
+            return {};
+        }
+
+        const auto port_type = (num_channels == 1) ? CLAP_PORT_MONO : CLAP_PORT_STEREO;
+
+        if (request.port_type && std::strcmp(request.port_type, port_type) != 0) {
+            return {};
+        }
+
+        channels[request.is_input ? 0 : 1] = num_channels;
+    }
+    return channels;
+}
+
+bool MyPlugin::CanApplyAudioPortsConfiguration(
+    const clap_audio_port_configuration_request_t* requests, const uint32_t count)
+{
+    if (is_active) {
+        return false;
+    }
+
+    const auto layout = ResolvePortRequests(
+        {ports_layout.input_channels, ports_layout.output_channels}, requests, count);
+
+    return layout.has_value();
+}
+
+bool MyPlugin::ApplyAudioPortsConfiguration(
+    const clap_audio_port_configuration_request_t* requests, const uint32_t count)
+{
+    if (is_active) {
+        return false;
+    }
+
+    const auto layout = ResolvePortRequests(
+        {ports_layout.input_channels, ports_layout.output_channels}, requests, count);
+
+    if (!layout) {
+        return false;
+    }
+
+    ports_layout = {.input_channels = (*layout)[0], .output_channels = (*layout)[1]};
+
+    return true;
+}
+
+bool MyPlugin::HasHardRealtimeRequirement()
+{
+    return false;
+}
+
+bool MyPlugin::SetRenderMode(const clap_plugin_render_mode mode)
+{
+    RenderMode new_mode = {};
+
+    if (mode == CLAP_RENDER_REALTIME) {
+        new_mode = RenderMode::Realtime;
+    } else if (mode == CLAP_RENDER_OFFLINE) {
+        new_mode = RenderMode::Offline;
+    } else {
+        return false;
+    }
+
+    if (new_mode == render_mode) {
+        return true;
+    }
+    render_mode = new_mode;
+
+    // The render profile is set up in Activate(), so if the host switches
+    // modes while we're active, we ask it to reactivate us. Until then, we
+    // carry on with the current profile, which is fine in both directions.
+    if (is_active) {
+        host->request_restart(host);
+    }
+    return true;
+}
+
+bool MyPlugin::SetDeterministic(const bool enabled)
+{
+    if (is_active) {
+        return false;
+    }
+    is_deterministic = enabled;
+
+    // The wider kernels round differently, and not every machine has them
+    dsp_kernels = enabled ? &kernels::GetDefaultKernels() : &kernels::Get();
+
+    return true;
+}
+
+bool MyPlugin::IsDeterministic()
+{
+    return is_deterministic;
+}
+
+bool MyPlugin::Seek(const uint64_t frame)
+{
+    if (!is_active || !is_deterministic) {
+        return false;
+    }
+
+    // Whatever is playing belongs to the part of the stream we're leaving.
+    // The host jumps anyway, so it won't miss the note end events.
+    voices.Clear();
+
+    stream_position = frame;
+
+    ResetToSilence();
+
+    return true;
+}
+
+uint32_t MyPlugin::GetParamCount()
+{
+    return NumParams;
+}
+
+bool MyPlugin::GetParamInfo(const uint32_t index, clap_param_info_t* info)
+{
+    if (index >= NumParams) {
+        return false;
+    }
+
+    param::FillInfo(ParamSpecs[index], index, info);
+
+    return true;
+}
+
+std::optional<double> MyPlugin::GetParamValue(const clap_id id)
+{
+    uint32_t i = id;
+    if (i >= NumParams) {
+        return {};
+    }
+
+    // This gets called on the main thread, but should return the value of the
+    // parameter according to the audio thread, since the value on the audio
+    // thread is the one that host communicates with us via
+    // CLAP_EVENT_PARAM_VALUE events.
+    //
+    // The audio thread publishes every value it receives to the
+    // `audio_to_main` channel, so we can just peek at the latest one, unless
+    // we have a newer value of our own that the audio thread hasn't picked up
+    // yet. We mustn't consume anything from the channel here, though; that's
+    // done in SyncAudioParamsToMain().
+    //
+    return main_to_audio.IsPending(i) ? main_params[i] : audio_to_main.Peek(i);
+}
+
+bool MyPlugin::ParamValueToText(const clap_id id, const double value,
+                                char* display, const uint32_t size)
+{
+    if (id >= NumParams) {
+        return false;
+    }
+
+    return param::ToText(ParamSpecs[id], value, display, size);
+}
+
+std::optional<double> MyPlugin::ParamTextToValue(const clap_id id, const char* display)
+{
+    if (id >= NumParams) {
+        return {};
+    }
+
+    return param::FromText(ParamSpecs[id], display);
+}
+
+// Chunks of the saved state (see state_format.h). Both contain a parameter
+// count followed by (ID, value) pairs, so parameters can be added and
+// removed without breaking old states.
+//
+// Parameters that only concern the machine the plugin runs on are kept
+// separately, so loading a preset doesn't change them.
+constexpr auto ChunkParams        = state::FourCC("PARM");
+constexpr auto ChunkMachineParams = state::FourCC("MACH");
+constexpr auto ChunkSample        = state::FourCC("SMPL");
+
+bool MyPlugin::IsMachineParam(const uint32_t index)
+{
+    return index == ParamRenderThreads;
+}
+
+bool MyPlugin::LoadState(const clap_istream_t* stream, const uint32_t context_type)
+{
+    // This only allocates the first time; saving never shrinks the buffer
+    state_buf.resize(state::MaxSize);
+
+    state::Reader reader(state_buf);
+
+    if (!reader.ReadFrom(stream)) {
+        return false;
+    }
+
+    // The values are staged here, so a state that turns out to be broken
+    // halfway through leaves the parameters as they were
+    std::array<float, NumParams> params = {};
+    std::copy_n(main_params, NumParams, params.begin());
+
+    // Whatever the state holds is kept within the parameters' ranges; a
+    // value that isn't even a number means the state is corrupt
+    const auto load_value = [&](const uint32_t id, const float value) {
+        if (!std::isfinite(value)) {
+            return false;
+        }
+        const auto& spec = ParamSpecs[id];
+
+        params[id] = std::clamp(value,
+                                static_cast<float>(spec.min_value),
+                                static_cast<float>(spec.max_value));
+        return true;
+    };
+
+    uint32_t version = 0;
+
+    if (reader.ReadHeader(version)) {
+        // Compatible additions are new chunks; the version only gets bumped
+        // for changes older versions of the plugin can't deal with
+        if (version > state::Version) {
+            return false;
+        }
+
+        const auto load_params = [&](const state::Reader::Chunk& chunk,
+                                     const bool is_machine_chunk) {
+            state::ChunkReader chunk_reader(chunk);
+
+            uint32_t count = 0;
+            if (!chunk_reader.Read(count)) {
+                return false;
+            }
+
+            for (uint32_t n = 0; n < count; ++n) {
+                uint32_t id = 0;
+                float value = 0.0f;
+
+                if (!chunk_reader.Read(id) || !chunk_reader.Read(value)) {
+                    return false;
+                }
+
+                // Skip parameters we no longer have, and anything that
+                // ended up in the wrong chunk
+                if (id < NumParams && IsMachineParam(id) == is_machine_chunk &&
+                    !load_value(id, value)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        std::string sample_path = {};
+
+        state::Reader::Chunk chunk = {};
+
+        while (reader.NextChunk(chunk)) {
+            if (chunk.tag == ChunkParams) {
+                if (!load_params(chunk, false)) {
+                    return false;
+                }
+
+            } else if (chunk.tag == ChunkMachineParams) {
+                if (context_type != CLAP_STATE_CONTEXT_FOR_PRESET &&
+                    !load_params(chunk, true)) {
+                    return false;
+                }
+
+            } else if (chunk.tag == ChunkSample) {
+                state::ChunkReader chunk_reader(chunk);
+
+                uint32_t length      = 0;
+                const uint8_t* bytes = nullptr;
+
+                if (!chunk_reader.Read(length) || !chunk_reader.ReadBytes(bytes, length)) {
+                    return false;
+                }
+                sample_path.assign(reinterpret_cast<const char*>(bytes), length);
+            }
+            // Unknown chunks are skipped
+        }
+
+        std::copy(params.begin(), params.end(), main_params);
+
+        // A sample that has been moved or deleted since doesn't invalidate
+        // the rest of the state; the sampler just stays silent
+        const auto& latest = pending_sample_file ? pending_sample_file : sample_file;
+
+        if (!sample_path.empty() && (!latest || latest->Path() != sample_path) &&
+            !LoadSample(sample_path.c_str()) && host_log) {
+
+            char text[512] = {};
+
+            snprintf(text,
+                     sizeof(text),
+                     "Couldn't load the sample %s",
+                     sample_path.c_str());
+
+            host_log->log(host, CLAP_LOG_WARNING, text);
+        }
+
+    } else {
+        // Unversioned legacy state: the raw value of the volume, the only
+        // parameter there was. Anything else without a header is not a
+        // state, including no state at all, and a header that's been cut
+        // off right after the magic number.
+        float volume   = 0.0f;
+        uint32_t magic = 0;
+
+        if (reader.Size() != sizeof(volume)) {
+            return false;
+        }
+        std::memcpy(&volume, reader.Data(), sizeof(volume));
+        std::memcpy(&magic, reader.Data(), sizeof(magic));
+
+        if (magic == state::Magic) {
+            return false;
+        }
+
+        if (!load_value(ParamVolume, volume)) {
+            return false;
+        }
+        main_params[ParamVolume] = params[ParamVolume];
+    }
+
+    // Make sure that the audio thread will pick up upon the modified
+    // parameters, even if the host isn't processing right now.
+    for (uint32_t i = 0; i < NumParams; ++i) {
+        main_to_audio.Publish(i, main_params[i]);
+    }
+    RequestParamFlush();
+
+    return true;
+}
+
+bool MyPlugin::SaveState(const clap_ostream_t* stream, const uint32_t context_type)
+{
+    // Synchronize any changes from the audio thread (that is, parameter
+    // values sent to us by the host) before we save the state of the
+    // plugin.
+    SyncAudioParamsToMain();
+
+    // The state holds no caches or other data that can be rebuilt, so all
+    // contexts get the complete state. Loading is where the context
+    // matters.
+    state::Writer writer(state_buf);
+
+    const auto save_params = [&](const uint32_t tag, const bool machine_params) {
+        writer.BeginChunk(tag);
+
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < NumParams; ++i) {
+            count += (IsMachineParam(i) == machine_params) ? 1 : 0;
+        }
+        writer.Write(count);
+
+        for (uint32_t i = 0; i < NumParams; ++i) {
+            if (IsMachineParam(i) == machine_params) {
+                writer.Write(i);
+                writer.Write(main_params[i]);
+            }
+        }
+        writer.EndChunk();
+    };
+
+    save_params(ChunkParams, false);
+    save_params(ChunkMachineParams, true);
+
+    // The sample is saved by reference
+    if (const auto& latest = pending_sample_file ? pending_sample_file : sample_file) {
+        const auto& path = latest->Path();
+
+        writer.BeginChunk(ChunkSample);
+        writer.Write(static_cast<uint32_t>(path.size()));
+        writer.WriteBytes(path.data(), path.size());
+        writer.EndChunk();
+    }
+
+    return writer.WriteTo(stream);
+}
+
+bool MyPlugin::LoadPreset(const uint32_t location_kind, const char* location,
+                          const char* load_key)
+{
+    const auto fail = [&](const char* msg) {
+        if (host_preset_load) {
+            host_preset_load->on_error(
+                host, location_kind, location, load_key, 0, msg);
+        }
+        return false;
+    };
+
+    // All our presets are in banks, so they always have a load key
+    if (location_kind != CLAP_PRESET_DISCOVERY_LOCATION_FILE || !location ||
+        !load_key) {
+        return fail("Unsupported preset location");
+    }
+
+    if (preset_bank.Path() != location && !preset_bank.Open(location)) {
+        return fail("Not a valid HelloCLAP preset bank");
+    }
+
+    const auto preset = preset_bank.Find(load_key);
+
+    if (!preset) {
+        return fail("Preset not found");
+    }
+
+    // Feed the preset's state straight from the mapped bank to LoadState
+    struct MemoryStream {
+        const uint8_t* data = nullptr;
+        uint64_t size       = 0;
+        uint64_t pos        = 0;
+    };
+
+    MemoryStream memory = {.data = preset->data, .size = preset->size};
+
+    const clap_istream_t stream = {
+        .ctx  = &memory,
+        .read = [](const clap_istream_t* stream, void* buffer,
+                   uint64_t size) -> int64_t {
+            auto m = static_cast<MemoryStream*>(stream->ctx);
+
+            const auto n = std::min(size, m->size - m->pos);
+            std::memcpy(buffer, m->data + m->pos, n);
+            m->pos += n;
+
+            return static_cast<int64_t>(n);
+        }};
+
+    if (!LoadState(&stream, CLAP_STATE_CONTEXT_FOR_PRESET)) {
+        return fail("Invalid preset data");
+    }
+
+    if (host_preset_load) {
+        host_preset_load->loaded(host, location_kind, location, load_key);
+    }
+    return true;
+}
+
+bool MyPlugin::LoadSample(const char* path)
+{
+    if (waveform != Waveform::Sample || !path) {
+        return false;
+    }
+
+    auto file = std::make_unique<SampleFile>();
+
+    if (!file->Open(path)) {
+        return false;
+    }
+
+    // The voices are streaming the current sample, so a new one can only
+    // take over in Activate()
+    if (is_active) {
+        pending_sample_file = std::move(file);
+        host->request_restart(host);
+    } else {
+        sample_file = std::move(file);
+        pending_sample_file.reset();
+    }
+    return true;
+}
+
+bool MyPlugin::GetSamplePath(char* path, const uint32_t capacity)
+{
+    const auto& latest = pending_sample_file ? pending_sample_file : sample_file;
+
+    if (!latest || latest->Path().size() >= capacity) {
+        return false;
+    }
+    std::memcpy(path, latest->Path().c_str(), latest->Path().size() + 1);
+
+    return true;
+}
+
+void MyPlugin::Flush(const clap_input_events_t* in, const clap_output_events_t* out)
+{
+    const uint32_t num_events = in->size(in);
+
+    pending_out_events.BeginBlock();
+
+    // For parameters that have been modified by the main thread,
+    // send CLAP_EVENT_PARAM_VALUE events to the host.
+    SyncMainParamsToAudio();
+
+    // Process events sent to our plugin from the host.
+    for (uint32_t event_index = 0; event_index < num_events; ++event_index) {
+        const auto event = in->get(in, event_index);
+        const auto kind  = ClassifyEvent(event, tuning_space_id);
+
+        // Hosts can flush us while we're deactivated, when the voice pool
+        // may not even be allocated; only parameter values and the
+        // transport can be handled without voices
+        if (!is_active && kind != EventKind::ParamValue && kind != EventKind::Transport) {
+            continue;
+        }
+
+        ProcessEvent(kind, event);
+    }
+
+    pending_out_events.Flush(out);
+}
+
+void MyPlugin::ProcessEvent(const EventKind kind,
+                            const clap_event_header_t* event)
+{
+    switch (kind) {
+    case EventKind::NoteOn:
+    case EventKind::NoteOff:
+    case EventKind::NoteChoke: {
+        const auto note_event = reinterpret_cast<const clap_event_note_t*>(event);
+
+        ProcessNote(kind,
+                    event->time,
+                    note_event->key,
+                    note_event->note_id,
+                    note_event->channel,
+                    static_cast<float>(note_event->velocity));
+    } break;
+
+    case EventKind::NoteExpression: {
+        const auto expression_event =
+            reinterpret_cast<const clap_event_note_expression_t*>(event);
+
+        const auto expression = ToExpression(expression_event->expression_id);
+
+        if (!expression) {
+            break;
+        }
+
+        // The voices only move towards the new value; see RenderVoices().
+        // Wildcards address all matching voices.
+        auto& target = voices.State().expression_target[*expression];
+
+        voices.ForEachMatching(
+            expression_event->key,
+            expression_event->note_id,
+            expression_event->channel,
+            [&](const uint32_t slot) {
+                target[voices.IndexOf(slot)] = static_cast<float>(
+                    expression_event->value);
+                return true;
+            });
+    } break;
+
+    case EventKind::ParamValue: {
+        const auto value_event =
+            reinterpret_cast<const clap_event_param_value_t*>(event);
+
+        // Hosts can send IDs we've never told them about
+        if (value_event->param_id >= NumParams) {
+            break;
+        }
+
+        SetAudioParam(value_event->param_id, value_event->value);
+    } break;
+
+    case EventKind::ParamMod: {
+        const auto mod_event = reinterpret_cast<const clap_event_param_mod_t*>(
+            event);
+
+        // Only parameters with a modulation lane are modulatable
+        if (mod_event->param_id >= NumParams ||
+            PolyLanes[mod_event->param_id] == NoPolyLane) {
+            break;
+        }
+
+        const auto lane = PolyLanes[mod_event->param_id];
+
+        const auto amount = static_cast<float>(mod_event->amount);
+
+        // Monophonic modulation also applies to voices started later. A
+        // polyphonic amount already includes the monophonic one, so it
+        // simply replaces it.
+        if (mod_event->key == -1 && mod_event->note_id == -1 &&
+            mod_event->channel == -1) {
+            mono_param_mod[lane] = amount;
+        }
+
+        voices.ForEachMatching(
+            mod_event->key,
+            mod_event->note_id,
+            mod_event->channel,
+            [&](const uint32_t slot) {
+                voices.State().param_mod[lane][voices.IndexOf(slot)] = amount;
+                return true;
+            });
+    } break;
+
+    case EventKind::Transport: {
+        const auto transport_event = reinterpret_cast<const clap_event_transport_t*>(event);
+
+        // Everything before the event has been rendered with the old
+        // transport, so it takes effect right at its frame
+        transport_clock.Sync(*transport_event);
+    } break;
+
+    case EventKind::Midi: {
+        const auto midi_event = reinterpret_cast<const clap_event_midi_t*>(event);
+
+        ProcessMidi(midi::DecodeMidi1(midi_event->data), event->time);
+    } break;
+
+    // We don't use any system exclusive messages
+    case EventKind::MidiSysex: break;
+
+    case EventKind::Midi2: {
+        const auto midi2_event = reinterpret_cast<const clap_event_midi2*>(event);
+
+        ProcessMidi(midi::DecodeMidi2(midi2_event->data), event->time);
+    } break;
+
+    case EventKind::Tuning: {
+        const auto tuning_event = reinterpret_cast<const clap_event_tuning_t*>(event);
+
+        const auto tuning_id = tuning_event->tunning_id;
+
+        // A channel of -1 sets the tuning of all channels
+        for (int16_t channel = 0; channel < TuningTable::NumChannels; ++channel) {
+            if (tuning_event->channel == -1 || tuning_event->channel == channel) {
+                channel_tunings[channel] = tuning_id;
+
+                LoadChannelTuning(channel, event->time);
+                UpdateVoicePitches(-1, channel);
+            }
+        }
+    } break;
+
+    case EventKind::Unhandled: break;
+    }
+}
+
+void MyPlugin::LoadChannelTuning(const int16_t channel, const uint32_t time)
+{
+    const auto tuning_id = channel_tunings[channel];
+
+    if (tuning_id == CLAP_INVALID_ID) {
+        tuning_table.ResetChannel(channel);
+        return;
+    }
+
+    tuning_table.SetChannelTuning(channel, [&](const int16_t key) {
+        return host_tuning->get_relative(host, tuning_id, channel, key, time);
+    });
+}
+
+void MyPlugin::RefreshDynamicTunings()
+{
+    // Only the keys that are actually playing need to be looked at, which
+    // is a lot cheaper than rebuilding the whole table every block
+    for (uint32_t i = 0; i < voices.Size(); ++i) {
+        const auto& voice = voices[i];
+
+        if (!TuningTable::IsValid(voice.channel, voice.key)) {
+            continue;
+        }
+
+        const auto tuning_id = channel_tunings[voice.channel];
+
+        if (tuning_id == CLAP_INVALID_ID) {
+            continue;
+        }
+
+        const auto offset = host_tuning->get_relative(
+            host, tuning_id, voice.channel, voice.key, 0);
+
+        if (static_cast<float>(offset) == tuning_table.Offset(voice.channel, voice.key)) {
+            continue;
+        }
+
+        tuning_table.SetKeyOffset(voice.channel, voice.key, static_cast<float>(offset));
+
+        // Updates every voice playing the same key
+        UpdateVoicePitches(voice.key, voice.channel);
+    }
+}
+
+void MyPlugin::OnTuningsChanged()
+{
+    if (!host_tuning || !host_tuning->get_tuning_count || !host_tuning->get_info) {
+        return;
+    }
+
+    bool any_dynamic = false;
+
+    const auto num_tunings = host_tuning->get_tuning_count(host);
+
+    for (uint32_t i = 0; i < num_tunings; ++i) {
+        clap_tuning_info_t info = {};
+
+        if (host_tuning->get_info(host, i, &info) && info.is_dynamic) {
+            any_dynamic = true;
+            break;
+        }
+    }
+
+    have_dynamic_tunings.store(any_dynamic, std::memory_order_relaxed);
+}
+
+void MyPlugin::ProcessNote(const EventKind kind, const uint32_t time,
+                           const int16_t key, const int32_t note_id,
+                           const int16_t channel, const float velocity)
+{
+    // If the event matches any of our voices, they must have been
+    // released.
+    voices.ForEachMatching(key, note_id, channel, [&](const uint32_t slot) {
+        if (kind == EventKind::NoteChoke) {
+            // Stop the voice immediately; don't process the release
+            // segment of its envelope.
+            voices.StopSlot(slot);
+        } else {
+            voices.Slot(slot).held = false;
+
+            // The voice keeps playing until the release has faded out
+            voices.State().envelope_stage[voices.IndexOf(slot)] =
+                EnvelopeStage::Release;
+        }
+        return true;
+    });
+
+    // Tunings can leave out keys
+    const auto is_tuned = TuningTable::IsValid(channel, key) &&
+                          channel_tunings[channel] != CLAP_INVALID_ID;
+
+    if (kind == EventKind::NoteOn && is_tuned &&
+        !host_tuning->should_play(host, channel_tunings[channel], channel, key)) {
+        return;
+    }
+
+    // If this is a note on event, create a new voice
+    // and add it to our pool.
+    if (kind == EventKind::NoteOn) {
+        if (voices.IsFull()) {
+            const auto victim_index = voices.FindVictim(
+                voice_steal_policy, [&](const uint32_t index) {
+                    const auto& state = voices.State();
+
+                    const auto volume = audio_params[ParamVolume] +
+                                        state.param_mod[VolumeLane][index];
+
+                    return state.envelope_level[index] * volume;
+                });
+
+            const auto& victim = voices[victim_index];
+
+            SendNoteEnd(time, victim.key, victim.note_id, victim.channel);
+
+            voices.Stop(victim_index);
+        }
+
+        const Voice voice = {
+            .held = true, .note_id = note_id, .channel = channel, .key = key};
+
+        const auto index = voices.Start(voice);
+
+        // The phase increment only changes with pitch bends, tunings, the
+        // tuning expression and pitch modulation, so it's calculated here,
+        // in UpdateVoicePitch(), and in RenderVoices() when the transposition
+        // changes
+        auto& state = voices.State();
+
+        state.ResetExpressions(index);
+
+        state.phase[index]          = 0.0f;
+        state.base_phase_inc[index] = tuning_table.PhaseIncrement(channel, key);
+        state.pitch_bend[index]     = VoicePitchBend(voice);
+        state.velocity[index]       = std::clamp(velocity, 0.0f, 1.0f);
+        state.key_track[index]      = std::clamp(key, int16_t{0}, int16_t{127}) / 127.0f;
+        state.lfo_phase[index]      = 0.0f;
+        state.lfo_start[index]      = transport_clock.Position();
+        state.envelope_stage[index] = EnvelopeStage::Attack;
+        state.envelope_level[index] = 0.0f;
+
+        // The matrix catches up with the voice in its first block
+        for (uint32_t lane = 0; lane < NumPolyParams; ++lane) {
+            state.param_mod[lane][index]  = mono_param_mod[lane];
+            state.modulation[lane][index] = mono_param_mod[lane];
+        }
+
+        RetuneVoice(index, audio_params[ParamTune]);
+
+        // The event falls between two internal frames; starting the
+        // oscillator that much further in puts the onset exactly where the
+        // host has put it
+        state.phase[index] = render_scheduler.SubFrameDelay(time) * state.phase_inc[index];
+
+        // The sampler's position follows the phase the same way, and the
+        // voice slot's stream starts reading from the top of the sample
+        if (waveform == Waveform::Sample && !mix_buffers.sample_frames.empty()) {
+            state.sample_pos[index] = state.phase[index] * sample_inc_per_phase_inc;
+
+            sample_streamer.Start(voices.SlotOf(index));
+        }
+    }
+}
+
+void MyPlugin::ProcessMidi(const midi::Op& op, const uint32_t time)
+{
+    // MIDI controllers that are mapped to parameters, using the General
+    // MIDI 2 sound controller assignments
+    struct ControllerMapping {
+        uint8_t controller = 0;
+        uint32_t param_id  = 0;
+    };
+
+    static constexpr ControllerMapping ControllerParams[] = {
+        {7, ParamVolume},
+        {10, ParamPan},
+        {72, ParamRelease},
+        {73, ParamAttack},
+        {75, ParamDecay},
+    };
+
+    // Channel mode messages
+    constexpr uint8_t AllSoundOff         = 120;
+    constexpr uint8_t ResetAllControllers = 121;
+    constexpr uint8_t AllNotesOff         = 123;
+
+    // MIDI notes don't have note IDs, so they all go through the same voice
+    // lookup as CLAP note events without one
+    constexpr int32_t NoNoteId = -1;
+
+    switch (op.type) {
+    case midi::OpType::NoteOn:
+        ProcessNote(EventKind::NoteOn, time, op.key, NoNoteId, op.channel, op.value);
+        break;
+
+    case midi::OpType::NoteOff:
+        ProcessNote(EventKind::NoteOff, time, op.key, NoNoteId, op.channel, op.value);
+        break;
+
+    case midi::OpType::Controller:
+        if (op.index == AllSoundOff) {
+            ProcessNote(EventKind::NoteChoke, time, -1, NoNoteId, op.channel, 0.0f);
+
+        } else if (op.index == AllNotesOff) {
+            ProcessNote(EventKind::NoteOff, time, -1, NoNoteId, op.channel, 0.0f);
+
+        } else if (op.index == ResetAllControllers) {
+            channel_pitch_bend[op.channel] = 0.0f;
+            UpdateVoicePitches(-1, op.channel);
+
+        } else {
+            for (const auto& mapping : ControllerParams) {
+                if (mapping.controller != op.index || mapping.param_id >= NumParams) {
+                    continue;
+                }
+
+                const auto& spec = ParamSpecs[mapping.param_id];
+
+                const auto value = spec.min_value +
+                                   op.value * (spec.max_value - spec.min_value);
+
+                SetAudioParam(mapping.param_id, static_cast<float>(value));
+
+                // The host needs to know about changes it didn't make
+                pending_out_events.StageParamValue(mapping.param_id,
+                                                   audio_params[mapping.param_id],
+                                                   time);
+            }
+        }
+        break;
+
+    case midi::OpType::PitchBend:
+        channel_pitch_bend[op.channel] = op.value * PitchBendRange;
+        UpdateVoicePitches(-1, op.channel);
+        break;
+
+    case midi::OpType::PerNotePitchBend:
+    case midi::OpType::PerNotePitch:
+        voices.ForEachMatching(op.key, NoNoteId, op.channel, [&](const uint32_t slot) {
+            auto& voice = voices.Slot(slot);
+
+            // The absolute pitch replaces the tuning of the key
+            voice.pitch_bend = (op.type == midi::OpType::PerNotePitchBend)
+                                   ? op.value * PerNotePitchBendRange
+                                   : op.value - voice.key -
+                                         tuning_table.Offset(voice.channel, voice.key);
+
+            UpdateVoicePitch(slot);
+            return true;
+        });
+        break;
+
+    // Pressure drives the pressure expression, like in MPE
+    case midi::OpType::PolyPressure:
+    case midi::OpType::ChannelPressure: {
+        auto& target = voices.State().expression_target[ExpressionPressure];
+
+        voices.ForEachMatching(op.key, NoNoteId, op.channel, [&](const uint32_t slot) {
+            target[voices.IndexOf(slot)] = op.value;
+            return true;
+        });
+    } break;
+
+    case midi::OpType::None: break;
+    }
+}
+
+std::optional<MyPlugin::Expression> MyPlugin::ToExpression(
+    const clap_note_expression id)
+{
+    switch (id) {
+    case CLAP_NOTE_EXPRESSION_VOLUME: return ExpressionVolume;
+    case CLAP_NOTE_EXPRESSION_PAN: return ExpressionPan;
+    case CLAP_NOTE_EXPRESSION_TUNING: return ExpressionTuning;
+    case CLAP_NOTE_EXPRESSION_BRIGHTNESS: return ExpressionBrightness;
+    case CLAP_NOTE_EXPRESSION_PRESSURE: return ExpressionPressure;
+    default: return {};
+    }
+}
+
+float MyPlugin::VoicePitchBend(const Voice& voice) const
+{
+    const auto channel_bend = (voice.channel >= 0 && voice.channel < NumMidiChannels)
+                                  ? channel_pitch_bend[voice.channel]
+                                  : 0.0f;
+
+    return voice.pitch_bend + channel_bend;
+}
+
+void MyPlugin::UpdateVoicePitch(const uint32_t slot)
+{
+    auto& state       = voices.State();
+    const auto index  = voices.IndexOf(slot);
+    const auto& voice = voices.Slot(slot);
+
+    state.base_phase_inc[index] = tuning_table.PhaseIncrement(voice.channel, voice.key);
+    state.pitch_bend[index]     = VoicePitchBend(voice);
+
+    RetuneVoice(index, audio_params[ParamTune]);
+}
+
+void MyPlugin::RetuneVoice(const uint32_t index, const float tune)
+{
+    auto& state = voices.State();
+
+    state.transpose[index] = state.pitch_bend[index] +
+                             state.expression[ExpressionTuning][index] + tune +
+                             state.modulation[TuneLane][index];
+
+    state.phase_inc[index] = state.base_phase_inc[index] *
+                             TuningTable::SemitoneRatio(state.transpose[index]);
+}
+
+void MyPlugin::UpdateVoicePitches(const int16_t key, const int16_t channel)
+{
+    voices.ForEachMatching(key, -1, channel, [&](const uint32_t slot) {
+        UpdateVoicePitch(slot);
+        return true;
+    });
+}
+
+template <typename T, MyPlugin::Waveform W>
+void MyPlugin::RenderAudio(const uint32_t num_frames, T* const* out,
+                           const bool add_to_output)
+{
+    // Blocks are cut on a fixed grid of `render_block_size` frames from the
+    // start of the stream, so the block-rate processing doesn't depend on
+    // how the host splits its buffers or where the events fall. Splits at
+    // events just shorten the blocks they fall into.
+    const auto grid_pos = render_scheduler.GridPosition();
+
+    for (uint32_t offset = 0, block_size = 0; offset < num_frames; offset += block_size) {
+        const auto grid_offset = static_cast<uint32_t>((grid_pos + offset) %
+                                                       render_block_size);
+
+        const auto to_grid = render_block_size - grid_offset;
+
+        block_size = std::min(num_frames - offset, to_grid);
+
+        // The voices are mixed right where they go in the host's buffers,
+        // unless there's an input in them to add the mix to
+        T* mix[NumMixChannels] = {GetMixBuffer<T>(0), GetMixBuffer<T>(1)};
+
+        if (out && !add_to_output) {
+            for (uint32_t c = 0; c < num_render_channels; ++c) {
+                mix[c] = out[c] + offset;
+            }
+        }
+
+        const auto controls = MakeBlockControls(block_size);
+
+        const auto num_voices = voices.Size();
+        const auto num_groups = std::min(num_voices / MinVoicesPerGroup,
+                                         MaxVoiceGroups);
+
+        // Batched instances may be running on a pool thread already, and
+        // pool requests can't be nested
+        const auto have_threads = !is_batched &&
+                                  (host_thread_pool || worker_pool.NumWorkers() > 0);
+
+        bool rendered = false;
+
+        // Summing the groups rounds differently than mixing all voices in
+        // one go, so deterministic renders always mix in groups, with or
+        // without threads
+        if ((have_threads || is_deterministic) && num_groups > 1) {
+            render_job = {.num_frames   = block_size,
+                          .num_groups   = num_groups,
+                          .controls     = controls,
+                          .render_group = &MyPlugin::RenderVoiceGroup<T, W>};
+
+            // Both block until all groups have been rendered
+            if (have_threads && host_thread_pool) {
+                rendered = host_thread_pool->request_exec(host, num_groups);
+
+            } else if (have_threads) {
+                worker_pool.Run(num_groups);
+                rendered = true;
+            }
+
+            // The same groups, one after the other
+            if (!rendered && is_deterministic) {
+                for (uint32_t group = 0; group < num_groups; ++group) {
+                    RenderVoiceGroup<T, W>(group);
+                }
+                rendered = true;
+            }
+
+            if (rendered) {
+                for (uint32_t c = 0; c < num_render_channels; ++c) {
+                    std::copy_n(GetGroupMixBuffer<T>(0, c), block_size, mix[c]);
+
+                    for (uint32_t group = 1; group < num_groups; ++group) {
+                        const auto group_mix = GetGroupMixBuffer<T>(group, c);
+
+                        dsp_kernels->For<T>().accumulate(mix[c], group_mix, block_size);
+                    }
+                }
+            }
+        }
+
+        // There are no threads to use, or the host has rejected our request
+        if (!rendered) {
+            RenderVoices<T, W>(
+                mix, GetGroupSampleBuffer(0), 0, num_voices, block_size, controls);
+        }
+
+        if (!out) {
+            frame_ledger.AddRendered(
+                GetRenderBuffer<T>().Write(mix[0], mix[1], block_size));
+
+        } else {
+            if (add_to_output) {
+                for (uint32_t c = 0; c < num_render_channels; ++c) {
+                    dsp_kernels->For<T>().accumulate(out[c] + offset, mix[c], block_size);
+                }
+            }
+            frame_ledger.AddRendered(block_size);
+        }
+
+        // Stopping a voice moves another one into its place, which changes
+        // the order of the mix and the voice groups. Deterministic renders
+        // can't have that happen wherever the host's blocks end.
+        if (is_deterministic) {
+            StopFinishedVoices();
+        }
+    }
+
+    render_scheduler.AddRenderedFrames(num_frames);
+
+    // Underruns are logged on the main thread
+    if constexpr (W == Waveform::Sample) {
+        const auto num_underruns = sample_streamer.NumUnderruns();
+
+        if (num_underruns != num_signalled_underruns) {
+            num_signalled_underruns = num_underruns;
+            host->request_callback(host);
+        }
+    }
+}
+
+void MyPlugin::ExecThreadPoolTask(const uint32_t task_index)
+{
+    // The floating-point mode is per thread, and the pool's threads don't
+    // inherit it from the audio thread
+    const ScopedFlushDenormals flush_denormals = {};
+
+    if (batch_job.count > 0) {
+        ExecBatchTask(task_index);
+        return;
+    }
+
+    (this->*render_job.render_group)(task_index);
+}
+
+void MyPlugin::ProcessBatch(MyPlugin* const* plugins,
+                            const clap_process_t* const* processes,
+                            clap_process_status* statuses, const uint32_t count)
+{
+    assert(count <= MaxBatchSize);
+
+    if (count == 0) {
+        return;
+    }
+
+    // Instances with the same configuration run the same render path with
+    // the same shared tables, so they're processed back to back, which keeps
+    // both in the caches. Hosts tend to pass their instances in the same
+    // order every time, so the sort mostly finds them in place.
+    const auto config_of = [&](const uint32_t i) {
+        const auto& plugin = *plugins[i];
+
+        return std::tuple(plugin.waveform,
+                          plugin.resample_mode,
+                          plugin.render_sample_rate_hz,
+                          plugin.num_render_channels);
+    };
+
+    std::array<uint32_t, MaxBatchSize> order = {};
+    std::iota(order.begin(), order.begin() + count, 0u);
+
+    std::sort(order.begin(), order.begin() + count, [&](const uint32_t a, const uint32_t b) {
+        const auto config_a = config_of(a);
+        const auto config_b = config_of(b);
+
+        return (config_a != config_b) ? config_a < config_b : a < b;
+    });
+
+    // The tasks get runs of consecutive instances, so each thread mostly
+    // stays within one group. More tasks than the pool's deques can hold
+    // wouldn't spread the load any better.
+    auto& lead = *plugins[0];
+
+    const auto num_tasks = std::min(count, MaxBatchTasks);
+
+    lead.batch_job = {.plugins   = plugins,
+                      .processes = processes,
+                      .statuses  = statuses,
+                      .order     = order.data(),
+                      .count     = count,
+                      .num_tasks = num_tasks};
+
+    bool processed = false;
+
+    if (num_tasks > 1) {
+        // Both block until all tasks have been run
+        if (lead.host_thread_pool) {
+            processed = lead.host_thread_pool->request_exec(lead.host, num_tasks);
+
+        } else if (lead.worker_pool.NumWorkers() > 0) {
+            lead.worker_pool.Run(num_tasks);
+            processed = true;
+        }
+    }
+
+    // There are no threads to use, or the host has rejected our request
+    if (!processed) {
+        for (uint32_t task = 0; task < num_tasks; ++task) {
+            lead.ExecBatchTask(task);
+        }
+    }
+
+    lead.batch_job = {};
+}
+
+void MyPlugin::ExecBatchTask(const uint32_t task_index)
+{
+    const auto& job = batch_job;
+
+    const auto first = static_cast<uint32_t>(uint64_t{job.count} * task_index /
+                                             job.num_tasks);
+    const auto last  = static_cast<uint32_t>(uint64_t{job.count} * (task_index + 1) /
+                                            job.num_tasks);
+
+    for (uint32_t k = first; k < last; ++k) {
+        const auto i = job.order[k];
+        auto& plugin = *job.plugins[i];
+
+        plugin.is_batched = true;
+        job.statuses[i]   = plugin.Process(job.processes[i]);
+        plugin.is_batched = false;
+    }
+}
+
+template <typename T, MyPlugin::Waveform W>
+void MyPlugin::RenderVoiceGroup(const uint32_t group)
+{
+    const auto& job = render_job;
+
+    // Spread the voices as evenly as possible across the groups. Each voice
+    // belongs to exactly one group, so the tasks never touch the same voice.
+    const auto num_voices  = voices.Size();
+    const auto first_voice = num_voices * group / job.num_groups;
+    const auto last_voice  = num_voices * (group + 1) / job.num_groups;
+
+    T* const mix[NumMixChannels] = {GetGroupMixBuffer<T>(group, 0),
+                                    GetGroupMixBuffer<T>(group, 1)};
+
+    RenderVoices<T, W>(mix,
+                       GetGroupSampleBuffer(group),
+                       first_voice,
+                       last_voice,
+                       job.num_frames,
+                       job.controls);
+}
+
+MyPlugin::BlockControls MyPlugin::MakeBlockControls(const uint32_t num_frames)
+{
+    // Advance the smoothed parameters once for the whole block; all voices
+    // share the same ramps. Likewise, the envelope coefficients and the
+    // expression smoothing only depend on the block size.
+    const auto volume_ramp = param_smoothers[ParamVolume].Next(num_frames);
+    const auto pan_ramp    = param_smoothers[ParamPan].Next(num_frames);
+    const auto tune_ramp   = param_smoothers[ParamTune].Next(num_frames);
+
+    const EnvelopeBlock envelope({.attack_ms  = audio_params[ParamAttack],
+                                  .decay_ms   = audio_params[ParamDecay],
+                                  .sustain    = audio_params[ParamSustain],
+                                  .release_ms = audio_params[ParamRelease]},
+                                 render_sample_rate_hz,
+                                 num_frames);
+
+    // Note expressions use the same time constant as parameters
+    const auto smoothing_frames = ParamSmoothingTimeMs * render_sample_rate_hz /
+                                  1000.0;
+
+    const auto expression_coeff = static_cast<float>(
+        1.0 - std::exp(-(num_frames / smoothing_frames)));
+
+    // Routes from the matrix slots. Amounts are relative to the range of
+    // their destination.
+    ModMatrix matrix = {};
+
+    for (uint32_t slot = 0; slot < NumModSlots; ++slot) {
+        const auto first = ParamModSlots + slot * ModSlotParams;
+
+        const auto source = std::clamp(static_cast<int>(audio_params[first]),
+                                       0,
+                                       static_cast<int>(mod::NumSources) - 1);
+
+        const auto lane = std::clamp(static_cast<int>(audio_params[first + 1]),
+                                     0,
+                                     static_cast<int>(NumPolyParams) - 1);
+
+        const auto& destination = ParamSpecs[PolyParamIds[lane]];
+
+        const auto range = destination.max_value - destination.min_value;
+
+        matrix.Add({.source = static_cast<mod::Source>(source),
+                    .lane   = static_cast<uint32_t>(lane),
+                    .amount = static_cast<float>(audio_params[first + 2] * range)});
+    }
+
+    // The LFOs are evaluated at the end of the block, and so is the song
+    // position they follow
+    transport_clock.Advance(num_frames);
+
+    const auto lfo_rate_hz = audio_params[ParamLfoRate];
+
+    const auto lfo_sync = static_cast<LfoSync>(std::clamp(
+        static_cast<int>(audio_params[ParamLfoSync]), 0, NumLfoSyncs - 1));
+
+    const auto lfo_retrigger = static_cast<LfoRetrigger>(
+        std::clamp(static_cast<int>(audio_params[ParamLfoRetrigger]),
+                   0,
+                   NumLfoRetriggers - 1));
+
+    const auto lfo_period = LfoPeriod(lfo_sync);
+
+    using LfoTiming = BlockControls::LfoTiming;
+
+    auto lfo_timing = (lfo_period > 0) ? LfoTiming::SyncedToNote : LfoTiming::Free;
+    auto lfo_phase  = 0.0f;
+
+    if (lfo_retrigger == LfoRetrigger::Bar) {
+        // The host may have jumped to just before the bar it reports
+        const auto since_bar = std::max<clap_beattime>(
+            transport_clock.Position() - transport_clock.BarStart(), 0);
+
+        if (lfo_period > 0) {
+            lfo_phase = static_cast<float>(static_cast<double>(since_bar % lfo_period) /
+                                           lfo_period);
+        } else {
+            // Free-running LFOs take the time since the bar line at the
+            // current tempo
+            const auto seconds = TransportClock::ToBeats(since_bar) * 60.0 /
+                                 transport_clock.TempoBpm();
+
+            const auto cycles = seconds * lfo_rate_hz;
+
+            lfo_phase = static_cast<float>(cycles - std::floor(cycles));
+        }
+        lfo_timing = LfoTiming::SyncedToBar;
+    }
+
+    const auto lfo_phase_inc = static_cast<float>(lfo_rate_hz * num_frames /
+                                                  render_sample_rate_hz);
+
+    return {.volume_ramp      = volume_ramp,
+            .pan_ramp         = pan_ramp,
+            .envelope         = envelope,
+            .tune             = tune_ramp.end,
+            .expression_coeff = expression_coeff,
+            .lfo_timing       = lfo_timing,
+            .lfo_phase_inc    = lfo_phase_inc,
+            .lfo_position     = transport_clock.Position(),
+            .lfo_period       = lfo_period,
+            .lfo_phase        = lfo_phase,
+            .matrix           = matrix};
+}
+
+clap_beattime MyPlugin::LfoPeriod(const LfoSync sync) const
+{
+    constexpr auto Beat = CLAP_BEATTIME_FACTOR;
+
+    const auto bar = transport_clock.BarLength();
+
+    switch (sync) {
+    case LfoSync::FourBars: return bar * 4;
+    case LfoSync::TwoBars: return bar * 2;
+    case LfoSync::OneBar: return bar;
+    case LfoSync::Half: return Beat * 2;
+    case LfoSync::Quarter: return Beat;
+    case LfoSync::Eighth: return Beat / 2;
+    case LfoSync::Sixteenth: return Beat / 4;
+    case LfoSync::ThirtySecond: return Beat / 8;
+    default: return 0;
+    }
+}
+
+const char* MyPlugin::ModDestinationName(const uint32_t lane)
+{
+    return (lane < NumPolyParams) ? ParamSpecs[PolyParamIds[lane]].name : nullptr;
+}
+
+// Constant-power pan law, normalised so a centred voice has unity gain in
+// both channels, just like before voices could be panned
+static std::array<float, 2> PanGains(const float pan)
+{
+    if (pan == 0.5f) {
+        return {1.0f, 1.0f};
+    }
+
+    const auto angle = std::clamp(pan, 0.0f, 1.0f) * static_cast<float>(M_PI_2);
+
+    return {static_cast<float>(M_SQRT2) * std::cos(angle),
+            static_cast<float>(M_SQRT2) * std::sin(angle)};
+}
+
+template <typename T, MyPlugin::Waveform W>
+void MyPlugin::RenderVoices(T* const* mix, float* sample_frames,
+                            const uint32_t first_voice, const uint32_t last_voice,
+                            const uint32_t num_frames, const BlockControls& controls)
+{
+    auto& state = voices.State();
+
+    const auto& volume_ramp = controls.volume_ramp;
+
+    auto& gain_start = state.gain_start;
+    auto& gain_end   = state.gain_end;
+
+    // The volume and pan expressions are applied as ramps over the block,
+    // so we need their values from before smoothing
+    auto& volume_expression = state.expression[ExpressionVolume];
+    auto& pan_expression    = state.expression[ExpressionPan];
+
+    std::copy(volume_expression.begin() + first_voice,
+              volume_expression.begin() + last_voice,
+              gain_start[0].begin() + first_voice);
+
+    std::copy(pan_expression.begin() + first_voice,
+              pan_expression.begin() + last_voice,
+              gain_start[1].begin() + first_voice);
+
+    // Move the expressions towards their targets. Every expression is a
+    // separate array, so these loops are vectorised across voices. The ones
+    // that return to zero would decay into subnormals, so they're flushed.
+    for (uint32_t e = 0; e < NumExpressions; ++e) {
+        auto value        = state.expression[e].data();
+        const auto target = state.expression_target[e].data();
+
+        for (uint32_t i = first_voice; i < last_voice; ++i) {
+            value[i] = FlushDenormal(value[i] +
+                                     (target[i] - value[i]) * controls.expression_coeff);
+        }
+    }
+
+    // The panning expression has to arrive at the exact centre again for
+    // the mono fast path below to kick in
+    for (uint32_t i = first_voice; i < last_voice; ++i) {
+        const auto& target = state.expression_target[ExpressionPan];
+
+        constexpr auto PanSnap = 1e-4f;
+
+        if (std::abs(target[i] - pan_expression[i]) < PanSnap) {
+            pan_expression[i] = target[i];
+        }
+    }
+
+    // One-pole smoothing never quite gets there
+    auto& tuning              = state.expression[ExpressionTuning];
+    const auto& tuning_target = state.expression_target[ExpressionTuning];
+
+    for (uint32_t i = first_voice; i < last_voice; ++i) {
+        constexpr auto TuningSnapSemitones = 1e-4f;
+
+        if (std::abs(tuning_target[i] - tuning[i]) < TuningSnapSemitones) {
+            tuning[i] = tuning_target[i];
+        }
+    }
+
+    // Advance the modulation sources by the block. The LFOs are triangles
+    // starting at zero, which are cheap to evaluate for many voices at once.
+    auto& envelope_start = state.envelope_start;
+
+    for (uint32_t i = first_voice; i < last_voice; ++i) {
+        envelope_start[i]       = state.envelope_level[i];
+        state.envelope_level[i] = controls.envelope.Advance(state.envelope_stage[i],
+                                                            envelope_start[i]);
+    }
+
+    // Tempo synced LFOs aren't accumulated, but derived from the song
+    // position, so they never drift from the host's beat
+    using LfoTiming = BlockControls::LfoTiming;
+
+    auto& lfo_phase = state.lfo_phase;
+
+    switch (controls.lfo_timing) {
+    case LfoTiming::Free:
+        for (uint32_t i = first_voice; i < last_voice; ++i) {
+            const auto phase = lfo_phase[i] + controls.lfo_phase_inc;
+            lfo_phase[i]     = phase - std::floor(phase);
+        }
+        break;
+
+    case LfoTiming::SyncedToNote:
+        for (uint32_t i = first_voice; i < last_voice; ++i) {
+            auto elapsed = (controls.lfo_position - state.lfo_start[i]) %
+                           controls.lfo_period;
+
+            // The host has jumped back to before the note on
+            if (elapsed < 0) {
+                elapsed += controls.lfo_period;
+            }
+            lfo_phase[i] = static_cast<float>(static_cast<double>(elapsed) /
+                                              controls.lfo_period);
+        }
+        break;
+
+    case LfoTiming::SyncedToBar:
+        std::fill(lfo_phase.begin() + first_voice,
+                  lfo_phase.begin() + last_voice,
+                  controls.lfo_phase);
+        break;
+    }
+
+    for (uint32_t i = first_voice; i < last_voice; ++i) {
+        auto shifted = lfo_phase[i] + 0.25f;
+        shifted -= std::floor(shifted);
+
+        state.lfo[i] = 1.0f - 4.0f * std::abs(shifted - 0.5f);
+    }
+
+    // Evaluate the modulation matrix, keeping the previous block's
+    // modulation to ramp from
+    std::array<const float*, NumPolyParams> mod_base = {};
+    std::array<float*, NumPolyParams> mod_out        = {};
+
+    for (uint32_t lane = 0; lane < NumPolyParams; ++lane) {
+        std::copy(state.modulation[lane].begin() + first_voice,
+                  state.modulation[lane].begin() + last_voice,
+                  state.modulation_start[lane].begin() + first_voice);
+
+        mod_base[lane] = state.param_mod[lane].data();
+        mod_out[lane]  = state.modulation[lane].data();
+    }
+
+    mod::SourceArrays sources = {};
+
+    sources[static_cast<uint32_t>(mod::Source::Envelope)]   = state.envelope_level.data();
+    sources[static_cast<uint32_t>(mod::Source::Lfo)]        = state.lfo.data();
+    sources[static_cast<uint32_t>(mod::Source::Velocity)]   = state.velocity.data();
+    sources[static_cast<uint32_t>(mod::Source::Key)]        = state.key_track.data();
+    sources[static_cast<uint32_t>(mod::Source::Brightness)] =
+        state.expression[ExpressionBrightness].data();
+    sources[static_cast<uint32_t>(mod::Source::Pressure)] =
+        state.expression[ExpressionPressure].data();
+
+    controls.matrix.Evaluate(sources, mod_base, mod_out, first_voice, last_voice);
+
+    // Retune the voices whose transposition has changed, whether by the
+    // tuning expression, the tune parameter or pitch modulation
+    for (uint32_t i = first_voice; i < last_voice; ++i) {
+        const auto transpose = state.pitch_bend[i] + tuning[i] + controls.tune +
+                               state.modulation[TuneLane][i];
+
+        if (transpose != state.transpose[i]) {
+            RetuneVoice(i, controls.tune);
+        }
+    }
+
+    // Fold each voice's envelope levels at both ends of the block, the volume
+    // and pan expressions and the modulation into the per-channel ramp
+    // endpoints. The endpoints are constant for the duration of the block,
+    // so we only need to calculate them once per voice instead of for every
+    // sample.
+    //
+    // The gain moves in a straight line between them, so a voice that's
+    // silent at both ends is silent for the whole block: released voices
+    // that are about to end, voices at zero volume, and so on. Only the
+    // audible voices are passed on to the render kernels, packed at the
+    // start of the group's range, so the per-sample work is proportional to
+    // what can actually be heard. The block-rate state above keeps being
+    // updated for every voice, so a voice is back in the render set as soon
+    // as its gain rises again, e.g. through modulation or an expression.
+    auto& audible_voice     = state.audible_voice;
+    auto& audible_phase     = state.audible_phase;
+    auto& audible_phase_inc = state.audible_phase_inc;
+
+    uint32_t num_audible = 0;
+
+    const auto& volume_start = state.modulation_start[VolumeLane];
+    const auto& volume_end   = state.modulation[VolumeLane];
+    const auto& pan_start    = state.modulation_start[PanLane];
+    const auto& pan_end      = state.modulation[PanLane];
+
+    const auto& pan_ramp = controls.pan_ramp;
+
+    const auto is_mono = (num_render_channels == 1);
+
+    bool all_centred = true;
+
+    for (uint32_t i = first_voice; i < last_voice; ++i) {
+        const auto start = 0.2f * envelope_start[i] * gain_start[0][i] *
+                           std::clamp(volume_ramp.start + volume_start[i], 0.0f, 1.0f);
+
+        const auto end = 0.2f * state.envelope_level[i] * volume_expression[i] *
+                         std::clamp(volume_ramp.end + volume_end[i], 0.0f, 1.0f);
+
+        if (std::max(std::abs(start), std::abs(end)) < SilentVoiceGain) {
+            // Nobody can hear where the oscillator is, but it has to be in
+            // the right place when the voice becomes audible again
+            const auto next_phase = state.phase[i] +
+                                    static_cast<double>(state.phase_inc[i]) * num_frames;
+
+            state.phase[i] = static_cast<float>(next_phase - std::floor(next_phase));
+
+            if constexpr (W == Waveform::Sample) {
+                if (sample_frames) {
+                    SkipSample(i, num_frames);
+                }
+            }
+            continue;
+        }
+
+        // Never ahead of `i`, so this doesn't overwrite anything that's yet
+        // to be read
+        const auto k = first_voice + num_audible++;
+
+        audible_voice[k]     = i;
+        audible_phase[k]     = state.phase[i];
+        audible_phase_inc[k] = state.phase_inc[i];
+
+        // The pan parameter is bipolar, the expression is not. A mono output
+        // renders every voice as if it were centred.
+        auto pan_from = gain_start[1][i] + 0.5f * (pan_ramp.start + pan_start[i]);
+        auto pan_to   = pan_expression[i] + 0.5f * (pan_ramp.end + pan_end[i]);
+
+        if (is_mono) {
+            pan_from = 0.5f;
+            pan_to   = 0.5f;
+        }
+
+        all_centred = all_centred && (pan_from == 0.5f) && (pan_to == 0.5f);
+
+        const auto [left_start, right_start] = PanGains(pan_from);
+        const auto [left_end, right_end]     = PanGains(pan_to);
+
+        gain_start[0][k] = start * left_start;
+        gain_start[1][k] = start * right_start;
+        gain_end[0][k]   = end * left_end;
+        gain_end[1][k]   = end * right_end;
+    }
+
+    // The channels of a stereo sample differ even for centred voices
+    if constexpr (W == Waveform::Sample) {
+        if (sample_frames && !is_mono && sample_file->NumChannels() > 1) {
+            all_centred = false;
+        }
+    }
+
+    const auto num_voices = num_audible;
+
+    auto phase     = audible_phase.data() + first_voice;
+    auto phase_inc = audible_phase_inc.data() + first_voice;
+
+    const float* const starts[NumMixChannels] = {gain_start[0].data() + first_voice,
+                                                 gain_start[1].data() + first_voice};
+
+    const float* const ends[NumMixChannels] = {gain_end[0].data() + first_voice,
+                                               gain_end[1].data() + first_voice};
+
+    const auto render_voices = [&](const kernels::Shape shape, const uint32_t num_channels) {
+        return dsp_kernels->For<T>().RenderVoices(shape, num_channels);
+    };
+
+    // Unless something is panned, both channels are the same, so we only
+    // render the left one and copy it. A mono output only needs that one.
+    const auto render = [&]<uint32_t NumChannels>() {
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            std::fill_n(mix[c], num_frames, T{});
+        }
+
+        if constexpr (W == Waveform::Sine) {
+            render_voices(kernels::Shape::Sine, NumChannels)(
+                mix, num_frames, num_voices, phase, phase_inc, starts, ends);
+
+        } else if constexpr (W == Waveform::Triangle) {
+            // The band-limited table doesn't alias even at low render rates.
+            // Every voice reads its own mip level, so they're rendered one by
+            // one.
+            for (uint32_t i = 0; i < num_voices; ++i) {
+                const auto table = triangle_table->Level(
+                    triangle_table->LevelFor(phase_inc[i]));
+
+                const float start[NumMixChannels] = {starts[0][i], starts[1][i]};
+                const float end[NumMixChannels]   = {ends[0][i], ends[1][i]};
+
+                osc::RenderWavetable<NumChannels>(mix,
+                                                  num_frames,
+                                                  phase[i],
+                                                  phase_inc[i],
+                                                  start,
+                                                  end,
+                                                  table,
+                                                  Wavetable::TableSize);
+            }
+
+        } else if constexpr (W == Waveform::Saw) {
+            // The PolyBLEP corrections keep the aliasing of the harmonically
+            // richer shapes down at the low render rate
+            render_voices(kernels::Shape::Saw, NumChannels)(
+                mix, num_frames, num_voices, phase, phase_inc, starts, ends);
+
+        } else if constexpr (W == Waveform::Square) {
+            render_voices(kernels::Shape::Square, NumChannels)(
+                mix, num_frames, num_voices, phase, phase_inc, starts, ends);
+
+        } else if constexpr (W == Waveform::Sample) {
+            // Every voice reads from a stream of its own, so they're played
+            // one by one. Without a sample, there's nothing to play.
+            for (uint32_t i = 0; sample_frames && i < num_voices; ++i) {
+                const float start[NumMixChannels] = {starts[0][i], starts[1][i]};
+                const float end[NumMixChannels]   = {ends[0][i], ends[1][i]};
+
+                RenderSampleVoice<NumChannels>(mix,
+                                               sample_frames,
+                                               audible_voice[first_voice + i],
+                                               num_frames,
+                                               start,
+                                               end);
+            }
+        }
+    };
+
+    if (all_centred) {
+        render.template operator()<1>();
+
+        if (!is_mono) {
+            std::copy_n(mix[0], num_frames, mix[1]);
+        }
+    } else {
+        render.template operator()<NumMixChannels>();
+    }
+
+    for (uint32_t k = first_voice; k < first_voice + num_audible; ++k) {
+        state.phase[audible_voice[k]] = audible_phase[k];
+    }
+}
+
+template <uint32_t NumChannels, typename T>
+void MyPlugin::RenderSampleVoice(T* const* mix, float* sample_frames, const uint32_t index,
+                                 const uint32_t num_frames, const float* gain_start,
+                                 const float* gain_end)
+{
+    auto& state = voices.State();
+    auto& pos   = state.sample_pos[index];
+
+    const auto stream       = voices.SlotOf(index);
+    const auto num_channels = sample_file->NumChannels();
+    const auto end_frame    = sample_file->NumFrames();
+    const auto inc          = SampleIncrement(state.phase_inc[index]);
+
+    // The scratch buffer holds the frames of a run, including the ones on
+    // both sides of the first and last positions, so the faster the voice
+    // moves through the sample, the shorter the runs
+    const auto max_run = static_cast<uint32_t>(
+        std::min<double>(num_frames, (SampleScratchFrames - 3) / inc));
+
+    for (uint32_t offset = 0; offset < num_frames && pos < end_frame;) {
+        const auto n = std::min(num_frames - offset, max_run);
+
+        const auto first = static_cast<uint32_t>(pos);
+        const auto last  = static_cast<uint32_t>(pos + inc * (n - 1)) + 1;
+
+        sample_streamer.Read(
+            stream, first, last - first + 1, sample_frames, sample_reads_may_block);
+
+        // The gains ramp over the whole block
+        float start[NumChannels] = {};
+        float end[NumChannels]   = {};
+        T* out[NumChannels]      = {};
+
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            const auto delta = (gain_end[c] - gain_start[c]) / num_frames;
+
+            start[c] = gain_start[c] + delta * offset;
+            end[c]   = gain_start[c] + delta * (offset + n);
+            out[c]   = mix[c] + offset;
+        }
+
+        osc::RenderSample<NumChannels>(
+            out, n, pos, inc, start, end, sample_frames, first, num_channels);
+
+        offset += n;
+    }
+
+    // Played to the end; the voice is stopped with the finished releases
+    if (pos >= end_frame) {
+        state.envelope_stage[index] = EnvelopeStage::Done;
+    }
+}
+
+void MyPlugin::SkipSample(const uint32_t index, const uint32_t num_frames)
+{
+    auto& state = voices.State();
+    auto& pos   = state.sample_pos[index];
+
+    const auto end_frame = sample_file->NumFrames();
+
+    pos += SampleIncrement(state.phase_inc[index]) * num_frames;
+
+    if (pos >= end_frame) {
+        state.envelope_stage[index] = EnvelopeStage::Done;
+    }
+
+    // The stream doesn't have to hold on to what's been skipped
+    const auto first = std::min(pos, static_cast<double>(end_frame));
+
+    sample_streamer.Skip(voices.SlotOf(index), static_cast<uint32_t>(first));
+}
+
+template <typename S, typename T>
+void MyPlugin::PublishFrames(const S* frames, const uint32_t num_frames,
+                             T* out_left, T* out_right, const bool add_to_output)
+{
+    if (add_to_output) {
+        const auto stride = (num_render_channels == 1) ? 0 : 1;
+
+        for (uint32_t i = 0; i < num_frames; ++i) {
+            out_left[i] += frames[i * (1 + stride)];
+        }
+        if (out_right) {
+            for (uint32_t i = 0; i < num_frames; ++i) {
+                out_right[i] += frames[i * (1 + stride) + stride];
+            }
+        }
+
+    } else if (num_render_channels == 1) {
+        // The mono mix goes to both channels of a stereo output. When
+        // resampling to single precision output, the mix has been written
+        // straight to the left channel already.
+        if constexpr (std::is_same_v<S, T>) {
+            if (frames != out_left) {
+                std::copy_n(frames, num_frames, out_left);
+            }
+        } else {
+            std::copy_n(frames, num_frames, out_left);
+        }
+        if (out_right) {
+            std::copy_n(out_left, num_frames, out_right);
+        }
+
+    } else {
+        for (uint32_t i = 0; i < num_frames; ++i) {
+            out_left[i]  = frames[i * 2];
+            out_right[i] = frames[i * 2 + 1];
+        }
+    }
+}
+
+uint32_t MyPlugin::Resample(float* out, const uint32_t num_out_frames)
+{
+    // A single interleaved call processes all channels with one set of
+    // bookkeeping. In mono mode, this is the same as processing channel 0.
+    auto in_len  = static_cast<uint32_t>(render_buf.Size());
+    auto out_len = num_out_frames;
+
+    resampler->Process(render_buf.Read(), in_len, out, out_len);
+
+    // The resampler returns the number actually consumed and written frames in
+    // `in_len` and `out_len`, respectively. We only need to advance the
+    // read cursor of the render buffer past the consumed frames; the
+    // leftover (if any) stays in place for the next call.
+    render_buf.Consume(in_len);
+
+    frame_ledger.AddConsumed(in_len);
+
+    return out_len;
+}
+
+ResamplerType MyPlugin::GetResamplerTypeParam(const float value)
+{
+    return static_cast<ResamplerType>(
+        std::clamp(static_cast<int>(value), 0, NumResamplerTypes - 1));
+}
+
+ResamplerType MyPlugin::SelectResamplerType(const float quality)
+{
+    const auto type = GetResamplerTypeParam(quality);
+
+    // Deterministic renders need a backend that can start at any phase;
+    // Speex can't, and polyphase is the closest in quality
+    if (is_deterministic) {
+        const auto is_speex = (type == ResamplerType::Speex ||
+                               type == ResamplerType::SpeexBest);
+
+        return is_speex ? ResamplerType::Polyphase : type;
+    }
+    return (render_mode == RenderMode::Offline) ? ResamplerType::SpeexBest : type;
+}
+
+const char* MyPlugin::ToString(const RenderRate rate)
+{
+    switch (rate) {
+    case RenderRate::Default: return "Default";
+    case RenderRate::Quarter: return "1/4x";
+    case RenderRate::Half: return "1/2x";
+    case RenderRate::Host: return "1x";
+    case RenderRate::Double: return "2x";
+    case RenderRate::Quadruple: return "4x";
+    default: return "Unknown";
+    }
+}
+
+const char* MyPlugin::ToString(const LfoSync sync)
+{
+    switch (sync) {
+    case LfoSync::Off: return "Off";
+    case LfoSync::FourBars: return "4 Bars";
+    case LfoSync::TwoBars: return "2 Bars";
+    case LfoSync::OneBar: return "1 Bar";
+    case LfoSync::Half: return "1/2";
+    case LfoSync::Quarter: return "1/4";
+    case LfoSync::Eighth: return "1/8";
+    case LfoSync::Sixteenth: return "1/16";
+    case LfoSync::ThirtySecond: return "1/32";
+    default: return "Unknown";
+    }
+}
+
+const char* MyPlugin::ToString(const LfoRetrigger retrigger)
+{
+    switch (retrigger) {
+    case LfoRetrigger::Note: return "Note";
+    case LfoRetrigger::Bar: return "Bar";
+    default: return "Unknown";
+    }
+}
+
+MyPlugin::RenderRate MyPlugin::GetRenderRateParam(const float value)
+{
+    return static_cast<RenderRate>(
+        std::clamp(static_cast<int>(value), 0, NumRenderRates - 1));
+}
+
+double MyPlugin::RenderRateHz(const RenderRate rate, const double output_rate_hz) const
+{
+    switch (rate) {
+    case RenderRate::Quarter: return output_rate_hz * 0.25;
+    case RenderRate::Half: return output_rate_hz * 0.5;
+    case RenderRate::Host: return output_rate_hz;
+    case RenderRate::Double: return output_rate_hz * 2.0;
+    case RenderRate::Quadruple: return output_rate_hz * 4.0;
+
+    case RenderRate::Default:
+    default: return has_fixed_render_rate ? RenderSampleRateHz : output_rate_hz;
+    }
+}
+
+void MyPlugin::RequestRestartIfRenderSetupChanged()
+{
+    if (!is_active || restart_requested) {
+        return;
+    }
+
+    // A different render rate or resampler backend means a different
+    // latency, and that can only be changed by reactivating the plugin.
+    // Until the host gets around to it, we carry on with the current setup.
+    auto changed = GetRenderRateParam(audio_params[ParamRenderRate]) !=
+                   render_rate;
+
+    // The quality parameter has no effect offline; see SelectResamplerType()
+    if (resampler) {
+        const auto new_type = SelectResamplerType(audio_params[ParamResampleQuality]);
+
+        changed = changed || (new_type != resampler_type);
+    }
+
+    if (changed) {
+        host->request_restart(host);
+        restart_requested = true;
+
+        render_setup_pending.store(true, std::memory_order_relaxed);
+        host->request_callback(host);
+    }
+}
+
+void MyPlugin::PrepareRenderSetup()
+{
+    // The audio thread has had the new values for a while
+    SyncAudioParamsToMain();
+
+    // The same choices as Activate() will make, as far as we can tell now
+    const auto sample_rate = output_sample_rate_hz;
+
+    const auto render_rate_hz = RenderRateHz(
+        GetRenderRateParam(main_params[ParamRenderRate]), sample_rate);
+
+    if (sample_rate <= 0.0 || render_rate_hz == sample_rate) {
+        return;
+    }
+
+    const auto type = SelectResamplerType(main_params[ParamResampleQuality]);
+
+    const auto num_channels = ports_layout.output_channels;
+
+    // Lives as long as the library
+    const auto simd = dsp_kernels;
+
+    // Nothing to build if it's the resampler we have
+    if (resampler && dsp_config && resampler->Type() == type &&
+        resampler->NumChannels() == num_channels && &resampler->SimdKernels() == simd &&
+        dsp_config->render_rate_hz == render_rate_hz) {
+        return;
+    }
+
+    background_worker::Post(
+        [handoff = prepared_resampler, type, num_channels, render_rate_hz, sample_rate,
+         simd] {
+            auto prepared = std::make_unique<PreparedResampler>(
+                PreparedResampler{.type         = type,
+                                  .num_channels = num_channels,
+                                  .in_rate_hz   = render_rate_hz,
+                                  .out_rate_hz  = sample_rate,
+                                  .simd         = simd});
+
+            prepared->resampler = CreateResampler(
+                type, num_channels, render_rate_hz, sample_rate, *simd);
+
+            if (prepared->resampler) {
+                handoff->Publish(std::move(prepared));
+            }
+        });
+}
+
+void MyPlugin::ResetRenderPipeline()
+{
+    render_buf.Clear();
+    render_buf64.Clear();
+
+    frame_ledger.Reset();
+
+    // Anywhere but in deterministic mode, the stream starts over
+    const auto position = is_deterministic ? stream_position : 0;
+
+    if (resampler) {
+        const auto num = resampler->RatioNum();
+        const auto den = resampler->RatioDen();
+
+        // Only Speex can't do this, and it's never used in deterministic
+        // mode; see SelectResamplerType()
+        resampler->ResetToPhase(static_cast<uint32_t>(position * num % den));
+
+        render_scheduler.Reset(
+            num, den, resampler->InputLatency(), render_lead, position);
+    } else {
+        render_scheduler.Reset(1, 1, 0, render_lead, position);
+    }
+
+    // The lead starts out silent
+    if (render_lead > 0) {
+        render_buf.WriteSilence(render_lead);
+
+        if (!resampler) {
+            render_buf64.WriteSilence(render_lead);
+        }
+        frame_ledger.AddRendered(render_lead);
+    }
+}
+
+uint32_t MyPlugin::OutputLatencyFrames() const
+{
+    if (!resampler) {
+        return render_lead;
+    }
+
+    // The lead is in render frames
+    const uint64_t num = resampler->RatioNum();
+    const uint64_t den = resampler->RatioDen();
+
+    return resampler->OutputLatency() +
+           static_cast<uint32_t>((render_lead * den + num / 2) / num);
+}
+
+template <typename T>
+void MyPlugin::ResampleAndPublishFrames(const uint32_t num_out_frames,
+                                        T* out_left, T* out_right,
+                                        const bool add_to_output)
+{
+    const auto num_channels = num_render_channels;
+
+    // The resampler only produces floats, so double precision output always
+    // goes through the scratch buffer
+    float* out = resample_buf.data();
+
+    if constexpr (std::is_same_v<T, float>) {
+        if (num_channels == 1 && !add_to_output) {
+            out = out_left;
+        }
+    }
+
+    // The scheduler has made sure the render buffer contains exactly the
+    // frames the resampler needs to fill the output buffer completely, so a
+    // single pass is always enough.
+    const auto resample_start = telemetry.Now();
+
+    const auto out_len = Resample(out, num_out_frames);
+
+    telemetry.AddStage(telemetry::Stage::Resample, resample_start);
+
+    assert(out_len == num_out_frames);
+
+    // Never leave garbage in the output if the above assumption is ever
+    // broken in release builds.
+    if (out_len < num_out_frames) {
+        std::fill(out + out_len * num_channels,
+                  out + num_out_frames * num_channels,
+                  0.0f);
+    }
+
+    const auto publish_start = telemetry.Now();
+
+    PublishFrames(out, num_out_frames, out_left, out_right, add_to_output);
+
+    telemetry.AddStage(telemetry::Stage::Publish, publish_start);
+
+    // The padding doesn't count
+    frame_ledger.AddPublished(std::min(out_len, num_out_frames));
+}
+
+template <typename T>
+bool MyPlugin::ReadInput(const clap_process_t* process, T* out_left, T* out_right)
+{
+    if (process->audio_inputs_count == 0) {
+        return false;
+    }
+
+    const auto& input = process->audio_inputs[0];
+
+    if (input.channel_count == 0 || (!input.data32 && !input.data64)) {
+        return false;
+    }
+
+    // A mono input feeds both channels
+    const auto right = (input.channel_count > 1) ? 1 : 0;
+
+    if (input.data64) {
+        DelayInput(input.data64[0],
+                   input.data64[right],
+                   out_left,
+                   out_right,
+                   process->frames_count);
+    } else {
+        DelayInput(input.data32[0],
+                   input.data32[right],
+                   out_left,
+                   out_right,
+                   process->frames_count);
+    }
+    return true;
+}
+
+template <typename S, typename T>
+void MyPlugin::DelayInput(const S* in_left, const S* in_right, T* out_left,
+                          T* out_right, const uint32_t num_frames)
+{
+    const auto delay_frames = static_cast<uint32_t>(input_delay[0].size());
+
+    // The downmix of a mono input is the input itself
+    const auto downmix = [&](const uint32_t i) {
+        return 0.5 * (static_cast<double>(in_left[i]) + in_right[i]);
+    };
+
+    if (delay_frames == 0) {
+        if (!out_right) {
+            for (uint32_t i = 0; i < num_frames; ++i) {
+                out_left[i] = static_cast<T>(downmix(i));
+            }
+            return;
+        }
+
+        // In place, the input already is where it needs to be
+        if constexpr (std::is_same_v<S, T>) {
+            if (in_left == out_left && in_right == out_right) {
+                return;
+            }
+        }
+        std::copy_n(in_left, num_frames, out_left);
+        std::copy_n(in_right, num_frames, out_right);
+        return;
+    }
+
+    // Every input frame is read before the output frame that may share its
+    // memory is written, so this works in place, too
+    auto& delay_left  = input_delay[0];
+    auto& delay_right = input_delay[1];
+    auto pos          = input_delay_pos;
+
+    if (!out_right) {
+        for (uint32_t i = 0; i < num_frames; ++i) {
+            const auto mono = downmix(i);
+
+            out_left[i]     = static_cast<T>(delay_left[pos]);
+            delay_left[pos] = mono;
+
+            pos = (pos + 1 == delay_frames) ? 0 : pos + 1;
+        }
+        input_delay_pos = pos;
+        return;
+    }
+
+    for (uint32_t i = 0; i < num_frames; ++i) {
+        const double left  = in_left[i];
+        const double right = in_right[i];
+
+        out_left[i]  = static_cast<T>(delay_left[pos]);
+        out_right[i] = static_cast<T>(delay_right[pos]);
+
+        delay_left[pos]  = left;
+        delay_right[pos] = right;
+
+        pos = (pos + 1 == delay_frames) ? 0 : pos + 1;
+    }
+    input_delay_pos = pos;
+}
+
+void MyPlugin::SendNoteEnd(const uint32_t time, const int16_t key,
+                           const int32_t note_id, const int16_t channel)
+{
+    // The staging buffer holds far more events than can possibly be
+    // generated between two process calls, so this can only fail if the
+    // host keeps refusing our events for a long time. The host will hardly
+    // miss a few note end events then.
+    pending_out_events.StageNoteEnd(time, key, note_id, channel);
+}
+
+void MyPlugin::SetAudioParam(const uint32_t i, const double value)
+{
+    assert(i < NumParams);
+
+    // Hosts can send anything. A value that isn't a number leaves the
+    // parameter as it is (and still gets published, so the main thread
+    // gets the current value back); everything else is kept within the
+    // parameter's range.
+    if (std::isfinite(value)) {
+        const auto& spec = ParamSpecs[i];
+
+        audio_params[i] = static_cast<float>(
+            std::clamp(value, spec.min_value, spec.max_value));
+    }
+
+    param_smoothers[i].SetTarget(audio_params[i]);
+
+    // Let the main thread know about the new value
+    audio_to_main.Publish(i, audio_params[i]);
+
+    if (i == ParamResampleQuality || i == ParamRenderRate) {
+        RequestRestartIfRenderSetupChanged();
+    }
+}
+
+void MyPlugin::SyncMainParamsToAudio()
+{
+    main_to_audio.Consume([&](const uint32_t i, const float value) {
+        // This publishes the value back, so GetParamValue() reports it once
+        // the change has been consumed.
+        SetAudioParam(i, value);
+
+        pending_out_events.StageParamValue(i, audio_params[i], 0);
+    });
+}
+
+void MyPlugin::SetMainParam(const uint32_t index, const float value)
+{
+    if (index >= NumParams) {
+        return;
+    }
+
+    main_params[index] = value;
+    main_to_audio.Publish(index, value);
+
+    RequestParamFlush();
+}
+
+void MyPlugin::RequestParamFlush()
+{
+    if (!host_params) {
+        return;
+    }
+
+    // Without a timer we can't tell when the changes have been consumed, so
+    // every change asks again
+    if (flush_requested && host_timer_support) {
+        return;
+    }
+    flush_requested = true;
+
+    host_params->request_flush(host);
+}
+
+bool MyPlugin::SyncAudioParamsToMain()
+{
+    bool any_changed = false;
+
+    audio_to_main.Consume([&](const uint32_t i, const float value) {
+        // If we have changed the parameter on the main thread in the
+        // meantime, our value is the newer one.
+        if (!main_to_audio.IsPending(i)) {
+            main_params[i] = value;
+            any_changed    = true;
+        }
+    });
+
     return any_changed;
 }
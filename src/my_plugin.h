@@ -9,23 +9,60 @@
 // Adjusted for C++20 by John Novak <john@johnnovak.net>
 // https://github.com/johnnovak/
 
+#include <algorithm>
 #include <array>
-#include <mutex>
+#include <atomic>
+#include <memory>
 #include <optional>
+#include <type_traits>
 #include <vector>
 
 #include "clap/clap.h"
-#include "speex/speex_resampler.h"
+#include "clap/ext/draft/tuning.h"
+
+#include "arena.h"
+#include "dsp_kernels.h"
+#include "envelope.h"
+#include "event_queue.h"
+#include "frame_ledger.h"
+#include "handoff.h"
+#include "midi_decoder.h"
+#include "mod_matrix.h"
+#include "output_event_queue.h"
+#include "param_exchange.h"
+#include "param_spec.h"
+#include "param_smoother.h"
+#include "preset_bank.h"
+#include "render_buffer.h"
+#include "render_scheduler.h"
+#include "resampler.h"
+#include "sample_file.h"
+#include "sample_streamer.h"
+#include "state_format.h"
+#include "telemetry.h"
+#include "transport_clock.h"
+#include "tuning_table.h"
+#include "voice_pool.h"
+#include "wavetable.h"
+#include "worker_pool.h"
+
+enum class ResampleMode { Off, On };
+
+constexpr auto NumResampleModes = 2;
 
 class MyPlugin {
 
 public:
-    enum Waveform { Sine, Triangle };
+    // `Sample` plays back sample content instead of an oscillator; see
+    // sample_content.h
+    enum Waveform { Sine, Triangle, Saw, Square, Sample };
+
+    static constexpr auto NumWaveforms = 5;
 
 public:
     // Init/shutdown
     MyPlugin(const clap_plugin_t plugin_class, const clap_host_t* host,
-             const Waveform waveform, const bool resample);
+             const Waveform waveform, const ResampleMode resample_mode);
 
     const clap_plugin_t* GetPluginClass();
 
@@ -35,11 +72,102 @@ public:
     bool Activate(const double sample_rate, const uint32_t min_frame_count,
                   const uint32_t max_frame_count);
 
+    void Deactivate();
+
+    // Audio thread. The first call after an activation renders a silent
+    // block; see WarmUp().
+    bool StartProcessing();
+
+    // Audio thread. Clears everything that's still playing, e.g. after the
+    // host has jumped to another position: the voices (their note end
+    // events go out with the next process or flush call), the input delay
+    // and the render pipeline.
+    void Reset();
+
+    // Called by the host on the main thread after we've asked it to with
+    // `clap_host.request_callback()`
+    void OnMainThread();
+
+    // Called by the host when a tuning has been added to or removed from
+    // its pool
+    void OnTuningsChanged();
+
+    // Called by the host on the main thread for the timers we've registered
+    // with `clap_host_timer_support.register_timer()`
+    void OnTimer(const clap_id timer_id);
+
+    // Called by the host's event loop for the fds we've registered with
+    // `clap_host_posix_fd_support.register_fd()`
+    void OnFd(const int fd, const clap_posix_fd_flags_t flags);
+
     // Processing
     clap_process_status Process(const clap_process_t* process);
 
     void Flush(const clap_input_events_t* in, const clap_output_events_t* out);
 
+    // Largest batch ProcessBatch() takes
+    static constexpr uint32_t MaxBatchSize = 1024;
+
+    // Processes many instances in one go, see batch_process.h; the first one
+    // leads the batch, i.e. its threads are used. Audio thread.
+    static void ProcessBatch(MyPlugin* const* plugins,
+                             const clap_process_t* const* processes,
+                             clap_process_status* statuses, const uint32_t count);
+
+    // Called by the host's thread pool or our own worker threads from within
+    // Process() or ProcessBatch()
+    void ExecThreadPoolTask(const uint32_t task_index);
+
+    // Number of output frames that can still be non-silent after the last
+    // voice has stopped
+    uint32_t GetTailLength();
+
+    // Delay of the output relative to the events in output frames
+    uint32_t GetLatency();
+
+    // Frame counts of the render pipeline as of the end of the last block;
+    // any thread
+    FrameLedger::Counters GetFrameCounters() const
+    {
+        return frame_ledger.Snapshot();
+    }
+
+    // Polyphony, so hosts can keep their own voice management in sync with
+    // ours for polyphonic modulation
+    bool GetVoiceInfo(clap_voice_info_t* info);
+
+    // Audio ports. The layout of the main ports can be changed while we're
+    // deactivated, either by picking one of our configurations or by asking
+    // for specific channel counts.
+    uint32_t GetAudioPortCount(const bool is_input);
+    bool GetAudioPortInfo(const uint32_t index, const bool is_input,
+                          clap_audio_port_info_t* info);
+
+    uint32_t GetAudioPortsConfigCount();
+    bool GetAudioPortsConfig(const uint32_t index, clap_audio_ports_config_t* config);
+    bool SelectAudioPortsConfig(const clap_id config_id);
+
+    // CLAP_INVALID_ID if the current layout isn't one of our configurations
+    clap_id GetCurrentAudioPortsConfig();
+    bool GetAudioPortsConfigPortInfo(const clap_id config_id, const uint32_t index,
+                                     const bool is_input, clap_audio_port_info_t* info);
+
+    bool CanApplyAudioPortsConfiguration(
+        const clap_audio_port_configuration_request_t* requests, const uint32_t count);
+    bool ApplyAudioPortsConfiguration(
+        const clap_audio_port_configuration_request_t* requests, const uint32_t count);
+
+    // Render mode
+    bool HasHardRealtimeRequirement();
+    bool SetRenderMode(const clap_plugin_render_mode mode);
+
+    // Bit-exact rendering from any position in the stream, see
+    // deterministic_render.h. The mode can only be changed while we're
+    // deactivated.
+    bool SetDeterministic(const bool enabled);
+    bool IsDeterministic();
+    bool Seek(const uint64_t frame);
+
     // Parameters
     uint32_t GetParamCount();
     bool GetParamInfo(const uint32_t index, clap_param_info_t* info);
@@ -50,62 +178,1252 @@ public:
 
     std::optional<double> ParamTextToValue(const clap_id id, const char* display);
 
-    // State handling
-    bool LoadState(const clap_istream_t* stream);
-    bool SaveState(const clap_ostream_t* stream);
+    // Changes a parameter from the main thread, e.g. from an editor. The
+    // change reaches the audio thread with the next process or flush call,
+    // which we ask the host for.
+    void SetMainParam(const uint32_t index, const float value);
+
+    // State handling. Plain state save/load calls use the project context.
+    bool LoadState(const clap_istream_t* stream, const uint32_t context_type);
+    bool SaveState(const clap_ostream_t* stream, const uint32_t context_type);
+
+    // Loads a preset from a preset bank, as announced by our preset
+    // discovery provider
+    bool LoadPreset(const uint32_t location_kind, const char* location,
+                    const char* load_key);
+
+    // The sample the sampler variant plays back, see sample_content.h
+    bool LoadSample(const char* path);
+    bool GetSamplePath(char* path, const uint32_t capacity);
 
 private:
-    void ProcessEvent(const clap_event_header_t* event);
+    void ProcessEvent(const EventKind kind, const clap_event_header_t* event);
+
+    // Note on, note off and choke events, wherever they come from.
+    // Wildcards are -1, as in CLAP note events.
+    void ProcessNote(const EventKind kind, const uint32_t time,
+                     const int16_t key, const int32_t note_id,
+                     const int16_t channel, const float velocity);
+
+    void ProcessMidi(const midi::Op& op, const uint32_t time);
+
+    // Sets a parameter on the audio thread and lets the main thread know;
+    // the value is clamped to the parameter's range, and ignored if it
+    // isn't finite
+    void SetAudioParam(const uint32_t i, const double value);
+
+    // Fetches the tuning of a channel from the host, or resets it to 12-TET
+    // if the channel has no tuning
+    void LoadChannelTuning(const int16_t channel, const uint32_t time);
+
+    // Queries the tunings of the playing voices again, for tunings that
+    // change over time
+    void RefreshDynamicTunings();
+
+    // The hot paths are specialised for every combination of waveform and
+    // resample mode at compile time, so they don't need to test either of
+    // them at runtime. The specialisation to use is picked when the plugin
+    // is created, and again on every activation, as the render rate
+    // parameter decides whether we resample.
+    using ProcessFn = clap_process_status (MyPlugin::*)(const clap_process_t*);
+
+    static ProcessFn SelectProcessFn(const Waveform waveform,
+                                     const ResampleMode resample_mode);
+
+    template <Waveform W, ResampleMode R>
+    clap_process_status ProcessVariant(const clap_process_t* process);
+
+    // `T` is the sample type of the host's output buffers (float for
+    // `data32`, double for `data64`)
+    template <typename T, Waveform W, ResampleMode R>
+    clap_process_status ProcessImpl(const clap_process_t* process,
+                                    T** out_buffers);
+
+    // Renders into the render buffer of sample type `T`, or if `out` is
+    // given, straight into the host's output channels, adding to what's
+    // there already with `add_to_output`
+    template <typename T, Waveform W>
+    void RenderAudio(const uint32_t num_frames, T* const* out, const bool add_to_output);
+
+    // Recalculate the phase increment of the voice in `slot`, or of all
+    // voices matching `key` and `channel`, after a pitch bend or a change
+    // of tuning
+    void UpdateVoicePitch(const uint32_t slot);
+    void UpdateVoicePitches(const int16_t key, const int16_t channel);
+
+    // Sets the phase increment of the voice at `index` from its pitch bend,
+    // tuning expression and pitch modulation, transposed by `tune`
+    void RetuneVoice(const uint32_t index, const float tune);
+
+    uint32_t Resample(float* out, const uint32_t num_out_frames);
+
+    ResamplerType GetResamplerTypeParam(const float value);
+
+    // The backend Activate() uses for a resample quality setting
+    ResamplerType SelectResamplerType(const float quality);
+
+    // Internal render rate, relative to the host's sample rate. The lower
+    // rates save CPU on background layers; oversampling keeps fast
+    // modulation free of aliasing. `Default` is the fixed
+    // `RenderSampleRateHz` for the resampled plugin variants, and the
+    // host's rate for the others.
+    enum class RenderRate { Default, Quarter, Half, Host, Double, Quadruple };
+
+    static constexpr auto NumRenderRates = 6;
+
+    static const char* ToString(const RenderRate rate);
+
+    RenderRate GetRenderRateParam(const float value);
+
+    // Tempo sync of the LFOs, as a note value; `Off` runs them at the LFO
+    // rate in Hz. Bars follow the host's time signature.
+    enum class LfoSync {
+        Off,
+        FourBars,
+        TwoBars,
+        OneBar,
+        Half,
+        Quarter,
+        Eighth,
+        Sixteenth,
+        ThirtySecond
+    };
+
+    static constexpr auto NumLfoSyncs = 9;
+
+    static const char* ToString(const LfoSync sync);
+
+    // Where the LFOs start their cycles: at the note on of their voice, or
+    // all together at every bar line
+    enum class LfoRetrigger { Note, Bar };
+
+    static constexpr auto NumLfoRetriggers = 2;
+
+    static const char* ToString(const LfoRetrigger retrigger);
+
+    double RenderRateHz(const RenderRate rate, const double output_rate_hz) const;
+
+    // Called on the audio thread when a parameter that only takes effect on
+    // activation changes (resample quality or render rate)
+    void RequestRestartIfRenderSetupChanged();
+
+    // Main thread. Starts building the resampler for the render setup the
+    // audio thread has asked to be restarted with on the background
+    // worker, so the activation doesn't have to; see `prepared_resampler`.
+    void PrepareRenderSetup();
+
+    // Puts the render pipeline back into its initial, silent state. In
+    // deterministic mode, that's the state it would be in at
+    // `stream_position` after nothing but silence.
+    void ResetRenderPipeline();
+
+    // Ends the glides of all smoothed parameters
+    void SnapParamSmoothers();
+
+    // Puts the render pipeline and the input delay into their silent state
+    // once no voice is playing, and ends all parameter glides; the instance
+    // goes idle until the next event
+    void ResetToSilence();
+
+    // Delay of the output relative to the events: the resampler's
+    // look-ahead plus the lead of deterministic renders, in output frames
+    uint32_t OutputLatencyFrames() const;
+
+    // Everything whose size depends on the activation settings: the
+    // resampler, the render and mix buffers, and the voice pool
+    struct DspConfig {
+        double sample_rate           = 0.0;
+        double render_rate_hz        = 0.0;
+        uint32_t max_frame_count     = 0;
+        ResamplerType resampler_type = ResamplerType::Speex;
+        uint32_t num_channels        = NumMixChannels;
+        bool is_deterministic        = false;
+
+        // Channels of the sample the rings are streaming; 0 without one
+        uint32_t sample_channels = 0;
+
+        bool operator==(const DspConfig&) const = default;
+    };
+
+    bool AllocateDspResources(const DspConfig& config);
+    void ReleaseDspResources();
+
+    // Audio thread. Runs one silent block of the maximum size through the
+    // whole render pipeline, so the first block with actual notes doesn't
+    // pay for the cache and TLB misses of touching the code and the DSP
+    // memory (including the resampler's, which isn't in our arena) for the
+    // first time. Leaves the pipeline as it was.
+    void WarmUp();
+
+    // Forgets all arrays carved out of `dsp_arena`, then frees it
+    void ReleaseDspBuffers();
+
+    // With `add_to_output`, our frames are mixed into what's already in the
+    // output buffers (the input, see ReadInput()) instead of replacing it
+    template <typename T>
+    void ResampleAndPublishFrames(const uint32_t num_out_frames, T* out_left,
+                                  T* out_right, const bool add_to_output);
+
+    // A null `out_right` means the output is mono
+    template <typename S, typename T>
+    void PublishFrames(const S* frames, const uint32_t num_frames, T* out_left,
+                       T* out_right, const bool add_to_output);
 
-    void RenderAudio(const uint32_t num_frames);
+    // Puts the audio input, delayed by our latency, into the output buffers.
+    // A mono output gets the input's downmix. Returns false if the host
+    // hasn't connected the input.
+    template <typename T>
+    bool ReadInput(const clap_process_t* process, T* out_left, T* out_right);
 
-    void ResampleAndPublishFrames(const uint32_t num_out_frames,
-                                  float* out_left, float* out_right);
+    template <typename S, typename T>
+    void DelayInput(const S* in_left, const S* in_right, T* out_left, T* out_right,
+                    const uint32_t num_frames);
 
-    void SyncMainParamsToAudio(const clap_output_events_t* out);
+    template <typename T>
+    RenderBuffer<T>& GetRenderBuffer()
+    {
+        if constexpr (std::is_same_v<T, double>) {
+            return render_buf64;
+        } else {
+            return render_buf;
+        }
+    }
+
+    template <typename T>
+    T* GetMixBuffer(const uint32_t channel)
+    {
+        const auto offset = channel * MaxRenderBlockSize;
+
+        if constexpr (std::is_same_v<T, double>) {
+            return mix_buffers.mix64.data() + offset;
+        } else {
+            return mix_buffers.mix.data() + offset;
+        }
+    }
+
+    template <typename T>
+    T* GetGroupMixBuffer(const uint32_t group, const uint32_t channel)
+    {
+        const auto offset = (group * NumMixChannels + channel) * MaxRenderBlockSize;
+
+        if constexpr (std::is_same_v<T, double>) {
+            return mix_buffers.group_mix64.data() + offset;
+        } else {
+            return mix_buffers.group_mix.data() + offset;
+        }
+    }
+
+    // nullptr unless the sampler has a sample
+    float* GetGroupSampleBuffer(const uint32_t group)
+    {
+        if (mix_buffers.sample_frames.empty()) {
+            return nullptr;
+        }
+        return mix_buffers.sample_frames.data() +
+               group * SampleScratchFrames * SampleFile::MaxChannels;
+    }
+
+    // Sampler: starts and stops refilling the voices' streams, from the
+    // host's event loop or from the streamer's own thread
+    void StartSampleStreaming();
+    void StopSampleStreaming();
+
+    // Logs the number of stream underruns if there have been new ones
+    void ReportSampleUnderruns();
+
+    // Stops the voices whose release has faded out, reporting their end at
+    // the last frame of the block
+    void StopFinishedVoices();
+
+    // Stages a note end event in `pending_out_events`
+    void SendNoteEnd(const uint32_t time, const int16_t key,
+                     const int32_t note_id, const int16_t channel);
+
+    void SyncMainParamsToAudio();
+
+    // Settings specific to the machine rather than the sound, like the
+    // number of render threads
+    static bool IsMachineParam(const uint32_t index);
     bool SyncAudioParamsToMain();
 
+    // Asks the host for a process or flush call to deliver our main thread
+    // parameter changes to the audio thread
+    void RequestParamFlush();
+
+    // Finishes the telemetry record of a process call, asking the host for
+    // a main thread callback to drain the records when enough have piled up
+    void EndTelemetryBlock();
+
+    // Collects the audio thread's telemetry records, and logs a summary once
+    // it covers enough audio
+    void DrainTelemetry();
+
+    // Logs the frame counts if the pipeline has dropped or duplicated
+    // frames since the last call
+    void ReportFrameViolations();
+
 private:
     static constexpr auto RenderSampleRateHz = 16789.0;
 
-    static constexpr auto ParamVolume = 0;
-    static constexpr auto NumParams   = 1;
+    // Voices are rendered in blocks of at most this many frames. Offline,
+    // larger blocks amortise the cost of dispatching the voice groups to
+    // the threads better; in real time, smaller blocks keep the scratch
+    // buffers in the L1 cache.
+    static constexpr uint32_t RealtimeRenderBlockSize = 256;
+    static constexpr uint32_t OfflineRenderBlockSize  = 1024;
+
+    static constexpr uint32_t MaxRenderBlockSize = OfflineRenderBlockSize;
+
+    // Deterministic renders use the same block size in both render modes.
+    // They run a block ahead of the output, so small blocks keep the extra
+    // latency down.
+    static constexpr uint32_t DeterministicRenderBlockSize = RealtimeRenderBlockSize;
+
+    // Block-rate events are quantised to this many output frames in real
+    // time (see EventQueue), so dense automation can't break rendering up
+    // into tiny blocks. Offline, CPU time isn't critical, so they stay
+    // sample-accurate.
+    static constexpr uint32_t RealtimeEventQuantum = 32;
+
+    // Voices are mixed in stereo, so they can be panned
+    static constexpr uint32_t NumMixChannels = 2;
+
+    // The input and the output form an in-place pair, so hosts can process
+    // us in place, and don't need to allocate an output buffer for us
+    static constexpr clap_id AudioInputPortId  = 1;
+    static constexpr clap_id AudioOutputPortId = 0;
+
+    // Channel counts of the main input and output, each either 1 or 2
+    struct AudioPortsLayout {
+        uint32_t input_channels  = 2;
+        uint32_t output_channels = 2;
+
+        bool operator==(const AudioPortsLayout&) const = default;
+    };
+
+    struct AudioPortsConfig {
+        clap_id id              = CLAP_INVALID_ID;
+        const char* name        = "";
+        AudioPortsLayout layout = {};
+    };
+
+    // The layouts we offer hosts to pick from. Other combinations of mono
+    // and stereo ports can still be requested through the configurable
+    // audio ports extension.
+    static constexpr std::array<AudioPortsConfig, 2> AudioPortsConfigs = {{
+        {.id = 0, .name = "Stereo", .layout = {2, 2}},
+        {.id = 1, .name = "Mono", .layout = {1, 1}},
+    }};
+
+    static void FillAudioPortInfo(const AudioPortsLayout& layout, const bool is_input,
+                                  clap_audio_port_info_t* info);
+
+    static constexpr uint32_t MaxPolyphony = 256;
+
+    // When there are threads to render on (the host's thread pool or our
+    // own workers), the voices are split into at most this many groups
+    // that get rendered in parallel. Groups smaller than
+    // `MinVoicesPerGroup` aren't worth the synchronisation overhead.
+    static constexpr uint32_t MaxVoiceGroups    = 8;
+    static constexpr uint32_t MinVoicesPerGroup = 16;
+
+    // Voices whose gain stays below this (-120 dB) for a whole block aren't
+    // rendered in that block; see RenderVoices()
+    static constexpr float SilentVoiceGain = 1e-6f;
+
+    // The sampler plays its sample at the original pitch on the 12-TET
+    // frequency of this key (middle C); other keys transpose it by their
+    // tuning
+    static constexpr double SampleRootKeyHz = 261.6255653005986;
+
+    // Voices read the sample in runs of at most this many frames, which
+    // limits how far up a sample can be transposed
+    static constexpr uint32_t SampleScratchFrames = 2 * SampleStreamer::ChunkFrames;
+    static constexpr double MaxSampleIncrement    = 8.0;
+
+    // Memory for the read-ahead rings of all voices (see sample_streamer.h);
+    // about 85 ms of stereo at 48 kHz per voice
+    static constexpr size_t SampleStreamBudgetBytes = 8 << 20;
+
+    static constexpr auto ParamVolume          = 0;
+    static constexpr auto ParamResampleQuality = 1;
+    static constexpr auto ParamRenderThreads   = 2;
+    static constexpr auto ParamRenderRate      = 3;
+    static constexpr auto ParamAttack          = 4;
+    static constexpr auto ParamDecay           = 5;
+    static constexpr auto ParamSustain         = 6;
+    static constexpr auto ParamRelease         = 7;
+    static constexpr auto ParamPan             = 8;
+    static constexpr auto ParamTune            = 9;
+    static constexpr auto ParamLfoRate         = 10;
+
+    // The modulation matrix slots have a source, a destination and an
+    // amount parameter each, starting at `ParamModSlots`
+    static constexpr auto ParamModSlots = 11;
+    static constexpr auto NumModSlots   = 4;
+    static constexpr auto ModSlotParams = 3;
+
+    // Parameters added after the matrix slots; IDs are never reused, so
+    // states saved before they existed still load
+    static constexpr auto ParamLfoSync      = ParamModSlots + NumModSlots * ModSlotParams;
+    static constexpr auto ParamLfoRetrigger = ParamLfoSync + 1;
+
+    static constexpr auto NumParams = ParamLfoRetrigger + 1;
+
+    // Name of a modulation destination lane
+    static const char* ModDestinationName(const uint32_t lane);
+
+    // The parameter registry, indexed by parameter ID. Everything else
+    // about the parameters (their storage, the exchange between the
+    // threads, the state and the per-voice modulation) is derived from it.
+    static constexpr std::array<param::Spec, NumParams> ParamSpecs = [] {
+        std::array<param::Spec, NumParams> specs = {};
+
+        // These flags enable polyphonic modulation.
+        specs[ParamVolume] = {.name  = "Volume",
+                              .flags = CLAP_PARAM_IS_AUTOMATABLE |
+                                       CLAP_PARAM_IS_MODULATABLE |
+                                       CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID,
+                              .min_value     = 0.0,
+                              .max_value     = 1.0,
+                              .default_value = 0.5,
+                              .unit          = param::Unit::Decibels,
+                              .precision     = 1};
+
+        // Switching backends reallocates the resampler and changes our latency,
+        // so this only takes effect the next time the plugin gets activated. We
+        // ask the host to do that as soon as it changes.
+        specs[ParamResampleQuality] = {
+            .name          = "Resample Quality",
+            .flags         = CLAP_PARAM_IS_STEPPED | CLAP_PARAM_IS_ENUM,
+            .min_value     = 0.0,
+            .max_value     = NumResamplerTypes - 1,
+            .default_value = static_cast<double>(ResamplerType::Speex),
+            .unit          = param::Unit::Enum,
+            .label         = [](const uint32_t value) {
+                return ::ToString(static_cast<ResamplerType>(value));
+            }};
+
+        // Only used if the host has no thread pool; takes effect the next time
+        // the plugin gets activated.
+        specs[ParamRenderThreads] = {
+            .name          = "Render Threads",
+            .flags         = CLAP_PARAM_IS_STEPPED,
+            .min_value     = 0.0,
+            .max_value     = WorkerPool::MaxWorkers,
+            .default_value = 0.0,
+            .unit          = param::Unit::Count,
+            .label         = [](const uint32_t value) {
+                return (value == 0) ? "Off" : nullptr;
+            }};
+
+        // Changes the resampling setup and our latency, so just like the
+        // resample quality, this takes effect on the next activation
+        specs[ParamRenderRate] = {
+            .name          = "Render Rate",
+            .flags         = CLAP_PARAM_IS_STEPPED | CLAP_PARAM_IS_ENUM,
+            .min_value     = 0.0,
+            .max_value     = NumRenderRates - 1,
+            .default_value = static_cast<double>(RenderRate::Default),
+            .unit          = param::Unit::Enum,
+            .label         = [](const uint32_t value) {
+                return ToString(static_cast<RenderRate>(value));
+            }};
+
+        // Envelope times in milliseconds. The defaults are short enough to keep
+        // notes sounding as before, just without the clicks.
+        const auto envelope_time = [](const char* name, const double max_ms,
+                                      const double default_ms) {
+            return param::Spec{.name          = name,
+                               .flags         = CLAP_PARAM_IS_AUTOMATABLE,
+                               .min_value     = 0.0,
+                               .max_value     = max_ms,
+                               .default_value = default_ms,
+                               .unit          = param::Unit::Milliseconds,
+                               .precision     = 1};
+        };
+
+        specs[ParamAttack]  = envelope_time("Attack", 2000.0, 2.0);
+        specs[ParamDecay]   = envelope_time("Decay", 5000.0, 300.0);
+        specs[ParamRelease] = envelope_time("Release", 5000.0, 50.0);
+
+        specs[ParamSustain] = {.name          = "Sustain",
+                               .flags         = CLAP_PARAM_IS_AUTOMATABLE,
+                               .min_value     = 0.0,
+                               .max_value     = 1.0,
+                               .default_value = 1.0,
+                               .unit          = param::Unit::Percent,
+                               .precision     = 0};
+
+        // Pan and tune are destinations for the modulation matrix as well,
+        // so they can be modulated per voice
+        constexpr auto PolyFlags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE |
+                                   CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID;
+
+        specs[ParamPan] = {.name          = "Pan",
+                           .flags         = PolyFlags,
+                           .min_value     = -1.0,
+                           .max_value     = 1.0,
+                           .default_value = 0.0,
+                           .unit          = param::Unit::Percent,
+                           .precision     = 0};
+
+        specs[ParamTune] = {.name          = "Tune",
+                            .flags         = PolyFlags,
+                            .min_value     = -24.0,
+                            .max_value     = 24.0,
+                            .default_value = 0.0,
+                            .unit          = param::Unit::Semitones,
+                            .precision     = 2};
+
+        // Every voice has its own LFO, which starts with the note unless
+        // it's retriggered by the bars
+        specs[ParamLfoRate] = {.name          = "LFO Rate",
+                               .flags         = CLAP_PARAM_IS_AUTOMATABLE,
+                               .min_value     = 0.01,
+                               .max_value     = 20.0,
+                               .default_value = 5.0,
+                               .unit          = param::Unit::Hertz,
+                               .precision     = 2};
+
+        // With tempo sync, the LFOs follow the host's song position instead
+        // of the rate
+        specs[ParamLfoSync] = {.name  = "LFO Sync",
+                               .flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED |
+                                        CLAP_PARAM_IS_ENUM,
+                               .min_value     = 0.0,
+                               .max_value     = NumLfoSyncs - 1,
+                               .default_value = static_cast<double>(LfoSync::Off),
+                               .unit          = param::Unit::Enum,
+                               .label         = [](const uint32_t value) {
+                                   return ToString(static_cast<LfoSync>(value));
+                               }};
+
+        specs[ParamLfoRetrigger] = {
+            .name          = "LFO Retrigger",
+            .flags         = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED |
+                             CLAP_PARAM_IS_ENUM,
+            .min_value     = 0.0,
+            .max_value     = NumLfoRetriggers - 1,
+            .default_value = static_cast<double>(LfoRetrigger::Note),
+            .unit          = param::Unit::Enum,
+            .label         = [](const uint32_t value) {
+                return ToString(static_cast<LfoRetrigger>(value));
+            }};
+
+        // Amounts are relative to the range of the destination parameter
+        constexpr const char* ModSlotNames[NumModSlots][ModSlotParams] = {
+            {"Mod 1 Source", "Mod 1 Destination", "Mod 1 Amount"},
+            {"Mod 2 Source", "Mod 2 Destination", "Mod 2 Amount"},
+            {"Mod 3 Source", "Mod 3 Destination", "Mod 3 Amount"},
+            {"Mod 4 Source", "Mod 4 Destination", "Mod 4 Amount"},
+        };
+
+        for (uint32_t slot = 0; slot < NumModSlots; ++slot) {
+            const auto first = ParamModSlots + slot * ModSlotParams;
+            const auto names = ModSlotNames[slot];
+
+            constexpr auto EnumFlags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED |
+                                       CLAP_PARAM_IS_ENUM;
+
+            specs[first] = {.name          = names[0],
+                            .flags         = EnumFlags,
+                            .min_value     = 0.0,
+                            .max_value     = mod::NumSources - 1,
+                            .default_value = 0.0,
+                            .unit          = param::Unit::Enum,
+                            .label         = [](const uint32_t value) {
+                                return mod::ToString(static_cast<mod::Source>(value));
+                            }};
+
+            // The number of destinations is only known once all of the
+            // parameters are, see NumPolyParams
+            specs[first + 1] = {.name          = names[1],
+                                .flags         = EnumFlags,
+                                .min_value     = 0.0,
+                                .max_value     = 0.0,
+                                .default_value = 0.0,
+                                .unit          = param::Unit::Enum,
+                                .label         = ModDestinationName};
+
+            specs[first + 2] = {.name          = names[2],
+                                .flags         = CLAP_PARAM_IS_AUTOMATABLE,
+                                .min_value     = -1.0,
+                                .max_value     = 1.0,
+                                .default_value = 0.0,
+                                .unit          = param::Unit::Percent,
+                                .precision     = 1};
+        }
+
+        const auto num_lanes = std::ranges::count_if(specs, [](const auto& spec) {
+            return (spec.flags & CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID) != 0;
+        });
+
+        for (uint32_t slot = 0; slot < NumModSlots; ++slot) {
+            specs[ParamModSlots + slot * ModSlotParams + 1].max_value = num_lanes - 1;
+        }
+
+        return specs;
+    }();
+
+    static_assert(std::ranges::none_of(ParamSpecs,
+                                       [](const auto& spec) {
+                                           return *spec.name == '\0';
+                                       }),
+                  "Every parameter ID needs an entry in ParamSpecs");
+
+    // Parameters that can be modulated per voice get a modulation lane in
+    // the voice state (see VoiceRenderState::param_mod), in ID order. All
+    // other parameters cost the voices nothing, no matter how many there
+    // are.
+    static constexpr uint32_t NoPolyLane = UINT32_MAX;
+
+    static constexpr auto IsPolyModulatable = [](const param::Spec& spec) {
+        return (spec.flags & CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID) != 0;
+    };
+
+    static constexpr uint32_t NumPolyParams = static_cast<uint32_t>(
+        std::ranges::count_if(ParamSpecs, IsPolyModulatable));
+
+    static constexpr std::array<uint32_t, NumParams> PolyLanes = [] {
+        std::array<uint32_t, NumParams> lanes = {};
+        uint32_t num_lanes                    = 0;
+
+        for (uint32_t i = 0; i < NumParams; ++i) {
+            lanes[i] = IsPolyModulatable(ParamSpecs[i]) ? num_lanes++ : NoPolyLane;
+        }
+        return lanes;
+    }();
 
+    // Parameter ID of every lane
+    static constexpr std::array<uint32_t, NumPolyParams> PolyParamIds = [] {
+        std::array<uint32_t, NumPolyParams> ids = {};
+
+        for (uint32_t i = 0; i < NumParams; ++i) {
+            if (PolyLanes[i] != NoPolyLane) {
+                ids[PolyLanes[i]] = i;
+            }
+        }
+        return ids;
+    }();
+
+    static constexpr auto VolumeLane = PolyLanes[ParamVolume];
+    static constexpr auto PanLane    = PolyLanes[ParamPan];
+    static constexpr auto TuneLane   = PolyLanes[ParamTune];
+
+    using ModMatrix = mod::Matrix<NumPolyParams, NumModSlots>;
+
+    // What changes over a render block, calculated once per block and
+    // shared by all voices
+    struct BlockControls {
+        ParamSmoother::Ramp volume_ramp = {};
+        ParamSmoother::Ramp pan_ramp    = {};
+        EnvelopeBlock envelope          = {};
+
+        // Transposition by the tune parameter in semitones; pitches only
+        // change at block boundaries
+        float tune = 0.0f;
+
+        // One-pole smoothing coefficient of the note expressions
+        float expression_coeff = 1.0f;
+
+        // How the LFO phases at the end of the block are found: advanced
+        // from the last block, from the song position relative to the
+        // voice's note on, or from the position in the bar, which is the
+        // same for all voices
+        enum class LfoTiming { Free, SyncedToNote, SyncedToBar };
+
+        LfoTiming lfo_timing = LfoTiming::Free;
+
+        // Free: the phase advance over the block in cycles
+        float lfo_phase_inc = 0.0f;
+
+        // SyncedToNote: the song position at the end of the block, and the
+        // length of a cycle, in beat time
+        clap_beattime lfo_position = 0;
+        clap_beattime lfo_period   = 0;
+
+        // SyncedToBar: the phase of all LFOs in cycles
+        float lfo_phase = 0.0f;
+
+        ModMatrix matrix = {};
+    };
+
+    BlockControls MakeBlockControls(const uint32_t num_frames);
+
+    // Length of an LFO cycle in beat time; zero if the LFOs aren't synced
+    clap_beattime LfoPeriod(const LfoSync sync) const;
+
+    // Renders the active voices in the [first_voice, last_voice) range into
+    // the `NumMixChannels` channels of `mix`. The sampler reads the frames
+    // of its voices into `sample_frames`, one of the group buffers (nullptr
+    // without a sample).
+    template <typename T, Waveform W>
+    void RenderVoices(T* const* mix, float* sample_frames, const uint32_t first_voice,
+                      const uint32_t last_voice, const uint32_t num_frames,
+                      const BlockControls& controls);
+
+    // Plays the sample for the active voice at `index` into the first
+    // `NumChannels` channels of `mix`, with the given gain ramps
+    template <uint32_t NumChannels, typename T>
+    void RenderSampleVoice(T* const* mix, float* sample_frames, const uint32_t index,
+                           const uint32_t num_frames, const float* gain_start,
+                           const float* gain_end);
+
+    // Moves a silent voice on through the sample by `num_frames`
+    void SkipSample(const uint32_t index, const uint32_t num_frames);
+
+    // Sample frames per render frame for a voice's phase increment
+    double SampleIncrement(const float phase_inc) const
+    {
+        return std::min(phase_inc * sample_inc_per_phase_inc, MaxSampleIncrement);
+    }
+
+    template <typename T, Waveform W>
+    void RenderVoiceGroup(const uint32_t group);
+
+
+    static constexpr auto ParamSmoothingTimeMs = 10.0;
+
+    // Pitch bend ranges in semitones. Per-note pitch bends use the MPE
+    // default range.
+    static constexpr float PitchBendRange        = 2.0f;
+    static constexpr float PerNotePitchBendRange = 48.0f;
+
+    static constexpr int16_t NumMidiChannels = 16;
+
+    // Only needed for matching events to voices and voice stealing
     struct Voice {
         bool held       = false;
         int32_t note_id = 0;
         int16_t channel = 0;
         int16_t key     = 0;
-        float phase     = 0.0f;
 
-        float param_offsets[NumParams] = {};
+        // Per-note pitch bend in semitones; see ProcessMidi()
+        float pitch_bend = 0.0f;
+    };
+
+    // Current pitch bend of a voice in semitones, per note and per channel
+    float VoicePitchBend(const Voice& voice) const;
+
+    // Note expressions that get smoothed per voice. Volume and tuning are
+    // applied by the render kernels, the others are kept as modulation
+    // sources.
+    enum Expression : uint32_t {
+        ExpressionVolume,
+        ExpressionPan,
+        ExpressionTuning,
+        ExpressionBrightness,
+        ExpressionPressure,
+        NumExpressions
+    };
+
+    static std::optional<Expression> ToExpression(const clap_note_expression id);
+
+    static constexpr float ExpressionDefaults[NumExpressions] = {
+        1.0f, // Volume, as a linear gain
+        0.5f, // Pan, 0 is left, 1 is right
+        0.0f, // Tuning in semitones
+        0.5f, // Brightness
+        0.0f, // Pressure
+    };
+
+    // Everything the render kernels need, in active voice order; see
+    // osc::RenderVoices()
+    struct VoiceRenderState {
+        ArenaArray<float> phase     = {};
+        ArenaArray<float> phase_inc = {};
+
+        // Sampler: the position in the sample, in sample frames
+        ArenaArray<double> sample_pos = {};
+
+        // The phase increment is the tuned key's increment from the tuning
+        // table, transposed by the pitch bends, the tuning expression and
+        // the pitch modulation. `transpose` is the sum it was calculated
+        // for, so it's only recalculated when the sum changes.
+        ArenaArray<float> base_phase_inc = {};
+        ArenaArray<float> pitch_bend     = {};
+        ArenaArray<float> transpose      = {};
+
+        // Modulation sources that are fixed when the voice starts, in [0, 1]
+        ArenaArray<float> velocity  = {};
+        ArenaArray<float> key_track = {};
+
+        // Per-voice LFO, in cycles, and the song position of the voice's
+        // note on for tempo synced LFOs
+        ArenaArray<float> lfo_phase         = {};
+        ArenaArray<clap_beattime> lfo_start = {};
+
+        // Amplitude envelopes; advanced once per block, see EnvelopeBlock
+        ArenaArray<EnvelopeStage> envelope_stage = {};
+        ArenaArray<float> envelope_level         = {};
+
+        // Polyphonic modulation offsets from the host, one array per lane;
+        // see PolyLanes
+        std::array<ArenaArray<float>, NumPolyParams> param_mod = {};
+
+        // The host's offsets plus those of the modulation matrix, as of the
+        // end of the last block
+        std::array<ArenaArray<float>, NumPolyParams> modulation = {};
+
+        // Smoothed note expressions and the values they're moving towards,
+        // one array per expression so they can be smoothed for many voices
+        // at once
+        std::array<ArenaArray<float>, NumExpressions> expression        = {};
+        std::array<ArenaArray<float>, NumExpressions> expression_target = {};
+
+        // Per-channel gain ramps of the block being rendered; only valid
+        // during rendering, so they're not moved along with the voices
+        std::array<ArenaArray<float>, NumMixChannels> gain_start = {};
+        std::array<ArenaArray<float>, NumMixChannels> gain_end   = {};
+
+        // The same goes for these: the modulation and the envelope levels
+        // at the start of the block, and the LFO outputs
+        std::array<ArenaArray<float>, NumPolyParams> modulation_start = {};
+        ArenaArray<float> envelope_start                              = {};
+        ArenaArray<float> lfo                                         = {};
+
+        // The voices that are audible in the block being rendered, and the
+        // oscillator state the render kernels work on for them; see
+        // RenderVoices()
+        ArenaArray<uint32_t> audible_voice  = {};
+        ArenaArray<float> audible_phase     = {};
+        ArenaArray<float> audible_phase_inc = {};
+
+        // To be called from the carving code passed to Arena::Build()
+        void Allocate(Arena& arena, const uint32_t num_voices)
+        {
+            for (auto array : {&phase, &phase_inc, &base_phase_inc, &pitch_bend,
+                               &transpose, &velocity, &key_track, &lfo_phase,
+                               &envelope_level, &envelope_start, &lfo,
+                               &audible_phase, &audible_phase_inc}) {
+                *array = arena.Allocate<float>(num_voices);
+            }
+            audible_voice = arena.Allocate<uint32_t>(num_voices);
+            lfo_start     = arena.Allocate<clap_beattime>(num_voices);
+            sample_pos    = arena.Allocate<double>(num_voices);
+
+            for (uint32_t lane = 0; lane < NumPolyParams; ++lane) {
+                param_mod[lane]        = arena.Allocate<float>(num_voices);
+                modulation[lane]       = arena.Allocate<float>(num_voices);
+                modulation_start[lane] = arena.Allocate<float>(num_voices);
+            }
+            for (uint32_t c = 0; c < NumMixChannels; ++c) {
+                gain_start[c] = arena.Allocate<float>(num_voices);
+                gain_end[c]   = arena.Allocate<float>(num_voices);
+            }
+            envelope_stage = arena.Allocate<EnvelopeStage>(num_voices);
+
+            for (uint32_t e = 0; e < NumExpressions; ++e) {
+                expression[e]        = arena.Allocate<float>(num_voices);
+                expression_target[e] = arena.Allocate<float>(num_voices);
+            }
+        }
+
+        // The arena hands out zeroed arrays; these are the non-zero defaults
+        void Reset()
+        {
+            envelope_stage.Fill(EnvelopeStage::Done);
+
+            for (uint32_t e = 0; e < NumExpressions; ++e) {
+                expression[e].Fill(ExpressionDefaults[e]);
+                expression_target[e].Fill(ExpressionDefaults[e]);
+            }
+        }
+
+        void Move(const uint32_t from, const uint32_t to)
+        {
+            phase[to]          = phase[from];
+            phase_inc[to]      = phase_inc[from];
+            sample_pos[to]     = sample_pos[from];
+            base_phase_inc[to] = base_phase_inc[from];
+            pitch_bend[to]     = pitch_bend[from];
+            transpose[to]      = transpose[from];
+            velocity[to]       = velocity[from];
+            key_track[to]      = key_track[from];
+            lfo_phase[to]      = lfo_phase[from];
+            lfo_start[to]      = lfo_start[from];
+            envelope_stage[to] = envelope_stage[from];
+            envelope_level[to] = envelope_level[from];
+
+            for (uint32_t lane = 0; lane < NumPolyParams; ++lane) {
+                param_mod[lane][to]  = param_mod[lane][from];
+                modulation[lane][to] = modulation[lane][from];
+            }
+            for (uint32_t e = 0; e < NumExpressions; ++e) {
+                expression[e][to]        = expression[e][from];
+                expression_target[e][to] = expression_target[e][from];
+            }
+        }
+
+        // Resets the expressions of a new voice
+        void ResetExpressions(const uint32_t index)
+        {
+            for (uint32_t e = 0; e < NumExpressions; ++e) {
+                expression[e][index]        = ExpressionDefaults[e];
+                expression_target[e][index] = ExpressionDefaults[e];
+            }
+        }
     };
 
     clap_plugin_t plugin_class         = {};
     const clap_host_t* host            = nullptr;
     const clap_plugin* plugin_instance = nullptr;
 
-    bool do_resample = false;
+    // Optional; nullptr if the host doesn't have a thread pool
+    const clap_host_thread_pool_t* host_thread_pool = nullptr;
+
+    // Our own worker threads for hosts without a thread pool. The number of
+    // threads is set per instance by the render threads parameter, which
+    // defaults to zero so that many instances don't oversubscribe the CPU.
+    WorkerPool worker_pool = {};
+
+    // Set by the host through the render extension. Offline, there are no
+    // real-time constraints, so Activate() trades CPU time for quality and
+    // throughput: best resampler quality, larger render blocks and as many
+    // render threads as there are cores.
+    enum class RenderMode { Realtime, Offline };
+
+    RenderMode render_mode = RenderMode::Realtime;
+
+    // Set through the deterministic render extension; takes effect on the
+    // next activation
+    bool is_deterministic = false;
+
+    bool is_active = false;
+
+    // Only changes while we're deactivated; the render path follows it on
+    // the next activation
+    AudioPortsLayout ports_layout = {};
+
+    // Settings the DSP resources have been allocated for; empty while
+    // they're not allocated. Hosts tend to deactivate and reactivate
+    // plugins with the same settings (e.g. when the latency changes or
+    // when switching between real-time and offline rendering), so the
+    // resources survive deactivation briefly: Deactivate() only asks the
+    // host for a main thread callback, and OnMainThread() releases them if
+    // we haven't been reactivated by then.
+    std::optional<DspConfig> dsp_config = {};
+
+    bool release_requested = false;
+
+    uint32_t render_block_size = RealtimeRenderBlockSize;
+
+    // Frames the voices are rendered ahead of the output in deterministic
+    // mode (a whole render block), otherwise 0; see render_scheduler.h
+    uint32_t render_lead = 0;
+
+    // Only used outside of the hot paths; see SelectProcessFn().
+    // `resample_mode` is the mode in use since the last activation, as
+    // instances of any variant resample if the render rate parameter asks
+    // for a rate other than the host's.
+    ResampleMode resample_mode = ResampleMode::Off;
+    Waveform waveform          = {};
+
+    // Whether the plugin variant renders at `RenderSampleRateHz` by default
+    bool has_fixed_render_rate = false;
+
+    // Render rate in use since the last activation
+    RenderRate render_rate = RenderRate::Default;
+
+    ProcessFn process_fn = nullptr;
+
+    // Shared by all instances. Looked up on activation, which builds the
+    // table if this is the first instance that needs it.
+    std::shared_ptr<const Wavetable> triangle_table = {};
+
+    // The SIMD kernels selected when the library was loaded, or the
+    // baseline ones in deterministic mode; the resampler uses them too
+    const kernels::Kernels* dsp_kernels = nullptr;
+
+    // Holds the memory of everything the audio thread renders with: the
+    // voices, the render, mix and resample buffers, and the input delay.
+    // Must be declared before them, as they point into it.
+    Arena dsp_arena = {};
 
-    Waveform waveform = {};
+    // Sampler: the sample the voices have been playing since the last
+    // activation, and one loaded since then, which takes over on the next
+    // one. The streamer reads from the former, so it's declared after it.
+    std::unique_ptr<SampleFile> sample_file         = {};
+    std::unique_ptr<SampleFile> pending_sample_file = {};
 
-    std::vector<Voice> voices = {};
+    // Sample frames per render frame, per unit of phase increment
+    double sample_inc_per_phase_inc = 0.0;
+
+    // Offline and in deterministic mode, voices read the frames that
+    // haven't been streamed in yet straight from the file
+    bool sample_reads_may_block = false;
+
+    // The voices' streams, one per voice slot; their rings are carved out
+    // of `dsp_arena`
+    SampleStreamer sample_streamer = {};
+
+    // Optional; nullptr if the host can't watch fds, in which case the
+    // streamer refills the rings on a thread of its own
+    const clap_host_posix_fd_support_t* host_posix_fd_support = nullptr;
+
+    // Wakes us up in the host's event loop to refill the rings
+    TimerFd stream_timer = {};
+
+    // Underruns the audio thread has asked to get logged, and the ones
+    // we've logged already on the main thread
+    uint64_t num_signalled_underruns = 0;
+    uint64_t num_logged_underruns    = 0;
+
+    VoicePool<Voice, VoiceRenderState> voices = {};
+
+    // Input events of the block being processed
+    EventQueue events = {};
+
+    // Events for the host, sent at the end of Process() and Flush()
+    OutputEventQueue<NumParams> pending_out_events = {};
+
+    VoiceStealPolicy voice_steal_policy = VoiceStealPolicy::Oldest;
+
+    // Monophonic modulation of the polyphonically modulatable parameters,
+    // for voices without polyphonic modulation
+    std::array<float, NumPolyParams> mono_param_mod = {};
+
+    // MIDI pitch bend of every channel in semitones
+    float channel_pitch_bend[NumMidiChannels] = {};
 
     double render_sample_rate_hz = 0.0;
     double output_sample_rate_hz = 0.0;
 
-    std::array<std::vector<float>, 2> render_buf = {};
+    // The number of channels of the output layout. In stereo, voices can be
+    // panned, so the mix is rendered, buffered and resampled in stereo. A
+    // mono output ignores panning and only renders and resamples one
+    // channel.
+    uint32_t num_render_channels = NumMixChannels;
+
+    // Frames rendered ahead of the output: the resampler's input, or the
+    // lead of deterministic renders. Otherwise, the voices are rendered
+    // straight into the host's buffers.
+    RenderBuffer<float> render_buf = {};
+
+    // Only used for double precision output of deterministic renders; the
+    // resampler backends work in single precision, so when resampling we
+    // always render floats and only widen them at the very end.
+    RenderBuffer<double> render_buf64 = {};
+
+    RenderScheduler render_scheduler = {};
+
+    // Output frames processed since the activation or the last seek. Only
+    // used in deterministic mode, to put the pipeline where it would be
+    // after a run of silence when it wakes up.
+    uint64_t stream_position = 0;
+
+    // The host's song position at the render position; drives the tempo
+    // synced LFOs
+    TransportClock transport_clock = {};
+
+    // Checks that the pipeline neither drops nor duplicates frames
+    FrameLedger frame_ledger = {};
+
+    // Number of violations we've logged already; main thread
+    uint64_t num_logged_frame_violations = 0;
+
+    // When there are no voices and the resampler's tail has died out, we
+    // skip rendering altogether and just output silence.
+    bool is_idle = true;
+
+    uint32_t tail_frames       = 0;
+    uint32_t frames_until_idle = 0;
+
+    // The block currently being rendered by the thread pool tasks
+    struct RenderJob {
+        uint32_t num_frames    = 0;
+        uint32_t num_groups    = 0;
+        BlockControls controls = {};
+
+        // The RenderVoiceGroup() specialisation to run
+        void (MyPlugin::*render_group)(const uint32_t group) = nullptr;
+    };
+
+    RenderJob render_job = {};
+
+    // The batch being processed by the thread pool tasks, if this instance
+    // leads one; see ProcessBatch()
+    struct BatchJob {
+        MyPlugin* const* plugins               = nullptr;
+        const clap_process_t* const* processes = nullptr;
+        clap_process_status* statuses          = nullptr;
+
+        // Indices into the arrays above, grouped by render configuration;
+        // every task processes the range of `order` it's dealt
+        const uint32_t* order = nullptr;
+        uint32_t count        = 0;
+        uint32_t num_tasks    = 0;
+    };
+
+    BatchJob batch_job = {};
+
+    // Processes the instances of a batch's task one after the other
+    void ExecBatchTask(const uint32_t task_index);
+
+    // The worker pool can't hold many more tasks than this per round
+    static constexpr uint32_t MaxBatchTasks = WorkStealingDeque::Capacity;
+
+    // Set while an instance is processed as part of a batch, as it may be
+    // running on a thread pool thread already
+    bool is_batched = false;
+
+    // Scratch buffers for mixing the voices. They're a few hundred
+    // kilobytes, so they're carved out of the arena on activation; see
+    // AllocateDspResources().
+    struct MixBuffers {
+        static constexpr auto MixSize = NumMixChannels * MaxRenderBlockSize;
+
+        // Planar stereo mix of all voices for the block being rendered
+        ArenaArray<float> mix    = {};
+        ArenaArray<double> mix64 = {};
+
+        // Each voice group is mixed into its own scratch buffers, then the
+        // groups are summed on the audio thread
+        ArenaArray<float> group_mix    = {};
+        ArenaArray<double> group_mix64 = {};
+
+        // The sample frames each voice group's voices read, interleaved;
+        // only allocated while the sampler has a sample
+        ArenaArray<float> sample_frames = {};
+
+        void Allocate(Arena& arena, const bool has_sample)
+        {
+            mix         = arena.Allocate<float>(MixSize);
+            mix64       = arena.Allocate<double>(MixSize);
+            group_mix   = arena.Allocate<float>(MaxVoiceGroups * MixSize);
+            group_mix64 = arena.Allocate<double>(MaxVoiceGroups * MixSize);
+
+            if (has_sample) {
+                sample_frames = arena.Allocate<float>(
+                    MaxVoiceGroups * SampleScratchFrames * SampleFile::MaxChannels);
+            }
+        }
+    };
+
+    MixBuffers mix_buffers = {};
+
+    // Created in Activate() according to the resample quality parameter
+    std::unique_ptr<Resampler> resampler = {};
+    double resample_ratio                = 0.0f;
+
+    ResamplerType resampler_type = ResamplerType::Speex;
+
+    // Events are rendered at the internal frame they map to, which is the
+    // resampler's look-ahead ahead of the output, so everything we output
+    // is delayed by the resampler's latency. We report this to the host so
+    // it can compensate. It can only change when we get (re)activated.
+    uint32_t latency_frames = 0;
+
+    // Optional; nullptr if the host doesn't support latency reporting
+    const clap_host_latency_t* host_latency = nullptr;
+
+    // The audio input gets delayed by `latency_frames` as well, so it lines
+    // up with our output. Without latency, the input goes straight to the
+    // output, which is free when the host processes us in place.
+    std::array<ArenaArray<double>, 2> input_delay = {};
+    uint32_t input_delay_pos                      = 0;
+
+    // Scratch output for WarmUp(), which is due after every activation
+    ArenaArray<float> warm_up_buf = {};
+    bool needs_warm_up            = false;
+
+    // Set once we've asked the host to reactivate us, so we don't flood it
+    // with requests while the quality parameter is being automated
+    bool restart_requested = false;
+
+    // Set by the audio thread along with `restart_requested`, so the main
+    // thread prepares the new render setup
+    std::atomic<bool> render_setup_pending = false;
+
+    // A resampler built on the background worker for the next activation,
+    // which takes it if it still fits the settings. Creating one takes up
+    // to a few milliseconds for the large filter tables, which would
+    // otherwise be spent on the main thread while the host waits for us to
+    // come back. Shared with the job, as that may outlive us.
+    struct PreparedResampler {
+        ResamplerType type           = ResamplerType::Speex;
+        uint32_t num_channels        = 0;
+        double in_rate_hz            = 0.0;
+        double out_rate_hz           = 0.0;
+        const kernels::Kernels* simd = nullptr;
+
+        std::unique_ptr<Resampler> resampler = {};
+    };
+
+    std::shared_ptr<Handoff<PreparedResampler>> prepared_resampler =
+        std::make_shared<Handoff<PreparedResampler>>();
+
+    // Resampler output for stereo content (interleaved) and for double
+    // precision output
+    ArenaArray<float> resample_buf = {};
+
+    // Only accessed by the audio thread
+    float audio_params[NumParams] = {};
+
+    std::array<ParamSmoother, NumParams> param_smoothers = {};
+
+    // Only accessed by the main thread
+    float main_params[NumParams] = {};
+
+    // Scratch buffer for saving and loading states; see state_format.h.
+    // Allocated on first use, as hosts scanning plugins never touch it.
+    std::vector<uint8_t> state_buf = {};
+
+    // The bank we've last loaded a preset from; stays mapped, as browsing
+    // through presets tends to load many presets from the same bank
+    PresetBank preset_bank = {};
+
+    // Optional; nullptr if the host doesn't support preset loading
+    const clap_host_preset_load_t* host_preset_load = nullptr;
+
+    // Optional; nullptr if the host doesn't support parameter flushing
+    const clap_host_params_t* host_params = nullptr;
+
+    // Optional; nullptr if the host doesn't support timers, in which case
+    // parameters are only synced when the host calls us
+    const clap_host_timer_support_t* host_timer_support = nullptr;
+
+    // Syncs the parameters between the two threads while the host isn't
+    // processing, e.g. while the transport is stopped
+    static constexpr uint32_t ParamSyncPeriodMs = 30;
+
+    clap_id param_sync_timer_id = CLAP_INVALID_ID;
+
+    // Set once we've asked the host for a flush, until our changes have been
+    // consumed, so editing many parameters at once results in a single
+    // request
+    bool flush_requested = false;
+
+    // Profiling of the process calls; compiled out unless TELEMETRY is
+    // defined. The summary is only accessed by the main thread.
+    telemetry::Recorder telemetry        = {};
+    telemetry::Summary telemetry_summary = {};
+
+    static constexpr double TelemetryReportPeriodS = 1.0;
+
+    // Optional; nullptr if the host can't log
+    const clap_host_log_t* host_log = nullptr;
+
+    // Optional; nullptr if the host doesn't provide tunings
+    const clap_host_tuning_t* host_tuning = nullptr;
+
+    // Phase increments of all keys on all channels, tuned
+    TuningTable tuning_table = {};
 
-    SpeexResamplerState* resampler = nullptr;
-    double resample_ratio          = 0.0f;
+    // Event space of the tuning events; UINT16_MAX if the host has none
+    uint16_t tuning_space_id = UINT16_MAX;
 
-    // for the audio thread
-    float audio_params[NumParams]        = {};
-    bool audio_params_changed[NumParams] = {};
+    // The host's tuning of each channel, as set by tuning events
+    std::array<clap_id, TuningTable::NumChannels> channel_tunings = {};
 
-    // for the main thread
-    float main_params[NumParams]        = {};
-    bool main_params_changed[NumParams] = {};
+    // Set on the main thread if any tuning in the host's pool is dynamic,
+    // in which case the voices' tunings are refreshed at block rate
+    std::atomic<bool> have_dynamic_tunings = false;
 
-    std::mutex sync_params = {};
+    // Parameter changes are passed between the two threads through these
+    // lock-free channels, so the audio thread never has to wait for the main
+    // thread.
+    ParamExchange<NumParams> main_to_audio = {};
+    ParamExchange<NumParams> audio_to_main = {};
 };
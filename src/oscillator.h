@@ -0,0 +1,470 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Block-based oscillator kernels. Instead of evaluating `sinf()` and friends
+// one sample at a time, a whole block is rendered in one go: the phase
+// increment and the gain ramp are calculated once per block by the caller,
+// and the kernels evaluate cheap polynomial waveform approximations either
+// for SIMD-sized runs of frames of a single voice, or for SIMD-sized groups
+// of voices at once.
+
+#include <cmath>
+#include <cstdint>
+
+#include "simd.h"
+
+namespace osc {
+inline namespace SIMD_ISA {
+
+// All shapes expect a phase in the [0, 1) range. The phase is first folded
+// into the [-0.25, 0.25] range which contains a single monotonic quarter
+// period of both the sine and the triangle wave; the remaining evaluation is
+// branchless.
+template <typename V>
+inline V FoldPhase(const V phase)
+{
+    const auto t = phase - V::Set(0.5f);
+    const auto a = Abs(t);
+
+    const auto quarter = V::Set(0.25f);
+    const auto folded  = quarter - Abs(a - quarter);
+
+    return CopySign(folded, t);
+}
+
+// Every shape gets the reciprocal of the phase increment as well; the
+// band-limited ones need it to scale their corrections to the width of a
+// sample.
+
+struct Sine {
+    template <typename V>
+    static V Eval(const V phase, const V inv_phase_inc)
+    {
+        const auto x  = FoldPhase(phase);
+        const auto x2 = x * x;
+
+        // Taylor series of -sin(2*pi*x) up to the 9th order term; the
+        // maximum error in the [-0.25, 0.25] range is about 4e-6 (-108 dB).
+        constexpr auto C1 = -6.283185307f;
+        constexpr auto C3 = 41.341702240f;
+        constexpr auto C5 = -81.605249276f;
+        constexpr auto C7 = 76.705859753f;
+        constexpr auto C9 = -42.058693944f;
+
+        auto p = V::Set(C9);
+        p      = p * x2 + V::Set(C7);
+        p      = p * x2 + V::Set(C5);
+        p      = p * x2 + V::Set(C3);
+        p      = p * x2 + V::Set(C1);
+
+        return p * x;
+    }
+};
+
+// Naive triangle; aliases at high pitches. The plugin uses the
+// band-limited wavetable version (see RenderWavetable()) instead, but this
+// is handy as a reference.
+struct Triangle {
+    template <typename V>
+    static V Eval(const V phase, const V inv_phase_inc)
+    {
+        return FoldPhase(phase) * V::Set(-4.0f);
+    }
+};
+
+// Polynomial band-limited step (PolyBLEP) residual for a step of -2 at phase
+// 0. This is the 2-point polynomial approximation of the difference between
+// a band-limited and a naive step. It is non-zero only within one sample of
+// the discontinuity, on both sides.
+//
+// Written as the difference of two clamped squares instead of the usual
+// two-branch form, so it vectorises without any compares:
+//
+//     t < dt:      -(1 - t/dt)^2
+//     t > 1 - dt:  ((t - 1)/dt + 1)^2
+//
+template <typename V>
+inline V PolyBlep(const V phase, const V inv_phase_inc)
+{
+    const auto zero = V::Set(0.0f);
+    const auto one  = V::Set(1.0f);
+
+    const auto a = Max(zero, one - phase * inv_phase_inc);
+    const auto b = Max(zero, (phase - one) * inv_phase_inc + one);
+
+    return b * b - a * a;
+}
+
+// Rising sawtooth, shifted by half a period so it starts at zero like the
+// other shapes
+struct Saw {
+    template <typename V>
+    static V Eval(const V phase, const V inv_phase_inc)
+    {
+        const auto t = Fract(phase + V::Set(0.5f));
+
+        return t * V::Set(2.0f) - V::Set(1.0f) - PolyBlep(t, inv_phase_inc);
+    }
+};
+
+// Square wave with a 50% duty cycle; high for the first half of the period
+struct Square {
+    template <typename V>
+    static V Eval(const V phase, const V inv_phase_inc)
+    {
+        const auto naive = CopySign(V::Set(1.0f), V::Set(0.5f) - phase);
+
+        // One step down at half period, one back up at the start
+        const auto down = PolyBlep(Fract(phase + V::Set(0.5f)), inv_phase_inc);
+        const auto up   = PolyBlep(phase, inv_phase_inc);
+
+        return naive + up - down;
+    }
+};
+
+// The kernels below add their output to `NumChannels` planar output
+// channels, `out[0]` to `out[NumChannels - 1]`. Every channel has a gain
+// ramp of its own, so a voice can be panned by giving it different gains
+// in each channel; the waveform itself is only evaluated once for all
+// channels.
+
+// Renders `num_frames` frames of a single voice and adds them to `out`. The
+// gain of channel `c` ramps linearly from `gain_start[c]` to `gain_end[c]`
+// over the block. `phase` is updated to the phase of the next frame after
+// the block.
+//
+// `T` is the sample type of the output (float or double); the shapes are
+// evaluated with the matching vector type.
+template <typename Shape, uint32_t NumChannels, typename T>
+inline void Render(T* const* out, const uint32_t num_frames, float& phase,
+                   const float phase_inc, const float* gain_start,
+                   const float* gain_end)
+{
+    using V = typename simd::VectorTypes<T>::Wide;
+
+    constexpr auto NumLanes = V::NumLanes;
+
+    if (num_frames == 0) {
+        return;
+    }
+
+    T gain_inc[NumChannels] = {};
+
+    for (uint32_t c = 0; c < NumChannels; ++c) {
+        gain_inc[c] = (static_cast<T>(gain_end[c]) - gain_start[c]) / num_frames;
+    }
+
+    const auto phase_step = V::Set(phase_inc * NumLanes);
+
+    // A zero phase increment only yields silence anyway; just make sure we
+    // don't divide by zero
+    const auto inv_inc = (phase_inc > 0.0f) ? 1.0f / phase_inc : 1.0f;
+
+    const auto inv_inc_v = V::Set(inv_inc);
+
+    auto p = Fract(V::Ramp(phase, phase_inc));
+
+    V g[NumChannels]         = {};
+    V gain_step[NumChannels] = {};
+
+    for (uint32_t c = 0; c < NumChannels; ++c) {
+        g[c]         = V::Ramp(gain_start[c], gain_inc[c]);
+        gain_step[c] = V::Set(gain_inc[c] * NumLanes);
+    }
+
+    uint32_t i = 0;
+
+    for (; i + NumLanes <= num_frames; i += NumLanes) {
+        const auto value = Shape::Eval(p, inv_inc_v);
+
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            const auto sum = V::Load(out[c] + i) + value * g[c];
+            sum.Store(out[c] + i);
+
+            g[c] = g[c] + gain_step[c];
+        }
+
+        p = Fract(p + phase_step);
+    }
+
+    // Process the leftover frames one by one
+    if (i < num_frames) {
+        using S = typename simd::VectorTypes<T>::Scalar;
+
+        const auto tail_phase = static_cast<T>(std::fmod(
+            static_cast<double>(phase) + static_cast<double>(phase_inc) * i, 1.0));
+
+        auto ps = S::Set(tail_phase);
+
+        S gs[NumChannels] = {};
+
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            gs[c] = S::Set(gain_start[c] + gain_inc[c] * i);
+        }
+
+        for (; i < num_frames; ++i) {
+            const auto value = Shape::Eval(ps, S::Set(inv_inc));
+
+            for (uint32_t c = 0; c < NumChannels; ++c) {
+                const auto sum = S::Load(out[c] + i) + value * gs[c];
+                sum.Store(out[c] + i);
+
+                gs[c] = gs[c] + S::Set(gain_inc[c]);
+            }
+
+            ps = Fract(ps + S::Set(phase_inc));
+        }
+    }
+
+    // Advance the phase in double precision so rounding errors don't
+    // accumulate across blocks
+    const auto next_phase = static_cast<double>(phase) +
+                            static_cast<double>(phase_inc) * num_frames;
+
+    phase = static_cast<float>(next_phase - std::floor(next_phase));
+}
+
+// Renders one voice per lane of `V` for a block and adds their sum to
+// `out`. The voice state is read from `NumLanes` consecutive entries of the
+// arrays, and the phases are written back at the end. `gain_start[c]` and
+// `gain_end[c]` point to the gains of channel `c`.
+template <typename Shape, uint32_t NumChannels, typename T, typename V>
+inline void RenderVoiceLanes(T* const* out, const uint32_t num_frames,
+                             float* phase, const float* phase_inc,
+                             const float* const* gain_start,
+                             const float* const* gain_end)
+{
+    constexpr auto NumLanes = V::NumLanes;
+
+    // The state is only converted into vectors once per block
+    T lanes[NumLanes];
+
+    const auto load = [&](const auto lane_value) {
+        for (uint32_t l = 0; l < NumLanes; ++l) {
+            lanes[l] = lane_value(l);
+        }
+        return V::Load(lanes);
+    };
+
+    const auto inc = load([&](const uint32_t l) { return phase_inc[l]; });
+
+    // A zero phase increment only yields silence anyway; just make sure we
+    // don't divide by zero
+    const auto inv_inc = load([&](const uint32_t l) {
+        return (phase_inc[l] > 0.0f) ? 1.0f / phase_inc[l] : 1.0f;
+    });
+
+    V g[NumChannels]         = {};
+    V gain_step[NumChannels] = {};
+
+    for (uint32_t c = 0; c < NumChannels; ++c) {
+        gain_step[c] = load([&](const uint32_t l) {
+            return (static_cast<T>(gain_end[c][l]) - gain_start[c][l]) / num_frames;
+        });
+
+        g[c] = load([&](const uint32_t l) { return gain_start[c][l]; });
+    }
+
+    auto p = load([&](const uint32_t l) { return phase[l]; });
+
+    for (uint32_t i = 0; i < num_frames; ++i) {
+        const auto value = Shape::Eval(p, inv_inc);
+
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            out[c][i] += HorizontalSum(value * g[c]);
+
+            g[c] = g[c] + gain_step[c];
+        }
+
+        p = Fract(p + inc);
+    }
+
+    // Same as in Render(): don't let rounding errors accumulate
+    for (uint32_t l = 0; l < NumLanes; ++l) {
+        const auto next_phase = static_cast<double>(phase[l]) +
+                                static_cast<double>(phase_inc[l]) * num_frames;
+
+        phase[l] = static_cast<float>(next_phase - std::floor(next_phase));
+    }
+}
+
+// Renders `num_voices` voices of the same shape for a block and adds them
+// to `out`. The voice state is a structure of arrays with one entry per
+// voice; the gain of each voice in channel `c` ramps linearly from
+// `gain_start[c]` to `gain_end[c]` over the block, and its phase is updated
+// to that of the next frame after the block.
+//
+// Whole groups of voices are rendered together with one voice per SIMD
+// lane, so every frame costs one evaluation of the shape per group instead
+// of per voice. The leftover voices are rendered one by one with Render(),
+// which vectorises over time instead.
+template <typename Shape, uint32_t NumChannels, typename T>
+inline void RenderVoices(T* const* out, const uint32_t num_frames,
+                         const uint32_t num_voices, float* phase,
+                         const float* phase_inc, const float* const* gain_start,
+                         const float* const* gain_end)
+{
+    using V = typename simd::VectorTypes<T>::Wide;
+
+    if (num_frames == 0) {
+        return;
+    }
+
+    const float* gs[NumChannels] = {};
+    const float* ge[NumChannels] = {};
+
+    const auto offset_gains = [&](const uint32_t v) {
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            gs[c] = gain_start[c] + v;
+            ge[c] = gain_end[c] + v;
+        }
+    };
+
+    uint32_t v = 0;
+
+    if constexpr (V::NumLanes > 1) {
+        for (; v + V::NumLanes <= num_voices; v += V::NumLanes) {
+            offset_gains(v);
+
+            RenderVoiceLanes<Shape, NumChannels, T, V>(
+                out, num_frames, phase + v, phase_inc + v, gs, ge);
+        }
+    }
+
+    for (; v < num_voices; ++v) {
+        float start[NumChannels] = {};
+        float end[NumChannels]   = {};
+
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            start[c] = gain_start[c][v];
+            end[c]   = gain_end[c][v];
+        }
+
+        Render<Shape, NumChannels>(
+            out, num_frames, phase[v], phase_inc[v], start, end);
+    }
+}
+
+// Same as Render(), but reads the waveform from one mip level of a
+// wavetable with linear interpolation. `table` must contain `table_size + 1`
+// samples (see Wavetable::Level()).
+template <uint32_t NumChannels, typename T>
+inline void RenderWavetable(T* const* out, const uint32_t num_frames,
+                            float& phase, const float phase_inc,
+                            const float* gain_start, const float* gain_end,
+                            const float* table, const uint32_t table_size)
+{
+    if (num_frames == 0) {
+        return;
+    }
+
+    T gain[NumChannels]     = {};
+    T gain_inc[NumChannels] = {};
+
+    for (uint32_t c = 0; c < NumChannels; ++c) {
+        gain[c]     = gain_start[c];
+        gain_inc[c] = (static_cast<T>(gain_end[c]) - gain_start[c]) / num_frames;
+    }
+
+    // Keep track of the phase in table samples
+    const auto size = static_cast<float>(table_size);
+    const auto inc  = phase_inc * size;
+
+    auto pos = phase * size;
+    if (pos >= size) {
+        pos -= size;
+    }
+
+    for (uint32_t i = 0; i < num_frames; ++i) {
+        const auto index = static_cast<uint32_t>(pos);
+        const auto frac  = pos - static_cast<float>(index);
+
+        const auto a = table[index];
+        const auto b = table[index + 1];
+
+        const auto value = static_cast<T>(a + (b - a) * frac);
+
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            out[c][i] += value * gain[c];
+            gain[c] += gain_inc[c];
+        }
+
+        pos += inc;
+        if (pos >= size) {
+            pos -= size;
+        }
+    }
+
+    const auto next_phase = static_cast<double>(phase) +
+                            static_cast<double>(phase_inc) * num_frames;
+
+    phase = static_cast<float>(next_phase - std::floor(next_phase));
+}
+
+// Plays back sample content at `inc` sample frames per output frame, with
+// linear interpolation. `frames` holds the interleaved sample frames from
+// `first_frame` on, which must cover every frame the block reads: up to
+// and including the one after `pos + inc * (num_frames - 1)`. A stereo
+// sample gets mixed down for a single output channel.
+template <uint32_t NumChannels, typename T>
+inline void RenderSample(T* const* out, const uint32_t num_frames, double& pos,
+                         const double inc, const float* gain_start,
+                         const float* gain_end, const float* frames,
+                         const uint32_t first_frame, const uint32_t sample_channels)
+{
+    if (num_frames == 0) {
+        return;
+    }
+
+    T gain[NumChannels]     = {};
+    T gain_inc[NumChannels] = {};
+
+    for (uint32_t c = 0; c < NumChannels; ++c) {
+        gain[c]     = gain_start[c];
+        gain_inc[c] = (static_cast<T>(gain_end[c]) - gain_start[c]) / num_frames;
+    }
+
+    // Relative to the first frame in the buffer, which is closer to zero,
+    // so it's precise enough in single precision within a block
+    auto x = static_cast<float>(pos - first_frame);
+
+    const auto step = static_cast<float>(inc);
+
+    for (uint32_t i = 0; i < num_frames; ++i) {
+        const auto index = static_cast<uint32_t>(x);
+        const auto frac  = x - static_cast<float>(index);
+
+        const auto a = frames + index * sample_channels;
+        const auto b = a + sample_channels;
+
+        if (sample_channels == 1) {
+            const auto value = static_cast<T>(a[0] + (b[0] - a[0]) * frac);
+
+            for (uint32_t c = 0; c < NumChannels; ++c) {
+                out[c][i] += value * gain[c];
+            }
+        } else if constexpr (NumChannels == 1) {
+            const auto left  = a[0] + (b[0] - a[0]) * frac;
+            const auto right = a[1] + (b[1] - a[1]) * frac;
+
+            out[0][i] += static_cast<T>(0.5f * (left + right)) * gain[0];
+        } else {
+            for (uint32_t c = 0; c < NumChannels; ++c) {
+                out[c][i] += static_cast<T>(a[c] + (b[c] - a[c]) * frac) * gain[c];
+            }
+        }
+
+        for (uint32_t c = 0; c < NumChannels; ++c) {
+            gain[c] += gain_inc[c];
+        }
+        x += step;
+    }
+
+    // The position itself is advanced in double precision, so it doesn't
+    // drift over long samples
+    pos += inc * num_frames;
+}
+
+} // namespace SIMD_ISA
+} // namespace osc
@@ -0,0 +1,205 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Staging area for the events we send to the host.
+//
+// The host's output event queue can refuse events when it's full, so
+// instead of pushing events straight into it (and silently losing the ones
+// it rejects), we collect them here during the block and hand them over in
+// a single pass at the end, in timestamp order. Parameter values are
+// coalesced, so only the last value of each parameter is sent per block.
+// Anything the host doesn't accept stays queued and is retried at the start
+// of the next block on the next Process() or Flush() call.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "clap/clap.h"
+
+template <uint32_t NumParams>
+class OutputEventQueue {
+
+public:
+    // Maximum number of note end events we can hold on to. That's a lot
+    // more than the number of voices that can end in a single block.
+    static constexpr uint32_t NoteCapacity = 1024;
+
+    // Must be called at the start of every Process() and Flush() call.
+    // Retried events refer to an earlier block, so they're moved to the
+    // start of the current one.
+    void BeginBlock()
+    {
+        for (uint32_t i = 0; i < num_notes; ++i) {
+            notes[i].header.time = 0;
+        }
+        for (uint32_t i = 0; i < num_pending_params; ++i) {
+            params[pending_params[i]].time = 0;
+        }
+    }
+
+    bool Empty() const
+    {
+        return num_notes == 0 && num_pending_params == 0;
+    }
+
+    // Replaces any value of the same parameter for the current block
+    void StageParamValue(const uint32_t param_id, const double value,
+                         const uint32_t time)
+    {
+        auto& param = params[param_id];
+
+        if (!param.pending) {
+            param.pending                        = true;
+            pending_params[num_pending_params++] = param_id;
+        }
+        param.value = value;
+        param.time  = time;
+    }
+
+    // Returns false if there's no room left for the event
+    bool StageNoteEnd(const uint32_t time, const int16_t key,
+                      const int32_t note_id, const int16_t channel)
+    {
+        if (num_notes == NoteCapacity) {
+            return false;
+        }
+
+        // Stay sorted by time, keeping the order of events with the same
+        // timestamp. Events are mostly staged in order, so this rarely
+        // moves anything.
+        auto pos = num_notes;
+
+        while (pos > 0 && notes[pos - 1].header.time > time) {
+            notes[pos] = notes[pos - 1];
+            --pos;
+        }
+
+        notes[pos] = {
+            .header     = {.size     = sizeof(clap_event_note_t),
+                           .time     = time,
+                           .space_id = CLAP_CORE_EVENT_SPACE_ID,
+                           .type     = CLAP_EVENT_NOTE_END,
+                           .flags    = 0},
+            .note_id    = note_id,
+            .port_index = 0,
+            .channel    = channel,
+            .key        = key,
+            .velocity   = 0.0
+        };
+        ++num_notes;
+
+        return true;
+    }
+
+    // Hands the staged events over to the host in timestamp order, with
+    // parameter values before note events of the same timestamp. Stops at
+    // the first event the host refuses, so the order is kept when retrying.
+    // Returns true if all events have been sent.
+    bool Flush(const clap_output_events_t* out)
+    {
+        uint32_t next_note = 0;
+
+        const auto push_notes_until = [&](const uint32_t time) {
+            while (next_note < num_notes) {
+                const auto& note = notes[next_note];
+
+                if (note.header.time >= time) {
+                    break;
+                }
+                if (!out->try_push(out, &note.header)) {
+                    return false;
+                }
+                ++next_note;
+            }
+            return true;
+        };
+
+        // Only the parameters that have changed are looked at, so this
+        // doesn't get slower with the number of parameters we have. Only a
+        // few change per block, and mostly in order, so an insertion sort
+        // is all we need.
+        for (uint32_t i = 1; i < num_pending_params; ++i) {
+            const auto id = pending_params[i];
+            auto pos      = i;
+
+            while (pos > 0 && params[pending_params[pos - 1]].time > params[id].time) {
+                pending_params[pos] = pending_params[pos - 1];
+                --pos;
+            }
+            pending_params[pos] = id;
+        }
+
+        bool ok           = true;
+        uint32_t num_sent = 0;
+
+        while (ok && num_sent < num_pending_params) {
+            const auto id = pending_params[num_sent];
+
+            ok = push_notes_until(params[id].time) && PushParamValue(out, id, params[id]);
+
+            if (ok) {
+                params[id].pending = false;
+                ++num_sent;
+            }
+        }
+
+        std::copy(pending_params.begin() + num_sent,
+                  pending_params.begin() + num_pending_params,
+                  pending_params.begin());
+
+        num_pending_params -= num_sent;
+
+        if (ok) {
+            ok = push_notes_until(UINT32_MAX);
+        }
+
+        // Keep whatever hasn't been sent for the next attempt
+        std::copy(notes.begin() + next_note,
+                  notes.begin() + num_notes,
+                  notes.begin());
+
+        num_notes -= next_note;
+
+        return ok;
+    }
+
+private:
+    struct PendingParam {
+        bool pending  = false;
+        uint32_t time = 0;
+        double value  = 0.0;
+    };
+
+    static bool PushParamValue(const clap_output_events_t* out,
+                               const uint32_t param_id,
+                               const PendingParam& param)
+    {
+        clap_event_param_value_t event = {
+            .header     = {.size     = sizeof(event),
+                           .time     = param.time,
+                           .space_id = CLAP_CORE_EVENT_SPACE_ID,
+                           .type     = CLAP_EVENT_PARAM_VALUE,
+                           .flags    = 0},
+            .param_id   = param_id,
+            .cookie     = nullptr,
+            .note_id    = -1,
+            .port_index = -1,
+            .channel    = -1,
+            .key        = -1,
+            .value      = param.value
+        };
+
+        return out->try_push(out, &event.header);
+    }
+
+    std::array<PendingParam, NumParams> params = {};
+
+    // IDs of the parameters with a pending value
+    std::array<uint32_t, NumParams> pending_params = {};
+    uint32_t num_pending_params                    = 0;
+
+    std::array<clap_event_note_t, NoteCapacity> notes = {};
+    uint32_t num_notes                                = 0;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Lock-free, one-directional channel for passing parameter values from one
+// thread to another (single producer, single consumer).
+//
+// The producer stores the new value of a parameter in a per-parameter atomic
+// then sets the parameter's bit in a dirty bitset. The consumer atomically
+// grabs and clears whole words of the bitset and reads the corresponding
+// values. Neither side ever blocks, and when the producer updates a
+// parameter several times before the consumer gets to it, only the latest
+// value is seen.
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+template <uint32_t NumParams>
+class ParamExchange {
+
+public:
+    static_assert(std::atomic<float>::is_always_lock_free);
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+    // Sets the initial values without marking them as changed. Must not be
+    // called concurrently with either side of the exchange.
+    void Reset(const float* params)
+    {
+        for (uint32_t i = 0; i < NumParams; ++i) {
+            values[i].store(params[i], std::memory_order_relaxed);
+        }
+        for (auto& word : dirty) {
+            word.store(0, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // Producer side
+    void Publish(const uint32_t index, const float value)
+    {
+        values[index].store(value, std::memory_order_relaxed);
+
+        dirty[index / BitsPerWord].fetch_or(Bit(index), std::memory_order_release);
+    }
+
+    // Consumer side; calls `fn(index, value)` for every parameter that has
+    // changed since the last call.
+    template <typename Fn>
+    void Consume(Fn&& fn)
+    {
+        for (uint32_t w = 0; w < NumWords; ++w) {
+            // Nothing changes in the vast majority of calls, and a plain
+            // load is much cheaper than a read-modify-write
+            if (dirty[w].load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+
+            auto bits = dirty[w].exchange(0, std::memory_order_acquire);
+
+            while (bits) {
+                const auto index = w * BitsPerWord +
+                                   static_cast<uint32_t>(std::countr_zero(bits));
+                bits &= bits - 1;
+
+                fn(index, values[index].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    // Returns true if the parameter has been published but not yet consumed.
+    // Can be called from either side.
+    bool IsPending(const uint32_t index) const
+    {
+        return dirty[index / BitsPerWord].load(std::memory_order_acquire) &
+               Bit(index);
+    }
+
+    // Returns true if any parameter has been published but not yet
+    // consumed. Can be called from either side.
+    bool AnyPending() const
+    {
+        for (const auto& word : dirty) {
+            if (word.load(std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Returns the most recently published value of a parameter. Can be
+    // called from either side.
+    float Peek(const uint32_t index) const
+    {
+        return values[index].load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr uint32_t BitsPerWord = 64;
+    static constexpr uint32_t NumWords = (NumParams + BitsPerWord - 1) / BitsPerWord;
+
+    static constexpr uint64_t Bit(const uint32_t index)
+    {
+        return uint64_t{1} << (index % BitsPerWord);
+    }
+
+    std::array<std::atomic<float>, NumParams> values  = {};
+    std::array<std::atomic<uint64_t>, NumWords> dirty = {};
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Block-rate parameter smoothing.
+//
+// Whenever a parameter changes, the smoother glides from the current value
+// to the new target instead of jumping to it, which would cause audible
+// "zipper noise". The smoothed curve is evaluated once per render block and
+// handed out as a linear ramp (the values at the start and at the end of the
+// block); the render kernels interpolate between the two. This way the cost
+// of smoothing is independent of the number of voices, and the voices can
+// add their own polyphonic offsets to the ramp endpoints.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+enum class SmoothingMode {
+    // Constant-rate glide that reaches the target in exactly the configured
+    // smoothing time
+    Linear,
+
+    // Exponential approach to the target; the smoothing time is the time
+    // constant of the filter (reaches ~63% of a change)
+    OnePole
+};
+
+class ParamSmoother {
+
+public:
+    struct Ramp {
+        float start = 0.0f;
+        float end   = 0.0f;
+    };
+
+    void Setup(const SmoothingMode _mode, const double smoothing_time_ms,
+               const double sample_rate_hz)
+    {
+        mode = _mode;
+
+        smoothing_frames = std::max(
+            1.0, std::round(smoothing_time_ms / 1000.0 * sample_rate_hz));
+
+        one_pole_coeff = std::exp(-1.0 / smoothing_frames);
+
+        SnapTo(target);
+    }
+
+    // Jumps to `value` immediately
+    void SnapTo(const float value)
+    {
+        target           = value;
+        current          = value;
+        frames_remaining = 0;
+    }
+
+    void SetTarget(const float value)
+    {
+        if (value == target) {
+            return;
+        }
+
+        target = value;
+
+        if (mode == SmoothingMode::Linear) {
+            frames_remaining = static_cast<uint32_t>(smoothing_frames);
+            step             = (target - current) / frames_remaining;
+        } else {
+            frames_remaining = 1;
+        }
+    }
+
+    bool IsSmoothing() const
+    {
+        return frames_remaining > 0;
+    }
+
+    float Current() const
+    {
+        return current;
+    }
+
+    // Advances the smoother by a block of `num_frames` frames and returns the
+    // start and end values of the ramp for the block.
+    Ramp Next(const uint32_t num_frames)
+    {
+        Ramp ramp = {current, current};
+
+        if (IsSmoothing()) {
+            if (mode == SmoothingMode::Linear) {
+                if (num_frames >= frames_remaining) {
+                    current          = target;
+                    frames_remaining = 0;
+                } else {
+                    current += step * num_frames;
+                    frames_remaining -= num_frames;
+                }
+            } else {
+                // Closed-form evaluation of the filter after `num_frames`
+                // steps
+                const auto decay = std::pow(one_pole_coeff, num_frames);
+                current = static_cast<float>(target + (current - target) * decay);
+
+                if (std::fabs(current - target) < SettledThreshold) {
+                    current          = target;
+                    frames_remaining = 0;
+                }
+            }
+            ramp.end = current;
+        }
+
+        return ramp;
+    }
+
+private:
+    // One-pole smoothing snaps to the target when it's closer than this
+    static constexpr auto SettledThreshold = 1e-5f;
+
+    SmoothingMode mode = SmoothingMode::Linear;
+
+    double smoothing_frames = 1.0;
+    double one_pole_coeff   = 0.0;
+
+    float target  = 0.0f;
+    float current = 0.0f;
+    float step    = 0.0f;
+
+    uint32_t frames_remaining = 0;
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Parameter metadata, and conversions between parameter values and text.
+//
+// Each parameter is described by a `param::Spec`: its name, range, flags and
+// how its values are displayed. The same description fills in the host's
+// `clap_param_info_t` and drives the text conversions, so adding a parameter
+// is a matter of adding an entry to the plugin's table.
+//
+// Hosts call the text conversions in tight loops to draw automation lanes
+// and parameter lists, so the formatter and the parser here are written by
+// hand: they never allocate, don't depend on the C locale, and cost about as
+// much as a few integer divisions. Values are displayed with a fixed number
+// of decimals, which is all parameters ever need.
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+#include "clap/ext/params.h"
+
+namespace param {
+
+enum class Unit : uint8_t {
+    None,
+
+    // Linear gain displayed in decibels
+    Decibels,
+
+    // Fractions displayed in percent
+    Percent,
+
+    Milliseconds,
+    Semitones,
+    Hertz,
+
+    // Stepped values that are displayed as plain integers, unless they have
+    // a label
+    Count,
+
+    // Stepped values that are always displayed by their label
+    Enum
+};
+
+// Returns the label of a stepped value, or nullptr if it has none
+using LabelFn = const char* (*)(uint32_t value);
+
+struct Spec {
+    const char* name = "";
+
+    // CLAP_PARAM_* flags
+    clap_param_info_flags flags = 0;
+
+    double min_value     = 0.0;
+    double max_value     = 1.0;
+    double default_value = 0.0;
+
+    Unit unit = Unit::None;
+
+    // Number of decimals displayed
+    uint8_t precision = 2;
+
+    // Only used for counts and enums
+    LabelFn label = nullptr;
+};
+
+namespace detail {
+
+constexpr auto MinDecibels = -120.0;
+
+inline bool IsStepped(const Spec& spec)
+{
+    return spec.unit == Unit::Count || spec.unit == Unit::Enum;
+}
+
+inline const char* Suffix(const Unit unit)
+{
+    switch (unit) {
+    case Unit::Decibels: return " dB";
+    case Unit::Percent: return " %";
+    case Unit::Milliseconds: return " ms";
+    case Unit::Semitones: return " st";
+    case Unit::Hertz: return " Hz";
+    default: return "";
+    }
+}
+
+inline char ToLower(const char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Case-insensitive comparison of `text` with a null-terminated string
+inline bool Equals(const char* text, const char* end, const char* str)
+{
+    for (; text < end; ++text, ++str) {
+        if (*str == '\0' || ToLower(*text) != ToLower(*str)) {
+            return false;
+        }
+    }
+    return *str == '\0';
+}
+
+inline const char* SkipSpaces(const char* text, const char* end)
+{
+    while (text < end && (*text == ' ' || *text == '\t')) {
+        ++text;
+    }
+    return text;
+}
+
+// Appends a null-terminated string; returns nullptr if it doesn't fit
+inline char* Append(char* out, char* end, const char* str)
+{
+    const auto length = std::strlen(str);
+
+    if (!out || static_cast<size_t>(end - out) < length) {
+        return nullptr;
+    }
+    std::memcpy(out, str, length);
+
+    return out + length;
+}
+
+// Writes `value` with `precision` decimals, rounded to nearest
+inline char* FormatFixed(char* out, char* end, const double value,
+                         const uint8_t precision)
+{
+    uint64_t scale = 1;
+    for (uint8_t i = 0; i < precision; ++i) {
+        scale *= 10;
+    }
+
+    // Parameter values are nowhere near this, but the host may ask about
+    // anything
+    const auto scaled = std::round(std::abs(value) * static_cast<double>(scale));
+
+    if (!(scaled < 1e18)) {
+        return nullptr;
+    }
+
+    const auto fixed = static_cast<uint64_t>(scaled);
+
+    if (value < 0.0 && fixed != 0) {
+        out = Append(out, end, "-");
+    }
+    if (!out) {
+        return nullptr;
+    }
+
+    const auto [integer_end, error] = std::to_chars(out, end, fixed / scale);
+
+    if (error != std::errc{}) {
+        return nullptr;
+    }
+    out = integer_end;
+
+    if (precision > 0) {
+        if (end - out < 1 + precision) {
+            return nullptr;
+        }
+        *out++ = '.';
+
+        // Fractional digits, least significant first
+        auto fraction = fixed % scale;
+
+        for (auto digit = out + precision - 1; digit >= out; --digit) {
+            *digit = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        out += precision;
+    }
+
+    return out;
+}
+
+// Parses a decimal number without an exponent, or "inf". Returns the end of
+// the number, or nullptr if there is none.
+inline const char* ParseNumber(const char* text, const char* end, double& value)
+{
+    auto negative = false;
+
+    if (text < end && (*text == '-' || *text == '+')) {
+        negative = (*text == '-');
+        ++text;
+    }
+
+    if (end - text >= 3 && Equals(text, text + 3, "inf")) {
+        value = negative ? -HUGE_VAL : HUGE_VAL;
+        return text + 3;
+    }
+
+    double integer    = 0.0;
+    double fraction   = 0.0;
+    double scale      = 1.0;
+    auto has_digits   = false;
+    const auto digits = [&](auto& accumulator, const bool is_fraction) {
+        while (text < end && *text >= '0' && *text <= '9') {
+            accumulator = accumulator * 10.0 + (*text - '0');
+            scale *= is_fraction ? 10.0 : 1.0;
+            has_digits = true;
+            ++text;
+        }
+    };
+
+    digits(integer, false);
+
+    if (text < end && (*text == '.' || *text == ',')) {
+        ++text;
+        digits(fraction, true);
+    }
+
+    if (!has_digits) {
+        return nullptr;
+    }
+
+    value = integer + fraction / scale;
+    value = negative ? -value : value;
+
+    return text;
+}
+
+} // namespace detail
+
+inline void FillInfo(const Spec& spec, const clap_id id, clap_param_info_t* info)
+{
+    std::memset(info, 0, sizeof(clap_param_info_t));
+
+    info->id    = id;
+    info->flags = spec.flags;
+
+    info->min_value     = spec.min_value;
+    info->max_value     = spec.max_value;
+    info->default_value = spec.default_value;
+
+    std::strncpy(info->name, spec.name, CLAP_NAME_SIZE - 1);
+}
+
+inline bool ToText(const Spec& spec, double value, char* display, const uint32_t size)
+{
+    if (size == 0) {
+        return false;
+    }
+
+    auto out       = display;
+    const auto end = display + size - 1;
+
+    value = std::clamp(value, spec.min_value, spec.max_value);
+
+    if (detail::IsStepped(spec)) {
+        const auto step  = static_cast<uint32_t>(std::round(value));
+        const auto label = spec.label ? spec.label(step) : nullptr;
+
+        out = label ? detail::Append(out, end, label)
+                    : detail::FormatFixed(out, end, step, 0);
+
+    } else if (spec.unit == Unit::Decibels) {
+        const auto db = (value > 0.0) ? 20.0 * std::log10(value) : -HUGE_VAL;
+
+        out = (db <= detail::MinDecibels)
+                  ? detail::Append(out, end, "-inf")
+                  : detail::FormatFixed(out, end, db, spec.precision);
+
+    } else if (spec.unit == Unit::Percent) {
+        out = detail::FormatFixed(out, end, value * 100.0, spec.precision);
+
+    } else {
+        out = detail::FormatFixed(out, end, value, spec.precision);
+    }
+
+    out = detail::Append(out, end, detail::Suffix(spec.unit));
+
+    if (!out) {
+        display[0] = '\0';
+        return false;
+    }
+    *out = '\0';
+
+    return true;
+}
+
+// Accepts what ToText() produces, with or without the unit, as well as
+// seconds for times
+inline std::optional<double> FromText(const Spec& spec, const char* display)
+{
+    const auto text_end = display + std::strlen(display);
+    const auto text     = detail::SkipSpaces(display, text_end);
+
+    // Trailing spaces are as irrelevant as leading ones
+    auto end = text_end;
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t')) {
+        --end;
+    }
+
+    if (detail::IsStepped(spec) && spec.label) {
+        const auto first = static_cast<uint32_t>(spec.min_value);
+        const auto last  = static_cast<uint32_t>(spec.max_value);
+
+        for (auto step = first; step <= last; ++step) {
+            const auto label = spec.label(step);
+
+            if (label && detail::Equals(text, end, label)) {
+                return step;
+            }
+        }
+    }
+
+    double value = 0.0;
+
+    auto number_end = detail::ParseNumber(text, end, value);
+
+    if (!number_end) {
+        return {};
+    }
+
+    const auto suffix = detail::SkipSpaces(number_end, end);
+
+    // The suffixes without the leading space
+    const auto unit = detail::Suffix(spec.unit);
+
+    if (suffix != end && !(*unit && detail::Equals(suffix, end, unit + 1))) {
+        if (spec.unit == Unit::Milliseconds && detail::Equals(suffix, end, "s")) {
+            value *= 1000.0;
+        } else {
+            return {};
+        }
+    }
+
+    switch (spec.unit) {
+    case Unit::Decibels: value = std::pow(10.0, value / 20.0); break;
+    case Unit::Percent: value /= 100.0; break;
+    case Unit::Count:
+    case Unit::Enum: value = std::round(value); break;
+    default: break;
+    }
+
+    if (std::isnan(value)) {
+        return {};
+    }
+
+    return std::clamp(value, spec.min_value, spec.max_value);
+}
+
+} // namespace param
@@ -7,15 +7,23 @@
 // Adjusted for C++20 by John Novak <john@johnnovak.net>
 // https://github.com/johnnovak/
 
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <string_view>
+
+#include "background_worker.h"
+#include "batch_process.h"
+#include "deterministic_render.h"
 #include "my_plugin.h"
+#include "preset_discovery.h"
+#include "sample_content.h"
+#include "shared_resources.h"
 
 //////////////////////////////////////////////////////////////////////////////
 // Plugin descriptors
 //////////////////////////////////////////////////////////////////////////////
 
-// Number of plugins in this dynamic library
-constexpr auto NumPlugins = 3;
-
 constexpr auto Vendor  = "nakst";
 constexpr auto Url     = "https://nakst.gitlab.io";
 constexpr auto Version = "1.0.0";
@@ -23,48 +31,84 @@ constexpr auto Version = "1.0.0";
 constexpr auto Features = (const char*[]){CLAP_PLUGIN_FEATURE_INSTRUMENT,
                                           CLAP_PLUGIN_FEATURE_SYNTHESIZER,
                                           CLAP_PLUGIN_FEATURE_STEREO,
+                                          CLAP_PLUGIN_FEATURE_MONO,
                                           nullptr};
 
-static const clap_plugin_descriptor_t plugin_descriptor_sine = {
+constexpr auto SamplerFeatures = (const char*[]){CLAP_PLUGIN_FEATURE_INSTRUMENT,
+                                                 CLAP_PLUGIN_FEATURE_SAMPLER,
+                                                 CLAP_PLUGIN_FEATURE_STEREO,
+                                                 CLAP_PLUGIN_FEATURE_MONO,
+                                                 nullptr};
 
-    .clap_version = CLAP_VERSION_INIT,
-    .id           = "org.nakst.clap-tutorial.HelloClapSine",
-    .name         = "HelloCLAP Sine",
-    .vendor       = Vendor,
-    .url          = Url,
-    .manual_url   = Url,
-    .support_url  = Url,
-    .version      = Version,
-    .description  = "Simple sine wave synth",
-    .features     = Features,
-};
+constexpr clap_plugin_descriptor_t MakeDescriptor(const char* id,
+                                                  const char* name,
+                                                  const char* description,
+                                                  const char* const* features = Features)
+{
+    return {.clap_version = CLAP_VERSION_INIT,
+            .id           = id,
+            .name         = name,
+            .vendor       = Vendor,
+            .url          = Url,
+            .manual_url   = Url,
+            .support_url  = Url,
+            .version      = Version,
+            .description  = description,
+            .features     = features};
+}
 
-static const clap_plugin_descriptor_t plugin_descriptor_resampled_sine = {
+// Every plugin in this library is the same MyPlugin class; they only differ
+// in the waveform and whether the voices are rendered at the internal rate.
+// Both are fixed for the lifetime of an instance, so MyPlugin selects a
+// render path specialised for the combination when it gets created.
+struct PluginVariant {
+    clap_plugin_descriptor_t descriptor = {};
 
-    .clap_version = CLAP_VERSION_INIT,
-    .id           = "org.nakst.clap-tutorial.HelloClapResampledSine",
-    .name         = "HelloCLAP Resampled Sine",
-    .vendor       = Vendor,
-    .url          = Url,
-    .manual_url   = Url,
-    .support_url  = Url,
-    .version      = Version,
-    .description  = "Simple sine wave synth (using resampling)",
-    .features     = Features,
+    MyPlugin::Waveform waveform = MyPlugin::Waveform::Sine;
+    ResampleMode resample_mode  = ResampleMode::Off;
 };
 
-static const clap_plugin_descriptor_t plugin_descriptor_triangle = {
+static const PluginVariant plugin_variants[] = {
+    {MakeDescriptor("org.nakst.clap-tutorial.HelloClapSine",
+                    "HelloCLAP Sine",
+                    "Simple sine wave synth"),
+     MyPlugin::Waveform::Sine,
+     ResampleMode::Off},
+
+    {MakeDescriptor("org.nakst.clap-tutorial.HelloClapResampledSine",
+                    "HelloCLAP Resampled Sine",
+                    "Simple sine wave synth (using resampling)"),
+     MyPlugin::Waveform::Sine,
+     ResampleMode::On},
+
+    {MakeDescriptor("org.nakst.clap-tutorial.HelloClapTriangle",
+                    "HelloCLAP Triangle",
+                    "Simple triangle wave synth"),
+     MyPlugin::Waveform::Triangle,
+     ResampleMode::Off},
+
+    {MakeDescriptor("org.nakst.clap-tutorial.HelloClapResampledSaw",
+                    "HelloCLAP Resampled Saw",
+                    "Band-limited sawtooth wave synth (using resampling)"),
+     MyPlugin::Waveform::Saw,
+     ResampleMode::On},
+
+    {MakeDescriptor("org.nakst.clap-tutorial.HelloClapResampledSquare",
+                    "HelloCLAP Resampled Square",
+                    "Band-limited square wave synth (using resampling)"),
+     MyPlugin::Waveform::Square,
+     ResampleMode::On},
+
+    {MakeDescriptor("org.nakst.clap-tutorial.HelloClapSampler",
+                    "HelloCLAP Sampler",
+                    "Plays back a sample streamed from disk",
+                    SamplerFeatures),
+     MyPlugin::Waveform::Sample,
+     ResampleMode::Off},
+};
 
-    .clap_version = CLAP_VERSION_INIT,
-    .id           = "org.nakst.clap-tutorial.HelloClapTriangle",
-    .name         = "HelloCLAP Triangle",
-    .vendor       = Vendor,
-    .url          = Url,
-    .manual_url   = Url,
-    .support_url  = Url,
-    .version      = Version,
-    .description  = "Simple triangle wave synth",
-    .features     = Features};
+// Number of plugins in this dynamic library
+constexpr auto NumPlugins = static_cast<uint32_t>(std::size(plugin_variants));
 
 //////////////////////////////////////////////////////////////////////////////
 // Extensions
@@ -82,9 +126,13 @@ static const clap_plugin_note_ports_t extension_note_ports = {
         }
 
         info->id = 0;
-        // TODO Also support the MIDI dialect.
-        info->supported_dialects = CLAP_NOTE_DIALECT_CLAP;
-        info->preferred_dialect  = CLAP_NOTE_DIALECT_CLAP;
+
+        // Raw MIDI gets decoded into the same note and parameter changes as
+        // CLAP events (see ProcessMidi()), but CLAP events can address
+        // individual voices through note IDs, so we prefer them.
+        info->supported_dialects = CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI |
+                                   CLAP_NOTE_DIALECT_MIDI2;
+        info->preferred_dialect = CLAP_NOTE_DIALECT_CLAP;
 
         snprintf(info->name, sizeof(info->name), "%s", "Note Port");
 
@@ -93,24 +141,60 @@ static const clap_plugin_note_ports_t extension_note_ports = {
 
 static const clap_plugin_audio_ports_t extension_audio_ports = {
     .count = [](const clap_plugin_t* plugin, bool is_input) -> uint32_t {
-        return is_input ? 0 : 1;
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetAudioPortCount(is_input);
     },
 
     .get = [](const clap_plugin_t* plugin, uint32_t index, bool is_input,
               clap_audio_port_info_t* info) -> bool {
-        if (is_input || index) {
-            return false;
-        }
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetAudioPortInfo(index, is_input, info);
+    }};
 
-        info->id            = 0;
-        info->channel_count = 2; // always stereo
-        info->flags         = CLAP_AUDIO_PORT_IS_MAIN;
-        info->port_type     = CLAP_PORT_STEREO;
-        info->in_place_pair = CLAP_INVALID_ID;
+static const clap_plugin_audio_ports_config_t extension_audio_ports_config = {
+    .count = [](const clap_plugin_t* plugin) -> uint32_t {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetAudioPortsConfigCount();
+    },
 
-        snprintf(info->name, sizeof(info->name), "%s", "Audio Output");
+    .get = [](const clap_plugin_t* plugin, uint32_t index,
+              clap_audio_ports_config_t* config) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetAudioPortsConfig(index, config);
+    },
 
-        return true;
+    .select = [](const clap_plugin_t* plugin, clap_id config_id) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->SelectAudioPortsConfig(config_id);
+    }};
+
+static const clap_plugin_audio_ports_config_info_t extension_audio_ports_config_info = {
+    .current_config = [](const clap_plugin_t* plugin) -> clap_id {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetCurrentAudioPortsConfig();
+    },
+
+    .get = [](const clap_plugin_t* plugin, clap_id config_id, uint32_t port_index,
+              bool is_input, clap_audio_port_info_t* info) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetAudioPortsConfigPortInfo(config_id, port_index, is_input, info);
+    }};
+
+static const clap_plugin_configurable_audio_ports_t extension_configurable_audio_ports = {
+    .can_apply_configuration =
+        [](const clap_plugin_t* plugin,
+           const clap_audio_port_configuration_request_t* requests,
+           uint32_t request_count) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->CanApplyAudioPortsConfiguration(requests, request_count);
+    },
+
+    .apply_configuration =
+        [](const clap_plugin_t* plugin,
+           const clap_audio_port_configuration_request_t* requests,
+           uint32_t request_count) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->ApplyAudioPortsConfiguration(requests, request_count);
     }};
 
 static const clap_plugin_params_t extension_params = {
@@ -165,126 +249,253 @@ static const clap_plugin_params_t extension_params = {
 static const clap_plugin_state_t extension_state = {
     .save = [](const clap_plugin_t* plugin, const clap_ostream_t* stream) -> bool {
         auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->SaveState(stream);
+        return my_plugin->SaveState(stream, CLAP_STATE_CONTEXT_FOR_PROJECT);
     },
 
     .load = [](const clap_plugin_t* plugin, const clap_istream_t* stream) -> bool {
         auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->LoadState(stream);
+        return my_plugin->LoadState(stream, CLAP_STATE_CONTEXT_FOR_PROJECT);
     }};
 
-//////////////////////////////////////////////////////////////////////////////
-// Plugin classes
-//////////////////////////////////////////////////////////////////////////////
-
-static const void* get_extension(const clap_plugin* plugin, const char* id)
-{
-    if (strcmp(id, CLAP_EXT_NOTE_PORTS) == 0) {
-        return &extension_note_ports;
+static const clap_plugin_state_context_t extension_state_context = {
+    .save = [](const clap_plugin_t* plugin, const clap_ostream_t* stream,
+               uint32_t context_type) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->SaveState(stream, context_type);
+    },
 
-    } else if (strcmp(id, CLAP_EXT_AUDIO_PORTS) == 0) {
-        return &extension_audio_ports;
+    .load = [](const clap_plugin_t* plugin, const clap_istream_t* stream,
+               uint32_t context_type) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->LoadState(stream, context_type);
+    }};
 
-    } else if (strcmp(id, CLAP_EXT_PARAMS) == 0) {
-        return &extension_params;
+static const clap_plugin_preset_load_t extension_preset_load = {
+    .from_location = [](const clap_plugin_t* plugin, uint32_t location_kind,
+                        const char* location, const char* load_key) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->LoadPreset(location_kind, location, load_key);
+    }};
 
-    } else if (strcmp(id, CLAP_EXT_STATE) == 0) {
-        return &extension_state;
+static const clap_plugin_tail_t extension_tail = {
+    .get = [](const clap_plugin_t* plugin) -> uint32_t {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetTailLength();
+    }};
 
-    } else {
-        return nullptr;
-    }
-}
+static const clap_plugin_thread_pool_t extension_thread_pool = {
+    .exec = [](const clap_plugin_t* plugin, uint32_t task_index) {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        my_plugin->ExecThreadPoolTask(task_index);
+    }};
 
-static const clap_plugin_t my_plugin_class_sine = {
+static const clap_plugin_latency_t extension_latency = {
+    .get = [](const clap_plugin_t* plugin) -> uint32_t {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetLatency();
+    }};
 
-    .desc        = &plugin_descriptor_sine,
-    .plugin_data = nullptr,
+static const clap_plugin_voice_info_t extension_voice_info = {
+    .get = [](const clap_plugin_t* plugin, clap_voice_info_t* info) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetVoiceInfo(info);
+    }};
 
-    .init = [](const clap_plugin* plugin) -> bool {
+static const clap_plugin_tuning_t extension_tuning = {
+    .changed = [](const clap_plugin_t* plugin) {
         auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->Init(plugin);
-    },
+        my_plugin->OnTuningsChanged();
+    }};
 
-    .destroy =
-        [](const clap_plugin* plugin) {
-            auto my_plugin = (MyPlugin*)plugin->plugin_data;
-            my_plugin->Shutdown();
-            delete my_plugin;
-        },
+static const clap_plugin_timer_support_t extension_timer_support = {
+    .on_timer = [](const clap_plugin_t* plugin, clap_id timer_id) {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        my_plugin->OnTimer(timer_id);
+    }};
 
-    .activate = [](const clap_plugin* plugin, double sample_rate,
-                   uint32_t min_frame_count, uint32_t max_frame_count) -> bool {
+static const clap_plugin_posix_fd_support_t extension_posix_fd_support = {
+    .on_fd = [](const clap_plugin_t* plugin, int fd, clap_posix_fd_flags_t flags) {
         auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
-    },
+        my_plugin->OnFd(fd, flags);
+    }};
 
-    .deactivate = [](const clap_plugin* plugin) {},
+// Instances of other plugins don't point at one of our descriptors
+static bool IsOurPlugin(const clap_plugin_t* plugin)
+{
+    return std::any_of(std::begin(plugin_variants),
+                       std::end(plugin_variants),
+                       [&](const auto& variant) { return plugin->desc == &variant.descriptor; });
+}
 
-    .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
+static const clap_tutorial_plugin_batch_process_t extension_batch_process = {
+    .process = [](const clap_plugin_t* const* plugins,
+                  const clap_process_t* const* processes,
+                  clap_process_status* statuses,
+                  uint32_t count) -> bool {
+        if (count > MyPlugin::MaxBatchSize) {
+            return false;
+        }
 
-    .stop_processing = [](const clap_plugin* plugin) {},
+        std::array<MyPlugin*, MyPlugin::MaxBatchSize> my_plugins = {};
 
-    .reset = [](const clap_plugin* plugin) {},
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!IsOurPlugin(plugins[i])) {
+                return false;
+            }
+            my_plugins[i] = (MyPlugin*)plugins[i]->plugin_data;
+        }
 
-    .process = [](const clap_plugin* plugin,
-                  const clap_process_t* process) -> clap_process_status {
-        auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->Process(process);
+        MyPlugin::ProcessBatch(my_plugins.data(), processes, statuses, count);
+        return true;
     },
 
-    .get_extension = [](const clap_plugin* plugin, const char* id) -> const void* {
-        return get_extension(plugin, id);
-    },
+    .max_count = []() -> uint32_t { return MyPlugin::MaxBatchSize; }};
 
-    .on_main_thread = [](const clap_plugin* plugin) {}};
+static const clap_tutorial_plugin_deterministic_render_t extension_deterministic_render = {
+    .set_enabled = [](const clap_plugin_t* plugin, bool enabled) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->SetDeterministic(enabled);
+    },
 
-static const clap_plugin_t my_plugin_class_resampled_sine = {
+    .is_enabled = [](const clap_plugin_t* plugin) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->IsDeterministic();
+    },
 
-    .desc        = &plugin_descriptor_resampled_sine,
-    .plugin_data = nullptr,
+    .seek = [](const clap_plugin_t* plugin, uint64_t frame) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->Seek(frame);
+    }};
 
-    .init = [](const clap_plugin* plugin) -> bool {
+static const clap_tutorial_plugin_sample_content_t extension_sample_content = {
+    .load = [](const clap_plugin_t* plugin, const char* path) -> bool {
         auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->Init(plugin);
+        return my_plugin->LoadSample(path);
     },
 
-    .destroy =
-        [](const clap_plugin* plugin) {
-            auto my_plugin = (MyPlugin*)plugin->plugin_data;
-            my_plugin->Shutdown();
-            delete my_plugin;
-        },
+    .get_path = [](const clap_plugin_t* plugin, char* path, uint32_t capacity) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->GetSamplePath(path, capacity);
+    }};
 
-    .activate = [](const clap_plugin* plugin, double sample_rate,
-                   uint32_t min_frame_count, uint32_t max_frame_count) -> bool {
+static const clap_plugin_render_t extension_render = {
+    .has_hard_realtime_requirement = [](const clap_plugin_t* plugin) -> bool {
         auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
+        return my_plugin->HasHardRealtimeRequirement();
     },
 
-    .deactivate = [](const clap_plugin* plugin) {},
+    .set = [](const clap_plugin_t* plugin, clap_plugin_render_mode mode) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->SetRenderMode(mode);
+    }};
 
-    .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
+//////////////////////////////////////////////////////////////////////////////
+// Plugin classes
+//////////////////////////////////////////////////////////////////////////////
 
-    .stop_processing = [](const clap_plugin* plugin) {},
+// Hosts query the extensions by their string IDs, often repeatedly, so we
+// keep them in a table sorted at compile time and binary search it instead
+// of going through a chain of `strcmp()` calls. Adding an extension is just
+// a matter of adding an entry here.
+//
+// Extensions that only make sense for some variants list the waveforms of
+// those variants, so the others don't advertise features they don't have.
+constexpr uint32_t WaveformBit(const MyPlugin::Waveform waveform)
+{
+    return uint32_t{1} << waveform;
+}
 
-    .reset = [](const clap_plugin* plugin) {},
+constexpr uint32_t AllWaveforms = (uint32_t{1} << MyPlugin::NumWaveforms) - 1;
 
-    .process = [](const clap_plugin* plugin,
-                  const clap_process_t* process) -> clap_process_status {
-        auto my_plugin = (MyPlugin*)plugin->plugin_data;
-        return my_plugin->Process(process);
-    },
+struct ExtensionEntry {
+    std::string_view id = {};
+    const void* vtable  = nullptr;
+    uint32_t waveforms  = AllWaveforms;
+};
 
-    .get_extension = [](const clap_plugin* plugin, const char* id) -> const void* {
-        return get_extension(plugin, id);
-    },
+template <size_t N>
+constexpr std::array<ExtensionEntry, N> SortExtensions(
+    std::array<ExtensionEntry, N> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+        return a.id < b.id;
+    });
+    return entries;
+}
 
-    .on_main_thread = [](const clap_plugin* plugin) {}};
+static constexpr auto extensions = SortExtensions(
+    std::to_array<ExtensionEntry>({
+        {CLAP_EXT_NOTE_PORTS, &extension_note_ports},
+        {CLAP_EXT_AUDIO_PORTS, &extension_audio_ports},
+        {CLAP_EXT_AUDIO_PORTS_CONFIG, &extension_audio_ports_config},
+        {CLAP_EXT_AUDIO_PORTS_CONFIG_INFO, &extension_audio_ports_config_info},
+        {CLAP_EXT_AUDIO_PORTS_CONFIG_INFO_COMPAT, &extension_audio_ports_config_info},
+        {CLAP_EXT_CONFIGURABLE_AUDIO_PORTS, &extension_configurable_audio_ports},
+        {CLAP_EXT_CONFIGURABLE_AUDIO_PORTS_COMPAT, &extension_configurable_audio_ports},
+        {CLAP_EXT_PARAMS, &extension_params},
+        {CLAP_EXT_STATE, &extension_state},
+        {CLAP_EXT_STATE_CONTEXT, &extension_state_context},
+        {CLAP_EXT_PRESET_LOAD, &extension_preset_load},
+        {CLAP_EXT_PRESET_LOAD_COMPAT, &extension_preset_load},
+        {CLAP_EXT_TAIL, &extension_tail},
+        {CLAP_EXT_THREAD_POOL, &extension_thread_pool},
+        {CLAP_EXT_RENDER, &extension_render},
+        {CLAP_EXT_LATENCY, &extension_latency},
+        {CLAP_EXT_VOICE_INFO, &extension_voice_info},
+        {CLAP_EXT_TUNING, &extension_tuning},
+        {CLAP_EXT_TIMER_SUPPORT, &extension_timer_support},
+        {CLAP_TUTORIAL_EXT_BATCH_PROCESS, &extension_batch_process},
+        {CLAP_TUTORIAL_EXT_DETERMINISTIC_RENDER, &extension_deterministic_render},
+
+        // Only the sampler streams sample content, from the host's event
+        // loop if it can
+        {CLAP_EXT_POSIX_FD_SUPPORT,
+         &extension_posix_fd_support,
+         WaveformBit(MyPlugin::Waveform::Sample)},
+        {CLAP_TUTORIAL_EXT_SAMPLE_CONTENT,
+         &extension_sample_content,
+         WaveformBit(MyPlugin::Waveform::Sample)},
+    }));
+
+static_assert(std::adjacent_find(extensions.begin(),
+                                 extensions.end(),
+                                 [](const auto& a, const auto& b) {
+                                     return a.id == b.id;
+                                 }) == extensions.end(),
+              "Duplicate extension ID");
 
-static const clap_plugin_t my_plugin_class_triangle = {
+static const void* get_extension(const clap_plugin* plugin, const char* id)
+{
+    const std::string_view key = id;
+
+    const auto it = std::lower_bound(extensions.begin(),
+                                     extensions.end(),
+                                     key,
+                                     [](const auto& entry, const auto& key) {
+                                         return entry.id < key;
+                                     });
+
+    if (it == extensions.end() || it->id != key) {
+        return nullptr;
+    }
+    if (it->waveforms == AllWaveforms) {
+        return it->vtable;
+    }
+
+    // The descriptor is the one of the plugin's variant; see create_plugin()
+    for (const auto& variant : plugin_variants) {
+        if (plugin->desc == &variant.descriptor) {
+            return (it->waveforms & WaveformBit(variant.waveform)) ? it->vtable
+                                                                    : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+// Shared by all variants; `desc` gets filled in by the factory
+static const clap_plugin_t my_plugin_class = {
 
-    .desc        = &plugin_descriptor_triangle,
+    .desc        = nullptr,
     .plugin_data = nullptr,
 
     .init = [](const clap_plugin* plugin) -> bool {
@@ -305,13 +516,24 @@ static const clap_plugin_t my_plugin_class_triangle = {
         return my_plugin->Activate(sample_rate, min_frame_count, max_frame_count);
     },
 
-    .deactivate = [](const clap_plugin* plugin) {},
+    .deactivate =
+        [](const clap_plugin* plugin) {
+            auto my_plugin = (MyPlugin*)plugin->plugin_data;
+            my_plugin->Deactivate();
+        },
 
-    .start_processing = [](const clap_plugin* plugin) -> bool { return true; },
+    .start_processing = [](const clap_plugin* plugin) -> bool {
+        auto my_plugin = (MyPlugin*)plugin->plugin_data;
+        return my_plugin->StartProcessing();
+    },
 
     .stop_processing = [](const clap_plugin* plugin) {},
 
-    .reset = [](const clap_plugin* plugin) {},
+    .reset =
+        [](const clap_plugin* plugin) {
+            auto my_plugin = (MyPlugin*)plugin->plugin_data;
+            my_plugin->Reset();
+        },
 
     .process = [](const clap_plugin* plugin,
                   const clap_process_t* process) -> clap_process_status {
@@ -323,7 +545,11 @@ static const clap_plugin_t my_plugin_class_triangle = {
         return get_extension(plugin, id);
     },
 
-    .on_main_thread = [](const clap_plugin* plugin) {}};
+    .on_main_thread =
+        [](const clap_plugin* plugin) {
+            auto my_plugin = (MyPlugin*)plugin->plugin_data;
+            my_plugin->OnMainThread();
+        }};
 
 //////////////////////////////////////////////////////////////////////////////
 // Plugin factory
@@ -337,18 +563,7 @@ static const clap_plugin_factory_t plugin_factory = {
 
     .get_plugin_descriptor = [](const clap_plugin_factory* factory,
                                 uint32_t index) -> const clap_plugin_descriptor_t* {
-        if (index == 0) {
-            return &plugin_descriptor_sine;
-
-        } else if (index == 1) {
-            return &plugin_descriptor_resampled_sine;
-
-        } else if (index == 2) {
-            return &plugin_descriptor_triangle;
-
-        } else {
-            return nullptr;
-        }
+        return (index < NumPlugins) ? &plugin_variants[index].descriptor : nullptr;
     },
 
     .create_plugin = [](const clap_plugin_factory* factory, const clap_host_t* host,
@@ -357,50 +572,58 @@ static const clap_plugin_factory_t plugin_factory = {
             return nullptr;
         }
 
-        if (strcmp(plugin_id, plugin_descriptor_sine.id) == 0) {
-            constexpr auto Resample = false;
-            auto my_plugin          = new MyPlugin(my_plugin_class_sine,
-                                          host,
-                                          MyPlugin::Waveform::Sine,
-                                          Resample);
+        for (const auto& variant : plugin_variants) {
+            if (strcmp(plugin_id, variant.descriptor.id) == 0) {
+                auto plugin_class = my_plugin_class;
+                plugin_class.desc = &variant.descriptor;
 
-            return my_plugin->GetPluginClass();
+                auto my_plugin = new MyPlugin(plugin_class,
+                                              host,
+                                              variant.waveform,
+                                              variant.resample_mode);
 
-        } else if (strcmp(plugin_id, plugin_descriptor_resampled_sine.id) == 0) {
-            constexpr auto Resample = true;
-            auto my_plugin = new MyPlugin(my_plugin_class_resampled_sine,
-                                          host,
-                                          MyPlugin::Waveform::Sine,
-                                          Resample);
-
-            return my_plugin->GetPluginClass();
-
-        } else if (strcmp(plugin_id, plugin_descriptor_triangle.id) == 0) {
-            constexpr auto Resample = false;
-            auto my_plugin          = new MyPlugin(my_plugin_class_triangle,
-                                          host,
-                                          MyPlugin::Waveform::Triangle,
-                                          Resample);
-
-            return my_plugin->GetPluginClass();
-
-        } else {
-            return nullptr;
+                return my_plugin->GetPluginClass();
+            }
         }
+        return nullptr;
     }};
 
 //////////////////////////////////////////////////////////////////////////////
 // Dynamic library definition
 //////////////////////////////////////////////////////////////////////////////
 
-extern "C" const clap_plugin_entry_t clap_entry = {
+// The only symbol the library exports
+extern "C" CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
     .clap_version = CLAP_VERSION_INIT,
 
-    .init = [](const char* path) -> bool { return true; },
+    // Keep this cheap: hosts load the library when scanning too. The shared
+    // tables only get built when the first instance is activated;
+    // selecting the SIMD kernels only takes a few CPUID queries.
+    .init = [](const char* path) -> bool {
+        kernels::Init();
+        shared_resources::Init();
+        background_worker::Init();
+        preset_discovery::Init(path);
+        return true;
+    },
 
-    .deinit = []() {},
+    .deinit =
+        []() {
+            // Jobs may hold on to shared resources, so the worker goes first
+            background_worker::Deinit();
+            shared_resources::Deinit();
+        },
 
     .get_factory = [](const char* factory_id) -> const void* {
-        return strcmp(factory_id, CLAP_PLUGIN_FACTORY_ID) ? nullptr : &plugin_factory;
+        if (strcmp(factory_id, CLAP_PLUGIN_FACTORY_ID) == 0) {
+            return &plugin_factory;
+
+        } else if (strcmp(factory_id, CLAP_PRESET_DISCOVERY_FACTORY_ID) == 0 ||
+                   strcmp(factory_id, CLAP_PRESET_DISCOVERY_FACTORY_ID_COMPAT) == 0) {
+            return preset_discovery::GetFactory();
+
+        } else {
+            return nullptr;
+        }
     }};
 
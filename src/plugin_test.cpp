@@ -0,0 +1,782 @@
+// CLAP instrument plugin tutorial
+//
+// Tests of the plugin's handling of bad input from the host.
+//
+// The plugin is linked in statically and driven through `clap_entry`, the
+// same way hosts drive it, each test with a fresh instance of the first
+// plugin in the factory. Every test is a separate CTest case, run by name.
+//
+// Usage:
+//
+//   PluginTest <test>
+//
+//   unknown-param-id    value events with IDs the plugin doesn't have, and
+//                       values that aren't numbers or are out of range
+//   state-empty         loading an empty state
+//   state-truncated     loading a state that ends within its header
+//   state-nan           loading states with values that aren't numbers, or
+//                       out of range
+//   flush-inactive      flushing note and parameter events before the first
+//                       activation
+//   flush-deactivated   the same after deactivating, once the plugin has
+//                       released its DSP resources
+//   reset               resetting the plugin while a note is playing
+//   variant-extensions  only the variants that can use an extension offer it
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "clap/clap.h"
+
+extern "C" const clap_plugin_entry_t clap_entry;
+
+namespace {
+
+constexpr double SampleRate       = 48000.0;
+constexpr uint32_t BlockSize      = 256;
+constexpr uint32_t NumOutChannels = 2;
+
+// As in sample_content.h
+constexpr auto SampleContentExtension = "org.nakst.clap-tutorial.sample-content/1";
+
+bool Check(const bool condition, const char* what)
+{
+    if (!condition) {
+        fprintf(stderr, "FAILED: %s\n", what);
+    }
+    return condition;
+}
+
+const clap_host_t Host = {
+    .clap_version = CLAP_VERSION,
+    .host_data    = nullptr,
+    .name         = "PluginTest",
+    .vendor       = "nakst",
+    .url          = "https://nakst.gitlab.io",
+    .version      = "1.0.0",
+
+    .get_extension = [](const clap_host_t*, const char*) -> const void* {
+        return nullptr;
+    },
+    .request_restart  = [](const clap_host_t*) {},
+    .request_process  = [](const clap_host_t*) {},
+    .request_callback = [](const clap_host_t*) {},
+};
+
+using Events = std::vector<const clap_event_header_t*>;
+
+clap_input_events_t InputEvents(const Events& events)
+{
+    return {.ctx  = const_cast<Events*>(&events),
+            .size = [](const clap_input_events_t* list) -> uint32_t {
+                return static_cast<uint32_t>(static_cast<Events*>(list->ctx)->size());
+            },
+            .get = [](const clap_input_events_t* list,
+                      uint32_t index) -> const clap_event_header_t* {
+                return (*static_cast<Events*>(list->ctx))[index];
+            }};
+}
+
+const clap_output_events_t AcceptEvents = {
+    .ctx      = nullptr,
+    .try_push = [](const clap_output_events_t*, const clap_event_header_t*) {
+        return true;
+    }};
+
+// An initialised instance of the plugin with the given ID (the first one
+// by default), destroyed with the test
+class TestPlugin {
+
+public:
+    TestPlugin() : TestPlugin(nullptr) {}
+
+    explicit TestPlugin(const char* plugin_id)
+    {
+        clap_entry.init("");
+
+        const auto factory = static_cast<const clap_plugin_factory_t*>(
+            clap_entry.get_factory(CLAP_PLUGIN_FACTORY_ID));
+
+        if (!plugin_id) {
+            plugin_id = factory->get_plugin_descriptor(factory, 0)->id;
+        }
+
+        plugin = factory->create_plugin(factory, &Host, plugin_id);
+
+        if (plugin && !plugin->init(plugin)) {
+            plugin->destroy(plugin);
+            plugin = nullptr;
+        }
+    }
+
+    ~TestPlugin()
+    {
+        if (plugin) {
+            if (is_active) {
+                plugin->stop_processing(plugin);
+                plugin->deactivate(plugin);
+            }
+            plugin->destroy(plugin);
+        }
+        clap_entry.deinit();
+    }
+
+    TestPlugin(const TestPlugin&)            = delete;
+    TestPlugin& operator=(const TestPlugin&) = delete;
+
+    const clap_plugin_t* Get() const
+    {
+        return plugin;
+    }
+
+    explicit operator bool() const
+    {
+        return plugin != nullptr;
+    }
+
+    template <typename T>
+    const T* Extension(const char* id) const
+    {
+        return static_cast<const T*>(plugin->get_extension(plugin, id));
+    }
+
+    bool Activate()
+    {
+        is_active = plugin->activate(plugin, SampleRate, 1, BlockSize) &&
+                    plugin->start_processing(plugin);
+        return is_active;
+    }
+
+    // Deactivates the plugin, and gives it the main thread callback it
+    // asks for to release its resources
+    void Deactivate()
+    {
+        plugin->stop_processing(plugin);
+        plugin->deactivate(plugin);
+        plugin->on_main_thread(plugin);
+
+        is_active = false;
+    }
+
+    // Processes one block with the given input events; returns false if
+    // the plugin fails or its output isn't finite
+    bool Process(const Events& events)
+    {
+        std::vector<float> left(BlockSize), right(BlockSize);
+
+        float* channels[NumOutChannels] = {left.data(), right.data()};
+
+        clap_audio_buffer_t output = {.data32        = channels,
+                                      .data64        = nullptr,
+                                      .channel_count = NumOutChannels,
+                                      .latency       = 0,
+                                      .constant_mask = 0};
+
+        const auto in = InputEvents(events);
+
+        // Accepts everything, and counts the note end events
+        const clap_output_events_t out = {
+            .ctx      = this,
+            .try_push = [](const clap_output_events_t* list,
+                           const clap_event_header_t* event) {
+                if (event->space_id == CLAP_CORE_EVENT_SPACE_ID &&
+                    event->type == CLAP_EVENT_NOTE_END) {
+                    ++static_cast<TestPlugin*>(list->ctx)->num_note_ends;
+                }
+                return true;
+            }};
+
+        const clap_process_t process = {.steady_time         = -1,
+                                        .frames_count        = BlockSize,
+                                        .transport           = nullptr,
+                                        .audio_inputs        = nullptr,
+                                        .audio_outputs       = &output,
+                                        .audio_inputs_count  = 0,
+                                        .audio_outputs_count = 1,
+                                        .in_events           = &in,
+                                        .out_events          = &out};
+
+        if (plugin->process(plugin, &process) == CLAP_PROCESS_ERROR) {
+            return false;
+        }
+
+        is_silent = true;
+
+        for (uint32_t i = 0; i < BlockSize; ++i) {
+            if (!std::isfinite(left[i]) || !std::isfinite(right[i])) {
+                return false;
+            }
+            is_silent = is_silent && left[i] == 0.0f && right[i] == 0.0f;
+        }
+        return true;
+    }
+
+    // Whether the output of the last Process() call was all zeros
+    bool IsSilent() const
+    {
+        return is_silent;
+    }
+
+    // Note end events sent to the host by all Process() calls
+    uint32_t NumNoteEnds() const
+    {
+        return num_note_ends;
+    }
+
+private:
+    const clap_plugin_t* plugin = nullptr;
+
+    bool is_silent         = false;
+    uint32_t num_note_ends = 0;
+
+    bool is_active = false;
+};
+
+clap_event_param_value_t MakeParamValue(const clap_id param_id, const double value)
+{
+    return {.header     = {.size     = sizeof(clap_event_param_value_t),
+                           .time     = 0,
+                           .space_id = CLAP_CORE_EVENT_SPACE_ID,
+                           .type     = CLAP_EVENT_PARAM_VALUE,
+                           .flags    = 0},
+            .param_id   = param_id,
+            .cookie     = nullptr,
+            .note_id    = -1,
+            .port_index = -1,
+            .channel    = -1,
+            .key        = -1,
+            .value      = value};
+}
+
+// Every kind of event that starts, stops or modulates voices, on key 60
+struct VoiceEvents {
+    clap_event_note_t note_on               = {};
+    clap_event_note_expression_t expression = {};
+    clap_event_param_mod_t mod              = {};
+    clap_event_midi_t midi_note_on          = {};
+    clap_event_midi2_t midi2_note_on        = {};
+    clap_event_note_t note_off              = {};
+
+    VoiceEvents()
+    {
+        const auto header = [](const uint32_t size, const uint16_t type) {
+            return clap_event_header_t{.size     = size,
+                                       .time     = 0,
+                                       .space_id = CLAP_CORE_EVENT_SPACE_ID,
+                                       .type     = type,
+                                       .flags    = 0};
+        };
+
+        note_on = {.header     = header(sizeof(clap_event_note_t), CLAP_EVENT_NOTE_ON),
+                   .note_id    = 1,
+                   .port_index = 0,
+                   .channel    = 0,
+                   .key        = 60,
+                   .velocity   = 1.0};
+
+        note_off        = note_on;
+        note_off.header = header(sizeof(clap_event_note_t), CLAP_EVENT_NOTE_OFF);
+
+        expression = {.header        = header(sizeof(clap_event_note_expression_t),
+                                              CLAP_EVENT_NOTE_EXPRESSION),
+                      .expression_id = CLAP_NOTE_EXPRESSION_VOLUME,
+                      .note_id       = -1,
+                      .port_index    = 0,
+                      .channel       = 0,
+                      .key           = 60,
+                      .value         = 0.5};
+
+        // Whatever parameter 0 is, modulating it addresses the voices
+        mod = {.header     = header(sizeof(clap_event_param_mod_t), CLAP_EVENT_PARAM_MOD),
+               .param_id   = 0,
+               .cookie     = nullptr,
+               .note_id    = -1,
+               .port_index = 0,
+               .channel    = 0,
+               .key        = 60,
+               .amount     = 0.5};
+
+        midi_note_on = {.header     = header(sizeof(clap_event_midi_t), CLAP_EVENT_MIDI),
+                        .port_index = 0,
+                        .data       = {0x90, 60, 100}};
+
+        // A MIDI 2.0 channel voice message note on, at full velocity
+        midi2_note_on = {.header     = header(sizeof(clap_event_midi2_t), CLAP_EVENT_MIDI2),
+                         .port_index = 0,
+                         .data       = {0x40903c00, 0xffff0000, 0, 0}};
+    }
+
+    Events All() const
+    {
+        return {&note_on.header,
+                &expression.header,
+                &mod.header,
+                &midi_note_on.header,
+                &midi2_note_on.header,
+                &note_off.header};
+    }
+};
+
+// The values of all parameters, as the host sees them
+std::vector<double> ParamValues(const TestPlugin& plugin)
+{
+    const auto params = plugin.Extension<clap_plugin_params_t>(CLAP_EXT_PARAMS);
+
+    std::vector<double> values(params->count(plugin.Get()));
+
+    for (uint32_t i = 0; i < values.size(); ++i) {
+        clap_param_info_t info = {};
+
+        params->get_info(plugin.Get(), i, &info);
+        params->get_value(plugin.Get(), info.id, &values[i]);
+    }
+    return values;
+}
+
+// Loads `bytes` as the plugin's state
+bool LoadState(const TestPlugin& plugin, const std::vector<uint8_t>& bytes)
+{
+    struct Stream {
+        const std::vector<uint8_t>& bytes;
+        size_t pos = 0;
+    } stream_data = {bytes};
+
+    const clap_istream_t stream = {
+        .ctx  = &stream_data,
+        .read = [](const clap_istream_t* stream, void* buffer, uint64_t size) -> int64_t {
+            auto& data = *static_cast<Stream*>(stream->ctx);
+
+            const auto n = std::min<uint64_t>(size, data.bytes.size() - data.pos);
+
+            if (n > 0) {
+                std::memcpy(buffer, data.bytes.data() + data.pos, n);
+                data.pos += n;
+            }
+
+            return static_cast<int64_t>(n);
+        }};
+
+    const auto state = plugin.Extension<clap_plugin_state_t>(CLAP_EXT_STATE);
+
+    return state->load(plugin.Get(), &stream);
+}
+
+template <typename T>
+void Append(std::vector<uint8_t>& bytes, const T value)
+{
+    const auto pos = bytes.size();
+    bytes.resize(pos + sizeof(T));
+
+    std::memcpy(bytes.data() + pos, &value, sizeof(T));
+}
+
+// FourCC codes, as in state_format.h
+constexpr uint32_t FourCC(const char (&s)[5])
+{
+    return static_cast<uint32_t>(static_cast<uint8_t>(s[0])) |
+           static_cast<uint32_t>(static_cast<uint8_t>(s[1])) << 8 |
+           static_cast<uint32_t>(static_cast<uint8_t>(s[2])) << 16 |
+           static_cast<uint32_t>(static_cast<uint8_t>(s[3])) << 24;
+}
+
+// A current state with a single parameter chunk of (ID, value) pairs
+std::vector<uint8_t> MakeState(const std::vector<std::pair<uint32_t, float>>& values)
+{
+    std::vector<uint8_t> bytes = {};
+
+    Append(bytes, FourCC("HCLP"));
+    Append(bytes, uint32_t{1});
+
+    Append(bytes, FourCC("PARM"));
+    Append(bytes, static_cast<uint32_t>(sizeof(uint32_t) + values.size() * 8));
+    Append(bytes, static_cast<uint32_t>(values.size()));
+
+    for (const auto& [id, value] : values) {
+        Append(bytes, id);
+        Append(bytes, value);
+    }
+    return bytes;
+}
+
+// Loads a state that must be rejected, and checks that the parameters
+// haven't changed
+bool CheckRejected(const char* what, const std::vector<uint8_t>& bytes)
+{
+    TestPlugin plugin = {};
+
+    if (!Check(bool(plugin), "create the plugin")) {
+        return false;
+    }
+    const auto before = ParamValues(plugin);
+
+    auto ok = Check(!LoadState(plugin, bytes), what);
+    ok      = Check(ParamValues(plugin) == before, "parameters unchanged") && ok;
+
+    return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Tests
+//////////////////////////////////////////////////////////////////////////////
+
+bool TestUnknownParamId()
+{
+    TestPlugin plugin = {};
+
+    if (!Check(bool(plugin), "create the plugin") || !Check(plugin.Activate(), "activate")) {
+        return false;
+    }
+
+    const auto params = plugin.Extension<clap_plugin_params_t>(CLAP_EXT_PARAMS);
+
+    const auto before = ParamValues(plugin);
+
+    // Just past the last parameter, way past it, and the invalid ID
+    const auto num_params = static_cast<clap_id>(before.size());
+
+    const clap_id ids[] = {num_params, 5000, 0x7fffffff, CLAP_INVALID_ID};
+
+    std::vector<clap_event_param_value_t> value_events = {};
+
+    for (const auto id : ids) {
+        value_events.push_back(MakeParamValue(id, 1.0e6));
+    }
+
+    Events events = {};
+
+    for (const auto& event : value_events) {
+        events.push_back(&event.header);
+    }
+
+    bool ok = Check(plugin.Process(events), "process the unknown IDs");
+
+    // And while not processing
+    const auto in = InputEvents(events);
+
+    params->flush(plugin.Get(), &in, &AcceptEvents);
+
+    ok = Check(plugin.Process({}), "process after the unknown IDs") && ok;
+    ok = Check(ParamValues(plugin) == before, "parameters unchanged") && ok;
+
+    for (const auto id : ids) {
+        double value = 0.0;
+        ok = Check(!params->get_value(plugin.Get(), id, &value),
+                   "no value for an unknown ID") &&
+             ok;
+    }
+
+    // Values for all the IDs we do have that must be ignored
+    const auto nan = std::numeric_limits<double>::quiet_NaN();
+    const auto inf = std::numeric_limits<double>::infinity();
+
+    const auto all_params = [&](const double value) -> const Events& {
+        value_events.clear();
+
+        for (clap_id id = 0; id < num_params; ++id) {
+            value_events.push_back(MakeParamValue(id, value));
+        }
+
+        events.clear();
+
+        for (const auto& event : value_events) {
+            events.push_back(&event.header);
+        }
+        return events;
+    };
+
+    ok = Check(plugin.Process(all_params(nan)), "process NaNs") && ok;
+    ok = Check(plugin.Process(all_params(inf)), "process infinities") && ok;
+
+    const auto non_finite = InputEvents(all_params(-inf));
+
+    params->flush(plugin.Get(), &non_finite, &AcceptEvents);
+
+    ok = Check(plugin.Process({}), "process after the non-finite values") && ok;
+    ok = Check(ParamValues(plugin) == before, "parameters unchanged") && ok;
+
+    // Out of range values are clamped to the range, whether they come in
+    // with a process or a flush call
+    const auto check_clamped = [&](const bool to_max) {
+        const auto values = ParamValues(plugin);
+
+        auto clamped = true;
+
+        for (clap_id id = 0; id < num_params; ++id) {
+            clap_param_info_t info = {};
+            params->get_info(plugin.Get(), id, &info);
+
+            const auto limit = to_max ? info.max_value : info.min_value;
+
+            // The plugin stores single precision values
+            clamped = clamped &&
+                      static_cast<float>(values[id]) == static_cast<float>(limit);
+        }
+        return clamped;
+    };
+
+    ok = Check(plugin.Process(all_params(1.0e300)) && plugin.Process({}),
+               "process values above the range") &&
+         ok;
+    ok = Check(check_clamped(true), "values clamped to the maximum") && ok;
+
+    const auto below_range = InputEvents(all_params(-1.0e300));
+
+    params->flush(plugin.Get(), &below_range, &AcceptEvents);
+
+    ok = Check(plugin.Process({}), "process after values below the range") && ok;
+    ok = Check(check_clamped(false), "values clamped to the minimum") && ok;
+
+    return ok;
+}
+
+bool TestStateEmpty()
+{
+    return CheckRejected("reject an empty state", {});
+}
+
+bool TestStateTruncated()
+{
+    std::vector<uint8_t> header_only = {};
+    Append(header_only, FourCC("HCLP"));
+
+    std::vector<uint8_t> odd_size = {};
+    Append(odd_size, 0.5f);
+    Append(odd_size, uint16_t{0});
+
+    auto ok = CheckRejected("reject a state that's just the magic", header_only);
+    ok      = CheckRejected("reject a legacy state of the wrong size", odd_size) && ok;
+
+    return ok;
+}
+
+bool TestStateNan()
+{
+    const auto nan = std::numeric_limits<float>::quiet_NaN();
+    const auto inf = std::numeric_limits<float>::infinity();
+
+    std::vector<uint8_t> legacy_nan = {};
+    Append(legacy_nan, nan);
+
+    // The NaN comes after a valid value, which mustn't be loaded either
+    auto ok = CheckRejected("reject a legacy NaN", legacy_nan);
+    ok      = CheckRejected("reject a NaN", MakeState({{0, 0.25f}, {1, nan}})) && ok;
+    ok      = CheckRejected("reject an infinity", MakeState({{0, inf}})) && ok;
+
+    // Out of range values are clamped to the range
+    TestPlugin plugin = {};
+
+    if (!Check(bool(plugin), "create the plugin")) {
+        return false;
+    }
+
+    const auto params = plugin.Extension<clap_plugin_params_t>(CLAP_EXT_PARAMS);
+
+    std::vector<std::pair<uint32_t, float>> values = {};
+
+    for (uint32_t i = 0; i < params->count(plugin.Get()); ++i) {
+        values.emplace_back(i, (i % 2) ? 1.0e10f : -1.0e10f);
+    }
+
+    ok = Check(LoadState(plugin, MakeState(values)), "load out of range values") && ok;
+
+    const auto loaded = ParamValues(plugin);
+
+    for (uint32_t i = 0; i < loaded.size(); ++i) {
+        clap_param_info_t info = {};
+        params->get_info(plugin.Get(), i, &info);
+
+        // The plugin stores single precision values
+        const auto value = static_cast<float>(loaded[i]);
+
+        ok = Check(value >= static_cast<float>(info.min_value) &&
+                       value <= static_cast<float>(info.max_value),
+                   "value within range") &&
+             ok;
+    }
+
+    ok = Check(plugin.Activate() && plugin.Process({}), "process the loaded state") && ok;
+
+    return ok;
+}
+
+// Flushes voice events together with a value for the first parameter
+// while `plugin` is inactive; only the value must be applied. Then checks
+// that the plugin still activates and processes.
+bool CheckInactiveFlush(TestPlugin& plugin)
+{
+    const auto params = plugin.Extension<clap_plugin_params_t>(CLAP_EXT_PARAMS);
+
+    clap_param_info_t info = {};
+    params->get_info(plugin.Get(), 0, &info);
+
+    const auto value = (info.min_value + info.max_value) / 2;
+
+    const auto value_event = MakeParamValue(info.id, value);
+
+    const VoiceEvents voice_events = {};
+
+    auto events = voice_events.All();
+    events.insert(events.begin() + 1, &value_event.header);
+
+    const auto in = InputEvents(events);
+
+    params->flush(plugin.Get(), &in, &AcceptEvents);
+
+    double flushed = 0.0;
+
+    auto ok = Check(params->get_value(plugin.Get(), info.id, &flushed) &&
+                        static_cast<float>(flushed) == static_cast<float>(value),
+                    "flushed value applied");
+
+    ok = Check(plugin.Activate() && plugin.Process({}), "process after the flush") && ok;
+
+    // And with the same events now that there are voices
+    ok = Check(plugin.Process(voice_events.All()), "process the voice events") && ok;
+
+    return ok;
+}
+
+bool TestFlushInactive()
+{
+    TestPlugin plugin = {};
+
+    if (!Check(bool(plugin), "create the plugin")) {
+        return false;
+    }
+    return CheckInactiveFlush(plugin);
+}
+
+bool TestFlushDeactivated()
+{
+    TestPlugin plugin = {};
+
+    if (!Check(bool(plugin), "create the plugin") || !Check(plugin.Activate(), "activate")) {
+        return false;
+    }
+
+    const VoiceEvents voice_events = {};
+
+    auto ok = Check(plugin.Process(voice_events.All()), "process the voice events");
+
+    plugin.Deactivate();
+
+    ok = CheckInactiveFlush(plugin) && ok;
+
+    return ok;
+}
+
+bool TestReset()
+{
+    TestPlugin plugin = {};
+
+    if (!Check(bool(plugin), "create the plugin") || !Check(plugin.Activate(), "activate")) {
+        return false;
+    }
+
+    const VoiceEvents voice_events = {};
+
+    auto ok = Check(plugin.Process({&voice_events.note_on.header}) &&
+                        plugin.Process({}) && !plugin.IsSilent(),
+                    "play a note");
+
+    // A note that's still held, and nothing in the pipeline survives
+    plugin.Get()->reset(plugin.Get());
+
+    ok = Check(plugin.Process({}), "process after the reset") && ok;
+    ok = Check(plugin.IsSilent(), "silent after the reset") && ok;
+    ok = Check(plugin.NumNoteEnds() == 1, "note end sent for the voice") && ok;
+
+    // The note off has no voice left to release
+    ok = Check(plugin.Process({&voice_events.note_off.header}) && plugin.Process({}) &&
+                   plugin.IsSilent() && plugin.NumNoteEnds() == 1,
+               "no voice after the reset") &&
+         ok;
+
+    return ok;
+}
+
+bool TestVariantExtensions()
+{
+    const auto factory = static_cast<const clap_plugin_factory_t*>(
+        clap_entry.get_factory(CLAP_PLUGIN_FACTORY_ID));
+
+    auto ok = true;
+
+    for (uint32_t i = 0; i < factory->get_plugin_count(factory); ++i) {
+        const auto descriptor = factory->get_plugin_descriptor(factory, i);
+
+        TestPlugin plugin(descriptor->id);
+
+        if (!Check(bool(plugin), "create the plugin")) {
+            return false;
+        }
+
+        // Only the sampler streams sample content
+        auto is_sampler = false;
+
+        for (auto feature = descriptor->features; *feature; ++feature) {
+            is_sampler = is_sampler ||
+                         strcmp(*feature, CLAP_PLUGIN_FEATURE_SAMPLER) == 0;
+        }
+
+        const auto has = [&](const char* id) {
+            return plugin.Extension<void>(id) != nullptr;
+        };
+
+        ok = Check(has(SampleContentExtension) == is_sampler,
+                   "sample content only for the sampler") &&
+             ok;
+        ok = Check(has(CLAP_EXT_POSIX_FD_SUPPORT) == is_sampler,
+                   "posix fd support only for the sampler") &&
+             ok;
+
+        // Everyone has the rest
+        ok = Check(has(CLAP_EXT_PARAMS), "params for every variant") && ok;
+    }
+    return ok;
+}
+
+struct Test {
+    const char* name = nullptr;
+    bool (*run)()    = nullptr;
+};
+
+constexpr Test Tests[] = {
+    {"unknown-param-id", TestUnknownParamId},
+    {"state-empty", TestStateEmpty},
+    {"state-truncated", TestStateTruncated},
+    {"state-nan", TestStateNan},
+    {"flush-inactive", TestFlushInactive},
+    {"flush-deactivated", TestFlushDeactivated},
+    {"reset", TestReset},
+    {"variant-extensions", TestVariantExtensions},
+};
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <test>; see plugin_test.cpp\n", argv[0]);
+        return 2;
+    }
+
+    for (const auto& test : Tests) {
+        if (strcmp(argv[1], test.name) == 0) {
+            const auto passed = test.run();
+
+            printf("%s: %s\n", test.name, passed ? "passed" : "FAILED");
+            return passed ? 0 : 1;
+        }
+    }
+
+    fprintf(stderr, "Unknown test %s\n", argv[1]);
+    return 2;
+}
@@ -0,0 +1,251 @@
+// CLAP instrument plugin tutorial
+//
+// Preset banks: a whole preset library in a single, indexed file.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "preset_bank.h"
+#include "state_format.h"
+
+constexpr auto Magic   = state::FourCC("HCPB");
+constexpr auto Version = 1;
+
+constexpr uint32_t HeaderSize = 6 * sizeof(uint32_t);
+constexpr uint32_t EntrySize  = 7 * sizeof(uint32_t);
+
+static uint32_t ReadU32(const uint8_t* p)
+{
+    uint32_t value = 0;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+bool PresetBank::Open(const std::string& path)
+{
+    Close();
+
+    if (!file.Open(path) || !Validate()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void PresetBank::Close()
+{
+    file.Close();
+
+    num_presets    = 0;
+    entries_offset = 0;
+    strings        = nullptr;
+    strings_size   = 0;
+}
+
+// The bank could be truncated or corrupted, so we check every offset in
+// the index once up front; after that, every access is known to be safe.
+// This only touches the index and the string table.
+bool PresetBank::Validate()
+{
+    const auto data = file.Data();
+    const auto size = file.Size();
+
+    if (size < HeaderSize || ReadU32(data) != Magic ||
+        ReadU32(data + 4) != Version) {
+        return false;
+    }
+
+    num_presets    = ReadU32(data + 8);
+    entries_offset = ReadU32(data + 12);
+
+    const auto strings_offset = ReadU32(data + 16);
+    strings_size              = ReadU32(data + 20);
+
+    const auto entries_end = uint64_t{entries_offset} +
+                             uint64_t{num_presets} * EntrySize;
+
+    if (entries_end > size || uint64_t{strings_offset} + strings_size > size) {
+        return false;
+    }
+
+    strings = reinterpret_cast<const char*>(data + strings_offset);
+
+    // If the table ends with a NUL, every string starting inside it
+    // is terminated within it too
+    if (num_presets > 0 &&
+        (strings_size == 0 || strings[strings_size - 1] != '\0')) {
+        return false;
+    }
+
+    const char* prev_key = nullptr;
+
+    for (uint32_t i = 0; i < num_presets; ++i) {
+        const auto entry = GetEntry(i);
+
+        if (entry.key >= strings_size || entry.name >= strings_size ||
+            entry.plugin_id >= strings_size || entry.tags > strings_size) {
+            return false;
+        }
+
+        if (uint64_t{entry.data_offset} + entry.data_size > size) {
+            return false;
+        }
+
+        // The tags must not run past the end of the table
+        auto tag_pos = entry.tags;
+
+        for (uint32_t t = 0; t < entry.num_tags; ++t) {
+            if (tag_pos >= strings_size) {
+                return false;
+            }
+            tag_pos += static_cast<uint32_t>(std::strlen(String(tag_pos))) + 1;
+        }
+
+        // Find() relies on the keys being sorted and unique
+        const auto key = String(entry.key);
+
+        if (prev_key && std::strcmp(prev_key, key) >= 0) {
+            return false;
+        }
+        prev_key = key;
+    }
+
+    return true;
+}
+
+PresetBank::Entry PresetBank::GetEntry(const uint32_t index) const
+{
+    const auto p = file.Data() + entries_offset + index * EntrySize;
+
+    return {.key         = ReadU32(p),
+            .name        = ReadU32(p + 4),
+            .plugin_id   = ReadU32(p + 8),
+            .tags        = ReadU32(p + 12),
+            .num_tags    = ReadU32(p + 16),
+            .data_offset = ReadU32(p + 20),
+            .data_size   = ReadU32(p + 24)};
+}
+
+PresetBank::Preset PresetBank::Get(const uint32_t index) const
+{
+    const auto entry = GetEntry(index);
+
+    return {.key       = String(entry.key),
+            .name      = String(entry.name),
+            .plugin_id = String(entry.plugin_id),
+            .tags      = String(entry.tags),
+            .num_tags  = entry.num_tags,
+            .data      = file.Data() + entry.data_offset,
+            .size      = entry.data_size};
+}
+
+std::optional<PresetBank::Preset> PresetBank::Find(const char* key) const
+{
+    uint32_t first = 0;
+    uint32_t last  = num_presets;
+
+    while (first < last) {
+        const auto mid = first + (last - first) / 2;
+        const auto cmp = std::strcmp(String(GetEntry(mid).key), key);
+
+        if (cmp == 0) {
+            return Get(mid);
+        } else if (cmp < 0) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return {};
+}
+
+bool WritePresetBank(const std::string& path, std::vector<PresetBankEntry> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+        return a.key < b.key;
+    });
+
+    const auto duplicate = std::adjacent_find(
+        entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+            return a.key == b.key;
+        });
+
+    if (duplicate != entries.end()) {
+        return false;
+    }
+
+    std::vector<char> strings = {};
+
+    const auto add_string = [&](const std::string& s) {
+        const auto offset = static_cast<uint32_t>(strings.size());
+        strings.insert(strings.end(), s.begin(), s.end());
+        strings.push_back('\0');
+        return offset;
+    };
+
+    const auto num_presets    = static_cast<uint32_t>(entries.size());
+    const auto entries_offset = HeaderSize;
+
+    std::vector<uint32_t> index = {};
+
+    for (const auto& entry : entries) {
+        index.push_back(add_string(entry.key));
+        index.push_back(add_string(entry.name));
+        index.push_back(add_string(entry.plugin_id));
+
+        const auto tags = static_cast<uint32_t>(strings.size());
+        for (const auto& tag : entry.tags) {
+            add_string(tag);
+        }
+        index.push_back(tags);
+        index.push_back(static_cast<uint32_t>(entry.tags.size()));
+
+        // Data offsets are filled in below
+        index.push_back(0);
+        index.push_back(static_cast<uint32_t>(entry.data.size()));
+    }
+
+    const auto strings_offset = entries_offset + num_presets * EntrySize;
+    const auto strings_size   = static_cast<uint32_t>(strings.size());
+
+    // Keep the states 4-byte aligned
+    auto data_offset = (strings_offset + strings_size + 3) & ~3u;
+
+    for (uint32_t i = 0; i < num_presets; ++i) {
+        index[i * 7 + 5] = data_offset;
+        data_offset += (static_cast<uint32_t>(entries[i].data.size()) + 3) & ~3u;
+    }
+
+    const auto file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    const uint32_t header[] = {
+        Magic, Version, num_presets, entries_offset, strings_offset, strings_size};
+
+    bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+
+    ok = ok && std::fwrite(index.data(), sizeof(uint32_t), index.size(), file) ==
+                   index.size();
+
+    ok = ok && std::fwrite(strings.data(), 1, strings.size(), file) ==
+                   strings.size();
+
+    const auto pad = [&](const size_t n) {
+        const uint8_t zeros[4] = {};
+        return std::fwrite(zeros, 1, (4 - n % 4) % 4, file) == (4 - n % 4) % 4;
+    };
+
+    ok = ok && pad(strings_offset + strings_size);
+
+    for (const auto& entry : entries) {
+        ok = ok &&
+             std::fwrite(entry.data.data(), 1, entry.data.size(), file) ==
+                 entry.data.size() &&
+             pad(entry.data.size());
+    }
+
+    return (std::fclose(file) == 0) && ok;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Preset banks: a whole preset library in a single, indexed file.
+//
+// A bank starts with a compact index of all its presets (load key, name,
+// plugin ID, tags, and where the preset's state is in the file), followed
+// by a string table and the states themselves, as written by
+// MyPlugin::SaveState(). The file is memory-mapped, so browsing and
+// searching a bank only ever touches the index and the strings, and
+// loading a preset reads its state straight from the mapping.
+//
+//     header:   magic (u32) | version (u32) | num_presets (u32) |
+//               entries_offset (u32) | strings_offset (u32) |
+//               strings_size (u32)
+//
+//     entry:    key (u32) | name (u32) | plugin_id (u32) | tags (u32) |
+//               num_tags (u32) | data_offset (u32) | data_size (u32)
+//
+// The string fields of the entries are offsets into the string table,
+// which contains NUL-terminated UTF-8 strings. An entry's tags are
+// `num_tags` consecutive strings. The entries are sorted by their load
+// key, which identifies the preset within the bank.
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+class PresetBank {
+
+public:
+    static constexpr auto FileExtension = "hclpbank";
+
+    struct Preset {
+        const char* key       = nullptr;
+        const char* name      = nullptr;
+        const char* plugin_id = nullptr;
+
+        // `num_tags` consecutive NUL-terminated strings
+        const char* tags  = nullptr;
+        uint32_t num_tags = 0;
+
+        // Saved plugin state
+        const uint8_t* data = nullptr;
+        uint32_t size       = 0;
+    };
+
+    // Maps the bank and validates its index. Returns false if the file
+    // can't be mapped or isn't a valid bank.
+    bool Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const
+    {
+        return file.IsOpen();
+    }
+
+    const std::string& Path() const
+    {
+        return file.Path();
+    }
+
+    uint32_t NumPresets() const
+    {
+        return num_presets;
+    }
+
+    Preset Get(const uint32_t index) const;
+
+    // Looks up a preset by its load key in O(log n)
+    std::optional<Preset> Find(const char* key) const;
+
+    template <typename Fn>
+    static void ForEachTag(const Preset& preset, Fn&& fn)
+    {
+        auto tag = preset.tags;
+
+        for (uint32_t i = 0; i < preset.num_tags; ++i) {
+            fn(tag);
+
+            while (*tag) {
+                ++tag;
+            }
+            ++tag;
+        }
+    }
+
+private:
+    struct Entry {
+        uint32_t key         = 0;
+        uint32_t name        = 0;
+        uint32_t plugin_id   = 0;
+        uint32_t tags        = 0;
+        uint32_t num_tags    = 0;
+        uint32_t data_offset = 0;
+        uint32_t data_size   = 0;
+    };
+
+    bool Validate();
+
+    Entry GetEntry(const uint32_t index) const;
+
+    const char* String(const uint32_t offset) const
+    {
+        return strings + offset;
+    }
+
+    MappedFile file = {};
+
+    uint32_t num_presets    = 0;
+    uint32_t entries_offset = 0;
+
+    const char* strings   = nullptr;
+    uint32_t strings_size = 0;
+};
+
+// A preset to be written into a bank
+struct PresetBankEntry {
+    std::string key       = {};
+    std::string name      = {};
+    std::string plugin_id = {};
+
+    std::vector<std::string> tags = {};
+
+    std::vector<uint8_t> data = {};
+};
+
+// Builds a bank from a list of presets; meant for tools that package the
+// preset library, not for the plugin itself. Load keys must be unique.
+bool WritePresetBank(const std::string& path, std::vector<PresetBankEntry> entries);
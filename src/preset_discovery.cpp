@@ -0,0 +1,144 @@
+// CLAP instrument plugin tutorial
+//
+// Preset discovery factory.
+
+#include <cstring>
+
+#include "preset_bank.h"
+#include "preset_discovery.h"
+
+namespace preset_discovery {
+
+static std::string factory_preset_dir = {};
+
+void Init(const char* plugin_path)
+{
+    std::string path = plugin_path ? plugin_path : "";
+
+#if defined(__APPLE__)
+    // The library path is the path of the bundle
+    factory_preset_dir = path + "/Contents/Resources/Presets";
+#else
+    // Next to the plugin library
+    const auto sep = path.find_last_of("/\\");
+    const auto dir = (sep == std::string::npos) ? std::string(".")
+                                                : path.substr(0, sep);
+
+    factory_preset_dir = dir + "/HelloCLAP Presets";
+#endif
+}
+
+const std::string& FactoryPresetDirectory()
+{
+    return factory_preset_dir;
+}
+
+static const clap_preset_discovery_provider_descriptor_t provider_descriptor = {
+    .clap_version = CLAP_VERSION_INIT,
+    .id           = "org.nakst.clap-tutorial.HelloClapPresets",
+    .name         = "HelloCLAP preset provider",
+    .vendor       = "nakst",
+};
+
+static bool provider_init(const clap_preset_discovery_provider* provider)
+{
+    auto indexer = static_cast<const clap_preset_discovery_indexer_t*>(
+        provider->provider_data);
+
+    const clap_preset_discovery_filetype_t filetype = {
+        .name           = "HelloCLAP preset bank",
+        .description    = "Collection of HelloCLAP presets",
+        .file_extension = PresetBank::FileExtension,
+    };
+
+    const clap_preset_discovery_location_t location = {
+        .flags    = CLAP_PRESET_DISCOVERY_IS_FACTORY_CONTENT,
+        .name     = "HelloCLAP factory presets",
+        .kind     = CLAP_PRESET_DISCOVERY_LOCATION_FILE,
+        .location = factory_preset_dir.c_str(),
+    };
+
+    return indexer->declare_filetype(indexer, &filetype) &&
+           indexer->declare_location(indexer, &location);
+}
+
+static bool provider_get_metadata(
+    const clap_preset_discovery_provider* provider, uint32_t location_kind,
+    const char* location,
+    const clap_preset_discovery_metadata_receiver_t* receiver)
+{
+    if (location_kind != CLAP_PRESET_DISCOVERY_LOCATION_FILE || !location) {
+        return false;
+    }
+
+    PresetBank bank = {};
+
+    if (!bank.Open(location)) {
+        receiver->on_error(receiver, 0, "Not a valid HelloCLAP preset bank");
+        return false;
+    }
+
+    // Everything comes from the index; the preset states themselves are
+    // never touched
+    for (uint32_t i = 0; i < bank.NumPresets(); ++i) {
+        const auto preset = bank.Get(i);
+
+        if (!receiver->begin_preset(receiver, preset.name, preset.key)) {
+            break;
+        }
+
+        const clap_universal_plugin_id_t plugin_id = {.abi = "clap",
+                                                      .id  = preset.plugin_id};
+
+        receiver->add_plugin_id(receiver, &plugin_id);
+        receiver->set_flags(receiver, CLAP_PRESET_DISCOVERY_IS_FACTORY_CONTENT);
+
+        PresetBank::ForEachTag(preset, [&](const char* tag) {
+            receiver->add_feature(receiver, tag);
+        });
+    }
+
+    return true;
+}
+
+static const clap_preset_discovery_factory_t factory = {
+    .count = [](const clap_preset_discovery_factory* factory) -> uint32_t {
+        return 1;
+    },
+
+    .get_descriptor = [](const clap_preset_discovery_factory* factory,
+                         uint32_t index)
+        -> const clap_preset_discovery_provider_descriptor_t* {
+        return (index == 0) ? &provider_descriptor : nullptr;
+    },
+
+    .create = [](const clap_preset_discovery_factory* factory,
+                 const clap_preset_discovery_indexer_t* indexer,
+                 const char* provider_id) -> const clap_preset_discovery_provider_t* {
+        if (strcmp(provider_id, provider_descriptor.id) != 0) {
+            return nullptr;
+        }
+
+        // The provider is stateless apart from the indexer it reports to
+        return new clap_preset_discovery_provider_t{
+            .desc          = &provider_descriptor,
+            .provider_data =
+                const_cast<clap_preset_discovery_indexer_t*>(indexer),
+            .init          = provider_init,
+            .destroy =
+                [](const clap_preset_discovery_provider* provider) {
+                    delete provider;
+                },
+            .get_metadata  = provider_get_metadata,
+            .get_extension = [](const clap_preset_discovery_provider* provider,
+                                const char* extension_id) -> const void* {
+                return nullptr;
+            }};
+    }};
+
+const clap_preset_discovery_factory_t* GetFactory()
+{
+    return &factory;
+}
+
+} // namespace preset_discovery
@@ -0,0 +1,28 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Preset discovery factory, so hosts can index our factory presets in
+// their own browsers without instantiating the plugin.
+//
+// The presets live in preset banks (see preset_bank.h). We declare the
+// factory preset directory as a location and the bank file type; the host
+// then crawls the directory and asks us for the metadata of each bank it
+// finds, which we can answer from the bank's index alone. Loading a preset
+// happens later through the plugin's preset-load extension.
+
+#include <string>
+
+#include "clap/clap.h"
+
+namespace preset_discovery {
+
+// Called from `clap_entry.init()` with the path of the plugin library
+void Init(const char* plugin_path);
+
+// Directory of the factory preset banks
+const std::string& FactoryPresetDirectory();
+
+const clap_preset_discovery_factory_t* GetFactory();
+
+} // namespace preset_discovery
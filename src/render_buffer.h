@@ -0,0 +1,174 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Fixed-capacity FIFO of interleaved mono or stereo frames that sits between
+// the voice renderer and the output stage (the resampler, or a plain copy
+// into the host's buffers).
+//
+// Storage is carved out of the instance's arena once in Allocate(), which
+// must be called on the main thread (from MyPlugin::Activate); after that,
+// writing and reading frames only moves the cursors, so the audio thread
+// never touches the heap.
+//
+// Every frame is stored twice, `capacity` frames apart. This way the
+// buffered frames can always be read back as a single contiguous span,
+// regardless of where the read cursor is, and we never need to shift the
+// leftover frames to the start of the buffer.
+//
+// `T` is the sample type (float or double).
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+#include "arena.h"
+
+template <typename T>
+class RenderBuffer {
+
+public:
+    static constexpr auto MaxChannels = 2;
+
+    // To be called from the carving code passed to Arena::Build()
+    void Allocate(Arena& arena, const size_t capacity_frames, const size_t _num_channels)
+    {
+        assert(_num_channels >= 1 && _num_channels <= MaxChannels);
+
+        capacity     = capacity_frames;
+        num_channels = _num_channels;
+
+        data = arena.Allocate<T>(capacity * 2 * num_channels);
+
+        Clear();
+    }
+
+    // Forgets the memory, which is owned by the arena; Allocate() must be
+    // called before the buffer can be used again
+    void Release()
+    {
+        data         = {};
+        capacity     = 0;
+        num_channels = 0;
+
+        Clear();
+    }
+
+    void Clear()
+    {
+        read_pos  = 0;
+        write_pos = 0;
+        size      = 0;
+    }
+
+    size_t NumChannels() const
+    {
+        return num_channels;
+    }
+
+    // Number of buffered frames
+    size_t Size() const
+    {
+        return size;
+    }
+
+    size_t Capacity() const
+    {
+        return capacity;
+    }
+
+    size_t FreeSpace() const
+    {
+        return capacity - size;
+    }
+
+    // Appends `num_frames` frames to the end of the buffer. `right` is
+    // ignored in mono mode. Returns the number of frames written, which is
+    // less than `num_frames` only if the buffer is full.
+    size_t Write(const T* left, const T* right, size_t num_frames)
+    {
+        assert(num_frames <= FreeSpace());
+        num_frames = std::min(num_frames, FreeSpace());
+
+        const auto first_part = std::min(num_frames, capacity - write_pos);
+
+        WriteFrames(left, right, 0, first_part, write_pos);
+        WriteFrames(left, right, first_part, num_frames - first_part, 0);
+
+        write_pos = (write_pos + num_frames) % capacity;
+        size += num_frames;
+
+        return num_frames;
+    }
+
+    // Appends `num_frames` silent frames, like Write()
+    size_t WriteSilence(size_t num_frames)
+    {
+        assert(num_frames <= FreeSpace());
+        num_frames = std::min(num_frames, FreeSpace());
+
+        const auto first_part = std::min(num_frames, capacity - write_pos);
+
+        ClearFrames(first_part, write_pos);
+        ClearFrames(num_frames - first_part, 0);
+
+        write_pos = (write_pos + num_frames) % capacity;
+        size += num_frames;
+
+        return num_frames;
+    }
+
+    // Returns a pointer to the oldest buffered frame; the next Size() frames
+    // are guaranteed to be contiguous (interleaved in stereo mode).
+    const T* Read() const
+    {
+        return data.data() + read_pos * num_channels;
+    }
+
+    // Discards `num_frames` frames from the start of the buffer.
+    void Consume(size_t num_frames)
+    {
+        assert(num_frames <= size);
+        num_frames = std::min(num_frames, size);
+
+        read_pos = (read_pos + num_frames) % capacity;
+        size -= num_frames;
+    }
+
+private:
+    void WriteFrames(const T* left, const T* right, const size_t src_pos,
+                     const size_t num_frames, const size_t dest_pos)
+    {
+        auto dest        = data.data() + dest_pos * num_channels;
+        auto dest_mirror = dest + capacity * num_channels;
+
+        if (num_channels == 1) {
+            std::copy_n(left + src_pos, num_frames, dest);
+            std::copy_n(left + src_pos, num_frames, dest_mirror);
+        } else {
+            for (size_t i = 0; i < num_frames; ++i) {
+                dest[i * 2]     = left[src_pos + i];
+                dest[i * 2 + 1] = right[src_pos + i];
+            }
+            std::copy_n(dest, num_frames * 2, dest_mirror);
+        }
+    }
+
+    void ClearFrames(const size_t num_frames, const size_t dest_pos)
+    {
+        auto dest        = data.data() + dest_pos * num_channels;
+        auto dest_mirror = dest + capacity * num_channels;
+
+        std::fill_n(dest, num_frames * num_channels, T{});
+        std::fill_n(dest_mirror, num_frames * num_channels, T{});
+    }
+
+    ArenaArray<T> data = {};
+
+    size_t capacity     = 0;
+    size_t num_channels = 0;
+
+    size_t read_pos  = 0;
+    size_t write_pos = 0;
+    size_t size      = 0;
+};
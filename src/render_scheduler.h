@@ -0,0 +1,188 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Exact bookkeeping of the internal render clock against the host's output
+// clock.
+//
+// When rendering at a different rate than the host's sample rate, we need
+// to know precisely how many internal frames to render so the resampler can
+// produce the requested number of output frames -- no more (that would
+// delay note events), and no less (that would force a second render pass).
+//
+// The scheduler models the resampler's input position with the same
+// integer + fraction arithmetic the Speex resampler uses internally: output
+// frame `j` (counted from the start of the stream) needs input frames up to
+// and including
+//
+//     S(j) = input_latency + floor(j * ratio_num / ratio_den)
+//
+// where `ratio_num / ratio_den` is the reduced input/output rate ratio and
+// `input_latency` is the resampler's look-ahead (half the filter length,
+// after `speex_resampler_skip_zeros()`). Without resampling the ratio is 1/1
+// and the latency is 0, so the same code handles both cases.
+//
+// Events are placed on the internal clock exactly, too. Output frame `j`
+// sits at input position
+//
+//     T(j) = input_latency + j * ratio_num / ratio_den
+//
+// which usually falls between two internal frames. Everything before it is
+// rendered before the event is processed, and the event takes effect from
+// the next frame, `ceil(T(j))`. The remaining fraction of a frame is made
+// up by the voices themselves (see SubFrameDelay()): a note starts with its
+// oscillator advanced by that fraction, as if it had started at `T(j)`.
+// Notes thus line up with the output frames to within a fraction of a
+// sample, rather than to within one internal frame.
+//
+// For deterministic renders (see deterministic_render.h), the clock can be
+// started at any output frame `p` of the stream instead: the internal frames
+// are then counted from `floor(p * ratio_num / ratio_den)`, and the
+// fractions carry on from `p * ratio_num % ratio_den`, exactly as if the
+// clock had been running from the start. Rendering also always covers whole
+// blocks of the render grid there, so the host's buffer sizes don't decide
+// where blocks get cut. That means rendering up to a block ahead of what the
+// output needs, so the events are placed a block later, at `T(j) + block`,
+// which is never ahead of what's been rendered, and the block worth of
+// frames at the start is silence.
+
+#include <cassert>
+#include <cstdint>
+
+class RenderScheduler {
+
+public:
+    // A non-zero `_block_size` renders whole blocks on the grid, starting at
+    // output frame `out_position`; the first `_block_size` frames count as
+    // rendered, and must be put into the render buffer as silence
+    void Reset(const uint32_t _ratio_num, const uint32_t _ratio_den,
+               const uint32_t _input_latency, const uint32_t _block_size = 0,
+               const uint64_t out_position = 0)
+    {
+        assert(_ratio_num > 0 && _ratio_den > 0);
+
+        ratio_num     = _ratio_num;
+        ratio_den     = _ratio_den;
+        input_latency = _input_latency;
+        block_size    = _block_size;
+
+        // Can't overflow for streams of up to a few years, as the ratio
+        // terms are limited to 2^20
+        const auto start = out_position * ratio_num;
+
+        out_pos_int  = 0;
+        out_pos_frac = start % ratio_den;
+
+        grid_origin = start / ratio_den;
+
+        total_rendered = block_size;
+    }
+
+    // Number of frames to render so that the resampler can produce the first
+    // `out_frame` output frames of the current block; at the end of the
+    // block, that's everything it needs to fill the host's buffer.
+    uint32_t FramesToRender(const uint32_t out_frame) const
+    {
+        auto needed = InputFramesNeeded(out_frame);
+
+        if (block_size > 0 && needed > 0) {
+            const auto grid_end = (grid_origin + needed + block_size - 1) / block_size *
+                                  block_size;
+
+            needed = grid_end - grid_origin;
+        }
+
+        return (needed > total_rendered)
+                     ? static_cast<uint32_t>(needed - total_rendered)
+                     : 0;
+    }
+
+    // Number of frames to render before processing an event at `out_frame`:
+    // all frames before the exact input position of the event. That's never
+    // more than the rest of the block needs (see FramesToRender()).
+    uint32_t FramesToRenderBefore(const uint32_t out_frame) const
+    {
+        const auto t = out_pos_frac + uint64_t{out_frame} * ratio_num;
+
+        // Index of the first input frame at or after the event
+        const auto first_frame = input_latency + block_size + out_pos_int +
+                                 (t + ratio_den - 1) / ratio_den;
+
+        return (first_frame > total_rendered)
+                     ? static_cast<uint32_t>(first_frame - total_rendered)
+                     : 0;
+    }
+
+    // Distance in internal frames, in [0, 1), from the exact input position
+    // of an event at `out_frame` to the first frame rendered after it, once
+    // FramesToRenderBefore() frames have been rendered
+    float SubFrameDelay(const uint32_t out_frame) const
+    {
+        const auto rem = (out_pos_frac + uint64_t{out_frame} * ratio_num) % ratio_den;
+
+        return (rem == 0) ? 0.0f
+                          : static_cast<float>(static_cast<double>(ratio_den - rem) /
+                                               ratio_den);
+    }
+
+    void AddRenderedFrames(const uint32_t num_frames)
+    {
+        total_rendered += num_frames;
+    }
+
+    // Advances the output clock past the current block
+    void FinishBlock(const uint32_t num_out_frames)
+    {
+        const auto t = out_pos_frac + uint64_t{num_out_frames} * ratio_num;
+
+        out_pos_int += t / ratio_den;
+        out_pos_frac = t % ratio_den;
+    }
+
+    // Total number of frames rendered since the last Reset()
+    uint64_t TotalRendered() const
+    {
+        return total_rendered;
+    }
+
+    // Position of the next frame to render on the render grid, which starts
+    // at the first internal frame of the stream
+    uint64_t GridPosition() const
+    {
+        return grid_origin + total_rendered;
+    }
+
+private:
+    // Total number of input frames the resampler must have received to
+    // produce the first `out_frame` output frames of the current block.
+    uint64_t InputFramesNeeded(const uint32_t out_frame) const
+    {
+        if (out_frame == 0) {
+            return 0;
+        }
+
+        // Index of the last input frame output frame `out_frame - 1` depends on
+        const auto t = out_pos_frac + uint64_t{out_frame - 1} * ratio_num;
+
+        const auto last_input_frame = input_latency + out_pos_int + t / ratio_den;
+
+        return last_input_frame + 1;
+    }
+
+    uint32_t ratio_num     = 1;
+    uint32_t ratio_den     = 1;
+    uint32_t input_latency = 0;
+
+    // Grid block size when rendering whole blocks, otherwise 0
+    uint32_t block_size = 0;
+
+    // Internal frame of the stream the clock has been started at
+    uint64_t grid_origin = 0;
+
+    // Position of the start of the current output block in input frames
+    // (integer part and fractional part in 1/ratio_den units)
+    uint64_t out_pos_int  = 0;
+    uint64_t out_pos_frac = 0;
+
+    uint64_t total_rendered = 0;
+};
@@ -0,0 +1,626 @@
+// CLAP instrument plugin tutorial
+//
+// Sample rate converter backends.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "dsp_kernels.h"
+#include "resampler.h"
+#include "shared_resources.h"
+
+#include "speex/speex_resampler.h"
+
+const char* ToString(const ResamplerType type)
+{
+    switch (type) {
+    case ResamplerType::Linear: return "Linear";
+    case ResamplerType::Cubic: return "Cubic";
+    case ResamplerType::Polyphase: return "Polyphase";
+    case ResamplerType::Speex: return "Speex";
+    case ResamplerType::SpeexBest: return "Speex (best)";
+    default: return "Unknown";
+    }
+}
+
+ResampleRatio ApproximateRatio(const double in_rate_hz, const double out_rate_hz)
+{
+    assert(in_rate_hz > 0.0 && out_rate_hz > 0.0);
+
+    // The common case of two integer rates is kept exact
+    if (in_rate_hz == std::floor(in_rate_hz) && in_rate_hz <= UINT32_MAX &&
+        out_rate_hz == std::floor(out_rate_hz) && out_rate_hz <= UINT32_MAX) {
+
+        const auto in  = static_cast<uint32_t>(in_rate_hz);
+        const auto out = static_cast<uint32_t>(out_rate_hz);
+        const auto gcd = std::gcd(in, out);
+
+        if (in / gcd <= MaxRatioTerm && out / gcd <= MaxRatioTerm) {
+            return {in / gcd, out / gcd};
+        }
+    }
+
+    // Otherwise, walk the convergents of the continued fraction expansion
+    // of the ratio until the next one would exceed the limit; each one is
+    // the best approximation for the size of its terms.
+    const auto ratio = in_rate_hz / out_rate_hz;
+
+    uint64_t num_prev = 1;
+    uint64_t den_prev = 0;
+    uint64_t num      = static_cast<uint64_t>(ratio);
+    uint64_t den      = 1;
+
+    auto x = ratio;
+
+    for (;;) {
+        const auto rem = x - std::floor(x);
+        if (rem < 1e-12) {
+            break;
+        }
+        x = 1.0 / rem;
+
+        const auto a        = static_cast<uint64_t>(x);
+        const auto num_next = a * num + num_prev;
+        const auto den_next = a * den + den_prev;
+
+        if (num_next > MaxRatioTerm || den_next > MaxRatioTerm) {
+            break;
+        }
+
+        num_prev = num;
+        den_prev = den;
+        num      = num_next;
+        den      = den_next;
+    }
+
+    // Ratios out of range are clamped; no sensible rate pair gets here
+    if (num == 0) {
+        return {1, MaxRatioTerm};
+    }
+    if (num > MaxRatioTerm) {
+        return {MaxRatioTerm, 1};
+    }
+    return {static_cast<uint32_t>(num), static_cast<uint32_t>(den)};
+}
+
+// Speex wants integer rates next to the ratio; it only uses them for
+// reporting
+static uint32_t NominalRate(const double rate_hz)
+{
+    return static_cast<uint32_t>(std::lround(rate_hz));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SpeexDSP backend
+//////////////////////////////////////////////////////////////////////////////
+
+class SpeexResampler final : public Resampler {
+
+public:
+    SpeexResampler(const ResamplerType _type, const uint32_t _num_channels,
+                   SpeexResamplerState* _state)
+        : state(_state)
+    {
+        type         = _type;
+        num_channels = _num_channels;
+
+        speex_resampler_skip_zeros(state);
+        UpdateRatio();
+    }
+
+    ~SpeexResampler() override
+    {
+        speex_resampler_destroy(state);
+    }
+
+    void Process(const float* in, uint32_t& in_len, float* out,
+                 uint32_t& out_len) override
+    {
+        spx_uint32_t spx_in_len  = in_len;
+        spx_uint32_t spx_out_len = out_len;
+
+        speex_resampler_process_interleaved_float(
+            state, in, &spx_in_len, out, &spx_out_len);
+
+        in_len  = spx_in_len;
+        out_len = spx_out_len;
+    }
+
+    void Reset() override
+    {
+        speex_resampler_reset_mem(state);
+        speex_resampler_skip_zeros(state);
+    }
+
+    bool ResetToPhase(const uint32_t frac) override
+    {
+        Reset();
+        return frac == 0;
+    }
+
+    // Speex only rebuilds its filter if the new ratio needs a different
+    // one, and keeps the rest of its state
+    bool SetRates(const double in_rate_hz, const double out_rate_hz) override
+    {
+        const auto ratio = ApproximateRatio(in_rate_hz, out_rate_hz);
+
+        if (speex_resampler_set_rate_frac(state,
+                                          ratio.num,
+                                          ratio.den,
+                                          NominalRate(in_rate_hz),
+                                          NominalRate(out_rate_hz)) !=
+            RESAMPLER_ERR_SUCCESS) {
+            return false;
+        }
+
+        UpdateRatio();
+        Reset();
+
+        return true;
+    }
+
+private:
+    void UpdateRatio()
+    {
+        spx_uint32_t num = 0;
+        spx_uint32_t den = 0;
+        speex_resampler_get_ratio(state, &num, &den);
+
+        ratio_num     = num;
+        ratio_den     = den;
+        input_latency = static_cast<uint32_t>(
+            speex_resampler_get_input_latency(state));
+    }
+
+    SpeexResamplerState* state = nullptr;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Interpolating backends
+//////////////////////////////////////////////////////////////////////////////
+
+// Each kernel calculates one output sample of a channel from `num_taps`
+// consecutive input frames starting at `x`. The output position lies
+// between input frames `x[taps_before]` and `x[taps_before + 1]`, at a
+// fractional distance of `frac / den` from the former. Kernels with inner
+// products run them on the SIMD kernels they're created with.
+
+struct LinearKernel {
+    static constexpr uint32_t num_taps    = 2;
+    static constexpr uint32_t taps_before = 0;
+
+    static LinearKernel Create(const uint32_t ratio_num, const uint32_t ratio_den,
+                         const kernels::Kernels&)
+    {
+        return {1.0f / static_cast<float>(ratio_den)};
+    }
+
+    float inv_den = 1.0f;
+
+    float Eval(const float* x, const uint32_t frac) const
+    {
+        const auto t = static_cast<float>(frac) * inv_den;
+        return x[0] + (x[1] - x[0]) * t;
+    }
+};
+
+struct CubicKernel {
+    static constexpr uint32_t num_taps    = 4;
+    static constexpr uint32_t taps_before = 1;
+
+    static CubicKernel Create(const uint32_t ratio_num, const uint32_t ratio_den,
+                         const kernels::Kernels&)
+    {
+        return {1.0f / static_cast<float>(ratio_den)};
+    }
+
+    float inv_den = 1.0f;
+
+    float Eval(const float* x, const uint32_t frac) const
+    {
+        // Catmull-Rom spline through the 4 points
+        const auto t = static_cast<float>(frac) * inv_den;
+
+        const auto c0 = x[1];
+        const auto c1 = 0.5f * (x[2] - x[0]);
+        const auto c2 = x[0] - 2.5f * x[1] + 2.0f * x[2] - 0.5f * x[3];
+        const auto c3 = 0.5f * (x[3] - x[0]) + 1.5f * (x[1] - x[2]);
+
+        return ((c3 * t + c2) * t + c1) * t + c0;
+    }
+};
+
+// The coefficients only depend on the conversion ratio, and computing them
+// takes a while for the longer filters, so instances converting between the
+// same rates share a single, read-only table
+struct PolyphaseTable {
+    PolyphaseTable(const uint32_t ratio_num, const uint32_t ratio_den)
+    {
+        // When downsampling, the cutoff must be lowered to the output
+        // Nyquist frequency, and the filter made longer so the transition
+        // band stays equally steep.
+        const auto downsample_factor = std::max(
+            1.0, static_cast<double>(ratio_num) / ratio_den);
+
+        const auto cutoff = RelativeCutoff / downsample_factor;
+
+        num_taps = std::min(
+            static_cast<uint32_t>(std::ceil(BaseNumTaps * downsample_factor / TapAlignment)) *
+                TapAlignment,
+            MaxNumTaps);
+
+        taps_before = num_taps / 2 - 1;
+
+        // Use a dedicated phase for every possible output position if
+        // there aren't too many of them; otherwise, interpolate between
+        // the two nearest precomputed phases.
+        exact_phases = (ratio_den <= MaxNumPhases);
+        num_phases   = exact_phases ? ratio_den : MaxNumPhases;
+
+        phase_scale = static_cast<float>(num_phases) / ratio_den;
+
+        // One extra phase at the end for interpolating past the last one
+        const auto num_rows = num_phases + 1;
+
+        coeffs.resize(static_cast<size_t>(num_rows) * num_taps);
+
+        for (uint32_t phase = 0; phase < num_rows; ++phase) {
+            const auto frac = static_cast<double>(phase) / num_phases;
+            auto row        = coeffs.data() + static_cast<size_t>(phase) * num_taps;
+
+            double sum = 0.0;
+
+            for (uint32_t n = 0; n < num_taps; ++n) {
+                // Distance of the tap from the output position
+                const auto x = static_cast<double>(n) - taps_before - frac;
+
+                const auto h = cutoff * Sinc(cutoff * x) * Kaiser(x, num_taps / 2.0);
+
+                row[n] = static_cast<float>(h);
+                sum += h;
+            }
+
+            // Normalise to unity gain at DC
+            for (uint32_t n = 0; n < num_taps; ++n) {
+                row[n] = static_cast<float>(row[n] / sum);
+            }
+        }
+    }
+
+    // Returns the table for a ratio, building it if no other resampler is
+    // using it. Main thread only, like the rest of the resampler setup.
+    static std::shared_ptr<const PolyphaseTable> Get(const uint32_t ratio_num,
+                                                     const uint32_t ratio_den)
+    {
+        const auto key = (static_cast<uint64_t>(ratio_num) << 32) | ratio_den;
+
+        return shared_resources::Get<PolyphaseTable>(
+            key, [&] { return PolyphaseTable(ratio_num, ratio_den); },
+            shared_resources::Retention::WhileUsed);
+    }
+
+    uint32_t num_taps    = 0;
+    uint32_t taps_before = 0;
+
+    bool exact_phases   = false;
+    uint32_t num_phases = 0;
+    float phase_scale   = 1.0f;
+
+    std::vector<float> coeffs = {};
+
+private:
+    static constexpr auto RelativeCutoff = 0.92;
+    static constexpr auto KaiserBeta     = 8.0;
+
+    static constexpr uint32_t BaseNumTaps  = 32;
+    static constexpr uint32_t MaxNumTaps   = 256;
+    static constexpr uint32_t TapAlignment = 8;
+    static constexpr uint32_t MaxNumPhases = 256;
+
+    static double Sinc(const double x)
+    {
+        if (std::fabs(x) < 1e-9) {
+            return 1.0;
+        }
+        return std::sin(M_PI * x) / (M_PI * x);
+    }
+
+    // Zeroth order modified Bessel function of the first kind
+    static double BesselI0(const double x)
+    {
+        double sum  = 1.0;
+        double term = 1.0;
+
+        for (int k = 1; k < 50; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+
+            if (term < sum * 1e-12) {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    static double Kaiser(const double x, const double half_width)
+    {
+        const auto r = x / half_width;
+        if (std::fabs(r) > 1.0) {
+            return 0.0;
+        }
+        return BesselI0(KaiserBeta * std::sqrt(1.0 - r * r)) / BesselI0(KaiserBeta);
+    }
+};
+
+class PolyphaseKernel {
+
+public:
+    static PolyphaseKernel Create(const uint32_t ratio_num, const uint32_t ratio_den,
+                                  const kernels::Kernels& simd)
+    {
+        return PolyphaseKernel(PolyphaseTable::Get(ratio_num, ratio_den), simd);
+    }
+
+    uint32_t num_taps    = 0;
+    uint32_t taps_before = 0;
+
+    float Eval(const float* x, const uint32_t frac) const
+    {
+        if (table->exact_phases) {
+            return fir(Row(frac), x, num_taps);
+        }
+
+        const auto pos   = static_cast<float>(frac) * table->phase_scale;
+        const auto phase = static_cast<uint32_t>(pos);
+        const auto t     = pos - static_cast<float>(phase);
+
+        return interpolate_fir(Row(phase), Row(phase + 1), x, num_taps, t);
+    }
+
+private:
+    PolyphaseKernel(std::shared_ptr<const PolyphaseTable> _table,
+                    const kernels::Kernels& simd)
+        : num_taps(_table->num_taps),
+          taps_before(_table->taps_before),
+          table(std::move(_table)),
+          fir(simd.fir),
+          interpolate_fir(simd.interpolate_fir)
+    {}
+
+    const float* Row(const uint32_t phase) const
+    {
+        return table->coeffs.data() + static_cast<size_t>(phase) * num_taps;
+    }
+
+    std::shared_ptr<const PolyphaseTable> table = {};
+
+    // The SIMD kernels the resampler was created with
+    kernels::FirFn fir                        = nullptr;
+    kernels::InterpolateFirFn interpolate_fir = nullptr;
+};
+
+// Generic resampler driving one of the above kernels. The input is
+// processed in chunks that get deinterleaved after the filter history of
+// each channel, so the kernels can always read their taps from contiguous
+// memory.
+template <typename Kernel>
+class InterpolatingResampler final : public Resampler {
+
+public:
+    InterpolatingResampler(const ResamplerType _type,
+                           const uint32_t _num_channels, const uint32_t num,
+                           const uint32_t den, const kernels::Kernels& simd)
+        : kernel(Kernel::Create(num, den, simd))
+    {
+        type         = _type;
+        num_channels = _num_channels;
+        simd_kernels = &simd;
+
+        mem.resize(num_channels);
+
+        SetRatio(num, den);
+    }
+
+    void Process(const float* in, uint32_t& in_len, float* out,
+                 uint32_t& out_len) override
+    {
+        uint32_t in_done  = 0;
+        uint32_t out_done = 0;
+
+        while (in_done < in_len && out_done < out_len) {
+            const auto chunk_len = std::min(in_len - in_done, ChunkLen);
+
+            for (uint32_t ch = 0; ch < num_channels; ++ch) {
+                auto dest = mem[ch].data() + history_len;
+                auto src  = in + static_cast<size_t>(in_done) * num_channels + ch;
+
+                for (uint32_t i = 0; i < chunk_len; ++i) {
+                    dest[i] = src[static_cast<size_t>(i) * num_channels];
+                }
+            }
+
+            while (last_sample < chunk_len && out_done < out_len) {
+                auto dest = out + static_cast<size_t>(out_done) * num_channels;
+
+                for (uint32_t ch = 0; ch < num_channels; ++ch) {
+                    dest[ch] = kernel.Eval(mem[ch].data() + last_sample, frac);
+                }
+                ++out_done;
+
+                last_sample += int_advance;
+                frac += frac_advance;
+
+                if (frac >= ratio_den) {
+                    frac -= ratio_den;
+                    ++last_sample;
+                }
+            }
+
+            const auto consumed = std::min(last_sample, chunk_len);
+            last_sample -= consumed;
+
+            // Keep the frames preceding the next unconsumed frame as history
+            for (auto& m : mem) {
+                std::copy_n(m.begin() + consumed, history_len, m.begin());
+            }
+
+            in_done += consumed;
+
+            if (consumed < chunk_len) {
+                break;
+            }
+        }
+
+        in_len  = in_done;
+        out_len = out_done;
+    }
+
+    void Reset() override
+    {
+        for (auto& m : mem) {
+            std::fill(m.begin(), m.end(), 0.0f);
+        }
+
+        // Start with the look-ahead already "consumed", just like
+        // `speex_resampler_skip_zeros()` does
+        last_sample = input_latency;
+        frac        = 0;
+    }
+
+    bool ResetToPhase(const uint32_t _frac) override
+    {
+        Reset();
+        frac = _frac % ratio_den;
+
+        return true;
+    }
+
+    bool SetRates(const double in_rate_hz, const double out_rate_hz) override
+    {
+        const auto [num, den] = ApproximateRatio(in_rate_hz, out_rate_hz);
+
+        kernel = Kernel::Create(num, den, *simd_kernels);
+        SetRatio(num, den);
+
+        return true;
+    }
+
+private:
+    static constexpr uint32_t ChunkLen = 1024;
+
+    // Also clears the history; the buffers only grow if the new kernel is
+    // longer
+    void SetRatio(const uint32_t num, const uint32_t den)
+    {
+        ratio_num = num;
+        ratio_den = den;
+
+        int_advance  = num / den;
+        frac_advance = num % den;
+
+        history_len   = kernel.num_taps - 1;
+        input_latency = history_len - kernel.taps_before;
+
+        for (auto& m : mem) {
+            m.resize(history_len + ChunkLen);
+        }
+
+        Reset();
+    }
+
+    Kernel kernel;
+
+    uint32_t int_advance  = 0;
+    uint32_t frac_advance = 0;
+
+    uint32_t history_len = 0;
+
+    // Position of the next output frame relative to the start of the
+    // current chunk, in input frames
+    uint32_t last_sample = 0;
+    uint32_t frac        = 0;
+
+    // Per-channel filter history followed by the current input chunk
+    std::vector<std::vector<float>> mem = {};
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Factory
+//////////////////////////////////////////////////////////////////////////////
+
+std::unique_ptr<Resampler> CreateResampler(const ResamplerType type,
+                                           const uint32_t num_channels,
+                                           const double in_rate_hz,
+                                           const double out_rate_hz,
+                                           const kernels::Kernels& simd)
+{
+    if (num_channels == 0 || !(in_rate_hz > 0.0) || !(out_rate_hz > 0.0)) {
+        return nullptr;
+    }
+
+    const auto [num, den] = ApproximateRatio(in_rate_hz, out_rate_hz);
+
+    switch (type) {
+    case ResamplerType::Linear:
+        return std::make_unique<InterpolatingResampler<LinearKernel>>(
+            type, num_channels, num, den, simd);
+
+    case ResamplerType::Cubic:
+        return std::make_unique<InterpolatingResampler<CubicKernel>>(
+            type, num_channels, num, den, simd);
+
+    case ResamplerType::Polyphase:
+        return std::make_unique<InterpolatingResampler<PolyphaseKernel>>(
+            type, num_channels, num, den, simd);
+
+    case ResamplerType::Speex:
+    case ResamplerType::SpeexBest: {
+        const auto quality = (type == ResamplerType::SpeexBest)
+                                   ? SPEEX_RESAMPLER_QUALITY_MAX
+                                   : SPEEX_RESAMPLER_QUALITY_DESKTOP;
+
+        int err    = 0;
+        auto state = speex_resampler_init_frac(num_channels,
+                                               num,
+                                               den,
+                                               NominalRate(in_rate_hz),
+                                               NominalRate(out_rate_hz),
+                                               quality,
+                                               &err);
+
+        if (!state) {
+            return nullptr;
+        }
+        return std::make_unique<SpeexResampler>(type, num_channels, state);
+    }
+
+    default: return nullptr;
+    }
+}
+
+bool UpdateResampler(std::unique_ptr<Resampler>& resampler,
+                     const ResamplerType type, const uint32_t num_channels,
+                     const double in_rate_hz, const double out_rate_hz,
+                     const kernels::Kernels& simd)
+{
+    // Speex doesn't use our kernels
+    const auto is_speex = (type == ResamplerType::Speex ||
+                           type == ResamplerType::SpeexBest);
+
+    if (resampler && resampler->Type() == type &&
+        resampler->NumChannels() == num_channels &&
+        (is_speex || &resampler->SimdKernels() == &simd) && in_rate_hz > 0.0 &&
+        out_rate_hz > 0.0 && resampler->SetRates(in_rate_hz, out_rate_hz)) {
+        return true;
+    }
+
+    // Free the old one first so both never exist at the same time
+    resampler.reset();
+    resampler = CreateResampler(type, num_channels, in_rate_hz, out_rate_hz, simd);
+
+    return resampler != nullptr;
+}
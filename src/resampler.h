@@ -0,0 +1,158 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Common interface for the sample rate converters used to get from the
+// internal render rate to the host's sample rate.
+//
+// All backends behave like a Speex resampler after
+// `speex_resampler_skip_zeros()`: they consume as much of the interleaved
+// input and produce as much output as they can, keep their own filter
+// history between calls, and output frame `j` depends on the input frames
+// up to `InputLatency() + floor(j * RatioNum() / RatioDen())`. That's what
+// allows the RenderScheduler to render exactly the right number of frames
+// regardless of the backend in use.
+
+#include <cstdint>
+#include <memory>
+
+#include "dsp_kernels.h"
+
+enum class ResamplerType {
+    // Linear interpolation; cheapest, for live monitoring
+    Linear,
+
+    // 4-point cubic Hermite interpolation
+    Cubic,
+
+    // Precomputed windowed-sinc polyphase FIR with SIMD inner products
+    Polyphase,
+
+    // SpeexDSP at desktop quality
+    Speex,
+
+    // SpeexDSP at maximum quality; too expensive for real-time use with
+    // many instances, but ideal for offline rendering
+    SpeexBest
+};
+
+constexpr auto NumResamplerTypes = 5;
+
+const char* ToString(const ResamplerType type);
+
+// Input/output rate ratio in lowest terms
+struct ResampleRatio {
+    uint32_t num = 1;
+    uint32_t den = 1;
+};
+
+// Upper limit for both terms of a ratio. Large enough to represent the
+// exact ratio of any two integer rates up to 1 MHz, and small enough to
+// keep the fractional position arithmetic of all backends exact.
+constexpr uint32_t MaxRatioTerm = 1 << 20;
+
+// Exact ratio of two integer rates if its terms are within `MaxRatioTerm`,
+// otherwise the closest ratio that is. Hosts may run at fractional rates
+// (e.g. 44100.04 Hz for pulled-down video, or varispeed); truncating those
+// to integers would make the output run slightly off the host's clock.
+ResampleRatio ApproximateRatio(const double in_rate_hz, const double out_rate_hz);
+
+class Resampler {
+
+public:
+    virtual ~Resampler() = default;
+
+    // Processes interleaved frames. On return, `in_len` and `out_len`
+    // contain the number of frames actually consumed and produced.
+    virtual void Process(const float* in, uint32_t& in_len, float* out,
+                         uint32_t& out_len) = 0;
+
+    // Clears the filter history
+    virtual void Reset() = 0;
+
+    // Clears the filter history like Reset(), but puts the first output
+    // frame `frac / RatioDen()` of an input frame further on: where a
+    // resampler that had been running from the start of the stream would be
+    // after an output frame `j` with `j * RatioNum() % RatioDen() == frac`.
+    // Returns false if the backend can't (Speex keeps its phase to itself).
+    virtual bool ResetToPhase(const uint32_t frac) = 0;
+
+    // Changes the conversion rates, keeping as much of the existing state
+    // (filter tables, buffers) as possible; also clears the history. Returns
+    // false if the backend can't do it, in which case it's unusable until
+    // the next successful call. Must be called on the main thread.
+    virtual bool SetRates(const double in_rate_hz, const double out_rate_hz) = 0;
+
+    ResamplerType Type() const
+    {
+        return type;
+    }
+
+    uint32_t NumChannels() const
+    {
+        return num_channels;
+    }
+
+    // The SIMD kernels the filters run on
+    const kernels::Kernels& SimdKernels() const
+    {
+        return *simd_kernels;
+    }
+
+    // Reduced input/output rate ratio
+    uint32_t RatioNum() const
+    {
+        return ratio_num;
+    }
+
+    uint32_t RatioDen() const
+    {
+        return ratio_den;
+    }
+
+    // Number of input frames the resampler needs to look ahead
+    uint32_t InputLatency() const
+    {
+        return input_latency;
+    }
+
+    // Equivalent of the look-ahead in output frames (rounded)
+    uint32_t OutputLatency() const
+    {
+        return static_cast<uint32_t>(
+            (uint64_t{input_latency} * ratio_den + ratio_num / 2) / ratio_num);
+    }
+
+protected:
+    ResamplerType type    = ResamplerType::Speex;
+    uint32_t num_channels = 0;
+
+    const kernels::Kernels* simd_kernels = &kernels::Get();
+
+    uint32_t ratio_num     = 1;
+    uint32_t ratio_den     = 1;
+    uint32_t input_latency = 0;
+};
+
+// Must be called on the main thread, as it allocates memory. Returns nullptr
+// if the resampler couldn't be created. The resampler converts by
+// `ApproximateRatio(in_rate_hz, out_rate_hz)`; use RatioNum() and RatioDen()
+// to find out the exact rates in effect. The filters run on `simd`, the
+// selected kernels unless bit-exact results across machines matter more
+// than speed.
+std::unique_ptr<Resampler> CreateResampler(const ResamplerType type,
+                                           const uint32_t num_channels,
+                                           const double in_rate_hz,
+                                           const double out_rate_hz,
+                                           const kernels::Kernels& simd = kernels::Get());
+
+// Reconfigures `resampler` for new rates if it's of the right type, channel
+// count and kernels, otherwise replaces it with a new one. Resamplers are kept
+// across reactivations this way, as hosts reactivate plugins on every
+// sample rate or buffer size change. Must be called on the main thread.
+// Returns false (leaving `resampler` empty) if no resampler could be
+// created.
+bool UpdateResampler(std::unique_ptr<Resampler>& resampler,
+                     const ResamplerType type, const uint32_t num_channels,
+                     const double in_rate_hz, const double out_rate_hz,
+                     const kernels::Kernels& simd = kernels::Get());
@@ -1,286 +1,876 @@
 #include <algorithm>
 #include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <execinfo.h>
+#include <fcntl.h>
+#include <memory>
+#include <optional>
+#include <random>
 #include <signal.h>
+#include <string>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
-#include "speex/speex_resampler.h"
+#include "dsp_kernels.h"
+#include "render_scheduler.h"
+#include "resampler.h"
 
 // --------------------------------------------------------------------------
-// Standalone test case for plugins that use a different internal sample rate
+// Resampler soak test for plugins that use a different internal sample rate
 // than the audio host's sample rate.
 //
-// The tests renders a 440 Hz sine wave at some internal sample rate,
-// resamples it to a different output rate using a fixed output chunk size
-// (this emulates how audio plugins request samples), and then writes it to a
-// WAV file.
+// The test renders a sine wave at some internal sample rate and resamples
+// it to a different output rate in chunks of varying size (this emulates
+// how audio hosts request samples), through the same scheduled render &
+// resample loop the plugin uses. Every backend is checked against an ideal
+// sine at the output rate:
 //
-// This is a very good test for ensuring we're not dropping samples or doing
-// anything weird during resampling as even single-sample glitches are very
-// audible with sine waves.
+// - THD+N: the power of everything but the ideal sine, relative to the
+//   sine
+//
+// - Glitches: output samples that are further from the ideal sine than any
+//   working backend ever gets
+//
+// - Discontinuities: jumps between neighbouring samples that are too steep
+//   for a smooth sine, such as a dropped or repeated sample. Unlike the
+//   glitch check, this one doesn't depend on the reference.
+//
+// - Drift: the difference between the number of frames rendered and the
+//   number the nominal rates call for. Any drift means the render clock
+//   runs off the host's clock, which delays events over time.
+//
+// Even single-sample glitches are very audible with sine waves, so the
+// output can also be written to WAV files to listen to.
+//
+// Usage:
+//
+//   ResamplerTest [options]
+//
+//   --type <name|all>     backend to test, e.g. `polyphase`; default all
+//   --render-rate <hz>    default 16789
+//   --output-rate <hz>    default 48000
+//   --frequency <hz>      of the sine, default 440
+//   --seconds <s>         length of the output, default 10; use hours'
+//                         worth of seconds for soak runs
+//   --chunks <spec>       chunk size distribution, default uniform:0:1023
+//                           fixed:<n>          always n frames
+//                           uniform:<min>:<max>
+//                           pow2:<min>:<max>   random powers of two, like
+//                                              hosts changing buffer sizes
+//   --seed <n>            of the chunk sizes, default 1
+//   --wav <path|none>     write 16-bit WAVs; with several backends, the
+//                         name of each is inserted before the extension.
+//                         Default none.
+//   --wav-mode <mode>     `buffered` (default) or `mapped`
+//   --max-thd-n <db>      fail backends with a higher THD+N
+//
+// The test exits with an error if any backend produces glitches,
+// discontinuities or drift, or the wrong number of frames.
 // --------------------------------------------------------------------------
 
 constexpr auto NumChannels = 2;
 
-// Test with render rates both lower & higher than the output rate
-constexpr double RenderSampleRateHz = 16789.0;
-// constexpr double RenderSampleRateHz = 96789.0;
-// constexpr double RenderSampleRateHz = 56789.0;
+constexpr double SineAmplitude = 0.2;
+
+// Skip the filter warm-up at the start when analysing the output
+constexpr uint64_t WarmUpFrames = 1024;
+
+// Errors are measured relative to the sine's amplitude. The linear
+// resampler's worst error with the default rates is around -50 dB, while a
+// single dropped sample exceeds -25 dB.
+constexpr double GlitchThresholdDb = -35.0;
+
+// Rounding the nominal input position may put it a frame off, but any more
+// than that is real drift
+constexpr int64_t MaxDriftFrames = 1;
+
+// Long runs report their progress at this interval of audio time
+constexpr double ProgressIntervalSeconds = 600.0;
+
+// --------------------------------------------------------------------------
+// Options
+// --------------------------------------------------------------------------
+
+struct ChunkSizes {
+    enum class Kind { Fixed, Uniform, PowerOfTwo };
+
+    Kind kind    = Kind::Uniform;
+    uint32_t min = 0;
+    uint32_t max = 1023;
+};
+
+enum class WavMode { Buffered, Mapped };
+
+struct Options {
+    std::vector<ResamplerType> types = {};
+
+    double render_rate_hz = 16789.0;
+    double output_rate_hz = 48000.0;
+    double frequency_hz   = 440.0;
+    double seconds        = 10.0;
+
+    ChunkSizes chunk_sizes = {};
+    uint64_t seed          = 1;
+
+    std::string wav_path = {};
+    WavMode wav_mode     = WavMode::Buffered;
+
+    std::optional<double> max_thd_n_db = {};
+};
+
+// Lower case letters and digits only, so `speex-best` and `SpeexBest` both
+// match "Speex (best)"
+std::string normalize_name(const std::string& name)
+{
+    std::string result = {};
+
+    for (const auto c : name) {
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            result += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+    return result;
+}
+
+std::optional<std::vector<ResamplerType>> parse_types(const std::string& name)
+{
+    std::vector<ResamplerType> types = {};
+
+    for (auto i = 0; i < NumResamplerTypes; ++i) {
+        const auto type = static_cast<ResamplerType>(i);
+
+        if (name == "all" || normalize_name(name) == normalize_name(ToString(type))) {
+            types.push_back(type);
+        }
+    }
+
+    if (types.empty()) {
+        return {};
+    }
+    return types;
+}
+
+// Empty chunks are allowed, but the output must make progress eventually
+std::optional<ChunkSizes> parse_chunk_sizes(const char* spec)
+{
+    ChunkSizes sizes = {};
+
+    unsigned min = 0;
+    unsigned max = 0;
+
+    if (sscanf(spec, "fixed:%u", &min) == 1 && min > 0) {
+        sizes = {ChunkSizes::Kind::Fixed, min, min};
+
+    } else if (sscanf(spec, "uniform:%u:%u", &min, &max) == 2 && min <= max && max > 0) {
+        sizes = {ChunkSizes::Kind::Uniform, min, max};
+
+    } else if (sscanf(spec, "pow2:%u:%u", &min, &max) == 2 && min > 0 && min <= max) {
+        sizes = {ChunkSizes::Kind::PowerOfTwo, min, max};
+
+    } else {
+        return {};
+    }
+    return sizes;
+}
+
+std::optional<Options> parse_options(const int argc, char** argv)
+{
+    Options options = {};
+
+    options.types = *parse_types("all");
+
+    for (auto i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return {};
+        }
+        const char* value = argv[++i];
+
+        if (arg == "--type") {
+            const auto types = parse_types(value);
+
+            if (!types) {
+                fprintf(stderr, "Unknown resampler type %s\n", value);
+                return {};
+            }
+            options.types = *types;
+
+        } else if (arg == "--render-rate") {
+            options.render_rate_hz = atof(value);
+        } else if (arg == "--output-rate") {
+            options.output_rate_hz = atof(value);
+        } else if (arg == "--frequency") {
+            options.frequency_hz = atof(value);
+        } else if (arg == "--seconds") {
+            options.seconds = atof(value);
+        } else if (arg == "--seed") {
+            options.seed = strtoull(value, nullptr, 10);
+
+        } else if (arg == "--chunks") {
+            const auto sizes = parse_chunk_sizes(value);
+
+            if (!sizes) {
+                fprintf(stderr, "Invalid chunk sizes %s\n", value);
+                return {};
+            }
+            options.chunk_sizes = *sizes;
+
+        } else if (arg == "--wav") {
+            options.wav_path = (strcmp(value, "none") == 0) ? "" : value;
+
+        } else if (arg == "--wav-mode") {
+            if (strcmp(value, "buffered") == 0) {
+                options.wav_mode = WavMode::Buffered;
+            } else if (strcmp(value, "mapped") == 0) {
+                options.wav_mode = WavMode::Mapped;
+            } else {
+                fprintf(stderr, "Unknown WAV mode %s\n", value);
+                return {};
+            }
+
+        } else if (arg == "--max-thd-n") {
+            options.max_thd_n_db = atof(value);
+
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return {};
+        }
+    }
+
+    if (options.render_rate_hz <= 0.0 || options.output_rate_hz <= 0.0 ||
+        options.seconds <= 0.0 || options.frequency_hz <= 0.0 ||
+        options.frequency_hz >= 0.5 * std::min(options.render_rate_hz, options.output_rate_hz)) {
+
+        fprintf(stderr, "Invalid rates or length; see resampler_test.cpp\n");
+        return {};
+    }
+
+    return options;
+}
+
+// Hosts pick the size of every process call, and may pass 0 frames too
+class ChunkGenerator {
+
+public:
+    ChunkGenerator(const ChunkSizes& _sizes, const uint64_t seed)
+        : sizes(_sizes), rng(seed)
+    {
+        for (uint32_t size = 1; size <= sizes.max && size != 0; size *= 2) {
+            if (size >= sizes.min) {
+                powers_of_two.push_back(size);
+            }
+        }
+    }
+
+    uint32_t Next()
+    {
+        switch (sizes.kind) {
+        case ChunkSizes::Kind::Fixed: return sizes.min;
+
+        case ChunkSizes::Kind::Uniform:
+            return std::uniform_int_distribution<uint32_t>(sizes.min, sizes.max)(rng);
 
-constexpr double OutputSampleRateHz = 48000.0;
+        case ChunkSizes::Kind::PowerOfTwo:
+            if (powers_of_two.empty()) {
+                return sizes.min;
+            }
+            return powers_of_two[std::uniform_int_distribution<size_t>(
+                0, powers_of_two.size() - 1)(rng)];
+
+        default: return sizes.min;
+        }
+    }
 
-constexpr int MaxFrameCount = 1024;
+private:
+    ChunkSizes sizes = {};
 
-std::array<std::vector<float>, 2> render_buf   = {};
-std::array<std::vector<float>, 2> resample_buf = {};
+    std::mt19937_64 rng;
 
-SpeexResamplerState* resampler = nullptr;
-double resample_ratio          = 0.0f;
+    std::vector<uint32_t> powers_of_two = {};
+};
 
-float phase = 0.0f;
+// --------------------------------------------------------------------------
+// WAV output
+// --------------------------------------------------------------------------
 
-typedef struct wavfile_header_s {
+struct WavHeader {
     char chunk_id[4];
-    int32_t chunk_size;
+    uint32_t chunk_size;
     char format[4];
 
-    char subchunk_id[4];
-    int32_t subchunk1_size;
-    int16_t audio_format;
-    int16_t num_channels;
-    int32_t sample_rate;
-    int32_t byte_rate;
-    int16_t block_align;
-    int16_t bits_per_sample;
+    char subchunk1_id[4];
+    uint32_t subchunk1_size;
+    uint16_t audio_format;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
 
     char subchunk2_id[4];
-    int32_t subchunk2_size;
-} wavfile_header_t;
+    uint32_t subchunk2_size;
+};
+
+static_assert(sizeof(WavHeader) == 44);
 
 constexpr auto PcmAudioFormat = 1;
 
-int write_wav_header(FILE* fp, int32_t num_frames)
+constexpr auto BytesPerFrame = NumChannels * sizeof(int16_t);
+
+// The size fields are 32 bits, which is enough for about 6 hours of stereo
+// audio at 48 kHz
+constexpr uint64_t MaxWavFrames = (UINT32_MAX - sizeof(WavHeader)) / BytesPerFrame;
+
+WavHeader make_wav_header(const uint32_t sample_rate, const uint64_t num_frames)
+{
+    const auto data_size = static_cast<uint32_t>(num_frames * BytesPerFrame);
+
+    return {.chunk_id       = {'R', 'I', 'F', 'F'},
+            .chunk_size     = 4 + (8 + 16) + (8 + data_size),
+            .format         = {'W', 'A', 'V', 'E'},
+            .subchunk1_id   = {'f', 'm', 't', ' '},
+            .subchunk1_size = 16,
+            .audio_format   = PcmAudioFormat,
+            .num_channels   = NumChannels,
+            .sample_rate    = sample_rate,
+            .byte_rate      = static_cast<uint32_t>(sample_rate * BytesPerFrame),
+            .block_align    = BytesPerFrame,
+            .bits_per_sample = 16,
+            .subchunk2_id   = {'d', 'a', 't', 'a'},
+            .subchunk2_size = data_size};
+}
+
+int16_t to_pcm16(const float sample)
 {
-    wavfile_header_t wh = {};
+    return static_cast<int16_t>(
+        std::lrint(std::clamp(sample, -1.0f, 1.0f) * static_cast<float>(INT16_MAX)));
+}
+
+class WavWriter {
+
+public:
+    virtual ~WavWriter() = default;
+
+    // Interleaved frames
+    virtual bool Write(const float* frames, const uint32_t num_frames) = 0;
+
+    // Completes the header
+    virtual bool Finish() = 0;
+};
+
+// Converts into a buffer and writes it out in large blocks
+class BufferedWavWriter : public WavWriter {
+
+public:
+    ~BufferedWavWriter() override
+    {
+        if (fp) {
+            fclose(fp);
+        }
+    }
+
+    bool Open(const std::string& path, const uint32_t _sample_rate)
+    {
+        sample_rate = _sample_rate;
+
+        fp = fopen(path.c_str(), "wb");
+
+        if (!fp) {
+            return false;
+        }
+
+        // Placeholder until we know the length
+        const WavHeader header = {};
+
+        buffer.reserve(BufferFrames * NumChannels);
+
+        return fwrite(&header, sizeof(header), 1, fp) == 1;
+    }
+
+    bool Write(const float* frames, const uint32_t num_frames) override
+    {
+        for (uint32_t i = 0; i < num_frames * NumChannels; ++i) {
+            buffer.push_back(to_pcm16(frames[i]));
+
+            if (buffer.size() == buffer.capacity() && !Flush()) {
+                return false;
+            }
+        }
+        num_written += num_frames;
+
+        return true;
+    }
+
+    bool Finish() override
+    {
+        if (!Flush()) {
+            return false;
+        }
+
+        const auto header = make_wav_header(sample_rate, num_written);
+
+        const auto ok = fseek(fp, 0, SEEK_SET) == 0 &&
+                        fwrite(&header, sizeof(header), 1, fp) == 1;
+
+        return (fclose(std::exchange(fp, nullptr)) == 0) && ok;
+    }
+
+private:
+    bool Flush()
+    {
+        const auto ok = fwrite(buffer.data(), sizeof(int16_t), buffer.size(), fp) ==
+                        buffer.size();
+        buffer.clear();
+
+        return ok;
+    }
+
+    static constexpr uint32_t BufferFrames = 16384;
+
+    FILE* fp = nullptr;
 
-    wh.chunk_id[0] = 'R';
-    wh.chunk_id[1] = 'I';
-    wh.chunk_id[2] = 'F';
-    wh.chunk_id[3] = 'F';
+    std::vector<int16_t> buffer = {};
 
-    wh.num_channels    = NumChannels;
-    wh.bits_per_sample = 16;
+    uint32_t sample_rate = 0;
+    uint64_t num_written = 0;
+};
 
-    auto subchunk2_size = num_frames * wh.num_channels * wh.bits_per_sample / 8;
+// Sizes the file up front and converts straight into a shared mapping of
+// it, leaving the writing to the OS
+class MappedWavWriter : public WavWriter {
 
-    constexpr auto Subchunk1Size = 16;
-    wh.chunk_size = 4 + (8 + Subchunk1Size) + (8 + subchunk2_size);
+public:
+    ~MappedWavWriter() override
+    {
+        Close();
+    }
+
+    bool Open(const std::string& path, const uint32_t sample_rate,
+              const uint64_t num_frames)
+    {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0) {
+            return false;
+        }
+
+        size = sizeof(WavHeader) + num_frames * BytesPerFrame;
+
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            return false;
+        }
+
+        const auto mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<uint8_t*>(mapping);
+
+        const auto header = make_wav_header(sample_rate, num_frames);
+        memcpy(data, &header, sizeof(header));
+
+        pos = reinterpret_cast<int16_t*>(data + sizeof(header));
+        end = reinterpret_cast<int16_t*>(data + size);
+
+        return true;
+    }
 
-    wh.format[0] = 'W';
-    wh.format[1] = 'A';
-    wh.format[2] = 'V';
-    wh.format[3] = 'E';
+    bool Write(const float* frames, const uint32_t num_frames) override
+    {
+        if (static_cast<size_t>(end - pos) < num_frames * NumChannels) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < num_frames * NumChannels; ++i) {
+            *pos++ = to_pcm16(frames[i]);
+        }
+        return true;
+    }
+
+    bool Finish() override
+    {
+        const auto ok = (pos == end) && msync(data, size, MS_SYNC) == 0;
+
+        return Close() && ok;
+    }
 
-    wh.subchunk_id[0] = 'f';
-    wh.subchunk_id[1] = 'm';
-    wh.subchunk_id[2] = 't';
-    wh.subchunk_id[3] = ' ';
+private:
+    bool Close()
+    {
+        auto ok = true;
 
-    wh.subchunk1_size = Subchunk1Size;
-    wh.audio_format   = PcmAudioFormat;
-    wh.sample_rate    = OutputSampleRateHz;
+        if (data) {
+            ok   = munmap(data, size) == 0;
+            data = nullptr;
+        }
+        if (fd >= 0) {
+            ok = (close(fd) == 0) && ok;
+            fd = -1;
+        }
+        return ok;
+    }
+
+    int fd        = -1;
+    uint8_t* data = nullptr;
+    size_t size   = 0;
 
-    wh.byte_rate   = wh.sample_rate * wh.num_channels * wh.bits_per_sample / 8;
-    wh.block_align = wh.num_channels * wh.bits_per_sample / 8;
+    int16_t* pos = nullptr;
+    int16_t* end = nullptr;
+};
+
+std::string wav_path_for(const Options& options, const ResamplerType type)
+{
+    if (options.types.size() == 1) {
+        return options.wav_path;
+    }
 
-    wh.subchunk2_id[0] = 'd';
-    wh.subchunk2_id[1] = 'a';
-    wh.subchunk2_id[2] = 't';
-    wh.subchunk2_id[3] = 'a';
-    wh.subchunk2_size  = subchunk2_size;
+    auto path        = options.wav_path;
+    const auto slash = path.find_last_of('/');
+    const auto dot   = path.find_last_of('.');
 
-    size_t write_count = fwrite(&wh, sizeof(wavfile_header_t), 1, fp);
+    const auto pos = (dot != std::string::npos &&
+                      (slash == std::string::npos || dot > slash))
+                         ? dot
+                         : path.size();
 
-    return (1 != write_count) ? -1 : 0;
+    return path.insert(pos, "." + normalize_name(ToString(type)));
 }
 
-void render(const int num_frames)
+std::unique_ptr<WavWriter> open_wav(const Options& options, const ResamplerType type,
+                                    const uint64_t num_frames)
 {
-    for (auto i = 0; i < num_frames; ++i) {
-        auto s = sinf(phase * 2.0f * M_PI) * 0.2f;
+    const auto path        = wav_path_for(options, type);
+    const auto sample_rate = static_cast<uint32_t>(std::lround(options.output_rate_hz));
 
-        phase += 440.0f / RenderSampleRateHz;
-        phase -= floorf(phase);
+    if (options.wav_mode == WavMode::Mapped) {
+        auto writer = std::make_unique<MappedWavWriter>();
 
-        render_buf[0].emplace_back(s);
-        render_buf[1].emplace_back(s);
+        if (writer->Open(path, sample_rate, num_frames)) {
+            return writer;
+        }
+    } else {
+        auto writer = std::make_unique<BufferedWavWriter>();
+
+        if (writer->Open(path, sample_rate)) {
+            return writer;
+        }
     }
+
+    fprintf(stderr, "Error opening %s\n", path.c_str());
+    exit(1);
 }
 
-void write_data(FILE* fp, const float* left, const float* right, const int num_frames)
+// --------------------------------------------------------------------------
+// Analysis
+// --------------------------------------------------------------------------
+
+// Phase of a sine at `frame`, in cycles. The integer part is dropped before
+// scaling by 2 pi so hours-long runs keep full precision.
+double sine_phase(const uint64_t frame, const double frequency_hz, const double rate_hz)
 {
-    for (int i = 0; i < num_frames; ++i) {
-        int16_t frame[2] = {static_cast<int16_t>(left[i] * INT16_MAX),
-                            static_cast<int16_t>(right[i] * INT16_MAX)};
+    const auto cycles = static_cast<double>(frame) * frequency_hz / rate_hz;
 
-        fwrite(frame, 2 * NumChannels, 1, fp);
-    }
+    return cycles - std::floor(cycles);
 }
 
-void init_resampler()
+double ideal_sine(const uint64_t frame, const double frequency_hz, const double rate_hz)
 {
-    resample_ratio = RenderSampleRateHz / OutputSampleRateHz;
+    return SineAmplitude * std::sin(2.0 * M_PI * sine_phase(frame, frequency_hz, rate_hz));
+}
 
-    const spx_uint32_t in_rate_hz = static_cast<spx_uint32_t>(RenderSampleRateHz);
-    const spx_uint32_t out_rate_hz = static_cast<spx_uint32_t>(OutputSampleRateHz);
+double to_db(const double ratio)
+{
+    return 20.0 * std::log10(ratio + 1e-12);
+}
 
-    constexpr auto ResampleQuality = SPEEX_RESAMPLER_QUALITY_DESKTOP;
+struct Analysis {
+    uint64_t num_frames = 0;
 
-    resampler = speex_resampler_init(
-        NumChannels, in_rate_hz, out_rate_hz, ResampleQuality, nullptr);
+    // Summed over all channels
+    double signal_energy = 0.0;
+    double error_energy  = 0.0;
+    double peak_error    = 0.0;
 
-    speex_resampler_skip_zeros(resampler);
+    uint64_t num_glitches     = 0;
+    uint64_t first_glitch_pos = 0;
 
-    const auto max_render_buf_size = static_cast<size_t>(
-        static_cast<double>(MaxFrameCount) * resample_ratio * 1.10f);
+    uint64_t num_discontinuities     = 0;
+    uint64_t first_discontinuity_pos = 0;
 
-    render_buf[0].resize(max_render_buf_size);
-    render_buf[1].resize(max_render_buf_size);
+    // Rendered frames minus the nominal number, in frames
+    int64_t min_drift = 0;
+    int64_t max_drift = 0;
 
-    render_buf[0].clear();
-    render_buf[1].clear();
-}
+    // Wrong number of output frames produced in a chunk
+    uint64_t num_short_chunks = 0;
 
-void resample(const int num_resampled_frames)
-{
-    resample_buf[0].resize(MaxFrameCount);
-    resample_buf[1].resize(MaxFrameCount);
+    double cpu_seconds = 0.0;
+
+    double ThdNDb() const
+    {
+        return 10.0 * std::log10(error_energy / std::max(signal_energy, 1e-30) + 1e-24);
+    }
 
-    auto input_len        = render_buf[0].size();
-    const auto output_len = static_cast<spx_uint32_t>(num_resampled_frames);
+    bool Passed(const std::optional<double>& max_thd_n_db) const
+    {
+        return num_glitches == 0 && num_discontinuities == 0 && num_short_chunks == 0 &&
+               min_drift >= -MaxDriftFrames && max_drift <= MaxDriftFrames &&
+               (!max_thd_n_db || ThdNDb() <= *max_thd_n_db);
+    }
+};
 
-    spx_uint32_t in_len  = input_len;
-    spx_uint32_t out_len = output_len;
+class Analyzer {
 
-    printf("resample:\n");
-    printf("  L IN   in_len: %3d, out_len: %3d\n", in_len, out_len);
+public:
+    Analyzer(const double _frequency_hz, const double _rate_hz)
+        : frequency_hz(_frequency_hz), rate_hz(_rate_hz)
+    {
+        glitch_threshold = SineAmplitude * std::pow(10.0, GlitchThresholdDb / 20.0);
+
+        // A smooth sine's second difference never exceeds A * w^2; a dropped
+        // or repeated sample makes it jump by about A * w, the largest step
+        // between two samples. The threshold is halfway to that, but leaves
+        // room for the corners of linearly interpolated output.
+        const auto w = 2.0 * M_PI * frequency_hz / rate_hz;
+
+        discontinuity_threshold = SineAmplitude * std::max(w / 2.0, 2.0 * w * w);
+    }
 
-    speex_resampler_process_float(
-        resampler, 0, render_buf[0].data(), &in_len, resample_buf[0].data(), &out_len);
+    // Interleaved frames, starting at output frame `pos`
+    void Add(const float* frames, const uint32_t num_frames, const uint64_t pos,
+             Analysis& analysis)
+    {
+        for (uint32_t i = 0; i < num_frames; ++i) {
+            const auto frame_pos = pos + i;
+            const auto expected  = ideal_sine(frame_pos, frequency_hz, rate_hz);
 
-    printf("  L OUT  in_len: %3d, out_len: %3d\n\n", in_len, out_len);
+            for (auto ch = 0; ch < NumChannels; ++ch) {
+                const double x = frames[i * NumChannels + ch];
 
-    in_len  = input_len;
-    out_len = output_len;
+                const auto second_diff = x - 2.0 * prev[ch][0] + prev[ch][1];
 
-    //	printf("  R IN   in_len: %4d, out_len: %3d\n", in_len, out_len);
+                prev[ch][1] = prev[ch][0];
+                prev[ch][0] = x;
 
-    speex_resampler_process_float(
-        resampler, 1, render_buf[1].data(), &in_len, resample_buf[1].data(), &out_len);
+                if (frame_pos < WarmUpFrames) {
+                    continue;
+                }
 
-    //	printf("  R OUT  in_len: %4d, out_len: %4d\n", in_len, out_len);
+                const auto err = x - expected;
 
-    // we're only shrinking here, so no data is lost
-    resample_buf[0].resize(out_len);
-    resample_buf[1].resize(out_len);
+                analysis.signal_energy += expected * expected;
+                analysis.error_energy += err * err;
+                analysis.peak_error = std::max(analysis.peak_error, std::fabs(err));
+
+                if (std::fabs(err) > glitch_threshold && analysis.num_glitches++ == 0) {
+                    analysis.first_glitch_pos = frame_pos;
+                }
+
+                if (std::fabs(second_diff) > discontinuity_threshold &&
+                    analysis.num_discontinuities++ == 0) {
+
+                    analysis.first_discontinuity_pos = frame_pos;
+                }
+            }
+        }
+
+        analysis.num_frames = pos + num_frames;
+    }
 
-    // Speex returns the number actually consumed and written samples in
-    // `in_len` and `out_len`, respectively. There are three outcomes:
-    //
-    // 1) The input buffer hasn't been fully consumed, but the output buffer
-    //    has been completely filled.
-    //
-    // 2) The output buffer hasn't been filled completely, but all input
-    //    samples have been consumed.
-    //
-    // 3) All input samples have been consumed and the output buffer has been
-    //    completely filled.
-    //
-    if (out_len < output_len) {
-        // Case 2: The output buffer hasn't been filled completely; we need to
-        // generate more input samples.
-        //
-        const auto num_out_frames_remaining = output_len - out_len;
-        const auto curr_out_pos             = out_len;
+private:
+    double frequency_hz = 0.0;
+    double rate_hz      = 0.0;
 
-        printf("  CASE 2:\n");
-        printf("    num_out_frames_remaining: %2d\n", num_out_frames_remaining);
+    double glitch_threshold        = 0.0;
+    double discontinuity_threshold = 0.0;
 
-        const auto render_frame_count = static_cast<int>(std::ceil(
-            static_cast<double>(num_out_frames_remaining) * resample_ratio));
+    // Last two samples of each channel
+    std::array<std::array<double, 2>, NumChannels> prev = {};
+};
 
-        printf("    render_frame_count:       %2d\n", render_frame_count);
+// --------------------------------------------------------------------------
+// Soak run
+// --------------------------------------------------------------------------
 
-        render_buf[0].clear();
-        render_buf[1].clear();
+Analysis run_backend(const Options& options, const ResamplerType type)
+{
+    // Start out at another rate and switch over, the way hosts reactivate
+    // plugins, so the test covers retuning an existing resampler too
+    auto res = CreateResampler(
+        type, NumChannels, options.render_rate_hz, options.output_rate_hz / 2);
 
-        resample_buf[0].resize(MaxFrameCount);
-        resample_buf[1].resize(MaxFrameCount);
+    if (!UpdateResampler(
+            res, type, NumChannels, options.render_rate_hz, options.output_rate_hz)) {
 
-        render(render_frame_count);
-        input_len = render_buf[0].size();
+        fprintf(stderr, "Error creating %s resampler\n", ToString(type));
+        exit(1);
+    }
 
-        in_len  = render_buf[0].size();
-        out_len = num_out_frames_remaining;
+    RenderScheduler scheduler = {};
+    scheduler.Reset(res->RatioNum(), res->RatioDen(), res->InputLatency());
 
-        printf("    L IN   in_len: %3d, out_len: %3d\n", in_len, out_len);
+    ChunkGenerator chunks(options.chunk_sizes, options.seed);
 
-        speex_resampler_process_float(resampler,
-                                      0,
-                                      render_buf[0].data(),
-                                      &in_len,
-                                      resample_buf[0].data() + curr_out_pos,
-                                      &out_len);
+    const auto max_chunk_frames = std::max(options.chunk_sizes.max, 1u);
 
-        printf("    L OUT  in_len: %3d, out_len: %3d\n", in_len, out_len);
+    // Interleaved input & output buffers; the scheduler renders exactly
+    // what the next chunk needs, so the input never holds more than a
+    // chunk's worth plus the look-ahead
+    std::vector<float> in_buf  = {};
+    std::vector<float> out_buf = {};
 
-        in_len  = render_buf[1].size();
-        out_len = num_out_frames_remaining;
+    in_buf.resize(static_cast<size_t>(
+        (max_chunk_frames * (options.render_rate_hz / options.output_rate_hz) +
+         res->InputLatency() + 2) *
+        NumChannels));
 
-        speex_resampler_process_float(resampler,
-                                      1,
-                                      render_buf[1].data(),
-                                      &in_len,
-                                      resample_buf[1].data() + curr_out_pos,
-                                      &out_len);
+    out_buf.resize(max_chunk_frames * NumChannels);
 
-        // we're only shrinking here, so no data is lost
-        const auto new_size = curr_out_pos + out_len;
-        printf("    resize render_buf from %zu to %u\n", resample_buf[0].size(), new_size);
+    const auto num_frames_total = static_cast<uint64_t>(options.output_rate_hz *
+                                                        options.seconds);
 
-        resample_buf[0].resize(new_size);
-        resample_buf[1].resize(new_size);
+    std::unique_ptr<WavWriter> wav = {};
 
-        printf("\n");
+    if (!options.wav_path.empty()) {
+        if (num_frames_total > MaxWavFrames) {
+            fprintf(stderr, "Error: too long for a WAV file; use --wav none\n");
+            exit(1);
+        }
+        wav = open_wav(options, type, num_frames_total);
     }
 
-    if (in_len < input_len) {
-        printf("  CASE 1: in_len: %u, input_len: %zu\n", in_len, input_len);
+    Analyzer analyzer(options.frequency_hz, options.output_rate_hz);
+    Analysis analysis = {};
+
+    const auto progress_frames = static_cast<uint64_t>(ProgressIntervalSeconds *
+                                                       options.output_rate_hz);
+    auto next_progress = progress_frames;
+
+    uint64_t in_pos   = 0;
+    uint64_t out_pos  = 0;
+    uint32_t in_count = 0;
 
-        if (in_len > 0) {
-            printf("    remaining: %zu\n", input_len - in_len);
-            // Case 1: The input buffer hasn't been fully consumed; we have
-            // leftover input samples that we need to keep for the next
-            // Process() call.
-            //
-            render_buf[0].erase(render_buf[0].begin(), render_buf[0].begin() + in_len);
-            render_buf[1].erase(render_buf[1].begin(), render_buf[1].begin() + in_len);
+    while (out_pos < num_frames_total) {
+        const auto chunk_size_frames = static_cast<uint32_t>(
+            std::min<uint64_t>(chunks.Next(), num_frames_total - out_pos));
+
+        // Rendering is not part of the measured CPU cost
+        const auto num_frames_to_render = scheduler.FramesToRender(chunk_size_frames);
+
+        if ((in_count + num_frames_to_render) * NumChannels > in_buf.size()) {
+            fprintf(stderr, "Error: %s resampler input overflow\n", ToString(type));
+            exit(1);
         }
 
-        printf("\n");
+        for (uint32_t i = 0; i < num_frames_to_render; ++i, ++in_pos) {
+            const auto s = static_cast<float>(
+                ideal_sine(in_pos, options.frequency_hz, options.render_rate_hz));
 
-    } else {
-        printf("  CASE 3: clear render_buf\n\n");
+            for (auto ch = 0; ch < NumChannels; ++ch) {
+                in_buf[(in_count + i) * NumChannels + ch] = s;
+            }
+        }
+        in_count += num_frames_to_render;
+
+        scheduler.AddRenderedFrames(num_frames_to_render);
+
+        auto in_len  = in_count;
+        auto out_len = chunk_size_frames;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        res->Process(in_buf.data(), in_len, out_buf.data(), out_len);
+
+        const auto end = std::chrono::steady_clock::now();
+
+        analysis.cpu_seconds += std::chrono::duration<double>(end - start).count();
+
+        if (out_len != chunk_size_frames) {
+            ++analysis.num_short_chunks;
+
+            std::fill(out_buf.begin() + out_len * NumChannels,
+                      out_buf.begin() + chunk_size_frames * NumChannels,
+                      0.0f);
+        }
+
+        // Keep the unconsumed frames for the next chunk
+        std::copy(in_buf.begin() + in_len * NumChannels,
+                  in_buf.begin() + in_count * NumChannels,
+                  in_buf.begin());
+        in_count -= in_len;
+
+        scheduler.FinishBlock(chunk_size_frames);
+
+        analyzer.Add(out_buf.data(), chunk_size_frames, out_pos, analysis);
+
+        if (wav && !wav->Write(out_buf.data(), chunk_size_frames)) {
+            fprintf(stderr, "Error writing WAV file\n");
+            exit(1);
+        }
+
+        out_pos += chunk_size_frames;
+
+        // Producing output frame `j` takes the input frames up to
+        // `InputLatency() + floor(j * ratio)` at the nominal rates
+        if (out_pos > 0) {
+            const auto nominal = static_cast<int64_t>(
+                res->InputLatency() +
+                std::floor(static_cast<double>(out_pos - 1) *
+                           (options.render_rate_hz / options.output_rate_hz)) +
+                1);
+
+            const auto drift = static_cast<int64_t>(in_pos) - nominal;
 
-        // Case 3: All input samples have been consumed and the output buffer
-        // has been completely filled.
-        //
-        render_buf[0].clear();
-        render_buf[1].clear();
+            analysis.min_drift = std::min(analysis.min_drift, drift);
+            analysis.max_drift = std::max(analysis.max_drift, drift);
+        }
+
+        if (out_pos >= next_progress) {
+            printf("  %s: %.0f of %.0f min\n",
+                   ToString(type),
+                   out_pos / options.output_rate_hz / 60.0,
+                   options.seconds / 60.0);
+            fflush(stdout);
+
+            next_progress += progress_frames;
+        }
+    }
+
+    if (wav && !wav->Finish()) {
+        fprintf(stderr, "Error writing WAV file\n");
+        exit(1);
+    }
+
+    return analysis;
+}
+
+const char* describe_chunk_sizes(const ChunkSizes& sizes)
+{
+    static char text[64] = {};
+
+    switch (sizes.kind) {
+    case ChunkSizes::Kind::Fixed: snprintf(text, sizeof(text), "%u", sizes.min); break;
+
+    case ChunkSizes::Kind::Uniform:
+        snprintf(text, sizeof(text), "%u to %u", sizes.min, sizes.max);
+        break;
+
+    case ChunkSizes::Kind::PowerOfTwo:
+        snprintf(text, sizeof(text), "powers of two from %u to %u", sizes.min, sizes.max);
+        break;
     }
+    return text;
 }
 
 void sigsegv_handler(int sig)
@@ -297,59 +887,94 @@ void sigsegv_handler(int sig)
     exit(1);
 }
 
-int main()
+int main(int argc, char** argv)
 {
     // To get backtraces
     signal(SIGSEGV, sigsegv_handler);
 
-    init_resampler();
+    const auto options = parse_options(argc, argv);
 
-    FILE* fp = fopen("out.wav", "wb");
-
-    // Write header placeholder
-    wavfile_header_t wh = {};
-    fwrite(&wh, sizeof(wavfile_header_t), 1, fp);
-
-    // Render sine wave
-    constexpr auto SecondsToRender = 3.0;
-
-    const auto num_frames_total = static_cast<int>(OutputSampleRateHz *
-                                                   SecondsToRender);
-
-    auto frames_to_write = num_frames_total;
-
-    while (frames_to_write > 0) {
-        // const auto chunk_size_frames = 256;
-        // Randomise chunk size for extra testing robustness
-        const auto chunk_size_frames = rand() % MaxFrameCount;
-
-        printf("------------------------------------\n");
-        printf("chunk_size_frames: %d\n", chunk_size_frames);
-
-        auto num_resampled_frames = std::min(frames_to_write, chunk_size_frames);
+    if (!options) {
+        return 1;
+    }
 
-        const auto num_frames_to_render = std::max(
-            static_cast<int>(static_cast<double>(num_resampled_frames) * resample_ratio -
-                             render_buf[0].size()),
-            0);
+    // The same kernels the plugin would pick on this machine
+    kernels::Init();
 
-        printf("  num_frames_to_render:          %3d\n", num_frames_to_render);
-        printf("  render_buf.size (pre-render):  %3zu\n", render_buf[0].size());
+    printf("Resampling %.0f s of %g Hz sine from %g Hz to %g Hz, "
+           "chunks of %s frames (seed %llu, %s kernels)\n\n",
+           options->seconds,
+           options->frequency_hz,
+           options->render_rate_hz,
+           options->output_rate_hz,
+           describe_chunk_sizes(options->chunk_sizes),
+           static_cast<unsigned long long>(options->seed),
+           kernels::ToString(kernels::Get().isa));
 
-        render(num_frames_to_render);
+    std::vector<std::pair<ResamplerType, Analysis>> results = {};
 
-        printf("  render_buf.size (post-render): %3zu\n\n", render_buf[0].size());
+    for (const auto type : options->types) {
+        results.emplace_back(type, run_backend(*options, type));
+    }
 
-        resample(num_resampled_frames);
-        write_data(fp, resample_buf[0].data(), resample_buf[1].data(), num_resampled_frames);
-        frames_to_write -= num_resampled_frames;
+    printf("  %-12s  %10s  %9s  %10s  %10s  %8s  %8s  %7s  %6s\n",
+           "backend",
+           "cpu (ms)",
+           "realtime",
+           "thd+n (dB)",
+           "peak (dB)",
+           "glitches",
+           "discont.",
+           "drift",
+           "result");
+
+    auto all_passed = true;
+
+    for (const auto& [type, analysis] : results) {
+        const auto passed = analysis.Passed(options->max_thd_n_db);
+
+        char drift[48] = {};
+        snprintf(drift,
+                 sizeof(drift),
+                 "%lld..%lld",
+                 static_cast<long long>(analysis.min_drift),
+                 static_cast<long long>(analysis.max_drift));
+
+        // Errors relative to the amplitude of the test signal
+        printf("  %-12s  %10.3f  %8.0fx  %10.1f  %10.1f  %8llu  %8llu  %7s  %6s\n",
+               ToString(type),
+               analysis.cpu_seconds * 1000.0,
+               options->seconds / std::max(analysis.cpu_seconds, 1e-9),
+               analysis.ThdNDb(),
+               to_db(analysis.peak_error / SineAmplitude),
+               static_cast<unsigned long long>(analysis.num_glitches),
+               static_cast<unsigned long long>(analysis.num_discontinuities),
+               drift,
+               passed ? "ok" : "FAIL");
+
+        all_passed = all_passed && passed;
     }
 
-    // Write WAV header
-    fseek(fp, 0, SEEK_SET);
-    write_wav_header(fp, num_frames_total);
+    // Details of the failures, to find them in the output
+    for (const auto& [type, analysis] : results) {
+        if (analysis.num_glitches > 0) {
+            printf("\n%s: first glitch at output frame %llu",
+                   ToString(type),
+                   static_cast<unsigned long long>(analysis.first_glitch_pos));
+        }
+        if (analysis.num_discontinuities > 0) {
+            printf("\n%s: first discontinuity at output frame %llu",
+                   ToString(type),
+                   static_cast<unsigned long long>(analysis.first_discontinuity_pos));
+        }
+        if (analysis.num_short_chunks > 0) {
+            printf("\n%s: %llu chunks were not filled completely",
+                   ToString(type),
+                   static_cast<unsigned long long>(analysis.num_short_chunks));
+        }
+    }
 
-    fclose(fp);
+    printf("\n");
 
-    return 0;
+    return all_passed ? 0 : 1;
 }
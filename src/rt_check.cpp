@@ -0,0 +1,380 @@
+// CLAP instrument plugin tutorial
+//
+// Real-time safety checker for the headless host.
+//
+// Function interception relies on the executable's definitions taking
+// precedence over the shared libraries' (ELF symbol interposition), so the
+// C library functions are only intercepted with glibc. On other platforms,
+// only allocations through the C++ `operator new` are caught.
+
+#include "rt_check.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(RT_CHECK) && !defined(_WIN32)
+    #include <dlfcn.h>
+    #include <execinfo.h>
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <semaphore.h>
+    #include <time.h>
+    #include <unistd.h>
+
+    #define RT_CHECK_ENABLED 1
+
+    #if defined(__GLIBC__)
+        #define RT_CHECK_LIBC 1
+    #endif
+#endif
+
+namespace rt_check {
+
+namespace {
+
+thread_local int audio_thread_depth = 0;
+
+#if defined(RT_CHECK_ENABLED)
+
+// Set while a violation is being reported, so the report's own calls don't
+// get reported
+thread_local bool is_reporting = false;
+
+std::atomic<uint64_t> num_violations = 0;
+
+// Further violations are only counted
+constexpr uint64_t MaxReports = 32;
+
+constexpr auto MaxBacktraceFrames = 32;
+
+void Print(const char* text)
+{
+    // Intercepted, but ignored while reporting
+    [[maybe_unused]] const auto result = write(STDERR_FILENO, text, strlen(text));
+}
+
+// Called by every intercepted function
+void Report(const char* function)
+{
+    if (audio_thread_depth == 0 || is_reporting) {
+        return;
+    }
+    is_reporting = true;
+
+    const auto count = num_violations.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if (count <= MaxReports) {
+        char message[128] = {};
+        snprintf(message,
+                 sizeof(message),
+                 "Real-time violation #%llu: %s() on the audio thread\n",
+                 static_cast<unsigned long long>(count),
+                 function);
+        Print(message);
+
+        void* frames[MaxBacktraceFrames] = {};
+        const auto num_frames = backtrace(frames, MaxBacktraceFrames);
+
+        // Skip Report() itself
+        backtrace_symbols_fd(frames + 1, num_frames - 1, STDERR_FILENO);
+    }
+
+    if (count == MaxReports) {
+        Print("Too many real-time violations; only counting from now on\n");
+    }
+
+    is_reporting = false;
+}
+
+#endif
+
+} // namespace
+
+#if defined(RT_CHECK_ENABLED)
+
+bool IsEnabled()
+{
+    return true;
+}
+
+uint64_t NumViolations()
+{
+    return num_violations.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool IsEnabled()
+{
+    return false;
+}
+
+uint64_t NumViolations()
+{
+    return 0;
+}
+
+#endif
+
+bool IsAudioThread()
+{
+    return audio_thread_depth > 0;
+}
+
+ScopedAudioThread::ScopedAudioThread()
+{
+    ++audio_thread_depth;
+}
+
+ScopedAudioThread::~ScopedAudioThread()
+{
+    --audio_thread_depth;
+}
+
+} // namespace rt_check
+
+#if defined(RT_CHECK_LIBC)
+
+//////////////////////////////////////////////////////////////////////////////
+// C library
+//////////////////////////////////////////////////////////////////////////////
+
+// The allocator's own entry points. Going through `dlsym()` isn't an option
+// for these, as it allocates itself.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+extern "C" void* malloc(size_t size) noexcept
+{
+    rt_check::Report("malloc");
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept
+{
+    rt_check::Report("calloc");
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) noexcept
+{
+    rt_check::Report("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr) noexcept
+{
+    if (ptr) {
+        rt_check::Report("free");
+    }
+    __libc_free(ptr);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size) noexcept
+{
+    rt_check::Report("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    rt_check::Report("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept
+{
+    rt_check::Report("posix_memalign");
+
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+
+    *ptr = __libc_memalign(alignment, size);
+
+    return (*ptr || size == 0) ? 0 : ENOMEM;
+}
+
+// Everything else is forwarded to the next definition. The lookup isn't
+// guarded: racing threads all store the same pointer.
+#define RT_CHECK_FORWARD(function, ...)                                            \
+    rt_check::Report(#function);                                                   \
+                                                                                   \
+    static decltype(&function) next = nullptr;                                     \
+                                                                                   \
+    if (!next) {                                                                   \
+        next = reinterpret_cast<decltype(&function)>(dlsym(RTLD_NEXT, #function)); \
+    }                                                                              \
+    return next(__VA_ARGS__)
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+{
+    RT_CHECK_FORWARD(pthread_mutex_lock, mutex);
+}
+
+extern "C" int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    RT_CHECK_FORWARD(pthread_cond_wait, cond, mutex);
+}
+
+extern "C" int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex,
+                                      const struct timespec* abstime)
+{
+    RT_CHECK_FORWARD(pthread_cond_timedwait, cond, mutex, abstime);
+}
+
+extern "C" int sem_wait(sem_t* sem)
+{
+    RT_CHECK_FORWARD(sem_wait, sem);
+}
+
+extern "C" int nanosleep(const struct timespec* duration, struct timespec* remaining)
+{
+    RT_CHECK_FORWARD(nanosleep, duration, remaining);
+}
+
+extern "C" int clock_nanosleep(clockid_t clock, int flags,
+                               const struct timespec* duration,
+                               struct timespec* remaining)
+{
+    RT_CHECK_FORWARD(clock_nanosleep, clock, flags, duration, remaining);
+}
+
+extern "C" int usleep(useconds_t usec)
+{
+    RT_CHECK_FORWARD(usleep, usec);
+}
+
+extern "C" unsigned int sleep(unsigned int seconds)
+{
+    RT_CHECK_FORWARD(sleep, seconds);
+}
+
+extern "C" int open(const char* path, int flags, ...)
+{
+    // The mode is only passed when a file may be created
+    mode_t mode = 0;
+
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = static_cast<mode_t>(va_arg(args, int));
+        va_end(args);
+    }
+
+    RT_CHECK_FORWARD(open, path, flags, mode);
+}
+
+extern "C" FILE* fopen(const char* path, const char* mode)
+{
+    RT_CHECK_FORWARD(fopen, path, mode);
+}
+
+extern "C" ssize_t read(int fd, void* buf, size_t count)
+{
+    RT_CHECK_FORWARD(read, fd, buf, count);
+}
+
+extern "C" ssize_t write(int fd, const void* buf, size_t count)
+{
+    RT_CHECK_FORWARD(write, fd, buf, count);
+}
+
+#undef RT_CHECK_FORWARD
+
+#elif defined(RT_CHECK_ENABLED)
+
+//////////////////////////////////////////////////////////////////////////////
+// C++ allocations
+//////////////////////////////////////////////////////////////////////////////
+
+void* operator new(std::size_t size)
+{
+    rt_check::Report("operator new");
+
+    if (auto ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    rt_check::Report("operator new");
+
+    const auto align = static_cast<std::size_t>(alignment);
+
+    void* ptr = nullptr;
+
+    if (posix_memalign(&ptr, std::max(align, sizeof(void*)), size ? size : 1) != 0) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr) {
+        rt_check::Report("operator delete");
+    }
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Real-time safety checker for the headless host.
+//
+// The host marks the thread it calls `process()` on as the audio thread for
+// the duration of the call. Built with `RT_CHECK` (the
+// `CLAP_TUTORIAL_RT_CHECK` CMake option), the host also replaces the memory
+// allocation functions, mutex and condition variable waits, sleeps and the
+// basic file I/O calls with versions that report every call made on the
+// audio thread with a backtrace. As these definitions live in the
+// executable, they take precedence over the C library's for the plugin too.
+//
+// Only the calling thread is checked; the plugin's own worker threads are
+// not marked.
+
+#include <cstdint>
+
+namespace rt_check {
+
+// Whether the functions are intercepted in this build
+bool IsEnabled();
+
+bool IsAudioThread();
+
+// Number of violations reported so far, on any thread
+uint64_t NumViolations();
+
+// Marks the calling thread as the audio thread while in scope
+class ScopedAudioThread {
+
+public:
+    ScopedAudioThread();
+    ~ScopedAudioThread();
+
+    ScopedAudioThread(const ScopedAudioThread&)            = delete;
+    ScopedAudioThread& operator=(const ScopedAudioThread&) = delete;
+};
+
+} // namespace rt_check
@@ -0,0 +1,36 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Sample content extension, for loading the sample the sampler variant
+// plays back.
+//
+// The sample is a WAV file (16, 24 or 32-bit integer or 32-bit float PCM,
+// in mono or stereo), played at its original pitch on middle C (key 60)
+// and transposed by the key's tuning elsewhere. It's streamed from disk
+// while it plays, so it can be any length (see sample_streamer.h). The
+// path is saved with the plugin's state, so the file must stay where it
+// is.
+//
+// This is not part of CLAP; only hosts that know about this plugin can use
+// it.
+
+#include "clap/clap.h"
+
+static constexpr char CLAP_TUTORIAL_EXT_SAMPLE_CONTENT[] =
+    "org.nakst.clap-tutorial.sample-content/1";
+
+typedef struct clap_tutorial_plugin_sample_content {
+    // Loads the sample from `path`. While the plugin is active, the voices
+    // keep playing the previous sample until the plugin gets restarted,
+    // which it asks the host to do. Returns false if the file can't be
+    // read, or if the plugin doesn't play samples.
+    // [main-thread]
+    bool(CLAP_ABI* load)(const clap_plugin_t* plugin, const char* path);
+
+    // Copies the path of the loaded sample into `path`, NUL-terminated.
+    // Returns false if no sample has been loaded, or if the path doesn't
+    // fit into `capacity` bytes.
+    // [main-thread]
+    bool(CLAP_ABI* get_path)(const clap_plugin_t* plugin, char* path, uint32_t capacity);
+} clap_tutorial_plugin_sample_content_t;
@@ -0,0 +1,218 @@
+// CLAP instrument plugin tutorial
+//
+// Sample content, played back from a WAV file.
+
+#include <algorithm>
+#include <cstring>
+
+#include "sample_file.h"
+
+#if !defined(_WIN32)
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+static uint16_t ReadU16(const uint8_t* p)
+{
+    uint16_t value = 0;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t ReadU32(const uint8_t* p)
+{
+    uint32_t value = 0;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static bool IsTag(const uint8_t* p, const char (&tag)[5])
+{
+    return std::memcmp(p, tag, 4) == 0;
+}
+
+bool SampleFile::Open(const std::string& path)
+{
+    if (!file.Open(path) || !ParseHeader()) {
+        file.Close();
+        return false;
+    }
+
+    num_head_frames = std::min(num_frames, HeadFrames);
+
+    head.resize(size_t{num_head_frames} * num_channels);
+    Decode(0, num_head_frames, head.data());
+
+    return true;
+}
+
+// WAV files are RIFF files: a sequence of tagged chunks, of which we need
+// the format and the sample data, and skip everything else (cue points,
+// metadata, and so on)
+bool SampleFile::ParseHeader()
+{
+    const auto data = file.Data();
+    const auto size = file.Size();
+
+    if (size < 12 || !IsTag(data, "RIFF") || !IsTag(data + 8, "WAVE")) {
+        return false;
+    }
+
+    constexpr uint16_t FormatPcm        = 1;
+    constexpr uint16_t FormatFloat      = 3;
+    constexpr uint16_t FormatExtensible = 0xfffe;
+
+    bool have_format    = false;
+    uint16_t format     = 0;
+    uint16_t bits       = 0;
+    uint32_t block_size = 0;
+
+    for (size_t pos = 12; pos + 8 <= size;) {
+        const auto chunk      = data + pos;
+        const auto chunk_size = ReadU32(chunk + 4);
+        const auto body       = pos + 8;
+
+        if (chunk_size > size - body) {
+            return false;
+        }
+
+        if (IsTag(chunk, "fmt ") && chunk_size >= 16) {
+            format         = ReadU16(chunk + 8);
+            num_channels   = ReadU16(chunk + 10);
+            sample_rate_hz = ReadU32(chunk + 12);
+            block_size     = ReadU16(chunk + 20);
+            bits           = ReadU16(chunk + 22);
+
+            // The actual format is the first two bytes of the sub-format GUID
+            if (format == FormatExtensible && chunk_size >= 26) {
+                format = ReadU16(chunk + 32);
+            }
+            have_format = true;
+
+        } else if (IsTag(chunk, "data") && have_format) {
+            frames = chunk + 8;
+
+            if (block_size == 0) {
+                return false;
+            }
+            num_frames = chunk_size / block_size;
+            break;
+        }
+
+        // Chunks are padded to an even size
+        pos = body + chunk_size + (chunk_size & 1);
+    }
+
+    if (!frames || num_channels < 1 || num_channels > MaxChannels ||
+        sample_rate_hz <= 0.0) {
+        return false;
+    }
+
+    if (format == FormatPcm && bits == 16) {
+        encoding = Encoding::Int16;
+    } else if (format == FormatPcm && bits == 24) {
+        encoding = Encoding::Int24;
+    } else if (format == FormatPcm && bits == 32) {
+        encoding = Encoding::Int32;
+    } else if (format == FormatFloat && bits == 32) {
+        encoding = Encoding::Float32;
+    } else {
+        return false;
+    }
+
+    bytes_per_frame = bits / 8 * num_channels;
+
+    return block_size == bytes_per_frame;
+}
+
+void SampleFile::Decode(const uint32_t first, const uint32_t count, float* dest) const
+{
+    const auto src         = frames + size_t{first} * bytes_per_frame;
+    const auto num_samples = size_t{count} * num_channels;
+
+    switch (encoding) {
+    case Encoding::Int16:
+        for (size_t i = 0; i < num_samples; ++i) {
+            const auto value = static_cast<int16_t>(ReadU16(src + i * 2));
+            dest[i]          = static_cast<float>(value) * (1.0f / 32768.0f);
+        }
+        break;
+
+    case Encoding::Int24:
+        for (size_t i = 0; i < num_samples; ++i) {
+            const auto p = src + i * 3;
+
+            // Into the top three bytes, so the shift extends the sign
+            const auto bytes = static_cast<uint32_t>(p[0]) << 8 |
+                               static_cast<uint32_t>(p[1]) << 16 |
+                               static_cast<uint32_t>(p[2]) << 24;
+
+            const auto value = static_cast<int32_t>(bytes) >> 8;
+            dest[i]          = static_cast<float>(value) * (1.0f / 8388608.0f);
+        }
+        break;
+
+    case Encoding::Int32:
+        for (size_t i = 0; i < num_samples; ++i) {
+            const auto value = static_cast<int32_t>(ReadU32(src + i * 4));
+            dest[i]          = static_cast<float>(value) * (1.0f / 2147483648.0f);
+        }
+        break;
+
+    case Encoding::Float32: std::memcpy(dest, src, num_samples * sizeof(float)); break;
+    }
+}
+
+#if defined(_WIN32)
+
+// Windows can't tell cheaply whether pages are resident, so the streaming
+// always runs on a thread that may block there (see SampleStreamer)
+bool SampleFile::Prefetch(const uint32_t first, const uint32_t count) const
+{
+    return true;
+}
+
+#else
+
+bool SampleFile::Prefetch(const uint32_t first, const uint32_t count) const
+{
+    static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    const auto begin = reinterpret_cast<uintptr_t>(frames + size_t{first} * bytes_per_frame);
+    const auto end   = begin + size_t{count} * bytes_per_frame;
+
+    const auto first_page = begin / page_size * page_size;
+    const auto length     = end - first_page;
+
+    // One byte per page; the lowest bit is set if the page is resident
+#if defined(__APPLE__)
+    using ResidencyFlag = char;
+#else
+    using ResidencyFlag = unsigned char;
+#endif
+    constexpr size_t MaxPagesPerQuery = 64;
+
+    ResidencyFlag resident[MaxPagesPerQuery] = {};
+
+    for (size_t offset = 0; offset < length; offset += MaxPagesPerQuery * page_size) {
+        const auto query_length = std::min(length - offset, MaxPagesPerQuery * page_size);
+        const auto num_pages    = (query_length + page_size - 1) / page_size;
+
+        const auto address = reinterpret_cast<void*>(first_page + offset);
+
+        if (mincore(address, query_length, resident) != 0) {
+            return false;
+        }
+
+        for (size_t i = 0; i < num_pages; ++i) {
+            if (!(resident[i] & 1)) {
+                // The OS reads the pages in the background
+                madvise(reinterpret_cast<void*>(first_page), length, MADV_WILLNEED);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#endif
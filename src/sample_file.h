@@ -0,0 +1,107 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Sample content, played back from a WAV file.
+//
+// Sample libraries are far too large to load into RAM, so the file is
+// memory-mapped, and only its first `HeadFrames` frames (the head) are
+// decoded into RAM when it's opened. Notes start playing from the head
+// right away, while the rest of the sample is streamed in behind them (see
+// sample_streamer.h).
+//
+// Reading from the mapping blocks on page faults while the OS reads the
+// file in, so nothing but the head may be read on the audio thread in real
+// time. Prefetch() tells whether a range can be decoded without waiting
+// for the disk, and asks the OS to start reading it in if not, so the
+// streaming never blocks whoever does it either.
+//
+// Supports 16, 24 and 32-bit integer and 32-bit float PCM, in mono or
+// stereo. Files are limited to 4 GiB by the format, so frame positions
+// always fit in 32 bits.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+class SampleFile {
+
+public:
+    static constexpr uint32_t MaxChannels = 2;
+
+    // About two thirds of a second at 48 kHz; long enough to cover the
+    // disk's latency a few times over, so voices never wait for the
+    // streaming to catch up
+    static constexpr uint32_t HeadFrames = 32768;
+
+    SampleFile() = default;
+
+    SampleFile(const SampleFile&)            = delete;
+    SampleFile& operator=(const SampleFile&) = delete;
+
+    // Main thread. Maps the file and decodes the head. Returns false if the
+    // file can't be mapped or isn't a WAV file we can play.
+    bool Open(const std::string& path);
+
+    const std::string& Path() const
+    {
+        return file.Path();
+    }
+
+    uint32_t NumChannels() const
+    {
+        return num_channels;
+    }
+
+    uint32_t NumFrames() const
+    {
+        return num_frames;
+    }
+
+    double SampleRateHz() const
+    {
+        return sample_rate_hz;
+    }
+
+    // The decoded head, interleaved; `NumHeadFrames()` frames
+    const float* Head() const
+    {
+        return head.data();
+    }
+
+    uint32_t NumHeadFrames() const
+    {
+        return num_head_frames;
+    }
+
+    // Decodes frames [first, first + count) into `dest`, interleaved. The
+    // frames must be within the file. Blocks until the OS has read them in
+    // if they haven't been yet.
+    void Decode(const uint32_t first, const uint32_t count, float* dest) const;
+
+    // Returns whether frames [first, first + count) can be decoded without
+    // waiting for the disk. If not, the OS gets asked to start reading them
+    // in, so they're likely to be ready the next time round. Never blocks.
+    bool Prefetch(const uint32_t first, const uint32_t count) const;
+
+private:
+    enum class Encoding { Int16, Int24, Int32, Float32 };
+
+    bool ParseHeader();
+
+    MappedFile file = {};
+
+    // The sample data in the mapping
+    const uint8_t* frames    = nullptr;
+    uint32_t bytes_per_frame = 0;
+
+    Encoding encoding     = Encoding::Int16;
+    uint32_t num_channels = 0;
+    uint32_t num_frames   = 0;
+    double sample_rate_hz = 0.0;
+
+    std::vector<float> head  = {};
+    uint32_t num_head_frames = 0;
+};
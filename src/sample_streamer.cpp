@@ -0,0 +1,313 @@
+// CLAP instrument plugin tutorial
+//
+// Streams sample content from disk for the voices.
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#include "sample_streamer.h"
+
+#if defined(__linux__)
+    #include <sys/timerfd.h>
+    #include <unistd.h>
+#endif
+
+SampleStreamer::~SampleStreamer()
+{
+    StopThread();
+}
+
+void SampleStreamer::Allocate(Arena& arena, const uint32_t num_streams,
+                              const uint32_t _num_channels, const size_t budget_bytes)
+{
+    num_channels = _num_channels;
+
+    const auto bytes_per_chunk = size_t{ChunkFrames} * num_channels * sizeof(float);
+
+    const auto num_chunks = std::max(budget_bytes / std::max<size_t>(num_streams, 1) /
+                                         bytes_per_chunk,
+                                     size_t{2});
+
+    ring_frames = static_cast<uint32_t>(num_chunks) * ChunkFrames;
+
+    streams = arena.Allocate<Stream>(num_streams);
+    rings   = arena.Allocate<float>(size_t{num_streams} * ring_frames * num_channels);
+}
+
+void SampleStreamer::Release()
+{
+    assert(!thread.joinable());
+
+    file    = nullptr;
+    streams = {};
+    rings   = {};
+
+    ring_frames  = 0;
+    num_channels = 0;
+}
+
+void SampleStreamer::Reset(const SampleFile* _file)
+{
+    assert(!_file || _file->NumChannels() == num_channels);
+
+    file = _file;
+
+    for (auto& stream : streams) {
+        stream.request.store(0, std::memory_order_relaxed);
+        stream.filled.store(0, std::memory_order_relaxed);
+
+        stream.generation      = 0;
+        stream.fill_generation = 0;
+        stream.fill_end        = 0;
+    }
+    num_underruns.store(0, std::memory_order_relaxed);
+}
+
+void SampleStreamer::Start(const uint32_t index)
+{
+    auto& stream = streams[index];
+
+    // Zero is reserved for streams that have never been started
+    if (++stream.generation == 0) {
+        stream.generation = 1;
+    }
+    stream.request.store(Pack(stream.generation, 0), std::memory_order_release);
+}
+
+void SampleStreamer::Skip(const uint32_t index, const uint32_t first)
+{
+    auto& stream = streams[index];
+
+    stream.request.store(Pack(stream.generation, first), std::memory_order_release);
+}
+
+uint32_t SampleStreamer::Read(const uint32_t index, const uint32_t first,
+                              const uint32_t count, float* dest, const bool may_block)
+{
+    assert(file && count <= ring_frames);
+
+    auto& stream = streams[index];
+
+    // From here on, the filling side may overwrite the frames before
+    // `first`, but none of the ones we're about to read
+    stream.request.store(Pack(stream.generation, first), std::memory_order_release);
+
+    const auto num_frames = file->NumFrames();
+    const auto head_end   = file->NumHeadFrames();
+
+    auto pos       = first;
+    const auto end = static_cast<uint32_t>(
+        std::min(uint64_t{first} + count, uint64_t{num_frames}));
+
+    // The head is always there
+    if (pos < head_end && pos < end) {
+        const auto n = std::min(head_end, end) - pos;
+
+        std::copy_n(file->Head() + size_t{pos} * num_channels,
+                    size_t{n} * num_channels,
+                    dest);
+        dest += size_t{n} * num_channels;
+        pos += n;
+    }
+
+    // Then whatever has been streamed in for this voice
+    const auto filled  = stream.filled.load(std::memory_order_acquire);
+    const auto is_ours = (filled >> 32) == stream.generation;
+
+    const auto streamed_end = is_ours ? std::min(static_cast<uint32_t>(filled), end) : 0;
+
+    if (pos < streamed_end) {
+        const auto ring = Ring(index);
+
+        while (pos < streamed_end) {
+            const auto ring_pos = pos % ring_frames;
+            const auto n        = std::min(streamed_end - pos, ring_frames - ring_pos);
+
+            std::copy_n(ring + size_t{ring_pos} * num_channels,
+                        size_t{n} * num_channels,
+                        dest);
+            dest += size_t{n} * num_channels;
+            pos += n;
+        }
+    }
+
+    // The streaming hasn't caught up
+    const auto num_missing = end - pos;
+
+    if (num_missing > 0) {
+        if (may_block) {
+            file->Decode(pos, num_missing, dest);
+        } else {
+            std::fill_n(dest, size_t{num_missing} * num_channels, 0.0f);
+            num_underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        dest += size_t{num_missing} * num_channels;
+    }
+
+    // Past the end of the sample
+    const auto num_after = count - (end - first);
+
+    std::fill_n(dest, size_t{num_after} * num_channels, 0.0f);
+
+    return may_block ? 0 : num_missing;
+}
+
+void SampleStreamer::Fill(const bool may_block)
+{
+    if (!file) {
+        return;
+    }
+
+    const auto num_frames = file->NumFrames();
+    const auto head_end   = file->NumHeadFrames();
+
+    for (uint32_t index = 0; index < streams.size(); ++index) {
+        auto& stream = streams[index];
+
+        const auto request    = stream.request.load(std::memory_order_acquire);
+        const auto generation = static_cast<uint32_t>(request >> 32);
+        const auto needed     = static_cast<uint32_t>(request);
+
+        if (generation == 0) {
+            continue;
+        }
+
+        // A new voice streams from the end of the head, and one that has
+        // moved on past what we've got skips ahead
+        if (generation != stream.fill_generation) {
+            stream.fill_generation = generation;
+            stream.fill_end        = head_end;
+        }
+        stream.fill_end = std::max(stream.fill_end, needed);
+
+        // The ring holds the frames from the first one still needed
+        const auto target = static_cast<uint32_t>(
+            std::min(uint64_t{needed} + ring_frames, uint64_t{num_frames}));
+
+        const auto ring = Ring(index);
+
+        bool has_read = false;
+
+        while (stream.fill_end < target) {
+            const auto ring_pos = stream.fill_end % ring_frames;
+
+            const auto n = std::min({target - stream.fill_end,
+                                     ChunkFrames - ring_pos % ChunkFrames,
+                                     ring_frames - ring_pos});
+
+            if (!may_block && !file->Prefetch(stream.fill_end, n)) {
+                break;
+            }
+
+            file->Decode(stream.fill_end, n, ring + size_t{ring_pos} * num_channels);
+
+            stream.fill_end += n;
+            stream.filled.store(Pack(generation, stream.fill_end),
+                                std::memory_order_release);
+            has_read = true;
+        }
+
+        // Have the OS read in the frames after these while the voice plays
+        // through the ring, so they're resident by the time they're due
+        if (has_read && !may_block && target < num_frames) {
+            file->Prefetch(target, std::min(num_frames - target, ring_frames));
+        }
+    }
+}
+
+void SampleStreamer::StartThread()
+{
+    if (thread.joinable()) {
+        return;
+    }
+    quit_requested = false;
+
+    thread = std::thread([this] { ThreadMain(); });
+}
+
+void SampleStreamer::StopThread()
+{
+    if (!thread.joinable()) {
+        return;
+    }
+    {
+        const std::lock_guard lock(thread_mutex);
+        quit_requested = true;
+    }
+    quit.notify_one();
+
+    thread.join();
+}
+
+void SampleStreamer::ThreadMain()
+{
+    std::unique_lock lock(thread_mutex);
+
+    while (!quit.wait_for(lock, std::chrono::milliseconds(FillPeriodMs), [this] {
+        return quit_requested;
+    })) {
+        // Our own thread can wait for the disk
+        Fill(true);
+    }
+}
+
+TimerFd::~TimerFd()
+{
+    Close();
+}
+
+#if defined(__linux__)
+
+bool TimerFd::Open(const uint32_t period_ms)
+{
+    Close();
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    const timespec period = {.tv_sec  = period_ms / 1000,
+                             .tv_nsec = static_cast<long>(period_ms % 1000) * 1000000};
+
+    const itimerspec spec = {.it_interval = period, .it_value = period};
+
+    if (timerfd_settime(fd, 0, &spec, nullptr) != 0) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void TimerFd::Close()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+    fd = -1;
+}
+
+void TimerFd::Acknowledge()
+{
+    // The number of ticks since the last call; we only care that there
+    // were some
+    uint64_t ticks = 0;
+
+    [[maybe_unused]] const auto result = read(fd, &ticks, sizeof(ticks));
+}
+
+#else
+
+bool TimerFd::Open(const uint32_t period_ms)
+{
+    return false;
+}
+
+void TimerFd::Close() {}
+
+void TimerFd::Acknowledge() {}
+
+#endif
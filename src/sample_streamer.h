@@ -0,0 +1,192 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Streams sample content from disk for the voices.
+//
+// Every voice slot has a stream (see VoicePool::SlotOf()), with a ring of
+// read-ahead frames. A voice plays the first frames of the sample from the
+// head, decoded into RAM when the file was opened (see sample_file.h), and
+// the rest from its ring, which gets refilled off the audio thread as the
+// voice plays. The rings share a fixed memory budget, carved out of the
+// instance's arena along with the voices, so starting a stream never
+// allocates, and the memory can be locked into RAM with the rest.
+//
+// The audio thread never waits for the disk: frames that haven't been
+// streamed in yet when a voice gets to them are played as silence, and
+// counted as underruns. Offline, where nobody waits for us, they are read
+// straight from the file instead, so bounces never drop out.
+//
+// Refilling is pull-based. The audio thread only publishes how far each
+// stream has been played; Fill() tops up every ring from there. It's called
+// either from the host's event loop, woken up periodically through a timer
+// fd (see TimerFd), or from a thread of the streamer's own if the host
+// can't do that. In the host's event loop, Fill() mustn't block, so it only
+// copies frames whose pages are resident already, and has the OS read in
+// the others in the background for the next round (see
+// SampleFile::Prefetch()).
+//
+// Each stream is a single-producer, single-consumer channel. The two sides
+// exchange positions through two atomic words that also carry the
+// stream's generation, which the audio thread bumps whenever it restarts a
+// stream for a new voice, so frames streamed in for the previous voice are
+// never played by the next one.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "arena.h"
+#include "sample_file.h"
+
+class SampleStreamer {
+
+public:
+    // Frames decoded per read; the rings are a whole number of these
+    static constexpr uint32_t ChunkFrames = 1024;
+
+    // Period of the refills; the rings hold several of them at any budget
+    static constexpr uint32_t FillPeriodMs = 5;
+
+    SampleStreamer() = default;
+    ~SampleStreamer();
+
+    SampleStreamer(const SampleStreamer&)            = delete;
+    SampleStreamer& operator=(const SampleStreamer&) = delete;
+
+    // To be called from the carving code passed to Arena::Build(). The
+    // budget is split evenly between the streams, and is only a target:
+    // every ring holds at least two chunks.
+    void Allocate(Arena& arena, const uint32_t num_streams, const uint32_t num_channels,
+                  const size_t budget_bytes);
+
+    // Forgets the memory, which is owned by the arena; the thread must not
+    // be running
+    void Release();
+
+    // Main thread, while nothing is streaming. Stops all streams, and sets
+    // the file they play from, which must have as many channels as the
+    // rings were allocated for.
+    void Reset(const SampleFile* file);
+
+    // Frames each ring holds
+    uint32_t RingFrames() const
+    {
+        return ring_frames;
+    }
+
+    // Audio thread. (Re)starts a stream from the first frame of the sample.
+    void Start(const uint32_t stream);
+
+    // Audio thread; any thread rendering the voice that owns the stream.
+    // Copies frames [first, first + count) of the stream's sample into
+    // `dest`, interleaved, and releases the frames before `first`, which
+    // must not be read again. Frames past the end of the sample are
+    // silent. `count` must not exceed RingFrames(). With `may_block`,
+    // frames that haven't been streamed in yet are read from the file;
+    // otherwise they're silent. Returns the number of frames that were
+    // missing.
+    uint32_t Read(const uint32_t stream, const uint32_t first, const uint32_t count,
+                  float* dest, const bool may_block);
+
+    // Audio thread. Releases the frames before `first`, for voices that
+    // move on without reading, e.g. while they're silent.
+    void Skip(const uint32_t stream, const uint32_t first);
+
+    // Refills the rings; never runs on more than one thread at a time.
+    // Without `may_block`, only frames that can be read without waiting
+    // for the disk are read.
+    void Fill(const bool may_block);
+
+    // Starts and stops a thread that calls Fill() every `FillPeriodMs`, for
+    // hosts that can't call it from their event loop
+    void StartThread();
+    void StopThread();
+
+    // Any thread. Number of Read() calls that had frames missing since the
+    // last Reset().
+    uint64_t NumUnderruns() const
+    {
+        return num_underruns.load(std::memory_order_relaxed);
+    }
+
+private:
+    static uint64_t Pack(const uint32_t generation, const uint32_t frame)
+    {
+        return uint64_t{generation} << 32 | frame;
+    }
+
+    // Each in a cache line of its own, as both sides write to them
+    struct alignas(64) Stream {
+        // Written by the audio thread: the generation, and the first frame
+        // that's still needed
+        std::atomic<uint64_t> request = 0;
+
+        // Written by the filling side: the generation it has last seen, and
+        // the end of the frames it has streamed in for it
+        std::atomic<uint64_t> filled = 0;
+
+        // Only accessed by the audio thread; 0 while the stream has never
+        // been started
+        uint32_t generation = 0;
+
+        // Only accessed by the filling side
+        uint32_t fill_generation = 0;
+        uint32_t fill_end        = 0;
+    };
+
+    float* Ring(const uint32_t stream)
+    {
+        return rings.data() + size_t{stream} * ring_frames * num_channels;
+    }
+
+    void ThreadMain();
+
+    const SampleFile* file = nullptr;
+
+    ArenaArray<Stream> streams = {};
+    ArenaArray<float> rings    = {};
+
+    uint32_t ring_frames  = 0;
+    uint32_t num_channels = 0;
+
+    std::atomic<uint64_t> num_underruns = 0;
+
+    std::thread thread           = {};
+    std::mutex thread_mutex      = {};
+    std::condition_variable quit = {};
+    bool quit_requested          = false;
+};
+
+// Periodic timer as a file descriptor that becomes readable at every tick,
+// for waking up code in the host's event loop through
+// `clap_host_posix_fd_support`. Only available on Linux; Open() fails
+// elsewhere.
+class TimerFd {
+
+public:
+    TimerFd() = default;
+    ~TimerFd();
+
+    TimerFd(const TimerFd&)            = delete;
+    TimerFd& operator=(const TimerFd&) = delete;
+
+    bool Open(const uint32_t period_ms);
+    void Close();
+
+    // -1 while closed
+    int Fd() const
+    {
+        return fd;
+    }
+
+    // To be called when the fd is readable; the host's event loop is
+    // level-triggered, so it would keep calling us otherwise
+    void Acknowledge();
+
+private:
+    int fd = -1;
+};
@@ -0,0 +1,78 @@
+// CLAP instrument plugin tutorial
+//
+// Registry of the DSP resources shared by all plugin instances.
+
+#include <cassert>
+#include <map>
+#include <mutex>
+#include <typeindex>
+#include <utility>
+
+#include "shared_resources.h"
+
+namespace shared_resources {
+
+static int ref_count = 0;
+
+// Activate() is a main thread call, but not every host has just one main
+// thread for all plugins, so the registry is only accessed under a lock
+static std::mutex registry_mutex = {};
+
+struct Entry {
+    // Only set for pinned resources
+    std::shared_ptr<const void> pinned = {};
+    std::weak_ptr<const void> resource = {};
+};
+
+static std::map<std::pair<std::type_index, uint64_t>, Entry> registry = {};
+
+void Init()
+{
+    const std::lock_guard lock(registry_mutex);
+
+    ++ref_count;
+}
+
+void Deinit()
+{
+    const std::lock_guard lock(registry_mutex);
+
+    assert(ref_count > 0);
+
+    if (--ref_count > 0) {
+        return;
+    }
+
+    registry.clear();
+}
+
+namespace detail {
+
+std::shared_ptr<const void> GetOrCreate(const std::type_info& type, const uint64_t key,
+                                        const Retention retention, const MakeFn& make)
+{
+    const std::lock_guard lock(registry_mutex);
+
+    // Drop the entries of resources nobody uses any more, so the registry
+    // doesn't grow with every ratio a session goes through
+    std::erase_if(registry,
+                  [](const auto& item) { return item.second.resource.expired(); });
+
+    // Resources are built under the lock, so instances asking for the same
+    // one at the same time don't build it twice
+    auto& entry = registry[{std::type_index(type), key}];
+
+    auto resource = entry.resource.lock();
+    if (!resource) {
+        resource       = make();
+        entry.resource = resource;
+    }
+    if (retention == Retention::Pinned) {
+        entry.pinned = resource;
+    }
+    return resource;
+}
+
+} // namespace detail
+
+} // namespace shared_resources
@@ -0,0 +1,72 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Registry of the DSP resources shared by all plugin instances.
+//
+// Most of the tables the plugin renders with only depend on a setting or
+// two: the wavetables on nothing at all, the key to phase increment tables
+// on the render rate, and the resampler's filter coefficients on the
+// conversion ratio. Projects often have dozens of instances running at the
+// same rates, so every table is built once, by the first instance that
+// needs it, and handed out to all the others. That saves the memory and
+// the time to build them, and all instances read the same copy, which then
+// stays in the caches.
+//
+// The resources are immutable once built. An instance that needs to change
+// one (e.g. to apply a microtuning) makes a private copy of just the part
+// it changes, i.e. copy-on-write; see TuningTable.
+//
+// Instances hold their own references, so a resource stays valid for as
+// long as they use it. How long the registry keeps it depends on the
+// resource: small, bounded sets like the wavetables and the tuning tables
+// are pinned until the library gets unloaded, so activating an instance
+// with settings that have been used before doesn't build anything. The
+// resampler tables are keyed on the conversion ratio, and a host with
+// varispeed or fractional rates can go through any number of those, so
+// they're only kept for as long as an instance uses them.
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <typeinfo>
+
+namespace shared_resources {
+
+// Called from `clap_entry.init()` and `clap_entry.deinit()`; calls must be
+// balanced. The last Deinit() drops the registry's references.
+void Init();
+void Deinit();
+
+enum class Retention {
+    // Kept until the last Deinit()
+    Pinned,
+    // Freed once the last instance using it drops its reference
+    WhileUsed
+};
+
+namespace detail {
+
+using MakeFn = std::function<std::shared_ptr<const void>()>;
+
+std::shared_ptr<const void> GetOrCreate(const std::type_info& type, const uint64_t key,
+                                        const Retention retention, const MakeFn& make);
+
+} // namespace detail
+
+// Returns the resource of type `T` for `key`, building it from what
+// `make()` returns if there's none yet. Must not be called from the audio
+// thread, or from within `make()`.
+template <typename T, typename Make>
+std::shared_ptr<const T> Get(const uint64_t key, Make&& make,
+                             const Retention retention = Retention::Pinned)
+{
+    const auto resource = detail::GetOrCreate(
+        typeid(T), key, retention, [&]() -> std::shared_ptr<const void> {
+            return std::make_shared<const T>(make());
+        });
+
+    return std::static_pointer_cast<const T>(resource);
+}
+
+} // namespace shared_resources
@@ -0,0 +1,838 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Minimal wrappers around the SIMD float vector types of the target
+// architecture. The DSP kernels are written once against this interface and
+// get instantiated with the widest vector type available at compile time
+// (AVX-512, AVX2, SSE2 or NEON), with a scalar fallback that is also used to
+// process the leftover frames at the end of a block. There are single and
+// double precision variants of every type.
+//
+// Everything lives in an inline namespace named after the instruction set
+// (`SIMD_ISA`), and so must every kernel built on top of it. Translation
+// units built for different instruction sets (see dsp_kernels.h) then get
+// distinct symbols for their instantiations, so the linker can't mix them
+// up.
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX512F__)
+    #include <immintrin.h>
+    #define SIMD_ISA avx512
+#elif defined(__AVX2__)
+    #include <immintrin.h>
+    #define SIMD_ISA avx2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SIMD_ISA sse2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define SIMD_ISA neon
+#else
+    #define SIMD_ISA scalar
+#endif
+
+namespace simd {
+inline namespace SIMD_ISA {
+
+// Scalar "vector" with a single lane
+struct F32x1 {
+    static constexpr auto NumLanes = 1;
+
+    float v;
+
+    static F32x1 Load(const float* p)
+    {
+        return {*p};
+    }
+
+    static F32x1 Set(const float x)
+    {
+        return {x};
+    }
+
+    // Returns {x, x + step, x + 2*step, ...}
+    static F32x1 Ramp(const float x, const float step)
+    {
+        return {x};
+    }
+
+    void Store(float* p) const
+    {
+        *p = v;
+    }
+
+    friend F32x1 operator+(const F32x1 a, const F32x1 b)
+    {
+        return {a.v + b.v};
+    }
+    friend F32x1 operator-(const F32x1 a, const F32x1 b)
+    {
+        return {a.v - b.v};
+    }
+    friend F32x1 operator*(const F32x1 a, const F32x1 b)
+    {
+        return {a.v * b.v};
+    }
+
+    friend F32x1 Abs(const F32x1 a)
+    {
+        return {a.v < 0.0f ? -a.v : a.v};
+    }
+
+    // Lane-wise maximum
+    friend F32x1 Max(const F32x1 a, const F32x1 b)
+    {
+        return {a.v > b.v ? a.v : b.v};
+    }
+
+    // Returns `a` with the sign of `b`
+    friend F32x1 CopySign(const F32x1 a, const F32x1 b)
+    {
+        uint32_t ia, ib;
+        memcpy(&ia, &a.v, sizeof(float));
+        memcpy(&ib, &b.v, sizeof(float));
+
+        ia = (ia & 0x7fffffff) | (ib & 0x80000000);
+
+        F32x1 r;
+        memcpy(&r.v, &ia, sizeof(float));
+        return r;
+    }
+
+    // Fractional part of a non-negative number
+    friend F32x1 Fract(const F32x1 a)
+    {
+        return {a.v - static_cast<float>(static_cast<int32_t>(a.v))};
+    }
+
+    // Sum of all lanes
+    friend float HorizontalSum(const F32x1 a)
+    {
+        return a.v;
+    }
+};
+
+// Scalar double precision "vector" with a single lane
+struct F64x1 {
+    static constexpr auto NumLanes = 1;
+
+    double v;
+
+    static F64x1 Load(const double* p)
+    {
+        return {*p};
+    }
+
+    static F64x1 Set(const double x)
+    {
+        return {x};
+    }
+
+    static F64x1 Ramp(const double x, const double step)
+    {
+        return {x};
+    }
+
+    void Store(double* p) const
+    {
+        *p = v;
+    }
+
+    friend F64x1 operator+(const F64x1 a, const F64x1 b)
+    {
+        return {a.v + b.v};
+    }
+    friend F64x1 operator-(const F64x1 a, const F64x1 b)
+    {
+        return {a.v - b.v};
+    }
+    friend F64x1 operator*(const F64x1 a, const F64x1 b)
+    {
+        return {a.v * b.v};
+    }
+
+    friend F64x1 Abs(const F64x1 a)
+    {
+        return {a.v < 0.0 ? -a.v : a.v};
+    }
+
+    friend F64x1 Max(const F64x1 a, const F64x1 b)
+    {
+        return {a.v > b.v ? a.v : b.v};
+    }
+
+    friend F64x1 CopySign(const F64x1 a, const F64x1 b)
+    {
+        uint64_t ia, ib;
+        memcpy(&ia, &a.v, sizeof(double));
+        memcpy(&ib, &b.v, sizeof(double));
+
+        ia = (ia & 0x7fffffffffffffff) | (ib & 0x8000000000000000);
+
+        F64x1 r;
+        memcpy(&r.v, &ia, sizeof(double));
+        return r;
+    }
+
+    friend F64x1 Fract(const F64x1 a)
+    {
+        return {a.v - static_cast<double>(static_cast<int64_t>(a.v))};
+    }
+
+    friend double HorizontalSum(const F64x1 a)
+    {
+        return a.v;
+    }
+};
+
+#if defined(__AVX512F__)
+
+// Some of the unmasked AVX-512 intrinsics are implemented with an undefined
+// pass-through operand in older GCC versions, which then warn about it
+// being uninitialised wherever they get inlined. The zero-masking forms
+// with all lanes enabled compile to the same instructions without that.
+static inline __m256d Extract256(const __m512d a, const int index)
+{
+    return index == 0 ? _mm512_maskz_extractf64x4_pd(0xf, a, 0)
+                      : _mm512_maskz_extractf64x4_pd(0xf, a, 1);
+}
+
+struct F32x16 {
+    static constexpr auto NumLanes = 16;
+
+    __m512 v;
+
+    static F32x16 Load(const float* p)
+    {
+        return {_mm512_loadu_ps(p)};
+    }
+
+    static F32x16 Set(const float x)
+    {
+        return {_mm512_set1_ps(x)};
+    }
+
+    static F32x16 Ramp(const float x, const float step)
+    {
+        const auto i = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        return {_mm512_add_ps(_mm512_set1_ps(x),
+                              _mm512_mul_ps(i, _mm512_set1_ps(step)))};
+    }
+
+    void Store(float* p) const
+    {
+        _mm512_storeu_ps(p, v);
+    }
+
+    friend F32x16 operator+(const F32x16 a, const F32x16 b)
+    {
+        return {_mm512_add_ps(a.v, b.v)};
+    }
+    friend F32x16 operator-(const F32x16 a, const F32x16 b)
+    {
+        return {_mm512_sub_ps(a.v, b.v)};
+    }
+    friend F32x16 operator*(const F32x16 a, const F32x16 b)
+    {
+        return {_mm512_mul_ps(a.v, b.v)};
+    }
+
+    friend F32x16 Abs(const F32x16 a)
+    {
+        return {_mm512_abs_ps(a.v)};
+    }
+
+    friend F32x16 Max(const F32x16 a, const F32x16 b)
+    {
+        return {_mm512_maskz_max_ps(0xffff, a.v, b.v)};
+    }
+
+    // The float bitwise operations need AVX-512DQ, the integer ones don't
+    friend F32x16 CopySign(const F32x16 a, const F32x16 b)
+    {
+        const auto sign_mask = _mm512_set1_epi32(INT32_MIN);
+
+        const auto magnitude = _mm512_maskz_andnot_epi32(
+            0xffff, sign_mask, _mm512_castps_si512(a.v));
+        const auto sign      = _mm512_and_si512(sign_mask, _mm512_castps_si512(b.v));
+
+        return {_mm512_castsi512_ps(_mm512_or_si512(magnitude, sign))};
+    }
+
+    friend F32x16 Fract(const F32x16 a)
+    {
+        return {_mm512_sub_ps(
+            a.v, _mm512_maskz_roundscale_ps(0xffff, a.v, _MM_FROUND_TO_ZERO))};
+    }
+
+    friend float HorizontalSum(const F32x16 a)
+    {
+        const auto lo = _mm256_castpd_ps(Extract256(_mm512_castps_pd(a.v), 0));
+        const auto hi = _mm256_castpd_ps(Extract256(_mm512_castps_pd(a.v), 1));
+
+        const auto sum8 = _mm256_add_ps(lo, hi);
+        const auto sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8),
+                                     _mm256_extractf128_ps(sum8, 1));
+
+        const auto sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+        const auto sum1 = _mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1));
+
+        return _mm_cvtss_f32(sum1);
+    }
+};
+
+struct F64x8 {
+    static constexpr auto NumLanes = 8;
+
+    __m512d v;
+
+    static F64x8 Load(const double* p)
+    {
+        return {_mm512_loadu_pd(p)};
+    }
+
+    static F64x8 Set(const double x)
+    {
+        return {_mm512_set1_pd(x)};
+    }
+
+    static F64x8 Ramp(const double x, const double step)
+    {
+        const auto i = _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0);
+        return {_mm512_add_pd(_mm512_set1_pd(x),
+                              _mm512_mul_pd(i, _mm512_set1_pd(step)))};
+    }
+
+    void Store(double* p) const
+    {
+        _mm512_storeu_pd(p, v);
+    }
+
+    friend F64x8 operator+(const F64x8 a, const F64x8 b)
+    {
+        return {_mm512_add_pd(a.v, b.v)};
+    }
+    friend F64x8 operator-(const F64x8 a, const F64x8 b)
+    {
+        return {_mm512_sub_pd(a.v, b.v)};
+    }
+    friend F64x8 operator*(const F64x8 a, const F64x8 b)
+    {
+        return {_mm512_mul_pd(a.v, b.v)};
+    }
+
+    friend F64x8 Abs(const F64x8 a)
+    {
+        return {_mm512_abs_pd(a.v)};
+    }
+
+    friend F64x8 Max(const F64x8 a, const F64x8 b)
+    {
+        return {_mm512_maskz_max_pd(0xff, a.v, b.v)};
+    }
+
+    friend F64x8 CopySign(const F64x8 a, const F64x8 b)
+    {
+        const auto sign_mask = _mm512_set1_epi64(INT64_MIN);
+
+        const auto magnitude = _mm512_maskz_andnot_epi64(
+            0xff, sign_mask, _mm512_castpd_si512(a.v));
+        const auto sign      = _mm512_and_si512(sign_mask, _mm512_castpd_si512(b.v));
+
+        return {_mm512_castsi512_pd(_mm512_or_si512(magnitude, sign))};
+    }
+
+    friend F64x8 Fract(const F64x8 a)
+    {
+        return {_mm512_sub_pd(
+            a.v, _mm512_maskz_roundscale_pd(0xff, a.v, _MM_FROUND_TO_ZERO))};
+    }
+
+    friend double HorizontalSum(const F64x8 a)
+    {
+        const auto sum4 = _mm256_add_pd(Extract256(a.v, 0), Extract256(a.v, 1));
+        const auto sum2 = _mm_add_pd(_mm256_castpd256_pd128(sum4),
+                                     _mm256_extractf128_pd(sum4, 1));
+
+        return _mm_cvtsd_f64(_mm_add_sd(sum2, _mm_unpackhi_pd(sum2, sum2)));
+    }
+};
+
+using F32xN = F32x16;
+using F64xN = F64x8;
+
+#elif defined(__AVX2__)
+
+struct F32x8 {
+    static constexpr auto NumLanes = 8;
+
+    __m256 v;
+
+    static F32x8 Load(const float* p)
+    {
+        return {_mm256_loadu_ps(p)};
+    }
+
+    static F32x8 Set(const float x)
+    {
+        return {_mm256_set1_ps(x)};
+    }
+
+    static F32x8 Ramp(const float x, const float step)
+    {
+        const auto i = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+        return {_mm256_add_ps(_mm256_set1_ps(x),
+                              _mm256_mul_ps(i, _mm256_set1_ps(step)))};
+    }
+
+    void Store(float* p) const
+    {
+        _mm256_storeu_ps(p, v);
+    }
+
+    friend F32x8 operator+(const F32x8 a, const F32x8 b)
+    {
+        return {_mm256_add_ps(a.v, b.v)};
+    }
+    friend F32x8 operator-(const F32x8 a, const F32x8 b)
+    {
+        return {_mm256_sub_ps(a.v, b.v)};
+    }
+    friend F32x8 operator*(const F32x8 a, const F32x8 b)
+    {
+        return {_mm256_mul_ps(a.v, b.v)};
+    }
+
+    friend F32x8 Abs(const F32x8 a)
+    {
+        return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)};
+    }
+
+    friend F32x8 Max(const F32x8 a, const F32x8 b)
+    {
+        return {_mm256_max_ps(a.v, b.v)};
+    }
+
+    friend F32x8 CopySign(const F32x8 a, const F32x8 b)
+    {
+        const auto sign_mask = _mm256_set1_ps(-0.0f);
+        return {_mm256_or_ps(_mm256_andnot_ps(sign_mask, a.v),
+                             _mm256_and_ps(sign_mask, b.v))};
+    }
+
+    friend F32x8 Fract(const F32x8 a)
+    {
+        return {_mm256_sub_ps(a.v, _mm256_round_ps(a.v, _MM_FROUND_TRUNC))};
+    }
+
+    friend float HorizontalSum(const F32x8 a)
+    {
+        const auto lo  = _mm256_castps256_ps128(a.v);
+        const auto hi  = _mm256_extractf128_ps(a.v, 1);
+        const auto sum = _mm_add_ps(lo, hi);
+
+        const auto shuf = _mm_movehdup_ps(sum);
+        const auto sums = _mm_add_ps(sum, shuf);
+
+        return _mm_cvtss_f32(_mm_add_ss(sums, _mm_movehl_ps(shuf, sums)));
+    }
+};
+
+struct F64x4 {
+    static constexpr auto NumLanes = 4;
+
+    __m256d v;
+
+    static F64x4 Load(const double* p)
+    {
+        return {_mm256_loadu_pd(p)};
+    }
+
+    static F64x4 Set(const double x)
+    {
+        return {_mm256_set1_pd(x)};
+    }
+
+    static F64x4 Ramp(const double x, const double step)
+    {
+        const auto i = _mm256_set_pd(3, 2, 1, 0);
+        return {_mm256_add_pd(_mm256_set1_pd(x),
+                              _mm256_mul_pd(i, _mm256_set1_pd(step)))};
+    }
+
+    void Store(double* p) const
+    {
+        _mm256_storeu_pd(p, v);
+    }
+
+    friend F64x4 operator+(const F64x4 a, const F64x4 b)
+    {
+        return {_mm256_add_pd(a.v, b.v)};
+    }
+    friend F64x4 operator-(const F64x4 a, const F64x4 b)
+    {
+        return {_mm256_sub_pd(a.v, b.v)};
+    }
+    friend F64x4 operator*(const F64x4 a, const F64x4 b)
+    {
+        return {_mm256_mul_pd(a.v, b.v)};
+    }
+
+    friend F64x4 Abs(const F64x4 a)
+    {
+        return {_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v)};
+    }
+
+    friend F64x4 Max(const F64x4 a, const F64x4 b)
+    {
+        return {_mm256_max_pd(a.v, b.v)};
+    }
+
+    friend F64x4 CopySign(const F64x4 a, const F64x4 b)
+    {
+        const auto sign_mask = _mm256_set1_pd(-0.0);
+        return {_mm256_or_pd(_mm256_andnot_pd(sign_mask, a.v),
+                             _mm256_and_pd(sign_mask, b.v))};
+    }
+
+    friend F64x4 Fract(const F64x4 a)
+    {
+        return {_mm256_sub_pd(a.v, _mm256_round_pd(a.v, _MM_FROUND_TRUNC))};
+    }
+
+    friend double HorizontalSum(const F64x4 a)
+    {
+        const auto lo  = _mm256_castpd256_pd128(a.v);
+        const auto hi  = _mm256_extractf128_pd(a.v, 1);
+        const auto sum = _mm_add_pd(lo, hi);
+
+        return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+    }
+};
+
+using F32xN = F32x8;
+using F64xN = F64x4;
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+struct F32x4 {
+    static constexpr auto NumLanes = 4;
+
+    __m128 v;
+
+    static F32x4 Load(const float* p)
+    {
+        return {_mm_loadu_ps(p)};
+    }
+
+    static F32x4 Set(const float x)
+    {
+        return {_mm_set1_ps(x)};
+    }
+
+    static F32x4 Ramp(const float x, const float step)
+    {
+        const auto i = _mm_set_ps(3, 2, 1, 0);
+        return {_mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(i, _mm_set1_ps(step)))};
+    }
+
+    void Store(float* p) const
+    {
+        _mm_storeu_ps(p, v);
+    }
+
+    friend F32x4 operator+(const F32x4 a, const F32x4 b)
+    {
+        return {_mm_add_ps(a.v, b.v)};
+    }
+    friend F32x4 operator-(const F32x4 a, const F32x4 b)
+    {
+        return {_mm_sub_ps(a.v, b.v)};
+    }
+    friend F32x4 operator*(const F32x4 a, const F32x4 b)
+    {
+        return {_mm_mul_ps(a.v, b.v)};
+    }
+
+    friend F32x4 Abs(const F32x4 a)
+    {
+        return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)};
+    }
+
+    friend F32x4 Max(const F32x4 a, const F32x4 b)
+    {
+        return {_mm_max_ps(a.v, b.v)};
+    }
+
+    friend F32x4 CopySign(const F32x4 a, const F32x4 b)
+    {
+        const auto sign_mask = _mm_set1_ps(-0.0f);
+        return {_mm_or_ps(_mm_andnot_ps(sign_mask, a.v),
+                          _mm_and_ps(sign_mask, b.v))};
+    }
+
+    friend F32x4 Fract(const F32x4 a)
+    {
+        // SSE2 has no floor; truncation is fine for non-negative values
+        return {_mm_sub_ps(a.v, _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)))};
+    }
+
+    friend float HorizontalSum(const F32x4 a)
+    {
+        const auto shuf = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1));
+        const auto sums = _mm_add_ps(a.v, shuf);
+
+        return _mm_cvtss_f32(_mm_add_ss(sums, _mm_movehl_ps(shuf, sums)));
+    }
+};
+
+struct F64x2 {
+    static constexpr auto NumLanes = 2;
+
+    __m128d v;
+
+    static F64x2 Load(const double* p)
+    {
+        return {_mm_loadu_pd(p)};
+    }
+
+    static F64x2 Set(const double x)
+    {
+        return {_mm_set1_pd(x)};
+    }
+
+    static F64x2 Ramp(const double x, const double step)
+    {
+        return {_mm_set_pd(x + step, x)};
+    }
+
+    void Store(double* p) const
+    {
+        _mm_storeu_pd(p, v);
+    }
+
+    friend F64x2 operator+(const F64x2 a, const F64x2 b)
+    {
+        return {_mm_add_pd(a.v, b.v)};
+    }
+    friend F64x2 operator-(const F64x2 a, const F64x2 b)
+    {
+        return {_mm_sub_pd(a.v, b.v)};
+    }
+    friend F64x2 operator*(const F64x2 a, const F64x2 b)
+    {
+        return {_mm_mul_pd(a.v, b.v)};
+    }
+
+    friend F64x2 Abs(const F64x2 a)
+    {
+        return {_mm_andnot_pd(_mm_set1_pd(-0.0), a.v)};
+    }
+
+    friend F64x2 Max(const F64x2 a, const F64x2 b)
+    {
+        return {_mm_max_pd(a.v, b.v)};
+    }
+
+    friend F64x2 CopySign(const F64x2 a, const F64x2 b)
+    {
+        const auto sign_mask = _mm_set1_pd(-0.0);
+        return {_mm_or_pd(_mm_andnot_pd(sign_mask, a.v),
+                          _mm_and_pd(sign_mask, b.v))};
+    }
+
+    friend F64x2 Fract(const F64x2 a)
+    {
+        return {_mm_sub_pd(a.v, _mm_cvtepi32_pd(_mm_cvttpd_epi32(a.v)))};
+    }
+
+    friend double HorizontalSum(const F64x2 a)
+    {
+        return _mm_cvtsd_f64(_mm_add_sd(a.v, _mm_unpackhi_pd(a.v, a.v)));
+    }
+};
+
+using F32xN = F32x4;
+using F64xN = F64x2;
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+struct F32x4 {
+    static constexpr auto NumLanes = 4;
+
+    float32x4_t v;
+
+    static F32x4 Load(const float* p)
+    {
+        return {vld1q_f32(p)};
+    }
+
+    static F32x4 Set(const float x)
+    {
+        return {vdupq_n_f32(x)};
+    }
+
+    static F32x4 Ramp(const float x, const float step)
+    {
+        constexpr float i[4] = {0, 1, 2, 3};
+        return {vmlaq_n_f32(vdupq_n_f32(x), vld1q_f32(i), step)};
+    }
+
+    void Store(float* p) const
+    {
+        vst1q_f32(p, v);
+    }
+
+    friend F32x4 operator+(const F32x4 a, const F32x4 b)
+    {
+        return {vaddq_f32(a.v, b.v)};
+    }
+    friend F32x4 operator-(const F32x4 a, const F32x4 b)
+    {
+        return {vsubq_f32(a.v, b.v)};
+    }
+    friend F32x4 operator*(const F32x4 a, const F32x4 b)
+    {
+        return {vmulq_f32(a.v, b.v)};
+    }
+
+    friend F32x4 Abs(const F32x4 a)
+    {
+        return {vabsq_f32(a.v)};
+    }
+
+    friend F32x4 Max(const F32x4 a, const F32x4 b)
+    {
+        return {vmaxq_f32(a.v, b.v)};
+    }
+
+    friend F32x4 CopySign(const F32x4 a, const F32x4 b)
+    {
+        const auto sign_mask = vdupq_n_u32(0x80000000);
+        return {vbslq_f32(sign_mask, b.v, a.v)};
+    }
+
+    friend F32x4 Fract(const F32x4 a)
+    {
+        return {vsubq_f32(a.v, vcvtq_f32_s32(vcvtq_s32_f32(a.v)))};
+    }
+
+    friend float HorizontalSum(const F32x4 a)
+    {
+    #if defined(__aarch64__)
+        return vaddvq_f32(a.v);
+    #else
+        const auto sum = vadd_f32(vget_low_f32(a.v), vget_high_f32(a.v));
+        return vget_lane_f32(vpadd_f32(sum, sum), 0);
+    #endif
+    }
+};
+
+    #if defined(__aarch64__)
+
+// Double precision NEON vectors are only available on AArch64
+struct F64x2 {
+    static constexpr auto NumLanes = 2;
+
+    float64x2_t v;
+
+    static F64x2 Load(const double* p)
+    {
+        return {vld1q_f64(p)};
+    }
+
+    static F64x2 Set(const double x)
+    {
+        return {vdupq_n_f64(x)};
+    }
+
+    static F64x2 Ramp(const double x, const double step)
+    {
+        const double r[2] = {x, x + step};
+        return {vld1q_f64(r)};
+    }
+
+    void Store(double* p) const
+    {
+        vst1q_f64(p, v);
+    }
+
+    friend F64x2 operator+(const F64x2 a, const F64x2 b)
+    {
+        return {vaddq_f64(a.v, b.v)};
+    }
+    friend F64x2 operator-(const F64x2 a, const F64x2 b)
+    {
+        return {vsubq_f64(a.v, b.v)};
+    }
+    friend F64x2 operator*(const F64x2 a, const F64x2 b)
+    {
+        return {vmulq_f64(a.v, b.v)};
+    }
+
+    friend F64x2 Abs(const F64x2 a)
+    {
+        return {vabsq_f64(a.v)};
+    }
+
+    friend F64x2 Max(const F64x2 a, const F64x2 b)
+    {
+        return {vmaxq_f64(a.v, b.v)};
+    }
+
+    friend F64x2 CopySign(const F64x2 a, const F64x2 b)
+    {
+        const auto sign_mask = vdupq_n_u64(0x8000000000000000);
+        return {vbslq_f64(sign_mask, b.v, a.v)};
+    }
+
+    friend F64x2 Fract(const F64x2 a)
+    {
+        return {vsubq_f64(a.v, vrndq_f64(a.v))};
+    }
+
+    friend double HorizontalSum(const F64x2 a)
+    {
+        return vaddvq_f64(a.v);
+    }
+};
+
+using F32xN = F32x4;
+using F64xN = F64x2;
+
+    #else
+
+using F32xN = F32x4;
+using F64xN = F64x1;
+
+    #endif
+
+#else
+
+using F32xN = F32x1;
+using F64xN = F64x1;
+
+#endif
+
+// Widest and single-lane vector types for a sample type, so the DSP
+// kernels can be written once for both float and double samples
+template <typename T>
+struct VectorTypes;
+
+template <>
+struct VectorTypes<float> {
+    using Wide   = F32xN;
+    using Scalar = F32x1;
+};
+
+template <>
+struct VectorTypes<double> {
+    using Wide   = F64xN;
+    using Scalar = F64x1;
+};
+
+} // namespace SIMD_ISA
+} // namespace simd
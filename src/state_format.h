@@ -0,0 +1,257 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Binary format of the saved plugin state.
+//
+// The state starts with a header (magic number and format version),
+// followed by a sequence of tagged chunks:
+//
+//     header:  magic (u32) | version (u32)
+//     chunk:   tag (u32)   | payload size in bytes (u32) | payload
+//
+// All values are little-endian. A reader that doesn't know a chunk skips
+// over it using its size, so new chunks can be added without breaking
+// older versions of the plugin, and removed without breaking newer ones.
+//
+// Loading reads the whole stream into a buffer that has been allocated up
+// front, then parses the chunks in place.
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "clap/clap.h"
+
+namespace state {
+
+static_assert(std::endian::native == std::endian::little,
+              "The state format assumes a little-endian host");
+
+constexpr uint32_t FourCC(const char (&s)[5])
+{
+    return static_cast<uint32_t>(static_cast<uint8_t>(s[0])) |
+           static_cast<uint32_t>(static_cast<uint8_t>(s[1])) << 8 |
+           static_cast<uint32_t>(static_cast<uint8_t>(s[2])) << 16 |
+           static_cast<uint32_t>(static_cast<uint8_t>(s[3])) << 24;
+}
+
+constexpr uint32_t Magic   = FourCC("HCLP");
+constexpr uint32_t Version = 1;
+
+// Upper limit for the size of a state; anything larger is rejected
+constexpr uint32_t MaxSize = 64 * 1024;
+
+// Serialises the state into a buffer, then writes it to the stream
+class Writer {
+
+public:
+    explicit Writer(std::vector<uint8_t>& _buf) : buf(_buf)
+    {
+        buf.clear();
+
+        Write(Magic);
+        Write(Version);
+    }
+
+    void BeginChunk(const uint32_t tag)
+    {
+        Write(tag);
+
+        chunk_size_pos = buf.size();
+        Write(uint32_t{0});
+    }
+
+    void EndChunk()
+    {
+        const auto size = static_cast<uint32_t>(buf.size() - chunk_size_pos -
+                                                sizeof(uint32_t));
+
+        std::memcpy(buf.data() + chunk_size_pos, &size, sizeof(size));
+    }
+
+    template <typename T>
+    void Write(const T value)
+    {
+        const auto pos = buf.size();
+        buf.resize(pos + sizeof(T));
+
+        std::memcpy(buf.data() + pos, &value, sizeof(T));
+    }
+
+    void WriteBytes(const void* data, const size_t count)
+    {
+        const auto pos = buf.size();
+        buf.resize(pos + count);
+
+        std::memcpy(buf.data() + pos, data, count);
+    }
+
+    // Streams can accept fewer bytes than requested, so we keep writing
+    // until the whole state is out
+    bool WriteTo(const clap_ostream_t* stream) const
+    {
+        size_t pos = 0;
+
+        while (pos < buf.size()) {
+            const auto written = stream->write(stream,
+                                               buf.data() + pos,
+                                               buf.size() - pos);
+            if (written <= 0) {
+                return false;
+            }
+            pos += static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+private:
+    std::vector<uint8_t>& buf;
+
+    size_t chunk_size_pos = 0;
+};
+
+// Reads a state from a stream into a preallocated buffer and walks its
+// chunks without copying them
+class Reader {
+
+public:
+    // `buf` must have `MaxSize` bytes; it's not resized
+    explicit Reader(std::vector<uint8_t>& _buf) : buf(_buf) {}
+
+    // Streams can return fewer bytes than requested, so we keep reading
+    // until the end of the stream
+    bool ReadFrom(const clap_istream_t* stream)
+    {
+        size = 0;
+
+        for (;;) {
+            if (size == buf.size()) {
+                // Either the state ends exactly here, or it's too large
+                uint8_t extra = 0;
+                return stream->read(stream, &extra, 1) == 0;
+            }
+
+            const auto read = stream->read(stream,
+                                           buf.data() + size,
+                                           buf.size() - size);
+            if (read < 0) {
+                return false;
+            }
+            if (read == 0) {
+                return true;
+            }
+            size += static_cast<size_t>(read);
+        }
+    }
+
+    // Total number of bytes read
+    size_t Size() const
+    {
+        return size;
+    }
+
+    const uint8_t* Data() const
+    {
+        return buf.data();
+    }
+
+    // Returns false if the data doesn't start with a valid header
+    bool ReadHeader(uint32_t& version)
+    {
+        uint32_t magic = 0;
+
+        pos = 0;
+
+        if (!Read(magic) || magic != Magic || !Read(version)) {
+            return false;
+        }
+        return true;
+    }
+
+    struct Chunk {
+        uint32_t tag        = 0;
+        const uint8_t* data = nullptr;
+        uint32_t size       = 0;
+    };
+
+    // Returns false at the end of the state, or if the next chunk is
+    // truncated
+    bool NextChunk(Chunk& chunk)
+    {
+        uint32_t tag        = 0;
+        uint32_t chunk_size = 0;
+
+        if (!Read(tag) || !Read(chunk_size) || chunk_size > size - pos) {
+            return false;
+        }
+
+        chunk = {.tag = tag, .data = buf.data() + pos, .size = chunk_size};
+
+        // Skipping a chunk is just a matter of moving past it
+        pos += chunk_size;
+
+        return true;
+    }
+
+private:
+    template <typename T>
+    bool Read(T& value)
+    {
+        if (size - pos < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, buf.data() + pos, sizeof(T));
+        pos += sizeof(T);
+
+        return true;
+    }
+
+    std::vector<uint8_t>& buf;
+
+    size_t size = 0;
+    size_t pos  = 0;
+};
+
+// Sequential reader for the payload of a chunk
+class ChunkReader {
+
+public:
+    explicit ChunkReader(const Reader::Chunk& chunk)
+        : data(chunk.data),
+          size(chunk.size)
+    {}
+
+    template <typename T>
+    bool Read(T& value)
+    {
+        if (size - pos < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+
+        return true;
+    }
+
+    // Points `bytes` at the next `count` bytes of the payload, in place
+    bool ReadBytes(const uint8_t*& bytes, const uint32_t count)
+    {
+        if (size - pos < count) {
+            return false;
+        }
+        bytes = data + pos;
+        pos += count;
+
+        return true;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+
+    uint32_t size = 0;
+    uint32_t pos  = 0;
+};
+
+} // namespace state
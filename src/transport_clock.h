@@ -0,0 +1,159 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// The host's transport, followed at the render rate.
+//
+// The host tells us where the song is at the start of every block (and
+// wherever it jumps or changes tempo within a block, with transport
+// events). In between, the clock runs on by itself at the host's tempo,
+// so we know the song position at every rendered frame, not just at block
+// boundaries.
+//
+// Positions are kept in CLAP's fixed-point beat time, in quarter notes
+// like the host's. That's exact for the whole length of any song, so tempo
+// synced modulation can be derived from the position directly (see
+// MyPlugin::MakeBlockControls()) instead of being accumulated block by
+// block: the phase at any position doesn't depend on how the audio got
+// split into blocks, so real-time and offline renders of a song come out
+// the same.
+//
+// While the host's transport is stopped, or if the host doesn't tell us
+// about it at all, the clock keeps running from where it is at the last
+// tempo we know of, so tempo synced modulation never stalls.
+
+#include <algorithm>
+#include <cmath>
+
+#include "clap/events.h"
+#include "clap/fixedpoint.h"
+
+class TransportClock {
+
+public:
+    // Main thread. Back to 120 BPM in 4/4 at the start of the song, with
+    // the transport stopped. Frames are counted at the render rate, while
+    // the host's tempo increments are per output sample.
+    void Reset(const double render_rate_hz, const double output_rate_hz)
+    {
+        frames_per_second   = render_rate_hz;
+        samples_per_frame   = output_rate_hz / render_rate_hz;
+        tempo_bpm           = DefaultTempoBpm;
+        tempo_inc_per_frame = 0.0;
+        position            = 0;
+        remainder           = 0.0;
+        bar_start           = 0;
+        bar_length          = 4 * CLAP_BEATTIME_FACTOR;
+        is_playing          = false;
+    }
+
+    // Takes over the host's transport at the current frame
+    void Sync(const clap_event_transport_t& transport)
+    {
+        if (transport.flags & CLAP_TRANSPORT_HAS_TEMPO) {
+            tempo_bpm           = std::max(transport.tempo, MinTempoBpm);
+            tempo_inc_per_frame = transport.tempo_inc * samples_per_frame;
+        }
+
+        if ((transport.flags & CLAP_TRANSPORT_HAS_TIME_SIGNATURE) &&
+            transport.tsig_num > 0 && transport.tsig_denom > 0) {
+            bar_length = transport.tsig_num * 4 * CLAP_BEATTIME_FACTOR /
+                         transport.tsig_denom;
+        }
+
+        is_playing = (transport.flags & CLAP_TRANSPORT_IS_PLAYING) != 0;
+
+        // A stopped transport would stop the clock
+        if (is_playing && (transport.flags & CLAP_TRANSPORT_HAS_BEATS_TIMELINE)) {
+            position  = transport.song_pos_beats;
+            bar_start = transport.bar_start;
+            remainder = 0.0;
+        }
+    }
+
+    // Moves the clock on by a number of frames, following the tempo ramp
+    void Advance(const double num_frames)
+    {
+        if (num_frames <= 0.0) {
+            return;
+        }
+
+        // The tempo changes linearly, so the mean over the frames is the
+        // one halfway through
+        const auto tempo_change = tempo_inc_per_frame * num_frames;
+        const auto mean_tempo   = std::max(tempo_bpm + tempo_change * 0.5, MinTempoBpm);
+
+        const auto beats = num_frames / frames_per_second * mean_tempo / 60.0;
+
+        // Carry the fraction of a beat time unit over to the next call, so
+        // cutting the same stretch of time into more calls doesn't slow
+        // the clock down
+        const auto units = beats * CLAP_BEATTIME_FACTOR + remainder;
+        const auto whole = std::floor(units);
+
+        position += static_cast<clap_beattime>(whole);
+        remainder = units - whole;
+
+        tempo_bpm = std::max(tempo_bpm + tempo_change, MinTempoBpm);
+
+        // The host tells us about the bars while it's playing; this keeps
+        // them going when it isn't
+        if (bar_length > 0 && position >= bar_start + bar_length) {
+            bar_start += (position - bar_start) / bar_length * bar_length;
+        }
+    }
+
+    // Song position in beat time
+    clap_beattime Position() const
+    {
+        return position;
+    }
+
+    // Start of the bar the song position is in, and the length of a bar,
+    // in beat time
+    clap_beattime BarStart() const
+    {
+        return bar_start;
+    }
+    clap_beattime BarLength() const
+    {
+        return bar_length;
+    }
+
+    double TempoBpm() const
+    {
+        return tempo_bpm;
+    }
+
+    bool IsPlaying() const
+    {
+        return is_playing;
+    }
+
+    static double ToBeats(const clap_beattime time)
+    {
+        return static_cast<double>(time) / CLAP_BEATTIME_FACTOR;
+    }
+
+private:
+    static constexpr double DefaultTempoBpm = 120.0;
+
+    // Keeps a ramp towards zero tempo from stopping the clock altogether
+    static constexpr double MinTempoBpm = 1.0;
+
+    double frames_per_second = 48000.0;
+    double samples_per_frame = 1.0;
+
+    double tempo_bpm           = DefaultTempoBpm;
+    double tempo_inc_per_frame = 0.0;
+
+    clap_beattime position = 0;
+
+    // Fraction of a beat time unit the position is ahead of `position`
+    double remainder = 0.0;
+
+    clap_beattime bar_start  = 0;
+    clap_beattime bar_length = 4 * CLAP_BEATTIME_FACTOR;
+
+    bool is_playing = false;
+};
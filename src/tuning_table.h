@@ -0,0 +1,204 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Per-channel key to phase increment tables.
+//
+// Converting a key into an oscillator frequency takes an `exp2()`, and with
+// a microtuning, a call into the host on top of that. Instead, the phase
+// increment of every key on every MIDI channel is kept in a table that is
+// only rebuilt when the render rate changes, or when the host tells us
+// about a new tuning. Starting a voice is then a single lookup, no matter
+// how the keys are tuned.
+//
+// Most channels are never tuned, and all of those read the same 12-TET
+// table, which is shared with every other instance at the same render
+// rate. A channel only gets a table of its own once it's tuned.
+//
+// Tunings are stored as offsets in semitones from 12-tone equal
+// temperament with A4 = 440 Hz, which is also how the host's tuning
+// extension reports them.
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+#include "shared_resources.h"
+
+class TuningTable {
+
+public:
+    static constexpr int16_t NumKeys     = 128;
+    static constexpr int16_t NumChannels = 16;
+
+    TuningTable()
+    {
+        channel_phase_inc.fill(Unset.data());
+    }
+
+    // Main thread. Rebuilds all phase increments, keeping the tunings.
+    void SetSampleRate(const double render_sample_rate_hz)
+    {
+        sample_rate_hz = render_sample_rate_hz;
+
+        equal_tempered = shared_resources::Get<EqualTemperament>(
+            std::bit_cast<uint64_t>(sample_rate_hz), [&] {
+                EqualTemperament table = {};
+
+                for (int16_t key = 0; key < NumKeys; ++key) {
+                    table.phase_inc[key] = Calculate(key);
+                }
+                return table;
+            });
+
+        for (int16_t channel = 0; channel < NumChannels; ++channel) {
+            if (tuned && tuned->is_tuned[channel]) {
+                RebuildChannel(channel);
+            } else {
+                channel_phase_inc[channel] = equal_tempered->phase_inc.data();
+            }
+        }
+    }
+
+    // Main thread. Allocates the private tables of tuned channels up front,
+    // so tunings can be applied on the audio thread. Without this, the
+    // tuning calls are ignored.
+    void EnableTunings()
+    {
+        if (!tuned) {
+            tuned = std::make_unique<TunedChannels>();
+        }
+    }
+
+    // Sets the tuning of one channel. `offset_fn(key)` returns the offset of
+    // `key` in semitones; this doesn't keep the function around.
+    template <typename OffsetFn>
+    void SetChannelTuning(const int16_t channel, OffsetFn&& offset_fn)
+    {
+        if (!tuned) {
+            return;
+        }
+
+        auto is_tuned = false;
+
+        for (int16_t key = 0; key < NumKeys; ++key) {
+            const auto offset = static_cast<float>(offset_fn(key));
+
+            tuned->offsets[channel][key] = offset;
+            is_tuned                     = is_tuned || (offset != 0.0f);
+        }
+
+        // Channels in 12-TET go back to the shared table
+        if (is_tuned) {
+            tuned->is_tuned[channel] = true;
+            RebuildChannel(channel);
+        } else {
+            ResetChannel(channel);
+        }
+    }
+
+    // Updates a single key, for tunings that change over time
+    void SetKeyOffset(const int16_t channel, const int16_t key, const float offset)
+    {
+        if (!tuned || tuned->offsets[channel][key] == offset) {
+            return;
+        }
+
+        // Copy-on-write: the first tuned key gives the channel a private
+        // copy of the shared table
+        if (!tuned->is_tuned[channel]) {
+            tuned->phase_inc[channel] = equal_tempered ? equal_tempered->phase_inc : Unset;
+            tuned->is_tuned[channel]  = true;
+
+            channel_phase_inc[channel] = tuned->phase_inc[channel].data();
+        }
+
+        tuned->offsets[channel][key]   = offset;
+        tuned->phase_inc[channel][key] = Calculate(key + offset);
+    }
+
+    // Back to 12-TET
+    void ResetChannel(const int16_t channel)
+    {
+        if (tuned) {
+            tuned->offsets[channel].fill(0.0f);
+            tuned->is_tuned[channel] = false;
+        }
+
+        channel_phase_inc[channel] = equal_tempered ? equal_tempered->phase_inc.data()
+                                                    : Unset.data();
+    }
+
+    static bool IsValid(const int16_t channel, const int16_t key)
+    {
+        return channel >= 0 && channel < NumChannels && key >= 0 && key < NumKeys;
+    }
+
+    // Tuning offset of a key in semitones; zero for out-of-range keys and
+    // channels
+    float Offset(const int16_t channel, const int16_t key) const
+    {
+        return (tuned && IsValid(channel, key)) ? tuned->offsets[channel][key] : 0.0f;
+    }
+
+    // Phase increment of a key in cycles per render frame. Keys and
+    // channels outside of the table are played in 12-TET.
+    float PhaseIncrement(const int16_t channel, const int16_t key) const
+    {
+        return IsValid(channel, key) ? channel_phase_inc[channel][key] : Calculate(key);
+    }
+
+    // Frequency ratio of an interval in semitones. Most voices aren't bent,
+    // so this skips the `exp2()` for them.
+    static float SemitoneRatio(const float semitones)
+    {
+        return (semitones == 0.0f) ? 1.0f : std::exp2(semitones / 12.0f);
+    }
+
+private:
+    using KeyTable = std::array<float, NumKeys>;
+
+    // 12-TET at one render rate; the same for every instance at that rate,
+    // so it's shared
+    struct EqualTemperament {
+        KeyTable phase_inc = {};
+    };
+
+    // Copies of the channels with a tuning
+    struct TunedChannels {
+        std::array<KeyTable, NumChannels> offsets   = {};
+        std::array<KeyTable, NumChannels> phase_inc = {};
+        std::array<bool, NumChannels> is_tuned      = {};
+    };
+
+    // Until the render rate is known
+    static constexpr KeyTable Unset = {};
+
+    float Calculate(const float pitch) const
+    {
+        if (sample_rate_hz <= 0.0) {
+            return 0.0f;
+        }
+
+        return static_cast<float>(440.0 * std::exp2((pitch - 57.0) / 12.0) /
+                                  sample_rate_hz);
+    }
+
+    void RebuildChannel(const int16_t channel)
+    {
+        for (int16_t key = 0; key < NumKeys; ++key) {
+            tuned->phase_inc[channel][key] = Calculate(key + tuned->offsets[channel][key]);
+        }
+        channel_phase_inc[channel] = tuned->phase_inc[channel].data();
+    }
+
+    double sample_rate_hz = 0.0;
+
+    std::shared_ptr<const EqualTemperament> equal_tempered = {};
+    std::unique_ptr<TunedChannels> tuned                    = {};
+
+    // Either the shared 12-TET table or the channel's private one
+    std::array<const float*, NumChannels> channel_phase_inc = {};
+};
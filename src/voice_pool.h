@@ -0,0 +1,457 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Fixed-capacity pool of voices for the audio thread.
+//
+// All voice slots are carved out of the instance's arena up front in
+// Allocate() (on the main thread); starting and stopping voices on the
+// audio thread only moves slot indices
+// between the free list and the dense list of active voices, so both are
+// O(1) and never touch the heap. When the pool is full, a victim voice is
+// chosen according to the voice stealing policy.
+//
+// The active voices are also indexed by (key, channel) and by note ID, so
+// finding the voices a note or modulation event refers to only visits the
+// voices that can actually match, instead of all of them. This is what
+// keeps dense MPE and per-note modulation streams cheap at high polyphony.
+//
+// The per-voice data is split in two. The metadata only needed to match
+// events and to pick a victim (`VoiceType`) stays in its slot for the
+// lifetime of the voice. The state the render kernels need every block
+// (`RenderState`) is a structure of arrays indexed by active voice, which
+// the pool keeps compacted in step with the active list, so rendering
+// streams through contiguous arrays without ever looking at the metadata.
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+#include "arena.h"
+
+enum class VoiceStealPolicy { Oldest, Quietest };
+
+// Intrusive doubly linked lists of slot indices, one list per bucket. A
+// slot can be in at most one list at a time.
+class SlotBuckets {
+
+public:
+    static constexpr auto None = std::numeric_limits<uint32_t>::max();
+
+    // To be called from the carving code passed to Arena::Build()
+    void Allocate(Arena& arena, const uint32_t num_buckets, const uint32_t num_slots)
+    {
+        heads = arena.Allocate<uint32_t>(num_buckets);
+
+        next      = arena.Allocate<uint32_t>(num_slots);
+        prev      = arena.Allocate<uint32_t>(num_slots);
+        bucket_of = arena.Allocate<uint32_t>(num_slots);
+    }
+
+    // Empties all lists
+    void Reset()
+    {
+        heads.Fill(None);
+        next.Fill(None);
+        prev.Fill(None);
+        bucket_of.Fill(None);
+    }
+
+    void Insert(const uint32_t bucket, const uint32_t slot)
+    {
+        assert(bucket_of[slot] == None);
+
+        const auto head = heads[bucket];
+
+        next[slot] = head;
+        prev[slot] = None;
+
+        if (head != None) {
+            prev[head] = slot;
+        }
+        heads[bucket]   = slot;
+        bucket_of[slot] = bucket;
+    }
+
+    // Does nothing if the slot isn't in any of the lists
+    void Remove(const uint32_t slot)
+    {
+        const auto bucket = bucket_of[slot];
+        if (bucket == None) {
+            return;
+        }
+
+        if (prev[slot] != None) {
+            next[prev[slot]] = next[slot];
+        } else {
+            heads[bucket] = next[slot];
+        }
+
+        if (next[slot] != None) {
+            prev[next[slot]] = prev[slot];
+        }
+        bucket_of[slot] = None;
+    }
+
+    uint32_t First(const uint32_t bucket) const
+    {
+        return heads[bucket];
+    }
+
+    uint32_t Next(const uint32_t slot) const
+    {
+        return next[slot];
+    }
+
+private:
+    ArenaArray<uint32_t> heads     = {};
+    ArenaArray<uint32_t> next      = {};
+    ArenaArray<uint32_t> prev      = {};
+    ArenaArray<uint32_t> bucket_of = {};
+};
+
+// `VoiceType` must have `key`, `channel` and `note_id` members with the
+// same meaning as in CLAP note events, and a `held` flag.
+//
+// `RenderState` must have an `Allocate(arena, num_voices)` method that
+// carves its arrays out of the arena, a `Reset()` method that initialises
+// them, and a `Move(from, to)` method that copies the state of the active
+// voice at index `from` to index `to`.
+template <typename VoiceType, typename RenderState>
+class VoicePool {
+
+public:
+    // To be called from the carving code passed to Arena::Build(); the pool
+    // can be used once Reset() has been called after that
+    void Allocate(Arena& arena, const uint32_t max_voices)
+    {
+        slots = arena.Allocate<VoiceType>(max_voices);
+        render_state.Allocate(arena, max_voices);
+        start_order = arena.Allocate<uint64_t>(max_voices);
+        positions   = arena.Allocate<uint32_t>(max_voices);
+
+        by_key_and_channel.Allocate(arena, NumKeyChannelBuckets, max_voices);
+        by_note_id.Allocate(arena, NumNoteIdBuckets, max_voices);
+
+        active    = arena.Allocate<uint32_t>(max_voices);
+        free_list = arena.Allocate<uint32_t>(max_voices);
+    }
+
+    // Main thread. Initialises the pool with all slots free.
+    void Reset()
+    {
+        render_state.Reset();
+
+        by_key_and_channel.Reset();
+        by_note_id.Reset();
+
+        num_active = 0;
+
+        // Pop the lowest slot indices first
+        num_free = Capacity();
+        std::iota(std::make_reverse_iterator(free_list.end()),
+                  std::make_reverse_iterator(free_list.begin()),
+                  0u);
+
+        next_start_order = 0;
+    }
+
+    // Forgets the memory, which is owned by the arena; Allocate() must be
+    // called before the pool can be used again
+    void Release()
+    {
+        *this = {};
+    }
+
+    // Stops all voices
+    void Clear()
+    {
+        while (num_active > 0) {
+            Stop(0);
+        }
+    }
+
+    // Number of active voices
+    uint32_t Size() const
+    {
+        return num_active;
+    }
+
+    uint32_t Capacity() const
+    {
+        return static_cast<uint32_t>(slots.size());
+    }
+
+    bool IsFull() const
+    {
+        return num_free == 0;
+    }
+
+    // Returns the active voice at `index` (in the [0, Size()) range). The
+    // order of the active voices changes when a voice is stopped.
+    VoiceType& operator[](const uint32_t index)
+    {
+        return slots[active[index]];
+    }
+
+    const VoiceType& operator[](const uint32_t index) const
+    {
+        return slots[active[index]];
+    }
+
+    // Render state of the active voices, in the same order as the voices
+    // themselves
+    RenderState& State()
+    {
+        return render_state;
+    }
+
+    const RenderState& State() const
+    {
+        return render_state;
+    }
+
+    // Starts a new voice in a free slot and returns its index among the
+    // active voices; the caller must initialise its render state. The pool
+    // must not be full.
+    uint32_t Start(const VoiceType& voice)
+    {
+        assert(!IsFull());
+
+        const auto slot = free_list[--num_free];
+
+        positions[slot]      = num_active;
+        active[num_active++] = slot;
+
+        slots[slot]       = voice;
+        start_order[slot] = next_start_order++;
+
+        by_key_and_channel.Insert(KeyChannelBucket(voice.key, voice.channel), slot);
+
+        // Voices without a note ID can't be addressed by one
+        if (voice.note_id >= 0) {
+            by_note_id.Insert(NoteIdBucket(voice.note_id), slot);
+        }
+
+        return positions[slot];
+    }
+
+    // Stops the active voice at `index` by moving the last active voice into
+    // its place.
+    void Stop(const uint32_t index)
+    {
+        assert(index < num_active);
+
+        const auto slot = active[index];
+
+        by_key_and_channel.Remove(slot);
+        by_note_id.Remove(slot);
+
+        free_list[num_free++] = slot;
+
+        const auto last = num_active - 1;
+
+        if (index != last) {
+            render_state.Move(last, index);
+        }
+
+        active[index]            = active[last];
+        positions[active[index]] = index;
+
+        --num_active;
+    }
+
+    // Returns the active voice in `slot`. Unlike indices, slots stay the
+    // same for the lifetime of a voice.
+    VoiceType& Slot(const uint32_t slot)
+    {
+        return slots[slot];
+    }
+
+    // Index of the active voice in `slot`; changes when other voices are
+    // stopped
+    uint32_t IndexOf(const uint32_t slot) const
+    {
+        return positions[slot];
+    }
+
+    // Slot of the active voice at `index`, e.g. for per-voice resources
+    // that must stay put while the render state gets compacted
+    uint32_t SlotOf(const uint32_t index) const
+    {
+        return active[index];
+    }
+
+    void StopSlot(const uint32_t slot)
+    {
+        Stop(positions[slot]);
+    }
+
+    // Calls `fn(slot)` for every active voice that matches the event
+    // fields, where -1 is a wildcard. `fn` may stop the voice it has been
+    // called for, and returns false to end the search early.
+    template <typename Fn>
+    void ForEachMatching(const int16_t key, const int32_t note_id,
+                         const int16_t channel, Fn&& fn)
+    {
+        const auto matches = [&](const uint32_t slot) {
+            const auto& voice = slots[slot];
+
+            return (key == -1 || voice.key == key) &&
+                   (note_id == -1 || voice.note_id == note_id) &&
+                   (channel == -1 || voice.channel == channel);
+        };
+
+        // Walks a bucket; the next slot must be fetched before calling
+        // `fn`, as that might unlink the current one
+        const auto visit_bucket = [&](const SlotBuckets& buckets,
+                                      const uint32_t bucket) {
+            for (auto slot = buckets.First(bucket); slot != SlotBuckets::None;) {
+                const auto next = buckets.Next(slot);
+
+                if (matches(slot) && !fn(slot)) {
+                    return false;
+                }
+                slot = next;
+            }
+            return true;
+        };
+
+        if (key != -1 && channel != -1) {
+            visit_bucket(by_key_and_channel, KeyChannelBucket(key, channel));
+
+        } else if (note_id != -1) {
+            visit_bucket(by_note_id, NoteIdBucket(note_id));
+
+        } else if (key != -1 && IsValidKey(key)) {
+            for (int16_t c = 0; c < NumChannels; ++c) {
+                if (!visit_bucket(by_key_and_channel, KeyChannelBucket(key, c))) {
+                    return;
+                }
+            }
+            visit_bucket(by_key_and_channel, OverflowBucket);
+
+        } else {
+            // Everything (or almost everything) matches anyway
+            for (uint32_t i = 0; i < Size();) {
+                const auto slot = active[i];
+
+                if (matches(slot)) {
+                    if (!fn(slot)) {
+                        return;
+                    }
+                    // Stopping the voice moves another one into this index
+                    if (i < Size() && active[i] != slot) {
+                        continue;
+                    }
+                }
+                ++i;
+            }
+        }
+    }
+
+    // Returns the index of the active voice that should be stolen to make
+    // room for a new one. Voices that are no longer held are always
+    // preferred over held ones. `loudness` is only used by the Quietest
+    // policy; it must return the current amplitude of the active voice at
+    // the index it gets called with.
+    //
+    // This is a linear scan, but it only happens when the pool is full, and
+    // its cost is bounded by the (small, fixed) pool capacity.
+    template <typename LoudnessFn>
+    uint32_t FindVictim(const VoiceStealPolicy policy, LoudnessFn&& loudness) const
+    {
+        assert(num_active > 0);
+
+        uint32_t victim = 0;
+
+        for (uint32_t i = 1; i < num_active; ++i) {
+            if (IsBetterVictim(policy, loudness, i, victim)) {
+                victim = i;
+            }
+        }
+
+        return victim;
+    }
+
+private:
+    static constexpr int16_t NumKeys     = 128;
+    static constexpr int16_t NumChannels = 16;
+
+    // Voices with out-of-range keys or channels all go into this bucket
+    static constexpr uint32_t OverflowBucket       = NumKeys * NumChannels;
+    static constexpr uint32_t NumKeyChannelBuckets = OverflowBucket + 1;
+
+    // Must be a power of two
+    static constexpr uint32_t NumNoteIdBuckets = 512;
+
+    static bool IsValidKey(const int16_t key)
+    {
+        return key >= 0 && key < NumKeys;
+    }
+
+    static uint32_t KeyChannelBucket(const int16_t key, const int16_t channel)
+    {
+        if (!IsValidKey(key) || channel < 0 || channel >= NumChannels) {
+            return OverflowBucket;
+        }
+        return static_cast<uint32_t>(key) * NumChannels +
+               static_cast<uint32_t>(channel);
+    }
+
+    static uint32_t NoteIdBucket(const int32_t note_id)
+    {
+        // Hosts usually hand out note IDs sequentially, but scramble them
+        // anyway in case a host uses a stride
+        const auto h = static_cast<uint32_t>(note_id) * 2654435761u;
+
+        return (h >> 16) & (NumNoteIdBuckets - 1);
+    }
+
+    template <typename LoudnessFn>
+    bool IsBetterVictim(const VoiceStealPolicy policy, LoudnessFn& loudness,
+                        const uint32_t a, const uint32_t b) const
+    {
+        const auto& voice_a = slots[active[a]];
+        const auto& voice_b = slots[active[b]];
+
+        if (voice_a.held != voice_b.held) {
+            return !voice_a.held;
+        }
+
+        if (policy == VoiceStealPolicy::Quietest) {
+            const auto loudness_a = loudness(a);
+            const auto loudness_b = loudness(b);
+
+            if (loudness_a != loudness_b) {
+                return loudness_a < loudness_b;
+            }
+        }
+
+        return start_order[active[a]] < start_order[active[b]];
+    }
+
+    ArenaArray<VoiceType> slots = {};
+
+    RenderState render_state = {};
+
+    // Order in which the voices in the slots were started (for stealing the
+    // oldest voice)
+    ArenaArray<uint64_t> start_order = {};
+    uint64_t next_start_order        = 0;
+
+    // Slot indices of the active voices; the first `num_active` are in use
+    ArenaArray<uint32_t> active = {};
+    uint32_t num_active         = 0;
+
+    // Index of each active slot in `active`
+    ArenaArray<uint32_t> positions = {};
+
+    SlotBuckets by_key_and_channel = {};
+    SlotBuckets by_note_id         = {};
+
+    // Slot indices of the free slots; a stack of `num_free`
+    ArenaArray<uint32_t> free_list = {};
+    uint32_t num_free              = 0;
+};
@@ -0,0 +1,77 @@
+// CLAP instrument plugin tutorial
+//
+// Band-limited wavetables for the oscillators.
+
+#include <array>
+#include <cmath>
+
+#include "shared_resources.h"
+#include "wavetable.h"
+
+Wavetable::Wavetable(const HarmonicFn harmonic_amplitude)
+{
+    static_assert((TableSize & (TableSize - 1)) == 0);
+    static_assert((MaxHarmonics >> (NumLevels - 1)) == 1);
+
+    data.resize(NumLevels * (TableSize + 1));
+
+    // Every partial is just a sine table read at a different speed
+    std::vector<double> sine(TableSize);
+    for (uint32_t n = 0; n < TableSize; ++n) {
+        sine[n] = std::sin(2.0 * M_PI * n / TableSize);
+    }
+
+    std::vector<double> level_data(TableSize);
+
+    for (uint32_t level = 0; level < NumLevels; ++level) {
+        std::fill(level_data.begin(), level_data.end(), 0.0);
+
+        const auto num_harmonics = MaxHarmonics >> level;
+
+        for (uint32_t h = 1; h <= num_harmonics; ++h) {
+            const auto amplitude = harmonic_amplitude(h);
+            if (amplitude == 0.0) {
+                continue;
+            }
+
+            for (uint32_t n = 0; n < TableSize; ++n) {
+                level_data[n] += amplitude * sine[(h * n) & (TableSize - 1)];
+            }
+        }
+
+        auto dest = data.data() + level * (TableSize + 1);
+        for (uint32_t n = 0; n < TableSize; ++n) {
+            dest[n] = static_cast<float>(level_data[n]);
+        }
+        dest[TableSize] = dest[0];
+    }
+}
+
+static double TriangleHarmonic(const uint32_t harmonic)
+{
+    // Only odd harmonics with alternating signs, falling off with 1/h^2
+    if (harmonic % 2 == 0) {
+        return 0.0;
+    }
+    const auto sign = ((harmonic / 2) % 2 == 0) ? 1.0 : -1.0;
+
+    return sign * 8.0 / (M_PI * M_PI) / (static_cast<double>(harmonic) * harmonic);
+}
+
+namespace wavetables {
+
+static constexpr std::array<Wavetable::HarmonicFn, NumWavetableShapes> harmonic_fns = {
+    TriangleHarmonic};
+
+std::shared_ptr<const Wavetable> Get(const WavetableShape shape)
+{
+    const auto index = static_cast<int>(shape);
+
+    // Building a table takes a few milliseconds, so we only do it when the
+    // first instance that needs it gets activated. Host scans and projects
+    // that never play this waveform don't pay for it at all.
+    return shared_resources::Get<Wavetable>(
+        index, [&] { return Wavetable(harmonic_fns[index]); });
+}
+
+} // namespace wavetables
@@ -0,0 +1,75 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Band-limited wavetables for the oscillators.
+//
+// Every table contains one cycle of a waveform at a number of mip levels,
+// one per octave. Each level only contains the harmonics that stay below the
+// Nyquist frequency for all fundamentals it's used for, so reading the
+// tables never aliases, no matter how low the render sample rate is.
+//
+// The tables are read-only once built, so each table is built once, when
+// the first plugin instance that needs it gets activated, and shared by
+// every plugin instance until the plugin library gets unloaded (see
+// shared_resources.h).
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class WavetableShape { Triangle };
+
+constexpr auto NumWavetableShapes = 1;
+
+class Wavetable {
+
+public:
+    static constexpr uint32_t TableSize = 2048;
+
+    // Keep the tables at least 2x oversampled so linear interpolation
+    // doesn't attenuate the top harmonics too much
+    static constexpr uint32_t MaxHarmonics = TableSize / 4;
+
+    // The number of harmonics halves at every level, from `MaxHarmonics`
+    // down to just the fundamental
+    static constexpr uint32_t NumLevels = 10;
+
+    // Returns the amplitude of the sine wave partial of a harmonic
+    using HarmonicFn = double (*)(const uint32_t harmonic);
+
+    explicit Wavetable(const HarmonicFn harmonic_amplitude);
+
+    // Returns the mip level to use for a phase increment (in cycles per
+    // sample)
+    uint32_t LevelFor(const float phase_inc) const
+    {
+        auto max_harmonic_inc = phase_inc * MaxHarmonics;
+
+        uint32_t level = 0;
+
+        while (level < NumLevels - 1 && max_harmonic_inc >= 0.5f) {
+            max_harmonic_inc *= 0.5f;
+            ++level;
+        }
+        return level;
+    }
+
+    // Returns `TableSize + 1` samples; the last one repeats the first, so
+    // interpolating never needs to wrap around.
+    const float* Level(const uint32_t level) const
+    {
+        return data.data() + level * (TableSize + 1);
+    }
+
+private:
+    std::vector<float> data = {};
+};
+
+namespace wavetables {
+
+// Builds the table on the first call; the table is then kept in the shared
+// resource registry. Must not be called from the audio thread.
+std::shared_ptr<const Wavetable> Get(const WavetableShape shape);
+
+} // namespace wavetables
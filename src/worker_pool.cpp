@@ -0,0 +1,202 @@
+// CLAP instrument plugin tutorial
+//
+// Internal pool of real-time worker threads.
+
+#include <algorithm>
+#include <system_error>
+
+#include "worker_pool.h"
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #include <immintrin.h>
+#endif
+
+// Number of times to check an atomic before going to sleep on it
+constexpr auto SpinCount = 4000;
+
+static void CpuRelax()
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    asm volatile("yield");
+#endif
+}
+
+// Blocks while `value == old`
+static void WaitWhileEqual(const std::atomic<uint32_t>& value, const uint32_t old)
+{
+    for (auto i = 0; i < SpinCount; ++i) {
+        if (value.load(std::memory_order_acquire) != old) {
+            return;
+        }
+        CpuRelax();
+    }
+
+    while (value.load(std::memory_order_acquire) == old) {
+        value.wait(old, std::memory_order_acquire);
+    }
+}
+
+// This is best effort; most systems only grant real-time priorities to
+// privileged processes, in which case the workers just run at normal
+// priority.
+static void SetRealtimePriority(std::thread& thread)
+{
+#if defined(_WIN32)
+    SetThreadPriority(thread.native_handle(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    sched_param param = {};
+
+    // Stay below the priority of the host's audio thread
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+
+    pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+#endif
+}
+
+WorkerPool::~WorkerPool()
+{
+    Stop();
+}
+
+uint32_t WorkerPool::Start(const uint32_t num_workers, const TaskFn _task_fn,
+                           void* _context)
+{
+    Stop();
+
+    task_fn = _task_fn;
+    context = _context;
+
+    quit.store(false, std::memory_order_relaxed);
+
+    // The workers must start waiting from the current generation, otherwise
+    // a thread that starts up late could miss the first round.
+    const auto start_generation = generation.load(std::memory_order_relaxed);
+
+    const auto n = std::min(num_workers, MaxWorkers);
+
+    workers.reserve(n);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        try {
+            workers.emplace_back(
+                &WorkerPool::WorkerMain, this, i + 1, start_generation);
+
+        } catch (const std::system_error&) {
+            // Make do with the threads we've managed to start
+            break;
+        }
+        SetRealtimePriority(workers.back());
+    }
+
+    return NumWorkers();
+}
+
+void WorkerPool::Stop()
+{
+    if (workers.empty()) {
+        return;
+    }
+
+    quit.store(true, std::memory_order_release);
+
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void WorkerPool::Run(const uint32_t num_tasks)
+{
+    if (workers.empty()) {
+        for (uint32_t i = 0; i < num_tasks; ++i) {
+            task_fn(context, i);
+        }
+        return;
+    }
+
+    // All workers are waiting for the next round at this point, so we can
+    // deal out the tasks without racing against anyone.
+    num_participants = NumWorkers() + 1;
+
+    for (uint32_t i = 0; i < num_tasks; ++i) {
+        deques[i % num_participants].Push(i);
+    }
+
+    tasks_remaining.store(num_tasks, std::memory_order_relaxed);
+    workers_busy.store(NumWorkers(), std::memory_order_relaxed);
+
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    RunTasks(0);
+
+    // Wait until every worker is done with this round before we can touch
+    // the deques again
+    for (auto busy = workers_busy.load(std::memory_order_acquire); busy != 0;
+         busy      = workers_busy.load(std::memory_order_acquire)) {
+        WaitWhileEqual(workers_busy, busy);
+    }
+}
+
+void WorkerPool::RunTasks(const uint32_t participant)
+{
+    while (tasks_remaining.load(std::memory_order_acquire) > 0) {
+        uint32_t task = 0;
+
+        if (TryGetTask(participant, task)) {
+            task_fn(context, task);
+            tasks_remaining.fetch_sub(1, std::memory_order_acq_rel);
+        } else {
+            // The remaining tasks are being executed by other threads
+            CpuRelax();
+        }
+    }
+}
+
+bool WorkerPool::TryGetTask(const uint32_t participant, uint32_t& task)
+{
+    if (deques[participant].Pop(task)) {
+        return true;
+    }
+
+    for (uint32_t i = 1; i < num_participants; ++i) {
+        const auto victim = (participant + i) % num_participants;
+
+        if (deques[victim].Steal(task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::WorkerMain(const uint32_t participant, uint32_t seen_generation)
+{
+    for (;;) {
+        WaitWhileEqual(generation, seen_generation);
+
+        seen_generation = generation.load(std::memory_order_acquire);
+
+        if (quit.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        RunTasks(participant);
+
+        if (workers_busy.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            workers_busy.notify_all();
+        }
+    }
+}
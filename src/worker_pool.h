@@ -0,0 +1,154 @@
+#pragma once
+
+// CLAP instrument plugin tutorial
+//
+// Internal pool of real-time worker threads for hosts that don't provide a
+// thread pool of their own.
+//
+// Every participant (the worker threads, and the audio thread calling
+// Run()) has its own work-stealing deque of task indices. Run() deals the
+// tasks out to the deques, wakes up the workers, and then joins in: each
+// participant pops tasks from the bottom of its own deque, and once that's
+// empty, steals from the top of the others' deques. Run() returns when all
+// workers have checked out of the current round.
+//
+// Waiting is done by spinning for a short while first, then falling back to
+// `std::atomic::wait()`, so a busy pool reacts within microseconds while an
+// idle one doesn't burn CPU.
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Chase-Lev deque with a fixed capacity. Push() and Pop() must only be
+// called by the owner; Steal() can be called by any thread.
+class WorkStealingDeque {
+
+public:
+    static constexpr auto Capacity = 64;
+
+    void Push(const uint32_t task)
+    {
+        const auto b = bottom.load(std::memory_order_relaxed);
+
+        assert(b - top.load(std::memory_order_acquire) < Capacity);
+
+        tasks[b % Capacity].store(task, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    bool Pop(uint32_t& task)
+    {
+        const auto b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // Empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        task = tasks[b % Capacity].load(std::memory_order_relaxed);
+
+        if (t == b) {
+            // Last task; race against the thieves for it
+            const auto won = top.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool Steal(uint32_t& task)
+    {
+        auto t = top.load(std::memory_order_acquire);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        const auto b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return false;
+        }
+
+        task = tasks[t % Capacity].load(std::memory_order_relaxed);
+
+        return top.compare_exchange_strong(
+            t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+private:
+    // Keep the owner's and the thieves' ends on separate cache lines
+    alignas(64) std::atomic<int64_t> top    = 0;
+    alignas(64) std::atomic<int64_t> bottom = 0;
+
+    std::array<std::atomic<uint32_t>, Capacity> tasks = {};
+};
+
+class WorkerPool {
+
+public:
+    // Executes a single task; called concurrently from several threads
+    using TaskFn = void (*)(void* context, const uint32_t task_index);
+
+    static constexpr uint32_t MaxWorkers = 8;
+
+    ~WorkerPool();
+
+    // Starts `num_workers` threads. Must be called on the main thread (from
+    // MyPlugin::Activate). Returns the number of threads actually started.
+    uint32_t Start(const uint32_t num_workers, const TaskFn task_fn,
+                   void* context);
+
+    // Joins all worker threads. Must not be called concurrently with Run().
+    void Stop();
+
+    uint32_t NumWorkers() const
+    {
+        return static_cast<uint32_t>(workers.size());
+    }
+
+    // Executes tasks [0, num_tasks) on the workers and the calling thread,
+    // and blocks until all of them have finished. Audio thread only.
+    void Run(const uint32_t num_tasks);
+
+private:
+    // Index 0 is the thread calling Run(), 1..N are the workers
+    void RunTasks(const uint32_t participant);
+
+    bool TryGetTask(const uint32_t participant, uint32_t& task);
+
+    void WorkerMain(const uint32_t participant, uint32_t seen_generation);
+
+    std::vector<std::thread> workers = {};
+
+    TaskFn task_fn = nullptr;
+    void* context  = nullptr;
+
+    std::array<WorkStealingDeque, MaxWorkers + 1> deques = {};
+
+    // Number of threads taking part in a round, including the caller
+    uint32_t num_participants = 1;
+
+    // Incremented at the start of every round to wake up the workers
+    alignas(64) std::atomic<uint32_t> generation = 0;
+
+    // Number of tasks not yet finished in the current round
+    alignas(64) std::atomic<uint32_t> tasks_remaining = 0;
+
+    // Number of workers that haven't finished the current round yet
+    alignas(64) std::atomic<uint32_t> workers_busy = 0;
+
+    std::atomic<bool> quit = false;
+};